@@ -0,0 +1,337 @@
+#pragma once
+
+// 可选的全局内存分配统计
+//
+// 编译时加上 -DSIMPLEGAMES_ALLOC_STATS 开启，此时本文件会替换全局的
+// operator new/delete，统计分配次数、分配字节数以及当前存活的堆内存。
+// 未开启时所有计数恒为0，开销可以忽略。
+//
+// 因为替换了全局operator new，开启时只能在一个编译单元中包含本文件
+// (本仓库的游戏都是单文件的，所以没有问题)。
+//
+// 环境变量:
+//   SIMPLEGAMES_ALLOC_BUDGET  稳定帧(没有输入的帧)允许的最大分配次数，默认0
+//   SIMPLEGAMES_ALLOC_STRICT  设为1时，超出预算直接abort()，方便抓调用栈
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+namespace alloc_stats {
+
+#ifdef SIMPLEGAMES_ALLOC_STATS
+    constexpr bool enabled = true;
+#else
+    constexpr bool enabled = false;
+#endif
+
+    struct counters {
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+        uint64_t bytes = 0;
+
+        counters operator-(const counters &rhs) const {
+            counters r;
+            r.allocs = allocs - rhs.allocs;
+            r.frees = frees - rhs.frees;
+            r.bytes = bytes - rhs.bytes;
+            return r;
+        }
+    };
+
+    namespace detail {
+        inline std::atomic<uint64_t> allocs{0};
+        inline std::atomic<uint64_t> frees{0};
+        inline std::atomic<uint64_t> bytes{0};
+        inline std::atomic<int64_t> live{0};
+        inline std::atomic<int64_t> peak_live{0};
+
+        inline void on_alloc(size_t n) {
+            allocs.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(n, std::memory_order_relaxed);
+            int64_t cur = live.fetch_add(int64_t(n), std::memory_order_relaxed) + int64_t(n);
+            int64_t peak = peak_live.load(std::memory_order_relaxed);
+            while( cur > peak && !peak_live.compare_exchange_weak(peak, cur, std::memory_order_relaxed) ) {}
+        }
+
+        inline void on_free(size_t n) {
+            frees.fetch_add(1, std::memory_order_relaxed);
+            live.fetch_sub(int64_t(n), std::memory_order_relaxed);
+        }
+    }
+
+    /// 到目前为止的累计计数
+    inline counters current() {
+        counters r;
+        if( enabled ) {
+            r.allocs = detail::allocs.load(std::memory_order_relaxed);
+            r.frees = detail::frees.load(std::memory_order_relaxed);
+            r.bytes = detail::bytes.load(std::memory_order_relaxed);
+        }
+        return r;
+    }
+
+    /// 当前存活的堆内存(字节)
+    inline int64_t live_bytes() {
+        return detail::live.load(std::memory_order_relaxed);
+    }
+
+    inline int64_t peak_live_bytes() {
+        return detail::peak_live.load(std::memory_order_relaxed);
+    }
+
+    /// 进程的峰值RSS(KiB)，不依赖SIMPLEGAMES_ALLOC_STATS
+    inline long peak_rss_kb() {
+        struct rusage ru;
+        if( getrusage(RUSAGE_SELF, &ru) != 0 )
+            return -1;
+        return ru.ru_maxrss;
+    }
+
+    /// 进程当前的RSS(KiB)，读取/proc/self/statm，不分配堆内存
+    inline long current_rss_kb() {
+        char buf[128];
+        int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        if( fd < 0 )
+            return -1;
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if( n <= 0 )
+            return -1;
+        buf[n] = 0;
+        long size = 0, resident = 0;
+        if( sscanf(buf, "%ld %ld", &size, &resident) != 2 )
+            return -1;
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    inline uint64_t budget_from_env() {
+        const char *s = getenv("SIMPLEGAMES_ALLOC_BUDGET");
+        return s ? strtoull(s, nullptr, 10) : 0;
+    }
+
+    inline bool strict_from_env() {
+        const char *s = getenv("SIMPLEGAMES_ALLOC_STRICT");
+        return s && s[0] == '1';
+    }
+
+    /// 按帧统计分配情况
+    /// 每帧调用begin()，在各个阶段开始时调用phase()，帧结束时调用end()
+    /// Example:
+    ///   stats.begin();
+    ///   stats.phase("draw");  ...
+    ///   stats.phase("logic"); ...
+    ///   stats.end(no_input);
+    class frame_stats {
+    public:
+        static constexpr int MAX_PHASES = 4;
+
+        frame_stats() : mBudget(budget_from_env()), mStrict(strict_from_env()) {}
+
+        void begin() {
+            mPhases = 0;
+            mBegin = current();
+            mPhaseBegin = mBegin;
+        }
+
+        /// 结束上一个阶段(如果有)并开始名为name的阶段
+        void phase(const char *name) {
+            auto now = current();
+            close_phase(now);
+            if( mPhases < MAX_PHASES ) {
+                mPhaseNames[mPhases] = name;
+                mPhaseCounters[mPhases] = counters();
+                mPhases += 1;
+            }
+            mPhaseBegin = now;
+        }
+
+        /// @param steady 这一帧是否为稳定帧(没有输入、没有状态变化)，只有稳定帧受预算约束
+        void end(bool steady) {
+            auto now = current();
+            close_phase(now);
+            mLast = now - mBegin;
+            mLastPhases = mPhases;
+            for( int i = 0; i < mPhases; i++ ) {
+                mLastPhaseNames[i] = mPhaseNames[i];
+                mLastPhaseCounters[i] = mPhaseCounters[i];
+            }
+            mFrames += 1;
+            if( steady ) {
+                mSteadyFrames += 1;
+                if( mLast.allocs > mMaxSteadyAllocs )
+                    mMaxSteadyAllocs = mLast.allocs;
+                if( mLast.allocs > mBudget ) {
+                    mOverBudget += 1;
+                    if( mStrict && enabled ) {
+                        fprintf(stderr, "[alloc_stats] steady frame made %llu allocations (budget %llu)\n",
+                                (unsigned long long)mLast.allocs, (unsigned long long)mBudget);
+                        abort();
+                    }
+                }
+            }
+        }
+
+        /// 上一帧的计数
+        const counters &last() const { return mLast; }
+
+        /// 上一帧各阶段的计数
+        int phases() const { return mLastPhases; }
+        const char *phase_name(int i) const { return mLastPhaseNames[i]; }
+        const counters &phase_counters(int i) const { return mLastPhaseCounters[i]; }
+
+        uint64_t budget() const { return mBudget; }
+        uint64_t frames() const { return mFrames; }
+        uint64_t over_budget_frames() const { return mOverBudget; }
+
+        /// 把调试信息格式化到buf中，不分配堆内存
+        int format_overlay(char *buf, size_t size) const {
+            if( !enabled ) {
+                return snprintf(buf, size, "RSS=%ldKiB PeakRSS=%ldKiB (alloc stats off)",
+                                current_rss_kb(), peak_rss_kb());
+            }
+            return snprintf(buf, size, "Alloc/frame=%llu(%lluB) Live=%lldKiB PeakRSS=%ldKiB Over=%llu/%llu",
+                            (unsigned long long)mLast.allocs, (unsigned long long)mLast.bytes,
+                            (long long)(live_bytes() / 1024), peak_rss_kb(),
+                            (unsigned long long)mOverBudget, (unsigned long long)mSteadyFrames);
+        }
+
+        int format_phases(char *buf, size_t size) const {
+            int n = 0;
+            if( size > 0 )
+                buf[0] = 0;
+            for( int i = 0; i < mLastPhases && n >= 0 && size_t(n) < size; i++ ) {
+                n += snprintf(buf + n, size - n, "%s%s=%llu", i ? " " : "",
+                              mLastPhaseNames[i], (unsigned long long)mLastPhaseCounters[i].allocs);
+            }
+            return n;
+        }
+
+        /// 退出时输出汇总，需在endwin()之后调用
+        void report(FILE *out, const char *who) const {
+            if( !enabled )
+                return;
+            auto total = current();
+            fprintf(out, "[%s] alloc stats: frames=%llu steady=%llu over_budget=%llu (budget %llu) max_steady_allocs=%llu\n",
+                    who, (unsigned long long)mFrames, (unsigned long long)mSteadyFrames,
+                    (unsigned long long)mOverBudget, (unsigned long long)mBudget,
+                    (unsigned long long)mMaxSteadyAllocs);
+            fprintf(out, "[%s] alloc stats: total allocs=%llu frees=%llu bytes=%llu peak_live=%lldKiB peak_rss=%ldKiB\n",
+                    who, (unsigned long long)total.allocs, (unsigned long long)total.frees,
+                    (unsigned long long)total.bytes, (long long)(peak_live_bytes() / 1024), peak_rss_kb());
+        }
+
+    private:
+        void close_phase(const counters &now) {
+            if( mPhases > 0 )
+                mPhaseCounters[mPhases - 1] = now - mPhaseBegin;
+        }
+
+        uint64_t mBudget;
+        bool mStrict;
+
+        counters mBegin;
+        counters mPhaseBegin;
+        counters mLast;
+
+        int mPhases = 0;
+        const char *mPhaseNames[MAX_PHASES] = {};
+        counters mPhaseCounters[MAX_PHASES];
+
+        int mLastPhases = 0;
+        const char *mLastPhaseNames[MAX_PHASES] = {};
+        counters mLastPhaseCounters[MAX_PHASES];
+
+        uint64_t mFrames = 0;
+        uint64_t mSteadyFrames = 0;
+        uint64_t mOverBudget = 0;
+        uint64_t mMaxSteadyAllocs = 0;
+    };
+
+} // namespace alloc_stats
+
+#ifdef SIMPLEGAMES_ALLOC_STATS
+
+// 在每块内存前面放一个头部记录大小，这样delete时不依赖sized delete
+// 对齐分配(operator new(size_t, std::align_val_t))的头部按对齐放大，大小仍然记在返回的指针前HEADER字节处。
+// 分配和释放的函数不内联，否则GCC看得到malloc()/free()和new/delete配对，会报-Wmismatched-new-delete
+namespace alloc_stats::detail {
+    constexpr size_t HEADER = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+    inline size_t aligned_header(std::align_val_t al) {
+        return size_t(al) > HEADER ? size_t(al) : HEADER;
+    }
+
+    [[gnu::noinline]] inline void *counted_alloc(size_t n, std::align_val_t al = std::align_val_t(HEADER)) {
+        size_t head = aligned_header(al);
+        void *raw;
+        if( head == HEADER ) {
+            raw = malloc(n + HEADER);
+        } else {
+            // aligned_alloc()要求大小是对齐的整数倍
+            raw = aligned_alloc(head, (head + n + head - 1) / head * head);
+        }
+        if( !raw )
+            return nullptr;
+        char *p = static_cast<char*>(raw) + head;
+        *reinterpret_cast<size_t*>(p - HEADER) = n;
+        on_alloc(n);
+        return p;
+    }
+
+    [[gnu::noinline]] inline void counted_free(void *p, std::align_val_t al = std::align_val_t(HEADER)) {
+        if( !p )
+            return;
+        char *c = static_cast<char*>(p);
+        on_free(*reinterpret_cast<size_t*>(c - HEADER));
+        free(c - aligned_header(al));
+    }
+
+    inline void *counted_new(size_t n, std::align_val_t al = std::align_val_t(HEADER)) {
+        void *p = counted_alloc(n, al);
+        if( !p )
+            throw std::bad_alloc();
+        return p;
+    }
+}
+
+void *operator new(size_t n) { return alloc_stats::detail::counted_new(n); }
+void *operator new[](size_t n) { return alloc_stats::detail::counted_new(n); }
+void *operator new(size_t n, const std::nothrow_t &) noexcept { return alloc_stats::detail::counted_alloc(n); }
+void *operator new[](size_t n, const std::nothrow_t &) noexcept { return alloc_stats::detail::counted_alloc(n); }
+
+void *operator new(size_t n, std::align_val_t al) { return alloc_stats::detail::counted_new(n, al); }
+void *operator new[](size_t n, std::align_val_t al) { return alloc_stats::detail::counted_new(n, al); }
+void *operator new(size_t n, std::align_val_t al, const std::nothrow_t &) noexcept {
+    return alloc_stats::detail::counted_alloc(n, al);
+}
+void *operator new[](size_t n, std::align_val_t al, const std::nothrow_t &) noexcept {
+    return alloc_stats::detail::counted_alloc(n, al);
+}
+
+void operator delete(void *p) noexcept { alloc_stats::detail::counted_free(p); }
+void operator delete[](void *p) noexcept { alloc_stats::detail::counted_free(p); }
+void operator delete(void *p, size_t) noexcept { alloc_stats::detail::counted_free(p); }
+void operator delete[](void *p, size_t) noexcept { alloc_stats::detail::counted_free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { alloc_stats::detail::counted_free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { alloc_stats::detail::counted_free(p); }
+
+void operator delete(void *p, std::align_val_t al) noexcept { alloc_stats::detail::counted_free(p, al); }
+void operator delete[](void *p, std::align_val_t al) noexcept { alloc_stats::detail::counted_free(p, al); }
+void operator delete(void *p, size_t, std::align_val_t al) noexcept { alloc_stats::detail::counted_free(p, al); }
+void operator delete[](void *p, size_t, std::align_val_t al) noexcept { alloc_stats::detail::counted_free(p, al); }
+void operator delete(void *p, std::align_val_t al, const std::nothrow_t &) noexcept {
+    alloc_stats::detail::counted_free(p, al);
+}
+void operator delete[](void *p, std::align_val_t al, const std::nothrow_t &) noexcept {
+    alloc_stats::detail::counted_free(p, al);
+}
+
+#endif // SIMPLEGAMES_ALLOC_STATS
@@ -0,0 +1,291 @@
+#pragma once
+
+// 用C++20协程写界面: 每个界面是一个coro::task，等输入和等时间都用co_await，
+// 所有界面由同一个事件循环驱动，不再各自在getch()上阻塞
+//
+//   coro::task<void> title() {
+//       while( true ) {
+//           int k = co_await loop.key();        // 等一个键
+//           co_await loop.sleep_for(100ms);     // 等一段时间
+//           co_await other_screen();            // 进入另一个界面，它返回后接着往下走
+//       }
+//   }
+//   loop.run(title());
+//
+// - task是惰性的，co_await时才开始执行，结束时直接切回等它的协程(对称转移，栈不会变深)
+// - 界面里抛出的异常(比如游戏结束)沿着co_await的链传给上一层，最后从run()抛出
+// - 同一时间只有一个协程在等输入(当前的界面); spawn()启动的后台协程只能等时间，
+//   它们和界面在同一个线程上交替执行，不需要加锁
+// - 没有协程等输入时不读键盘，按键留在终端的缓冲区里; 等输入时用wtimeout()睡到
+//   最近的一个定时器，不会忙等
+//
+// 需要-std=c++20
+
+#ifndef NCURSES_WIDECHAR
+#define NCURSES_WIDECHAR 1
+#endif
+
+#include <curses.h>
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace coro {
+
+    using clock = std::chrono::steady_clock;
+
+    template <class T = void>
+    class task;
+
+    namespace detail {
+
+        struct promise_base {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            /// 结束时切回等这个task的协程，没有人等(run()或者spawn()的)时回到事件循环
+            struct final_awaiter {
+                bool await_ready() noexcept { return false; }
+
+                template <class P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+                    auto next = h.promise().continuation;
+                    return next ? next : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            final_awaiter final_suspend() noexcept { return {}; }
+
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        template <class T>
+        struct promise : promise_base {
+            std::optional<T> value;
+
+            task<T> get_return_object();
+            void return_value(T v) { value.emplace(std::move(v)); }
+        };
+
+        template <>
+        struct promise<void> : promise_base {
+            task<void> get_return_object();
+            void return_void() {}
+        };
+
+    } // namespace detail
+
+    template <class T>
+    class task {
+    public:
+        using promise_type = detail::promise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        explicit task(handle_type h) : mHandle(h) {}
+        task(task &&other) noexcept : mHandle(std::exchange(other.mHandle, {})) {}
+        task(const task &) = delete;
+        task &operator=(const task &) = delete;
+
+        task &operator=(task &&other) noexcept {
+            if( this != &other ) {
+                if( mHandle )
+                    mHandle.destroy();
+                mHandle = std::exchange(other.mHandle, {});
+            }
+            return *this;
+        }
+
+        ~task() {
+            if( mHandle )
+                mHandle.destroy();
+        }
+
+        bool done() const { return !mHandle || mHandle.done(); }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+            mHandle.promise().continuation = caller;
+            return mHandle;
+        }
+
+        T await_resume() {
+            auto &p = mHandle.promise();
+            if( p.error )
+                std::rethrow_exception(p.error);
+            if constexpr( !std::is_void_v<T> )
+                return std::move(*p.value);
+        }
+
+    private:
+        friend class event_loop;
+        handle_type mHandle;
+    };
+
+    namespace detail {
+        template <class T>
+        task<T> promise<T>::get_return_object() {
+            return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> promise<void>::get_return_object() {
+            return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+        }
+    } // namespace detail
+
+    class event_loop {
+    public:
+        explicit event_loop(WINDOW *win) : mWin(win) {}
+
+        event_loop(const event_loop &) = delete;
+        event_loop &operator=(const event_loop &) = delete;
+
+        struct key_awaiter {
+            event_loop &loop;
+            int timeout_ms;
+            int key = ERR;
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                if( loop.mInput )
+                    throw std::logic_error("coro::event_loop: two coroutines waiting for input");
+                loop.mInput = h;
+                loop.mInputResult = &key;
+                loop.mInputDeadline = timeout_ms < 0 ? clock::time_point::max()
+                                                     : clock::now() + std::chrono::milliseconds(timeout_ms);
+            }
+
+            int await_resume() const noexcept { return key; }
+        };
+
+        struct sleep_awaiter {
+            event_loop &loop;
+            clock::time_point until;
+
+            bool await_ready() const noexcept { return until <= clock::now(); }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                loop.mTimers.push_back(timer{until, loop.mTimerSeq++, h});
+                std::push_heap(loop.mTimers.begin(), loop.mTimers.end(), timer_later);
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        /// 等一个键，timeout_ms和wtimeout()一样: 负数表示一直等，超时返回ERR
+        key_awaiter key(int timeout_ms = -1) { return key_awaiter{*this, timeout_ms}; }
+
+        sleep_awaiter sleep_until(clock::time_point until) { return sleep_awaiter{*this, until}; }
+
+        template <class Rep, class Period>
+        sleep_awaiter sleep_for(std::chrono::duration<Rep, Period> d) {
+            return sleep_awaiter{*this, clock::now() + std::chrono::duration_cast<clock::duration>(d)};
+        }
+
+        /// 启动一个后台协程，和界面交替执行，只能等时间不能等输入；它抛出的异常从run()抛出
+        void spawn(task<void> t) {
+            auto h = t.mHandle;
+            mBackground.push_back(std::move(t));
+            resume(h);
+        }
+
+        /// 执行root直到它结束，返回它的结果
+        template <class T>
+        T run(task<T> root) {
+            resume(root.mHandle);
+            while( !root.mHandle.done() ) {
+                rethrow_background();
+                pump();
+            }
+            rethrow_background();
+            return root.await_resume();
+        }
+
+    private:
+        struct timer {
+            clock::time_point when;
+            unsigned long long seq;     // 同一时间的按先后顺序
+            std::coroutine_handle<> handle;
+        };
+
+        static bool timer_later(const timer &a, const timer &b) {
+            return a.when != b.when ? a.when > b.when : a.seq > b.seq;
+        }
+
+        void resume(std::coroutine_handle<> h) {
+            h.resume();
+        }
+
+        void rethrow_background() {
+            for( size_t i = 0; i < mBackground.size(); ) {
+                if( !mBackground[i].done() ) {
+                    i++;
+                    continue;
+                }
+                task<void> t = std::move(mBackground[i]);
+                mBackground.erase(mBackground.begin() + long(i));
+                t.await_resume();
+            }
+        }
+
+        /// 等到有输入或者下一个定时器到期，然后恢复对应的协程
+        void pump() {
+            clock::time_point wake = clock::time_point::max();
+            if( mInput )
+                wake = mInputDeadline;
+            if( !mTimers.empty() )
+                wake = std::min(wake, mTimers.front().when);
+            if( !mInput && wake == clock::time_point::max() )
+                throw std::logic_error("coro::event_loop: nothing to wait for");
+
+            auto now = clock::now();
+            if( mInput ) {
+                int ms = -1;
+                if( wake != clock::time_point::max() ) {
+                    auto left = wake > now ? wake - now : clock::duration::zero();
+                    auto rounded = std::chrono::ceil<std::chrono::milliseconds>(left);
+                    ms = int(rounded.count());
+                }
+                wtimeout(mWin, ms);
+                int k = wgetch(mWin);
+                wtimeout(mWin, -1);
+                if( k != ERR || clock::now() >= mInputDeadline ) {
+                    auto h = std::exchange(mInput, {});
+                    *mInputResult = k;
+                    resume(h);
+                }
+            } else if( wake > now ) {
+                std::this_thread::sleep_until(wake);
+            }
+
+            now = clock::now();
+            while( !mTimers.empty() && mTimers.front().when <= now ) {
+                std::pop_heap(mTimers.begin(), mTimers.end(), timer_later);
+                auto h = mTimers.back().handle;
+                mTimers.pop_back();
+                resume(h);
+            }
+        }
+
+        WINDOW *mWin;
+        std::coroutine_handle<> mInput;     // 正在等输入的协程
+        int *mInputResult = nullptr;
+        clock::time_point mInputDeadline;
+        std::vector<timer> mTimers;         // 按时间排的最小堆
+        unsigned long long mTimerSeq = 0;
+        std::vector<task<void>> mBackground;
+    };
+
+} // namespace coro
@@ -0,0 +1,170 @@
+#pragma once
+
+// 每帧的临时内存: 画一帧时拼的字符串、临时数组都从这里分配，帧结束时reset()一次全部丢掉
+//
+//   frame_mem::arena a;
+//   frame_mem::string s(a);               // 和std::string一样用，内存来自a
+//   frame_mem::append_int(s += "Score: ", score);
+//   ... 画出来 ...
+//   a.reset();                            // 帧结束
+//
+// 分配只是把指针往后挪，释放什么也不做; reset()只把指针挪回第一块的开头，是O(1)的。
+// 一块用完了才向全局的operator new要新的一块(是上一块的两倍)，要来的块一直留着，
+// 所以最费内存的那一帧之后，稳定的帧不再调用全局的分配器(alloc_stats.h能看到)。
+// 从这里分配的东西不能活过reset()，要留到下一帧的(比如和上一帧比较的HUD文字)拷贝到普通的std::string里。
+// 只在一个线程里用。
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace frame_mem {
+
+    class arena {
+    public:
+        /// 第一块在构造时就要好，一般的帧从第一帧起就不用再向全局分配器要内存
+        explicit arena(size_t first_chunk = 4096) : mNextSize(first_chunk) {
+            grow(first_chunk);
+        }
+
+        arena(const arena &) = delete;
+        arena &operator=(const arena &) = delete;
+
+        void *allocate(size_t n, size_t align) {
+            while( true ) {
+                if( mCur < mChunks.size() ) {
+                    chunk &c = mChunks[mCur];
+                    size_t at = (mOffset + align - 1) & ~(align - 1);
+                    if( at + n <= c.size ) {
+                        mOffset = at + n;
+                        mUsed += n;
+                        if( mUsed > mHighWater )
+                            mHighWater = mUsed;
+                        return c.data.get() + at;
+                    }
+                    // 这一块放不下，换下一块(已有的块跳过去，下一帧照样用)
+                    if( mCur + 1 < mChunks.size() ) {
+                        mCur += 1;
+                        mOffset = 0;
+                        continue;
+                    }
+                }
+                grow(n + align);
+            }
+        }
+
+        /// 丢掉这一帧分配的所有东西
+        void reset() {
+            mCur = 0;
+            mOffset = 0;
+            mUsed = 0;
+            mFrames += 1;
+        }
+
+        /// 这一帧到目前为止分配的字节数
+        size_t used() const { return mUsed; }
+
+        /// 分配得最多的一帧用了多少字节
+        size_t high_water() const { return mHighWater; }
+
+        /// 向全局分配器要的字节数和次数
+        size_t reserved() const { return mReserved; }
+        uint64_t grows() const { return mGrows; }
+
+        /// 调试信息，不分配堆内存
+        int format_stats(char *buf, size_t size) const {
+            return snprintf(buf, size, "frame arena: used=%zuB peak=%zuB reserved=%zuB in %zu chunk(s), grown %llu times",
+                            mUsed, mHighWater, mReserved, mChunks.size(), (unsigned long long)mGrows);
+        }
+
+        /// 退出时输出，需在endwin()之后调用
+        void report(FILE *out, const char *who) const {
+            fprintf(out, "[%s] frame arena: peak=%zuB reserved=%zuB in %zu chunk(s), grown %llu times over %llu frames\n",
+                    who, mHighWater, mReserved, mChunks.size(), (unsigned long long)mGrows,
+                    (unsigned long long)mFrames);
+        }
+
+    private:
+        struct chunk {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        void grow(size_t at_least) {
+            size_t size = mNextSize;
+            while( size < at_least )
+                size *= 2;
+            mNextSize = size * 2;
+            mChunks.push_back(chunk{std::unique_ptr<char[]>(new char[size]), size});
+            mCur = mChunks.size() - 1;
+            mOffset = 0;
+            mReserved += size;
+            mGrows += 1;
+        }
+
+        std::vector<chunk> mChunks;
+        size_t mCur = 0;            // 正在用的块
+        size_t mOffset = 0;         // 块里下一个空闲的位置
+        size_t mNextSize;
+        size_t mUsed = 0;
+        size_t mHighWater = 0;
+        size_t mReserved = 0;
+        uint64_t mGrows = 0;
+        uint64_t mFrames = 0;
+    };
+
+    /// 标准库容器用的分配器，deallocate()什么也不做
+    template <class T>
+    class allocator {
+    public:
+        using value_type = T;
+
+        allocator(arena &a) noexcept : mArena(&a) {}
+
+        template <class U>
+        allocator(const allocator<U> &other) noexcept : mArena(other.get_arena()) {}
+
+        T *allocate(size_t n) {
+            return static_cast<T*>(mArena->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *, size_t) noexcept {}
+
+        arena *get_arena() const noexcept { return mArena; }
+
+        template <class U>
+        bool operator==(const allocator<U> &other) const noexcept { return mArena == other.get_arena(); }
+
+        template <class U>
+        bool operator!=(const allocator<U> &other) const noexcept { return mArena != other.get_arena(); }
+
+    private:
+        arena *mArena;
+    };
+
+    template <class CharT>
+    using basic_string = std::basic_string<CharT, std::char_traits<CharT>, allocator<CharT>>;
+    using string = basic_string<char>;
+    using wstring = basic_string<wchar_t>;
+
+    template <class T>
+    using vector = std::vector<T, allocator<T>>;
+
+    /// 把整数追加到字符串后面，不经过locale和流
+    template <class CharT, class Traits, class Alloc, class Int>
+    std::basic_string<CharT, Traits, Alloc> &append_int(std::basic_string<CharT, Traits, Alloc> &s, Int v) {
+        static_assert(std::is_integral_v<Int>, "append_int() takes integers");
+        char buf[24];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        for( const char *p = buf; p != r.ptr; p++ )
+            s.push_back(CharT(*p));
+        return s;
+    }
+
+} // namespace frame_mem
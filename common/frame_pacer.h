@@ -0,0 +1,207 @@
+#pragma once
+
+// 自适应帧率: 终端失去焦点时降低刷新率或者暂停渲染
+//
+// 焦点来自终端的焦点报告(CSI ?1004h)，终端在获得/失去焦点时发送ESC [ I / ESC [ O。
+// 这里用define_key()把它们注册成两个自定义键值，游戏照常用wgetch()读到。
+// tmux需要打开focus-events (set -g focus-events on)才会转发，此时切换窗口/面板
+// 也会产生焦点事件，相当于"不可见"的提示。终端不支持时永远认为有焦点，行为和以前一样。
+//
+// 环境变量:
+//   SIMPLEGAMES_UNFOCUSED_FPS  失去焦点时的帧率，默认1，设为0时完全暂停渲染
+//   SIMPLEGAMES_PACING_STATS   设置后退出时输出CPU时间、帧数和唤醒次数
+//
+// 等待用的是wtimeout()+wgetch()，有输入时立刻醒来，没有输入时一直睡到下一帧，
+// 不再忙等。
+
+#ifndef NCURSES_WIDECHAR
+#define NCURSES_WIDECHAR 1
+#endif
+
+#include <curses.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+namespace pacing {
+
+    using clock = std::chrono::steady_clock;
+
+    constexpr int KEY_FOCUS_IN = KEY_MAX + 1;
+    constexpr int KEY_FOCUS_OUT = KEY_MAX + 2;
+
+    class focus_tracker {
+    public:
+        focus_tracker() : mEnabled(false), mFocused(true) {}
+
+        /// 在initscr()之后调用
+        void enable() {
+            if( mEnabled )
+                return;
+            define_key("\033[I", KEY_FOCUS_IN);
+            define_key("\033[O", KEY_FOCUS_OUT);
+            fputs("\033[?1004h", stdout);
+            fflush(stdout);
+            mEnabled = true;
+        }
+
+        /// 在endwin()之前调用
+        void disable() {
+            if( !mEnabled )
+                return;
+            fputs("\033[?1004l", stdout);
+            fflush(stdout);
+            define_key("\033[I", 0);
+            define_key("\033[O", 0);
+            mEnabled = false;
+        }
+
+        /// 如果k是焦点事件则更新状态并返回true
+        bool handle_key(int k) {
+            if( k == KEY_FOCUS_IN ) {
+                mFocused = true;
+                return true;
+            } else if( k == KEY_FOCUS_OUT ) {
+                mFocused = false;
+                return true;
+            }
+            return false;
+        }
+
+        bool focused() const {
+            return mFocused;
+        }
+
+    private:
+        bool mEnabled;
+        bool mFocused;
+    };
+
+    inline clock::duration unfocused_interval_from_env() {
+        const char *s = getenv("SIMPLEGAMES_UNFOCUSED_FPS");
+        double fps = s ? atof(s) : 1.0;
+        if( fps <= 0 )
+            return clock::duration::zero();
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    }
+
+    inline double cpu_seconds() {
+        struct rusage ru;
+        if( getrusage(RUSAGE_SELF, &ru) != 0 )
+            return 0;
+        return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+    }
+
+    inline long context_switches() {
+        struct rusage ru;
+        if( getrusage(RUSAGE_SELF, &ru) != 0 )
+            return 0;
+        return ru.ru_nvcsw + ru.ru_nivcsw;
+    }
+
+    /// 决定什么时候画下一帧，以及可以睡多久
+    /// focused_interval为0表示每次都画(由调用者自己控制节奏)
+    /// 失去焦点时间隔为unfocused_interval，为0表示暂停渲染
+    class frame_pacer {
+    public:
+        frame_pacer(clock::duration focused_interval, clock::duration unfocused_interval = unfocused_interval_from_env()) :
+            mFocusedInterval(focused_interval),
+            mUnfocusedInterval(unfocused_interval),
+            mFocused(true),
+            mNextFrame(clock::now()),
+            mStart(clock::now()),
+            mCpuStart(cpu_seconds()),
+            mCswStart(context_switches()) {}
+
+        void set_focused(bool focused) {
+            if( focused && !mFocused )
+                mNextFrame = clock::now(); // 获得焦点时立刻画一帧
+            mFocused = focused;
+        }
+
+        bool focused() const {
+            return mFocused;
+        }
+
+        bool paused() const {
+            return !mFocused && mUnfocusedInterval == clock::duration::zero();
+        }
+
+        clock::duration interval() const {
+            return mFocused ? mFocusedInterval : mUnfocusedInterval;
+        }
+
+        /// 是否该画下一帧了
+        bool frame_due(clock::time_point now) const {
+            return !paused() && now >= mNextFrame;
+        }
+
+        void frame_done(clock::time_point now) {
+            mFrames += 1;
+            mNextFrame += interval();
+            if( mNextFrame < now )
+                mNextFrame = now + interval();
+        }
+
+        /// 给wtimeout()用的等待时间(毫秒)，最多等到deadline(比如模拟的下一个tick)
+        /// 暂停且没有deadline时返回-1，即一直等到有输入
+        int timeout_ms(clock::time_point now, clock::time_point deadline = clock::time_point::max()) const {
+            clock::time_point until = deadline;
+            // 间隔为0时由调用者控制节奏，不参与等待时间的计算
+            if( !paused() && interval() != clock::duration::zero() && mNextFrame < until )
+                until = mNextFrame;
+            if( until == clock::time_point::max() )
+                return -1;
+            if( until <= now )
+                return 0;
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count();
+            // 向上取整，避免早醒一点点又空转一次
+            if( clock::duration(std::chrono::milliseconds(ms)) < until - now )
+                ms += 1;
+            return int(ms);
+        }
+
+        /// 每次从wgetch()返回时调用，用于统计唤醒次数
+        void wakeup() {
+            mWakeups += 1;
+        }
+
+        unsigned long long frames() const { return mFrames; }
+        unsigned long long wakeups() const { return mWakeups; }
+
+        int format_stats(char *buf, size_t size) const {
+            double secs = std::chrono::duration<double>(clock::now() - mStart).count();
+            if( secs <= 0 )
+                secs = 1e-9;
+            return snprintf(buf, size, "%s fps=%.1f wakeups/s=%.1f cpu=%.1f%%",
+                            mFocused ? "focused" : (paused() ? "paused" : "unfocused"),
+                            mFrames / secs, mWakeups / secs, (cpu_seconds() - mCpuStart) / secs * 100);
+        }
+
+        /// 退出时输出CPU和唤醒次数，需在endwin()之后调用
+        void report(FILE *out, const char *who) const {
+            double secs = std::chrono::duration<double>(clock::now() - mStart).count();
+            if( secs <= 0 )
+                secs = 1e-9;
+            double cpu = cpu_seconds() - mCpuStart;
+            fprintf(out, "[%s] pacing: %.1fs wall, %.3fs cpu (%.2f%%), %llu frames (%.1f/s), %llu wakeups (%.1f/s), %ld context switches\n",
+                    who, secs, cpu, cpu / secs * 100, mFrames, mFrames / secs, mWakeups, mWakeups / secs,
+                    context_switches() - mCswStart);
+        }
+
+    private:
+        clock::duration mFocusedInterval;
+        clock::duration mUnfocusedInterval;
+        bool mFocused;
+        clock::time_point mNextFrame;
+
+        clock::time_point mStart;
+        double mCpuStart;
+        long mCswStart;
+        unsigned long long mFrames = 0;
+        unsigned long long mWakeups = 0;
+    };
+
+} // namespace pacing
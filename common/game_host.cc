@@ -0,0 +1,671 @@
+// 多人对局服务: 一个常驻进程同时跑成千上万局2048、贪吃蛇和扫雷，玩家从本地的Unix socket连进来
+// compile with: c++ -O2 -std=c++20 -pthread game_host.cc -o game-host
+//
+// 用法:
+//   game-host [--socket PATH] [--threads N]     启动服务
+//   game-host --connect GAME [--socket PATH]    在当前终端(pty)里玩一局，GAME是2048、snake或mines
+//   game-host --stats [--socket PATH]           输出服务的统计
+// 协议和每局游戏的状态见game_host.h，模拟大量玩家见host_load.cc。
+//
+// - 固定数量的工作线程(--threads或SIMPLEGAMES_HOST_THREADS，默认最多4个)，
+//   每个线程一个epoll，接受连接的主线程把新连接轮流分给它们，之后一直在同一个线程上，不用加锁
+// - 只有正在跑的贪吃蛇需要定时器，每个线程的定时器放在一个最小堆里，epoll_wait睡到最近的一个;
+//   没有按键也没有定时器时线程一直睡着，不占CPU
+// - 画面写进每个线程的frame_mem::arena，直接write()出去; 写不完时剩下的部分留在连接里，
+//   等socket可写时再写，这期间的变化只记一个标志，写完后画一次最新的状态(跳过中间的帧)
+// - 每个连接除了游戏本身只有几十字节，--stats输出平均每局的状态大小和进程的RSS增量
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "game_host.h"
+
+using clock_type = std::chrono::steady_clock;
+
+/// 进程占的物理内存
+static size_t rss_bytes() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if( !f )
+        return 0;
+    if( fscanf(f, "%ld %ld", &pages, &resident) != 2 )
+        resident = 0;
+    fclose(f);
+    return size_t(resident) * size_t(sysconf(_SC_PAGESIZE));
+}
+
+/// 上千个连接需要上千个文件描述符，把软限制提到硬限制
+static void raise_fd_limit() {
+    struct rlimit rl;
+    if( getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max ) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static bool make_address(const std::string &path, sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if( path.size() >= sizeof(addr.sun_path) ) {
+        fprintf(stderr, "game-host: socket path too long: %s\n", path.c_str());
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/// 所有工作线程共用的统计，只在连接建立、断开和发出一帧时更新
+struct host_stats {
+    std::atomic<uint64_t> sessions[host::KINDS] = {};
+    std::atomic<uint64_t> state_bytes{0};     // 活着的连接和游戏占的内存
+    std::atomic<uint64_t> pending_bytes{0};   // 写不出去、留在连接里的输出
+    std::atomic<uint64_t> total_sessions{0};
+    std::atomic<uint64_t> keys{0};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> skipped{0};         // 因为输出积压跳过的帧
+    std::atomic<uint64_t> bytes_out{0};
+    size_t base_rss = 0;
+    int threads = 0;
+};
+
+static std::string format_stats(const host_stats &st) {
+    uint64_t n[host::KINDS], total = 0;
+    for( int k = 0; k < host::KINDS; k++ ) {
+        n[k] = st.sessions[k].load(std::memory_order_relaxed);
+        total += n[k];
+    }
+    size_t rss = rss_bytes();
+    size_t extra = rss > st.base_rss ? rss - st.base_rss : 0;
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+             "sessions: %llu (2048 %llu, snake %llu, mines %llu) on %d threads, %llu since start\n"
+             "state:    %.0f B/session (connection + game), %llu B waiting in output buffers\n"
+             "rss:      %.1f MiB, %.2f KiB/session over the idle process\n"
+             "traffic:  %llu keys, %llu snake ticks, %llu frames (%llu skipped), %.1f MiB out\n",
+             (unsigned long long)total, (unsigned long long)n[host::KIND_2048],
+             (unsigned long long)n[host::KIND_SNAKE], (unsigned long long)n[host::KIND_MINES], st.threads,
+             (unsigned long long)st.total_sessions.load(),
+             total ? double(st.state_bytes.load()) / double(total) : 0.0,
+             (unsigned long long)st.pending_bytes.load(),
+             double(rss) / (1 << 20), total ? double(extra) / 1024 / double(total) : 0.0,
+             (unsigned long long)st.keys.load(), (unsigned long long)st.ticks.load(),
+             (unsigned long long)st.frames.load(), (unsigned long long)st.skipped.load(),
+             double(st.bytes_out.load()) / (1 << 20));
+    return buf;
+}
+
+/// 一个工作线程和它的所有连接
+class worker {
+public:
+    worker(host_stats &stats) : mStats(stats) {
+        mEpoll = epoll_create1(EPOLL_CLOEXEC);
+        mWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKE_ID;
+        epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWake, &ev);
+    }
+
+    worker(const worker &) = delete;
+    worker &operator=(const worker &) = delete;
+
+    ~worker() {
+        for( auto &c : mSlots ) {
+            if( c.fd >= 0 )
+                close(c.fd);
+        }
+        close(mWake);
+        close(mEpoll);
+    }
+
+    void start() {
+        mThread = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        mStop.store(true, std::memory_order_relaxed);
+        uint64_t one = 1;
+        (void)!write(mWake, &one, sizeof(one));
+        if( mThread.joinable() )
+            mThread.join();
+    }
+
+    /// 主线程调用，把新连接交给这个线程
+    void adopt(int fd) {
+        {
+            std::lock_guard<std::mutex> lock(mIncomingLock);
+            mIncoming.push_back(fd);
+        }
+        uint64_t one = 1;
+        (void)!write(mWake, &one, sizeof(one));
+    }
+
+private:
+    static constexpr uint64_t WAKE_ID = ~uint64_t(0);
+    static constexpr size_t HELLO_MAX = 31;
+
+    /// 一个连接，游戏开始前先收第一行
+    struct connection {
+        int fd = -1;
+        uint32_t gen = 0;           // 槽位每次重用加一，旧的定时器和事件据此认出来丢掉
+        host::key_decoder keys;
+        uint8_t hello_len = 0;
+        bool armed = false;         // 有没有定时器在堆里
+        bool dirty = false;         // 输出积压时画面又变了
+        bool want_out = false;      // 在等EPOLLOUT
+        std::unique_ptr<host::session> game;
+        std::unique_ptr<char[]> hello;  // 只在收第一行时有
+        std::string pending;            // 只在写不完时有
+    };
+
+    struct timer {
+        clock_type::time_point when;
+        uint32_t slot;
+        uint32_t gen;
+        bool operator>(const timer &rhs) const { return when > rhs.when; }
+    };
+
+    static uint64_t event_id(uint32_t slot, uint32_t gen) {
+        return uint64_t(gen) << 32 | slot;
+    }
+
+    size_t footprint(const connection &c) const {
+        return sizeof(connection) + (c.game ? c.game->footprint() : 0) + (c.hello ? HELLO_MAX + 1 : 0) +
+               (c.pending.empty() ? 0 : c.pending.capacity());
+    }
+
+    void run() {
+        epoll_event events[64];
+        while( !mStop.load(std::memory_order_relaxed) ) {
+            int n = epoll_wait(mEpoll, events, 64, timeout_ms());
+            for( int i = 0; i < n; i++ ) {
+                uint64_t id = events[i].data.u64;
+                if( id == WAKE_ID ) {
+                    take_incoming();
+                    continue;
+                }
+                uint32_t slot = uint32_t(id), gen = uint32_t(id >> 32);
+                if( slot >= mSlots.size() || mSlots[slot].gen != gen || mSlots[slot].fd < 0 )
+                    continue;
+                if( events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) )
+                    readable(slot);
+                if( mSlots[slot].fd >= 0 && mSlots[slot].gen == gen && (events[i].events & EPOLLOUT) )
+                    writable(slot);
+            }
+            run_timers();
+            mArena.reset();
+        }
+    }
+
+    int timeout_ms() {
+        if( mTimers.empty() )
+            return -1;
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(mTimers.top().when - clock_type::now()).count();
+        return wait <= 0 ? 0 : int(wait) + 1;
+    }
+
+    void take_incoming() {
+        uint64_t v;
+        (void)!read(mWake, &v, sizeof(v));
+        std::vector<int> fds;
+        {
+            std::lock_guard<std::mutex> lock(mIncomingLock);
+            fds.swap(mIncoming);
+        }
+        for( int fd : fds ) {
+            uint32_t slot;
+            if( !mFree.empty() ) {
+                slot = mFree.back();
+                mFree.pop_back();
+            } else {
+                slot = uint32_t(mSlots.size());
+                mSlots.emplace_back();
+            }
+            connection &c = mSlots[slot];
+            c.fd = fd;
+            c.gen += 1;
+            c.hello.reset(new char[HELLO_MAX + 1]);
+            c.hello_len = 0;
+            mStats.state_bytes.fetch_add(footprint(c), std::memory_order_relaxed);
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = event_id(slot, c.gen);
+            epoll_ctl(mEpoll, EPOLL_CTL_ADD, fd, &ev);
+        }
+    }
+
+    void drop(uint32_t slot) {
+        connection &c = mSlots[slot];
+        if( c.game )
+            mStats.sessions[c.game->type()].fetch_sub(1, std::memory_order_relaxed);
+        mStats.state_bytes.fetch_sub(footprint(c), std::memory_order_relaxed);
+        mStats.pending_bytes.fetch_sub(c.pending.size(), std::memory_order_relaxed);
+        close(c.fd);
+        c.fd = -1;
+        c.game.reset();
+        c.hello.reset();
+        c.keys = host::key_decoder();
+        c.armed = c.dirty = c.want_out = false;
+        std::string().swap(c.pending);
+        // gen不清零，堆里还留着的定时器靠它认出来
+        mFree.push_back(slot);
+    }
+
+    void readable(uint32_t slot) {
+        char buf[512];
+        ssize_t n = read(mSlots[slot].fd, buf, sizeof(buf));
+        if( n <= 0 ) {
+            if( n < 0 && (errno == EAGAIN || errno == EINTR) )
+                return;
+            drop(slot);
+            return;
+        }
+
+        connection &c = mSlots[slot];
+        bool changed = false;
+        ssize_t i = 0;
+        if( !c.game ) {
+            // 第一行
+            for( ; i < n && c.hello; i++ ) {
+                if( buf[i] != '\n' ) {
+                    if( c.hello_len < HELLO_MAX )
+                        c.hello[c.hello_len++] = buf[i];
+                    continue;
+                }
+                c.hello[c.hello_len] = 0;
+                i += 1;
+                if( !start_game(slot) )
+                    return;
+                changed = true;
+                break;
+            }
+        }
+        if( !c.game )
+            return;
+
+        for( ; i < n; i++ ) {
+            int k = c.keys.feed((unsigned char)buf[i]);
+            if( k < 0 )
+                continue;
+            if( k == 'q' || k == 3 ) {
+                drop(slot);
+                return;
+            }
+            mStats.keys.fetch_add(1, std::memory_order_relaxed);
+            changed = c.game->key(k) || changed;
+        }
+        if( changed )
+            present(slot);
+        arm(slot);
+    }
+
+    bool start_game(uint32_t slot) {
+        connection &c = mSlots[slot];
+        if( strcmp(c.hello.get(), "stats") == 0 ) {
+            std::string text = format_stats(mStats);
+            // 统计只有几百字节，阻塞地写完也很快
+            int flags = fcntl(c.fd, F_GETFL);
+            fcntl(c.fd, F_SETFL, flags & ~O_NONBLOCK);
+            (void)!send(c.fd, text.data(), text.size(), MSG_NOSIGNAL);
+            drop(slot);
+            return false;
+        }
+
+        mStats.state_bytes.fetch_sub(footprint(c), std::memory_order_relaxed);
+        c.game = host::make_session(c.hello.get(), mSeeds());
+        c.hello.reset();
+        mStats.state_bytes.fetch_add(footprint(c), std::memory_order_relaxed);
+        if( !c.game ) {
+            static const char msg[] = "unknown game, try 2048, snake or mines\r\n";
+            (void)!send(c.fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL);
+            drop(slot);
+            return false;
+        }
+        mStats.sessions[c.game->type()].fetch_add(1, std::memory_order_relaxed);
+        mStats.total_sessions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /// 游戏需要定时器而堆里没有时放一个进去
+    void arm(uint32_t slot) {
+        connection &c = mSlots[slot];
+        if( c.armed || !c.game )
+            return;
+        int ms = c.game->tick_ms();
+        if( ms <= 0 )
+            return;
+        c.armed = true;
+        mTimers.push(timer{clock_type::now() + std::chrono::milliseconds(ms), slot, c.gen});
+    }
+
+    void run_timers() {
+        auto now = clock_type::now();
+        while( !mTimers.empty() && mTimers.top().when <= now ) {
+            timer t = mTimers.top();
+            mTimers.pop();
+            if( t.slot >= mSlots.size() )
+                continue;
+            connection &c = mSlots[t.slot];
+            if( c.gen != t.gen || c.fd < 0 || !c.game )
+                continue;
+            c.armed = false;
+            mStats.ticks.fetch_add(1, std::memory_order_relaxed);
+            if( c.game->tick() )
+                present(t.slot);
+            if( mSlots[t.slot].fd < 0 || mSlots[t.slot].gen != t.gen )
+                continue;
+            int ms = c.game->tick_ms();
+            if( ms > 0 ) {
+                // 按上一次的时间往后排，不因为处理得晚而变慢; 落后太多时从现在重新开始
+                auto when = t.when + std::chrono::milliseconds(ms);
+                if( when < now )
+                    when = now + std::chrono::milliseconds(ms);
+                c.armed = true;
+                mTimers.push(timer{when, t.slot, t.gen});
+            }
+        }
+    }
+
+    /// 画一帧发出去; 上一帧还没写完时只记下来
+    void present(uint32_t slot) {
+        connection &c = mSlots[slot];
+        if( !c.pending.empty() ) {
+            if( !c.dirty )
+                mStats.skipped.fetch_add(1, std::memory_order_relaxed);
+            c.dirty = true;
+            return;
+        }
+        c.dirty = false;
+        frame_mem::string out(mArena);
+        out.reserve(1024);
+        c.game->render(out);
+        mStats.frames.fetch_add(1, std::memory_order_relaxed);
+        send_bytes(slot, out.data(), out.size());
+    }
+
+    void send_bytes(uint32_t slot, const char *data, size_t size) {
+        connection &c = mSlots[slot];
+        ssize_t n = send(c.fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if( n < 0 ) {
+            if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+                drop(slot);
+                return;
+            }
+            n = 0;
+        }
+        mStats.bytes_out.fetch_add(uint64_t(n), std::memory_order_relaxed);
+        if( size_t(n) == size )
+            return;
+
+        // 剩下的留着，等可写时再发
+        mStats.state_bytes.fetch_sub(footprint(c), std::memory_order_relaxed);
+        c.pending.assign(data + n, size - size_t(n));
+        mStats.state_bytes.fetch_add(footprint(c), std::memory_order_relaxed);
+        mStats.pending_bytes.fetch_add(c.pending.size(), std::memory_order_relaxed);
+        watch_output(slot, true);
+    }
+
+    void writable(uint32_t slot) {
+        connection &c = mSlots[slot];
+        if( c.pending.empty() ) {
+            watch_output(slot, false);
+            return;
+        }
+        ssize_t n = send(c.fd, c.pending.data(), c.pending.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if( n < 0 ) {
+            if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                drop(slot);
+            return;
+        }
+        mStats.bytes_out.fetch_add(uint64_t(n), std::memory_order_relaxed);
+        mStats.pending_bytes.fetch_sub(uint64_t(n), std::memory_order_relaxed);
+        mStats.state_bytes.fetch_sub(footprint(c), std::memory_order_relaxed);
+        c.pending.erase(0, size_t(n));
+        if( c.pending.empty() )
+            std::string().swap(c.pending);  // 积压的内存还回去
+        mStats.state_bytes.fetch_add(footprint(c), std::memory_order_relaxed);
+        if( !c.pending.empty() )
+            return;
+        watch_output(slot, false);
+        if( c.dirty )
+            present(slot);
+    }
+
+    void watch_output(uint32_t slot, bool on) {
+        connection &c = mSlots[slot];
+        if( c.want_out == on )
+            return;
+        c.want_out = on;
+        epoll_event ev{};
+        ev.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.u64 = event_id(slot, c.gen);
+        epoll_ctl(mEpoll, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    host_stats &mStats;
+    int mEpoll;
+    int mWake;
+    std::thread mThread;
+    std::atomic<bool> mStop{false};
+
+    std::mutex mIncomingLock;
+    std::vector<int> mIncoming;
+
+    std::vector<connection> mSlots;
+    std::vector<uint32_t> mFree;
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> mTimers;
+    frame_mem::arena mArena;
+    std::mt19937_64 mSeeds{std::random_device{}()};
+};
+
+static int serve(const std::string &path, int threads) {
+    sockaddr_un addr;
+    if( !make_address(path, addr) )
+        return 1;
+    // 连得上说明已经有一个game-host在用这个socket，不能把它顶掉;
+    // 连不上(ECONNREFUSED)才是上一次没有正常退出时留下的socket文件，可以删掉
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if( probe >= 0 ) {
+        bool live = connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0;
+        int err = errno;
+        close(probe);
+        if( live ) {
+            fprintf(stderr, "game-host: already running on %s\n", path.c_str());
+            return 1;
+        }
+        if( err == ECONNREFUSED ) {
+            unlink(path.c_str());
+        } else if( err != ENOENT ) {
+            fprintf(stderr, "game-host: cannot check %s: %s\n", path.c_str(), strerror(err));
+            return 1;
+        }
+    }
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if( lfd < 0 || bind(lfd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(lfd, 4096) != 0 ) {
+        fprintf(stderr, "game-host: cannot listen on %s: %s\n", path.c_str(), strerror(errno));
+        return 1;
+    }
+
+    // SIGINT和SIGTERM从signalfd读，主线程在poll里等连接和信号
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    host_stats stats;
+    stats.threads = threads;
+    std::vector<std::unique_ptr<worker>> workers;
+    for( int i = 0; i < threads; i++ ) {
+        workers.push_back(std::make_unique<worker>(stats));
+        workers.back()->start();
+    }
+    stats.base_rss = rss_bytes();
+    fprintf(stderr, "game-host: listening on %s with %d threads\n", path.c_str(), threads);
+
+    size_t next = 0;
+    pollfd fds[2] = {{lfd, POLLIN, 0}, {sfd, POLLIN, 0}};
+    while( true ) {
+        if( poll(fds, 2, -1) < 0 ) {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+        if( fds[1].revents )
+            break;
+        if( fds[0].revents & POLLIN ) {
+            int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if( fd < 0 ) {
+                // 文件描述符用完时先不接，等有连接断开
+                if( errno == EMFILE || errno == ENFILE )
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            workers[next++ % workers.size()]->adopt(fd);
+        }
+    }
+
+    fprintf(stderr, "%s", format_stats(stats).c_str());
+    for( auto &w : workers )
+        w->stop();
+    close(lfd);
+    close(sfd);
+    unlink(path.c_str());
+    return 0;
+}
+
+static int connect_to(const std::string &path) {
+    sockaddr_un addr;
+    if( !make_address(path, addr) )
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if( fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 ) {
+        fprintf(stderr, "game-host: cannot connect to %s: %s\n", path.c_str(), strerror(errno));
+        if( fd >= 0 )
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int print_stats(const std::string &path) {
+    int fd = connect_to(path);
+    if( fd < 0 )
+        return 1;
+    (void)!write(fd, "stats\n", 6);
+    char buf[1024];
+    ssize_t n;
+    while( (n = read(fd, buf, sizeof(buf))) > 0 )
+        fwrite(buf, 1, size_t(n), stdout);
+    close(fd);
+    return 0;
+}
+
+/// 把当前终端切到raw模式，接到服务上的一局游戏
+static int play(const std::string &path, const char *game) {
+    int fd = connect_to(path);
+    if( fd < 0 )
+        return 1;
+    std::string hello = std::string(game) + "\n";
+    (void)!write(fd, hello.data(), hello.size());
+
+    termios saved, raw;
+    bool tty = tcgetattr(STDIN_FILENO, &saved) == 0;
+    if( tty ) {
+        raw = saved;
+        cfmakeraw(&raw);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    // 备用屏幕，隐藏光标
+    (void)!write(STDOUT_FILENO, "\x1b[?1049h\x1b[?25l\x1b[2J", 18);
+
+    pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+    char buf[4096];
+    while( poll(fds, 2, -1) >= 0 ) {
+        if( fds[0].revents & (POLLIN | POLLHUP) ) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if( n <= 0 || send(fd, buf, size_t(n), MSG_NOSIGNAL) < 0 )
+                break;
+        }
+        if( fds[1].revents & (POLLIN | POLLHUP) ) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if( n <= 0 || write(STDOUT_FILENO, buf, size_t(n)) < 0 )
+                break;
+        }
+    }
+
+    (void)!write(STDOUT_FILENO, "\x1b[?25h\x1b[?1049l", 14);
+    if( tty )
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    close(fd);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--socket PATH] [--threads N]\n"
+            "       %s --connect 2048|snake|mines [--socket PATH]\n"
+            "       %s --stats [--socket PATH]\n",
+            argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+    std::string path = host::socket_path();
+    const char *game = nullptr;
+    bool stats = false;
+    int threads = 0;
+    if( const char *env = getenv("SIMPLEGAMES_HOST_THREADS") )
+        threads = atoi(env);
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp(argv[i], "--socket") == 0 && i + 1 < argc ) {
+            path = argv[++i];
+        } else if( strcmp(argv[i], "--threads") == 0 && i + 1 < argc ) {
+            threads = atoi(argv[++i]);
+        } else if( strcmp(argv[i], "--connect") == 0 && i + 1 < argc ) {
+            game = argv[++i];
+        } else if( strcmp(argv[i], "--stats") == 0 ) {
+            stats = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if( game )
+        return play(path, game);
+    if( stats )
+        return print_stats(path);
+
+    if( threads <= 0 )
+        threads = int(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+    raise_fd_limit();
+    return serve(path, threads);
+}
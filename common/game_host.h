@@ -0,0 +1,433 @@
+#pragma once
+
+// 多人对局服务(game_host.cc)里的一局游戏: 只有游戏规则、按键和画面，不管连接和线程
+//
+// 每局的状态尽量小，直接用各个游戏自己的紧凑表示:
+//   2048    x2048::Grid，4x4的网格128字节
+//   snake   arena::field里放一条蛇，每个格子1字节，20x12的场地240字节
+//   mines   扫雷的grid，三个位平面，9x9的网格48字节
+// 画面是纯文本加少量的ANSI控制序列，每帧从左上角整个重画(都不到1KB)，
+// 连接慢的时候中间的帧直接跳过，只画最新的状态，所以不用给每个连接攒输出。
+//
+// 协议(Unix socket上的字节流):
+//   客户端先发一行"<游戏> [种子]\n"，游戏是2048、snake或mines; 之后发的每个字节都是按键，
+//   光标键按终端的转义序列(\e[A或者\eOA)发。服务端每次画面变化时发一帧，q结束这一局。
+//   发"stats\n"时服务端回复一段统计文字后关闭连接。
+//
+// 环境变量:
+//   SIMPLEGAMES_HOST_SOCKET   socket的路径，默认$XDG_RUNTIME_DIR/simplegames-host.sock，
+//                             没有XDG_RUNTIME_DIR时是/tmp/simplegames-host-<uid>.sock
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include "frame_arena.h"
+#include "../x2048/grid.h"
+#include "../snake/arena.h"
+#include "../minesweeper/grid.h"
+
+namespace host {
+
+    enum kind : uint8_t { KIND_2048, KIND_SNAKE, KIND_MINES, KINDS };
+
+    constexpr const char *KIND_NAMES[KINDS] = {"2048", "snake", "mines"};
+
+    /// 光标键，普通的按键就是字节本身
+    enum : int { K_UP = 256, K_DOWN, K_LEFT, K_RIGHT };
+
+    inline std::string socket_path() {
+        if( const char *env = getenv("SIMPLEGAMES_HOST_SOCKET"); env && env[0] )
+            return env;
+        if( const char *dir = getenv("XDG_RUNTIME_DIR"); dir && dir[0] )
+            return std::string(dir) + "/simplegames-host.sock";
+        return "/tmp/simplegames-host-" + std::to_string(getuid()) + ".sock";
+    }
+
+    /// 按键的转义序列一个字节一个字节地到，状态只有一个字节，放在连接里
+    class key_decoder {
+    public:
+        /// 返回解出来的键，序列没完时返回-1
+        int feed(unsigned char c) {
+            switch( mState ) {
+            case 1:
+                mState = (c == '[' || c == 'O') ? 2 : 0;
+                return mState ? -1 : c;
+            case 2:
+                mState = 0;
+                switch( c ) {
+                case 'A': return K_UP;
+                case 'B': return K_DOWN;
+                case 'C': return K_RIGHT;
+                case 'D': return K_LEFT;
+                default: return -1;
+                }
+            default:
+                if( c == 0x1b ) {
+                    mState = 1;
+                    return -1;
+                }
+                return c;
+            }
+        }
+
+    private:
+        uint8_t mState = 0;
+    };
+
+    /// 把wasd和hjkl也当成方向键
+    inline int direction_key(int k) {
+        switch( k ) {
+        case 'w': case 'k': return K_UP;
+        case 's': case 'j': return K_DOWN;
+        case 'a': case 'h': return K_LEFT;
+        case 'd': case 'l': return K_RIGHT;
+        default: return k;
+        }
+    }
+
+    class session {
+    public:
+        virtual ~session() = default;
+
+        /// 处理一个键，返回画面是否变了
+        virtual bool key(int k) = 0;
+
+        /// 定时器到了，返回画面是否变了
+        virtual bool tick() { return false; }
+
+        /// 现在需要的定时器间隔(毫秒)，0表示不需要，这局游戏睡着不占CPU
+        virtual int tick_ms() const { return 0; }
+
+        /// 把整个画面追加到out
+        virtual void render(frame_mem::string &out) const = 0;
+
+        /// 这局游戏占的内存(对象本身加上它自己分配的)
+        virtual size_t footprint() const = 0;
+
+        kind type() const { return mKind; }
+
+    protected:
+        explicit session(kind k) : mKind(k) {}
+
+        /// 每帧的开头: 光标回到左上角
+        static void begin_frame(frame_mem::string &out) {
+            out += "\x1b[H";
+        }
+
+        /// 行尾清掉上一帧留下的字
+        static void end_line(frame_mem::string &out) {
+            out += "\x1b[K\r\n";
+        }
+
+        /// 帧的末尾清掉下面的行
+        static void end_frame(frame_mem::string &out) {
+            out += "\x1b[J";
+        }
+
+    private:
+        kind mKind;
+    };
+
+    class session_2048 : public session {
+    public:
+        explicit session_2048(uint64_t seed) : session(KIND_2048), mGrid(4, 4) {
+            mGrid.seed(seed);
+            restart();
+        }
+
+        bool key(int k) override {
+            k = direction_key(k);
+            if( k == 'r' ) {
+                restart();
+                return true;
+            }
+            x2048::DIRECTION d;
+            switch( k ) {
+            case K_UP: d = x2048::DIRECTION::UP; break;
+            case K_DOWN: d = x2048::DIRECTION::DOWN; break;
+            case K_LEFT: d = x2048::DIRECTION::LEFT; break;
+            case K_RIGHT: d = x2048::DIRECTION::RIGHT; break;
+            default: return false;
+            }
+            if( mGrid.is_fail() )
+                return false;
+            bool moved = false;
+            mGrid.merge(d, &moved);
+            if( !moved )
+                return false;
+            mGrid.generate_randomly();
+            return true;
+        }
+
+        void render(frame_mem::string &out) const override {
+            begin_frame(out);
+            frame_mem::append_int(out += "2048  score ", mGrid.score());
+            end_line(out);
+            for( int y = 0; y < mGrid.height(); y++ ) {
+                out += "+------+------+------+------+";
+                end_line(out);
+                out += '|';
+                for( int x = 0; x < mGrid.width(); x++ ) {
+                    auto v = mGrid.get(x, y);
+                    char num[24];
+                    int n = v ? snprintf(num, sizeof(num), "%lld", (long long)v) : 0;
+                    for( int pad = 6 - n; pad > 0; pad-- )
+                        out += ' ';
+                    out.append(num, n);
+                    out += '|';
+                }
+                end_line(out);
+            }
+            out += "+------+------+------+------+";
+            end_line(out);
+            out += mGrid.is_fail() ? "game over, r to restart" : "arrows/wasd to slide, r restart, q quit";
+            end_line(out);
+            end_frame(out);
+        }
+
+        size_t footprint() const override {
+            return sizeof(*this) + size_t(mGrid.width()) * mGrid.height() * sizeof(x2048::Grid::storage_t);
+        }
+
+    private:
+        void restart() {
+            mGrid.reset();
+            mGrid.generate(2);
+            mGrid.generate(2);
+        }
+
+        x2048::Grid mGrid;
+    };
+
+    class session_snake : public session {
+    public:
+        static constexpr int WIDTH = 20;
+        static constexpr int HEIGHT = 12;
+        static constexpr int TICK_MS = 120;
+
+        explicit session_snake(uint64_t seed) : session(KIND_SNAKE), mRng(seed) {
+            restart();
+        }
+
+        bool key(int k) override {
+            k = direction_key(k);
+            int dir = -1;
+            switch( k ) {
+            case K_UP: dir = arena::UP; break;
+            case K_DOWN: dir = arena::DOWN; break;
+            case K_LEFT: dir = arena::LEFT; break;
+            case K_RIGHT: dir = arena::RIGHT; break;
+            case ' ':
+                // 空格开始或者暂停
+                if( mField.alive_count() == 0 )
+                    return false;
+                mRunning = !mRunning;
+                return true;
+            case 'r':
+                restart();
+                return true;
+            default:
+                return false;
+            }
+            if( mField.alive_count() == 0 || !mField.allowed(0, dir) )
+                return false;
+            mNext = uint8_t(dir);
+            mRunning = true;
+            return true;
+        }
+
+        bool tick() override {
+            if( !mRunning )
+                return false;
+            if( mField.step(&mNext) > 0 )
+                put_apple();
+            if( mField.alive_count() == 0 )
+                mRunning = false;
+            return true;
+        }
+
+        int tick_ms() const override {
+            return mRunning ? TICK_MS : 0;
+        }
+
+        void render(frame_mem::string &out) const override {
+            begin_frame(out);
+            frame_mem::append_int(out += "snake  length ", mField.get_snake(0).length);
+            end_line(out);
+            border(out);
+            for( int y = 0; y < HEIGHT; y++ ) {
+                out += '|';
+                for( int x = 0; x < WIDTH; x++ ) {
+                    int idx = y * WIDTH + x;
+                    if( mField.is_apple(idx) )
+                        out += '*';
+                    else if( mField.is_body(idx) )
+                        out += idx == mField.get_snake(0).head ? '@' : 'o';
+                    else
+                        out += ' ';
+                }
+                out += '|';
+                end_line(out);
+            }
+            border(out);
+            if( mField.alive_count() == 0 )
+                out += "game over, r to restart";
+            else if( !mRunning )
+                out += "arrows/wasd to start, space pause, q quit";
+            end_line(out);
+            end_frame(out);
+        }
+
+        size_t footprint() const override {
+            return sizeof(*this) + size_t(WIDTH) * HEIGHT;
+        }
+
+    private:
+        static void border(frame_mem::string &out) {
+            out += '+';
+            out.append(WIDTH, '-');
+            out += '+';
+            end_line(out);
+        }
+
+        void restart() {
+            mField.reset(WIDTH, HEIGHT);
+            mField.add_snake(WIDTH / 2, HEIGHT / 2, arena::RIGHT, 3);
+            mNext = arena::RIGHT;
+            mRunning = false;
+            put_apple();
+        }
+
+        void put_apple() {
+            // 空格子从随机的位置开始往后找，场地满了就不放
+            int cells = WIDTH * HEIGHT;
+            int start = int(mRng.below(uint32_t(cells)));
+            for( int i = 0; i < cells; i++ ) {
+                int idx = (start + i) % cells;
+                if( mField.at(idx) == 0 ) {
+                    mField.put_apple(idx);
+                    return;
+                }
+            }
+        }
+
+        arena::field mField;
+        x2048::Rng mRng;
+        uint8_t mNext = arena::RIGHT;
+        bool mRunning = false;
+    };
+
+    class session_mines : public session {
+    public:
+        static constexpr int WIDTH = 9;
+        static constexpr int HEIGHT = 9;
+        static constexpr int MINES = 10;
+
+        explicit session_mines(uint64_t seed) : session(KIND_MINES), mGrid(WIDTH, HEIGHT), mSeed(seed) {}
+
+        bool key(int k) override {
+            k = direction_key(k);
+            switch( k ) {
+            case K_UP: mY = uint8_t((mY + HEIGHT - 1) % HEIGHT); return true;
+            case K_DOWN: mY = uint8_t((mY + 1) % HEIGHT); return true;
+            case K_LEFT: mX = uint8_t((mX + WIDTH - 1) % WIDTH); return true;
+            case K_RIGHT: mX = uint8_t((mX + 1) % WIDTH); return true;
+            case 'r':
+                mGrid = grid(WIDTH, HEIGHT);
+                mPlaced = mLost = false;
+                mSeed = mSeed * 6364136223846793005ull + 1442695040888963407ull;
+                return true;
+            case 'f':
+                if( over() || mGrid.is_opened(mX, mY) )
+                    return false;
+                mGrid.set_flag(mX, mY, !mGrid.has_flag(mX, mY));
+                return true;
+            case ' ': case '\r': case '\n':
+                if( over() )
+                    return false;
+                // 第一下打开的格子周围不放地雷
+                if( !mPlaced ) {
+                    mGrid.place_mines(MINES, std::make_pair(int(mX), int(mY)), mSeed);
+                    mPlaced = true;
+                }
+                mLost = mGrid.try_open(mX, mY) == OPEN_RESULT_BOMW;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        void render(frame_mem::string &out) const override {
+            begin_frame(out);
+            out += "mines  ";
+            frame_mem::append_int(out, MINES);
+            out += " mines";
+            end_line(out);
+            for( int y = 0; y < HEIGHT; y++ ) {
+                for( int x = 0; x < WIDTH; x++ ) {
+                    bool cursor = x == mX && y == mY;
+                    if( cursor )
+                        out += "\x1b[7m";
+                    out += ' ';
+                    if( mGrid.is_opened(x, y) ) {
+                        int n = mGrid.count(x, y);
+                        out += n ? char('0' + n) : '.';
+                    } else if( mLost && mGrid.is_mine(x, y) ) {
+                        out += '*';
+                    } else {
+                        out += mGrid.has_flag(x, y) ? 'F' : '#';
+                    }
+                    if( cursor )
+                        out += "\x1b[m";
+                }
+                end_line(out);
+            }
+            if( mLost )
+                out += "boom, r to restart";
+            else if( mPlaced && mGrid.is_succeed() )
+                out += "cleared, r to restart";
+            else
+                out += "arrows/wasd move, space open, f flag, q quit";
+            end_line(out);
+            end_frame(out);
+        }
+
+        size_t footprint() const override {
+            return sizeof(*this) + mGrid.plane_words() * 3 * sizeof(grid::word);
+        }
+
+    private:
+        bool over() const {
+            return mLost || (mPlaced && mGrid.is_succeed());
+        }
+
+        grid mGrid;
+        uint64_t mSeed;
+        uint8_t mX = WIDTH / 2;
+        uint8_t mY = HEIGHT / 2;
+        bool mPlaced = false;
+        bool mLost = false;
+    };
+
+    /// 按客户端发的第一行建一局游戏，不认识的游戏返回空
+    inline std::unique_ptr<session> make_session(const char *hello, uint64_t default_seed) {
+        char name[16] = {0};
+        unsigned long long seed = default_seed;
+        if( sscanf(hello, "%15s %llu", name, &seed) < 1 )
+            return nullptr;
+        if( strcmp(name, "2048") == 0 )
+            return std::make_unique<session_2048>(seed);
+        if( strcmp(name, "snake") == 0 )
+            return std::make_unique<session_snake>(seed);
+        if( strcmp(name, "mines") == 0 )
+            return std::make_unique<session_mines>(seed);
+        return nullptr;
+    }
+
+} // namespace host
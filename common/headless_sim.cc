@@ -0,0 +1,394 @@
+// 不开界面的并行模拟: 自我对局和生成局面，工作线程按NUMA节点放置(numa.h)，按节点输出吞吐量
+// compile with: c++ -O2 -std=c++20 -pthread headless_sim.cc -o headless-sim
+//
+// 用法:
+//   headless-sim [--time SEC] [-j N] [--seed S] [--width W] [--height H] [--book PATH] [NAME...]
+//   headless-sim --list
+// NAME是模拟名字的一部分，只跑名字里有它的; -j默认是所有允许的CPU，SIMPLEGAMES_NUMA见numa.h。
+//
+// 模拟:
+//   2048-greedy      2048贪心自我对局(每步选立即得分最多的方向)，每次操作是一步
+//   2048-expectimax  2048自我对局，先查开局库，查不到时做2层expectimax(book.h)，每次操作是一步;
+//                    开局库在每个节点上各读一份
+//   mines-gen        生成30x16、99个地雷的局面，从中间开始用求解器(solver.h)推，
+//                    卡住时偷看，统计不用猜就能解开的局面，每次操作是一个局面
+//   snake-selfplay   40x20的场地上4条蛇按默认规则(arena.h的default_move)走到只剩一条，每次操作是一步
+//
+// 每个工作线程在自己绑好节点以后才建网格、置换表、求解器和随机数发生器，这些页首次写入时
+// 就分配在本节点上; 线程之间不共享可写的东西，结果最后才汇总。
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "numa.h"
+#include "../x2048/grid.h"
+#include "../x2048/book.h"
+#include "../minesweeper/grid.h"
+#include "../minesweeper/solver.h"
+#include "../snake/arena.h"
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    double seconds = 2;
+    int threads = 0;
+    uint64_t seed = 1;
+    int width = 4;
+    int height = 6;
+    std::string book;
+};
+
+/// 每个节点一份的只读数据
+struct tables {
+    x2048::book::Book book;
+};
+
+/// 一个工作线程的结果，各自写在自己的缓存行里
+struct alignas(64) worker_result {
+    uint64_t ops = 0;
+    uint64_t games = 0;
+    uint64_t extra = 0;     // 各个模拟自己的计数(开局库命中、不用猜的局面)
+    double seconds = 0;
+};
+
+/// 一个模拟在一个工作线程里的状态，step()做一次操作
+class simulation {
+public:
+    virtual ~simulation() = default;
+    virtual void step(worker_result &r) = 0;
+};
+
+static uint64_t mix_seed(uint64_t base, uint64_t worker) {
+    x2048::Rng rng(base ^ (worker * 0x9e3779b97f4a7c15ull));
+    return rng.next();
+}
+
+class sim_2048_greedy : public simulation {
+public:
+    sim_2048_greedy(const options &opt, uint64_t seed) : mGrid(opt.width, opt.height), mScratch(opt.width, opt.height), mSeeds(seed) {
+        restart();
+    }
+
+    void step(worker_result &r) override {
+        int best = -1;
+        x2048::i64 best_gain = -1;
+        for( int d = 0; d < 4; d++ ) {
+            mScratch = mGrid;
+            bool moved = false;
+            x2048::i64 gain = mScratch.only_merge(x2048::DIRECTION(d), &moved);
+            if( moved && gain > best_gain ) {
+                best = d;
+                best_gain = gain;
+            }
+        }
+        r.ops += 1;
+        if( best < 0 ) {
+            r.games += 1;
+            restart();
+            return;
+        }
+        mGrid.merge(x2048::DIRECTION(best));
+        mGrid.generate_randomly();
+    }
+
+private:
+    void restart() {
+        mGrid.reset();
+        mGrid.seed(mSeeds.next());
+        mGrid.generate(2);
+    }
+
+    x2048::Grid mGrid;
+    x2048::Grid mScratch;
+    x2048::Rng mSeeds;
+};
+
+class sim_2048_expectimax : public simulation {
+public:
+    sim_2048_expectimax(const options &opt, uint64_t seed, const tables *shared)
+        : mGrid(opt.width, opt.height), mSeeds(seed), mShared(shared) {
+        restart();
+    }
+
+    void step(worker_result &r) override {
+        x2048::DIRECTION d;
+        bool found = mShared && mShared->book.deeper_than_live() && mShared->book.lookup(mGrid, d);
+        r.extra += found;
+        r.ops += 1;
+        if( !found && !mSearch.best_move(mGrid, x2048::book::LIVE_DEPTH, d) ) {
+            r.games += 1;
+            restart();
+            return;
+        }
+        bool moved = false;
+        mGrid.merge(d, &moved);
+        if( moved )
+            mGrid.generate_randomly();
+    }
+
+private:
+    void restart() {
+        mGrid.reset();
+        mGrid.seed(mSeeds.next());
+        mGrid.generate(2);
+    }
+
+    x2048::Grid mGrid;
+    x2048::Rng mSeeds;
+    x2048::book::Expectimax mSearch;    // 置换表在第一次搜索时由这个线程分配
+    const tables *mShared;
+};
+
+class sim_mines_gen : public simulation {
+public:
+    static constexpr int WIDTH = 30;
+    static constexpr int HEIGHT = 16;
+    static constexpr int MINES = 99;
+
+    explicit sim_mines_gen(uint64_t seed) : mSeeds(seed) {}
+
+    void step(worker_result &r) override {
+        grid g(WIDTH, HEIGHT);
+        g.place_mines(MINES, std::make_pair(WIDTH / 2, HEIGHT / 2), mSeeds.next());
+        g.try_open(WIDTH / 2, HEIGHT / 2);
+        // 求解器在这个线程里做，不另外起线程
+        solver s(g, 256, 1);
+        bool guessed = false;
+        while( true ) {
+            s.run();
+            if( g.is_succeed() || s.hint() == 0 )
+                break;
+            guessed = true;
+        }
+        r.ops += 1;
+        r.games += 1;
+        r.extra += !guessed;
+    }
+
+private:
+    x2048::Rng mSeeds;
+};
+
+class sim_snake_selfplay : public simulation {
+public:
+    static constexpr int WIDTH = 40;
+    static constexpr int HEIGHT = 20;
+    static constexpr int SNAKES = 4;
+    static constexpr int MAX_STEPS = 4000;
+
+    explicit sim_snake_selfplay(uint64_t seed) : mRng(seed) {
+        restart();
+    }
+
+    void step(worker_result &r) override {
+        uint8_t moves[arena::MAX_SNAKES] = {};
+        for( int i = 0; i < mField.get_count(); i++ )
+            moves[i] = mField.get_snake(i).alive ? arena::default_move(mField, i) : 0;
+        int eaten = mField.step(moves);
+        for( int i = 0; i < eaten; i++ )
+            put_apple();
+        r.ops += 1;
+        if( mField.alive_count() <= 1 || ++mSteps >= MAX_STEPS ) {
+            r.games += 1;
+            restart();
+        }
+    }
+
+private:
+    void restart() {
+        mField.reset(WIDTH, HEIGHT);
+        mSteps = 0;
+        static const int START[SNAKES][3] = {
+            {5, 3, arena::RIGHT}, {WIDTH - 6, HEIGHT - 4, arena::LEFT},
+            {WIDTH - 6, 3, arena::DOWN}, {5, HEIGHT - 4, arena::UP},
+        };
+        for( auto &s : START )
+            mField.add_snake(s[0], s[1], s[2], 4);
+        for( int i = 0; i < 8; i++ )
+            put_apple();
+    }
+
+    void put_apple() {
+        int cells = WIDTH * HEIGHT;
+        int start = int(mRng.below(uint32_t(cells)));
+        for( int i = 0; i < cells; i++ ) {
+            int idx = (start + i) % cells;
+            if( mField.at(idx) == 0 ) {
+                mField.put_apple(idx);
+                return;
+            }
+        }
+    }
+
+    arena::field mField;
+    x2048::Rng mRng;
+    int mSteps = 0;
+};
+
+struct sim_kind {
+    const char *name;
+    bool wants_book;
+    std::unique_ptr<simulation> (*make)(const options &, uint64_t seed, const tables *shared);
+};
+
+static const sim_kind SIMS[] = {
+    {"2048-greedy", false, [](const options &o, uint64_t s, const tables *) -> std::unique_ptr<simulation> {
+        return std::make_unique<sim_2048_greedy>(o, s);
+    }},
+    {"2048-expectimax", true, [](const options &o, uint64_t s, const tables *t) -> std::unique_ptr<simulation> {
+        return std::make_unique<sim_2048_expectimax>(o, s, t);
+    }},
+    {"mines-gen", false, [](const options &, uint64_t s, const tables *) -> std::unique_ptr<simulation> {
+        return std::make_unique<sim_mines_gen>(s);
+    }},
+    {"snake-selfplay", false, [](const options &, uint64_t s, const tables *) -> std::unique_ptr<simulation> {
+        return std::make_unique<sim_snake_selfplay>(s);
+    }},
+};
+
+static std::string cpu_ranges(const std::vector<int> &cpus) {
+    std::string out;
+    for( size_t i = 0; i < cpus.size(); ) {
+        size_t j = i;
+        while( j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1 )
+            j++;
+        if( !out.empty() )
+            out += ',';
+        out += std::to_string(cpus[i]);
+        if( j > i )
+            out += '-' + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+static void run_sim(const sim_kind &kind, const options &opt, const numa::topology &topo,
+                    const numa::replicated<tables> *shared) {
+    std::vector<worker_result> results(size_t(opt.threads));
+    std::atomic<int> ready{0};
+    clock_type::time_point start;
+    std::atomic<bool> started{false};
+
+    auto placed = numa::run(topo, opt.threads, [&](const numa::worker &w) {
+        // 状态在绑好节点以后才建
+        auto sim = kind.make(opt, mix_seed(opt.seed, uint64_t(w.index)), shared ? &shared->local() : nullptr);
+        worker_result r;
+
+        // 所有线程都建好状态以后一起开始，最后一个到的定开始时间
+        if( ready.fetch_add(1) + 1 == opt.threads ) {
+            start = clock_type::now();
+            started.store(true, std::memory_order_release);
+        }
+        while( !started.load(std::memory_order_acquire) )
+            std::this_thread::yield();
+        auto deadline = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opt.seconds));
+
+        auto now = clock_type::now();
+        while( now < deadline ) {
+            sim->step(r);
+            now = clock_type::now();
+        }
+        r.seconds = std::chrono::duration<double>(now - start).count();
+        results[size_t(w.index)] = r;
+    });
+
+    printf("%s\n", kind.name);
+    worker_result total;
+    for( int n = 0; n < topo.size(); n++ ) {
+        worker_result sum;
+        int threads = 0;
+        for( auto &w : placed ) {
+            if( w.node != n )
+                continue;
+            auto &r = results[size_t(w.index)];
+            sum.ops += r.ops;
+            sum.games += r.games;
+            sum.extra += r.extra;
+            sum.seconds = std::max(sum.seconds, r.seconds);
+            threads += 1;
+        }
+        if( threads == 0 )
+            continue;
+        printf("  node %-3d cpus %-12s %3d threads %12llu ops %12.0f ops/s %10.0f ops/s/thread %9llu games\n",
+               topo.at(n).id, cpu_ranges(topo.at(n).cpus).c_str(), threads, (unsigned long long)sum.ops,
+               double(sum.ops) / sum.seconds, double(sum.ops) / sum.seconds / threads, (unsigned long long)sum.games);
+        total.ops += sum.ops;
+        total.games += sum.games;
+        total.extra += sum.extra;
+        total.seconds = std::max(total.seconds, sum.seconds);
+    }
+    printf("  total    %28d threads %12llu ops %12.0f ops/s %10.0f ops/s/thread %9llu games\n",
+           opt.threads, (unsigned long long)total.ops, double(total.ops) / total.seconds,
+           double(total.ops) / total.seconds / opt.threads, (unsigned long long)total.games);
+    if( strcmp(kind.name, "2048-expectimax") == 0 )
+        printf("  book hits: %.1f%% of moves\n", total.ops ? 100.0 * double(total.extra) / double(total.ops) : 0.0);
+    else if( strcmp(kind.name, "mines-gen") == 0 )
+        printf("  solved without guessing: %.1f%% of boards\n", total.games ? 100.0 * double(total.extra) / double(total.games) : 0.0);
+}
+
+int main(int argc, char **argv) {
+    options opt;
+    opt.book = x2048::book::book_path();
+    std::vector<std::string> filters;
+    for( int i = 1; i < argc; i++ ) {
+        auto arg = [&](const char *name) { return strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if( arg("--time") ) {
+            opt.seconds = atof(argv[++i]);
+        } else if( arg("-j") ) {
+            opt.threads = atoi(argv[++i]);
+        } else if( arg("--seed") ) {
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        } else if( arg("--width") ) {
+            opt.width = atoi(argv[++i]);
+        } else if( arg("--height") ) {
+            opt.height = atoi(argv[++i]);
+        } else if( arg("--book") ) {
+            opt.book = argv[++i];
+        } else if( strcmp(argv[i], "--list") == 0 ) {
+            for( auto &s : SIMS )
+                printf("%s\n", s.name);
+            return 0;
+        } else if( argv[i][0] != '-' ) {
+            filters.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "usage: %s [--time SEC] [-j N] [--seed S] [--width W] [--height H] [--book PATH] [NAME...]\n"
+                            "       %s --list\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if( opt.width <= 0 || opt.height <= 0 || opt.seconds <= 0 )
+        return 2;
+
+    auto topo = numa::topology::detect();
+    if( opt.threads <= 0 )
+        opt.threads = topo.cpus();
+    printf("%d NUMA node(s)%s, %d threads\n", topo.size(), topo.fake() ? " (fake)" : "", opt.threads);
+
+    std::unique_ptr<numa::replicated<tables>> shared;
+    for( auto &kind : SIMS ) {
+        bool wanted = filters.empty();
+        for( auto &f : filters )
+            wanted = wanted || strstr(kind.name, f.c_str()) != nullptr;
+        if( !wanted )
+            continue;
+        if( kind.wants_book && !shared ) {
+            // 每个节点上读一份开局库，没有文件时只是查不到
+            shared = std::make_unique<numa::replicated<tables>>(topo, [&](int) {
+                auto t = std::make_unique<tables>();
+                t->book.open(opt.book, true);
+                return t;
+            });
+            if( !shared->on(0).book.loaded() )
+                printf("no opening book at %s, 2048-expectimax searches every move\n", opt.book.c_str());
+        }
+        run_sim(kind, opt, topo, kind.wants_book ? shared.get() : nullptr);
+    }
+    return 0;
+}
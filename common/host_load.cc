@@ -0,0 +1,312 @@
+// 给多人对局服务(game_host.cc)加压: 模拟成千上万个同时在玩的玩家
+// compile with: c++ -O2 -std=c++20 -pthread host_load.cc -o host-load
+//
+// 用法:
+//   host-load [--sessions N] [--rate KEYS] [--time SEC] [--threads N] [--mix 2048,snake,mines] [--socket PATH]
+//
+// 每个玩家一个连接，按--mix轮流选游戏，之后按泊松过程随机地按键(平均每秒--rate个，默认1)，
+// 读到的画面只数字节不解析。一个线程用epoll管它分到的所有连接，定时器放在最小堆里。
+// 结束时输出连接数、按键数、收到的字节数和按键延迟(从发出按键到下一次收到输出，
+// 下一个键之前都没有输出的不算; 贪吃蛇的画面也会随tick刷新，它的延迟不太准)，
+// 再向服务要一份统计(--stats的内容)。
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "game_host.h"
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    std::string path = host::socket_path();
+    int sessions = 1000;
+    int threads = 1;
+    double rate = 1;
+    double seconds = 10;
+    std::vector<std::string> mix = {"2048", "snake", "mines"};
+};
+
+struct result {
+    uint64_t connected = 0;
+    uint64_t failed = 0;
+    uint64_t closed = 0;        // 服务端提前关掉的
+    uint64_t keys = 0;
+    uint64_t unanswered = 0;    // 下一个键之前都没有收到输出的
+    uint64_t bytes = 0;
+    std::vector<float> latency_ms;
+};
+
+/// 一个线程模拟的所有玩家
+class player_group {
+public:
+    player_group(const options &opt, int first, int count) : mOpt(opt), mFirst(first), mCount(count), mRng(first + 1) {}
+
+    void run(clock_type::time_point end) {
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        mPlayers.resize(size_t(mCount));
+        auto now = clock_type::now();
+        for( int i = 0; i < mCount; i++ ) {
+            if( !open(ep, i) )
+                continue;
+            mTimers.push(timer{now + next_gap(), i});
+        }
+
+        epoll_event events[256];
+        char buf[16384];
+        while( true ) {
+            now = clock_type::now();
+            if( now >= end )
+                break;
+            auto until = mTimers.empty() ? end : std::min(end, mTimers.top().when);
+            int wait = int(std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count());
+            int n = epoll_wait(ep, events, 256, std::max(wait, 0));
+            now = clock_type::now();
+            for( int e = 0; e < n; e++ ) {
+                player &p = mPlayers[events[e].data.u32];
+                ssize_t got;
+                while( (got = recv(p.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0 ) {
+                    mResult.bytes += uint64_t(got);
+                    if( p.key_at != clock_type::time_point() ) {
+                        mResult.latency_ms.push_back(float(std::chrono::duration<double, std::milli>(now - p.key_at).count()));
+                        p.key_at = clock_type::time_point();
+                    }
+                }
+                if( got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK) ) {
+                    mResult.closed += 1;
+                    epoll_ctl(ep, EPOLL_CTL_DEL, p.fd, nullptr);
+                    close(p.fd);
+                    p.fd = -1;
+                }
+            }
+            while( !mTimers.empty() && mTimers.top().when <= now ) {
+                timer t = mTimers.top();
+                mTimers.pop();
+                player &p = mPlayers[size_t(t.index)];
+                if( p.fd < 0 )
+                    continue;
+                press(p);
+                mTimers.push(timer{t.when + next_gap(), t.index});
+            }
+        }
+
+        for( auto &p : mPlayers ) {
+            if( p.fd >= 0 )
+                close(p.fd);
+        }
+        close(ep);
+    }
+
+    result &get_result() { return mResult; }
+
+private:
+    struct player {
+        int fd = -1;
+        int game = 0;
+        clock_type::time_point key_at;  // 还没收到回应的按键
+    };
+
+    struct timer {
+        clock_type::time_point when;
+        int index;
+        bool operator>(const timer &rhs) const { return when > rhs.when; }
+    };
+
+    bool open(int ep, int i) {
+        player &p = mPlayers[size_t(i)];
+        p.game = (mFirst + i) % int(mOpt.mix.size());
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, mOpt.path.c_str(), sizeof(addr.sun_path) - 1);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        // 服务端的backlog满了时等一下再试
+        int tries = 0;
+        while( fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 ) {
+            if( errno != EAGAIN || ++tries > 200 ) {
+                close(fd);
+                fd = -1;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        if( fd < 0 ) {
+            mResult.failed += 1;
+            return false;
+        }
+        std::string hello = mOpt.mix[size_t(p.game)] + " " + std::to_string(mFirst + i) + "\n";
+        if( send(fd, hello.data(), hello.size(), MSG_NOSIGNAL) < 0 ) {
+            close(fd);
+            mResult.failed += 1;
+            return false;
+        }
+        p.fd = fd;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u32 = uint32_t(i);
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        mResult.connected += 1;
+        return true;
+    }
+
+    /// 随便按一个这个游戏里有用的键
+    void press(player &p) {
+        static const char *ARROWS[] = {"\x1b[A", "\x1b[B", "\x1b[C", "\x1b[D"};
+        const char *key = ARROWS[mRng() % 4];
+        const std::string &game = mOpt.mix[size_t(p.game)];
+        uint32_t r = uint32_t(mRng() % 16);
+        if( game == "mines" && r < 4 )
+            key = r == 0 ? "f" : r == 1 ? "r" : " ";
+        else if( game != "mines" && r == 0 )
+            key = "r";  // 输了以后重新开始
+        if( send(p.fd, key, strlen(key), MSG_NOSIGNAL | MSG_DONTWAIT) > 0 ) {
+            mResult.keys += 1;
+            // 没有让画面变化的键(比如2048里滑不动的方向)收不到回应，不算延迟
+            if( p.key_at != clock_type::time_point() )
+                mResult.unanswered += 1;
+            p.key_at = clock_type::now();
+        }
+    }
+
+    std::chrono::nanoseconds next_gap() {
+        std::exponential_distribution<double> gap(mOpt.rate);
+        return std::chrono::nanoseconds(int64_t(gap(mRng) * 1e9));
+    }
+
+    const options &mOpt;
+    int mFirst;
+    int mCount;
+    std::mt19937_64 mRng;
+    std::vector<player> mPlayers;
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> mTimers;
+    result mResult;
+};
+
+static float percentile(std::vector<float> &v, double p) {
+    if( v.empty() )
+        return 0;
+    size_t i = std::min(v.size() - 1, size_t(p * double(v.size())));
+    std::nth_element(v.begin(), v.begin() + ptrdiff_t(i), v.end());
+    return v[i];
+}
+
+static void print_host_stats(const std::string &path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if( fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0 ) {
+        if( fd >= 0 )
+            close(fd);
+        return;
+    }
+    (void)!write(fd, "stats\n", 6);
+    char buf[1024];
+    ssize_t n;
+    printf("host:\n");
+    while( (n = read(fd, buf, sizeof(buf))) > 0 )
+        fwrite(buf, 1, size_t(n), stdout);
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    options opt;
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp(argv[i], "--sessions") == 0 && i + 1 < argc ) {
+            opt.sessions = atoi(argv[++i]);
+        } else if( strcmp(argv[i], "--threads") == 0 && i + 1 < argc ) {
+            opt.threads = std::max(1, atoi(argv[++i]));
+        } else if( strcmp(argv[i], "--rate") == 0 && i + 1 < argc ) {
+            opt.rate = atof(argv[++i]);
+        } else if( strcmp(argv[i], "--time") == 0 && i + 1 < argc ) {
+            opt.seconds = atof(argv[++i]);
+        } else if( strcmp(argv[i], "--socket") == 0 && i + 1 < argc ) {
+            opt.path = argv[++i];
+        } else if( strcmp(argv[i], "--mix") == 0 && i + 1 < argc ) {
+            opt.mix.clear();
+            std::string s = argv[++i];
+            size_t beg = 0;
+            while( beg <= s.size() ) {
+                size_t end = s.find(',', beg);
+                if( end == std::string::npos )
+                    end = s.size();
+                if( end > beg )
+                    opt.mix.push_back(s.substr(beg, end - beg));
+                beg = end + 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [--sessions N] [--rate KEYS] [--time SEC] [--threads N] [--mix 2048,snake,mines] [--socket PATH]\n", argv[0]);
+            return 2;
+        }
+    }
+    if( opt.mix.empty() || opt.sessions <= 0 || opt.rate <= 0 ) {
+        fprintf(stderr, "host-load: nothing to do\n");
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    struct rlimit rl;
+    if( getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max ) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    std::vector<std::unique_ptr<player_group>> groups;
+    int per = (opt.sessions + opt.threads - 1) / opt.threads;
+    for( int first = 0; first < opt.sessions; first += per )
+        groups.push_back(std::make_unique<player_group>(opt, first, std::min(per, opt.sessions - first)));
+
+    auto beg = clock_type::now();
+    auto end = beg + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opt.seconds));
+    std::vector<std::thread> threads;
+    for( auto &g : groups )
+        threads.emplace_back([&g, end] { g->run(end); });
+
+    // 所有连接都还开着的时候要统计，不然服务那边已经少了
+    std::this_thread::sleep_until(end - std::chrono::milliseconds(200));
+    print_host_stats(opt.path);
+    for( auto &t : threads )
+        t.join();
+    double secs = std::chrono::duration<double>(clock_type::now() - beg).count();
+
+    result total;
+    for( auto &g : groups ) {
+        result &r = g->get_result();
+        total.connected += r.connected;
+        total.failed += r.failed;
+        total.closed += r.closed;
+        total.keys += r.keys;
+        total.unanswered += r.unanswered;
+        total.bytes += r.bytes;
+        total.latency_ms.insert(total.latency_ms.end(), r.latency_ms.begin(), r.latency_ms.end());
+    }
+    printf("load:\n");
+    printf("sessions: %llu connected, %llu failed, %llu closed by the host\n",
+           (unsigned long long)total.connected, (unsigned long long)total.failed, (unsigned long long)total.closed);
+    printf("keys:     %llu (%.0f/s), %llu without a new frame, %.1f MiB received\n",
+           (unsigned long long)total.keys, double(total.keys) / secs, (unsigned long long)total.unanswered,
+           double(total.bytes) / (1 << 20));
+    auto &lat = total.latency_ms;
+    printf("latency:  p50 %.2fms  p90 %.2fms  p99 %.2fms  max %.2fms\n",
+           percentile(lat, 0.5), percentile(lat, 0.9), percentile(lat, 0.99), percentile(lat, 1.0));
+    return 0;
+}
@@ -0,0 +1,299 @@
+// 游戏里热点函数的基准测试，带硬件性能计数器(perf_counters.h)
+// compile with: c++ -O2 -std=c++20 kernel_bench.cc -o kernel-bench
+//
+// 用法:
+//   kernel-bench [--events SPEC]... [--time SEC] [NAME...]
+//   kernel-bench --list
+// NAME是测试名字的一部分，只跑名字里有它的测试; --events指定要数的事件(见perf_counters.h，
+// 可以给多次，每次是一组)，不给时用SIMPLEGAMES_PERF_EVENTS或者"default"。
+// 输出每个测试每次操作的时间，计数器能用时再输出IPC和每次操作的缺失数，
+// 带*的值是计数器轮流数出来再按比例放大的。
+//
+// 测试:
+//   2048-merge       Grid::only_merge，4x4和5x5的随机残局轮流向四个方向滑(包括拷贝网格)
+//   2048-spawn       Grid::generate_randomly，在有一半空格子的网格上出子(包括拷贝网格)
+//   mines-count      grid::count，512x512、15%地雷的网格上每个格子数一遍周围的地雷
+//   mines-open       grid::try_open，从空白格子连开一片，每次操作是打开的一个格子
+//                    (包括每次清掉已打开的位平面)
+//   mines-frontier   grid::set_flag维护边界，在连开过的512x512网格的边界旁边插旗再拔掉，每次操作是插或拔一次
+//   mines-rescan     不维护边界时找边界: 扫一遍整个网格，数每个打开的格子周围未定的格子
+//   snake-regions    free_regions::set_open，蛇在40x40的场地上走，每次操作是一个格子变化
+//   snake-rebuild    free_regions::rebuild，40x40的场地
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+#include "../x2048/grid.h"
+#include "../minesweeper/grid.h"
+#include "../snake/region.h"
+
+using clock_type = std::chrono::steady_clock;
+
+// 结果写到这里，免得编译器把测的东西优化掉
+static volatile uint64_t sink;
+
+struct kernel {
+    const char *name;
+    /// 做一批，返回做了多少次操作
+    std::function<uint64_t()> batch;
+};
+
+/// 随机走若干步得到的残局
+static std::vector<x2048::Grid> random_boards(int width, int height, int count, uint64_t seed) {
+    std::vector<x2048::Grid> out;
+    std::mt19937_64 rng(seed);
+    for( int i = 0; i < count; i++ ) {
+        x2048::Grid g(width, height);
+        g.seed(rng());
+        g.generate(2);
+        int steps = int(rng() % 200);
+        for( int s = 0; s < steps && !g.is_fail(); s++ ) {
+            bool moved = false;
+            g.merge(x2048::DIRECTION(rng() % 4), &moved);
+            if( moved )
+                g.generate_randomly();
+        }
+        out.push_back(g);
+    }
+    return out;
+}
+
+static std::vector<kernel> make_kernels() {
+    std::vector<kernel> ks;
+
+    {
+        auto boards = std::make_shared<std::vector<x2048::Grid>>(random_boards(4, 4, 512, 1));
+        auto more = random_boards(5, 5, 512, 2);
+        boards->insert(boards->end(), more.begin(), more.end());
+        ks.push_back({"2048-merge", [boards] {
+            x2048::Grid scratch(4, 4);
+            uint64_t sum = 0;
+            for( auto &b : *boards ) {
+                for( int d = 0; d < 4; d++ ) {
+                    scratch = b;
+                    bool moved;
+                    sum += uint64_t(scratch.only_merge(x2048::DIRECTION(d), &moved)) + moved;
+                }
+            }
+            sink = sum;
+            return uint64_t(boards->size() * 4);
+        }});
+    }
+
+    {
+        // 一半的格子有数字
+        auto boards = std::make_shared<std::vector<x2048::Grid>>();
+        std::mt19937_64 rng(3);
+        for( int i = 0; i < 1024; i++ ) {
+            x2048::Grid g(4, 4);
+            g.seed(rng());
+            for( int c = 0; c < 8; c++ )
+                g.generate(2 << (rng() % 6));
+            boards->push_back(g);
+        }
+        ks.push_back({"2048-spawn", [boards] {
+            x2048::Grid scratch(4, 4);
+            uint64_t sum = 0;
+            for( auto &b : *boards ) {
+                scratch = b;
+                sum += scratch.generate_randomly();
+            }
+            sink = sum;
+            return uint64_t(boards->size());
+        }});
+    }
+
+    auto mines = std::make_shared<grid>(512, 512);
+    mines->place_mines(512 * 512 * 15 / 100, std::make_pair(256, 256), uint64_t(4));
+
+    ks.push_back({"mines-count", [mines] {
+        uint64_t sum = 0;
+        for( int y = 0; y < mines->height(); y++ )
+            for( int x = 0; x < mines->width(); x++ )
+                sum += mines->count(x, y);
+        sink = sum;
+        return uint64_t(mines->cells());
+    }});
+
+    {
+        // 周围没有地雷的格子做起点，才会连开一片
+        auto starts = std::make_shared<std::vector<std::pair<int, int>>>();
+        std::mt19937_64 rng(5);
+        while( starts->size() < 64 ) {
+            int x = int(rng() % 512), y = int(rng() % 512);
+            if( !mines->is_mine(x, y) && mines->count(x, y) == 0 )
+                starts->emplace_back(x, y);
+        }
+        auto board = std::make_shared<grid>(*mines);
+        ks.push_back({"mines-open", [board, starts] {
+            uint64_t opened = 0;
+            for( auto [x, y] : *starts ) {
+                // 只清位平面，打开的格子数接着往上加，两次相减就是这次打开的
+                memset(board->opened_plane(), 0, board->plane_words() * sizeof(grid::word));
+                size_t before = board->num_opened();
+                board->try_open(x, y);
+                opened += board->num_opened() - before;
+            }
+            sink = opened;
+            return opened;
+        }});
+    }
+
+    {
+        // 先从几个空白格子连开，边界有几千个格子
+        auto board = std::make_shared<grid>(*mines);
+        std::mt19937_64 rng(7);
+        for( int n = 0; n < 16; ) {
+            int x = int(rng() % 512), y = int(rng() % 512);
+            if( !board->is_mine(x, y) && board->count(x, y) == 0 ) {
+                board->try_open(x, y);
+                n++;
+            }
+        }
+        auto tracked = std::make_shared<grid>(*board);
+        tracked->track_frontier(true);
+        ks.push_back({"mines-frontier", [tracked] {
+            static std::mt19937_64 rng(8);
+            uint64_t ops = 0, sum = 0;
+            for( int i = 0; i < 2048; i++ ) {
+                auto &f = tracked->frontier()[rng() % tracked->frontier().size()];
+                int x = int(f.index % 512) + int(rng() % 3) - 1, y = int(f.index / 512) + int(rng() % 3) - 1;
+                if( x < 0 || x >= 512 || y < 0 || y >= 512 || tracked->is_opened(x, y) )
+                    continue;
+                tracked->set_flag(x, y, !tracked->has_flag(x, y));
+                sum += tracked->frontier().size();
+                tracked->set_flag(x, y, !tracked->has_flag(x, y));
+                sum += tracked->frontier().size();
+                ops += 2;
+            }
+            sink = sum;
+            return ops;
+        }});
+        ks.push_back({"mines-rescan", [board] {
+            uint64_t cells = 0;
+            for( int y = 0; y < 512; y++ )
+                for( int x = 0; x < 512; x++ )
+                    if( board->is_opened(x, y) )
+                        cells += board->unresolved(x, y) != 0;
+            sink = cells;
+            return uint64_t(1);
+        }});
+    }
+
+    {
+        // 一条长100的蛇随机地走，四个方向试了都走不通时原地掉头(走到刚空出来的蛇尾)
+        struct walk {
+            free_regions regions;
+            std::vector<int> body;
+            size_t head = 0;
+            std::mt19937_64 rng{6};
+        };
+        auto w = std::make_shared<walk>();
+        w->regions.reset(40, 40);
+        // 开始时蛇占着最上面的100个格子，body[head]是蛇头，它后面一个是蛇尾
+        for( int idx = 0; idx < 100; idx++ ) {
+            w->body.push_back(idx);
+            w->regions.set_open(idx, false);
+        }
+        w->head = w->body.size() - 1;
+        ks.push_back({"snake-regions", [w] {
+            static const int dx[4] = {1, -1, 0, 0}, dy[4] = {0, 0, 1, -1};
+            uint64_t ops = 0, sum = 0;
+            for( int step = 0; step < 4096; step++ ) {
+                int cur = w->body[w->head];
+                int next = -1;
+                for( int t = 0; t < 4 && next < 0; t++ ) {
+                    int d = int(w->rng() % 4);
+                    int x = cur % 40 + dx[d], y = cur / 40 + dy[d];
+                    if( x >= 0 && x < 40 && y >= 0 && y < 40 && w->regions.is_open(y * 40 + x) )
+                        next = y * 40 + x;
+                }
+                size_t tail = (w->head + 1) % w->body.size();
+                w->regions.set_open(w->body[tail], true);
+                if( next < 0 )
+                    next = w->body[tail];
+                w->regions.set_open(next, false);
+                w->body[tail] = next;
+                w->head = tail;
+                ops += 2;
+                // 游戏里每个tick都要问一次连通性
+                sum += w->regions.connected(next, w->body[(tail + 1) % w->body.size()]);
+            }
+            sink = sum;
+            return ops;
+        }});
+        ks.push_back({"snake-rebuild", [w] {
+            for( int i = 0; i < 64; i++ )
+                w->regions.rebuild();
+            sink = w->regions.rebuilds();
+            return uint64_t(64);
+        }});
+    }
+
+    return ks;
+}
+
+int main(int argc, char **argv) {
+    std::string events;
+    double min_time = 0.5;
+    std::vector<std::string> filters;
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp(argv[i], "--events") == 0 && i + 1 < argc ) {
+            if( !events.empty() )
+                events += ';';
+            events += argv[++i];
+        } else if( strcmp(argv[i], "--time") == 0 && i + 1 < argc ) {
+            min_time = atof(argv[++i]);
+        } else if( strcmp(argv[i], "--list") == 0 ) {
+            printf("events:");
+            for( auto &e : perfctr::known_events() )
+                printf(" %s", e.name);
+            printf("\npresets:\n");
+            for( auto &p : perfctr::PRESETS )
+                printf("  %-8s %s\n", p.name, p.events);
+            return 0;
+        } else if( argv[i][0] != '-' ) {
+            filters.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "usage: %s [--events SPEC]... [--time SEC] [NAME...]\n       %s --list\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    perfctr::counters counters(events.c_str());
+    if( !counters.problems().empty() )
+        printf("counters: %s%s\n", counters.problems().c_str(), counters.available() ? "" : "; timing only");
+
+    for( auto &k : make_kernels() ) {
+        bool wanted = filters.empty();
+        for( auto &f : filters )
+            wanted = wanted || strstr(k.name, f.c_str()) != nullptr;
+        if( !wanted )
+            continue;
+
+        k.batch();  // 预热
+        uint64_t ops = 0;
+        auto beg = clock_type::now();
+        double secs = 0;
+        counters.start();
+        do {
+            ops += k.batch();
+            secs = std::chrono::duration<double>(clock_type::now() - beg).count();
+        } while( secs < min_time );
+        counters.stop();
+
+        char buf[512];
+        counters.format(buf, sizeof(buf), double(ops));
+        printf("%-14s %12llu ops  %8.2f ns/op  %s\n", k.name, (unsigned long long)ops, secs * 1e9 / double(ops),
+               counters.available() ? buf : "");
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+// NUMA节点上的线程放置，给不开界面的模拟(headless_sim.cc)用
+//
+//   auto topo = numa::topology::detect();
+//   numa::replicated<Table> tables(topo, [](int node) { return load_table(); });  // 每个节点一份
+//   numa::run(topo, threads, [&](const numa::worker &w) {
+//       Boards boards(...);              // 在绑好的线程里分配，首次写入(first touch)的页就在本节点上
+//       tables.local().lookup(...);       // 本节点的那一份
+//   });
+//
+// - 节点和CPU从/sys/devices/system/node读，只留sched_getaffinity()允许的CPU;
+//   没有这个目录(非Linux、容器里没挂sysfs)时当成一个节点
+// - 线程按节点轮流分，绑到整个节点的CPU集合上(节点里怎么调度交给内核)，
+//   并把内存策略设成MPOL_LOCAL，即使进程是在numactl --interleave下启动的，新分配的页也在本节点上
+// - 只读的表(比如2048的开局库)用replicated在每个节点上各建一份，由绑在那个节点上的线程建，
+//   查表不跨节点。可写的东西(网格、置换表、随机数状态)由各个工作线程自己分配。
+//
+// 环境变量:
+//   SIMPLEGAMES_NUMA  off: 当成一个节点，不绑线程
+//                     fake:N: 把允许的CPU平均分成N个假的节点，在单路的机器上检查放置和统计
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace numa {
+
+    struct node {
+        int id;                 // 系统里的节点号，假的节点从0开始编
+        std::vector<int> cpus;
+    };
+
+    namespace detail {
+
+        /// "0-3,8-11"这样的CPU列表
+        inline std::vector<int> parse_cpulist(const char *s) {
+            std::vector<int> out;
+            while( *s ) {
+                char *end;
+                long a = strtol(s, &end, 10);
+                if( end == s )
+                    break;
+                long b = a;
+                s = end;
+                if( *s == '-' ) {
+                    b = strtol(s + 1, &end, 10);
+                    s = end;
+                }
+                for( long c = a; c <= b; c++ )
+                    out.push_back(int(c));
+                while( *s == ',' || *s == '\n' || *s == ' ' )
+                    s++;
+            }
+            return out;
+        }
+
+        inline std::vector<int> allowed_cpus() {
+            std::vector<int> out;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if( sched_getaffinity(0, sizeof(set), &set) == 0 ) {
+                for( int c = 0; c < CPU_SETSIZE; c++ )
+                    if( CPU_ISSET(c, &set) )
+                        out.push_back(c);
+            }
+            if( out.empty() ) {
+                for( unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); c++ )
+                    out.push_back(int(c));
+            }
+            return out;
+        }
+
+        inline int &current_node() {
+            static thread_local int node = -1;
+            return node;
+        }
+
+    } // namespace detail
+
+    class topology {
+    public:
+        /// 按SIMPLEGAMES_NUMA和sysfs得到节点
+        static topology detect() {
+            topology t;
+            std::vector<int> allowed = detail::allowed_cpus();
+            const char *env = getenv("SIMPLEGAMES_NUMA");
+            if( env && strcmp(env, "off") == 0 ) {
+                t.mNodes.push_back(node{0, allowed});
+                return t;
+            }
+            if( env && strncmp(env, "fake:", 5) == 0 ) {
+                int n = std::clamp(atoi(env + 5), 1, int(allowed.size()));
+                for( int i = 0; i < n; i++ ) {
+                    node nd{i, {}};
+                    for( size_t c = allowed.size() * size_t(i) / size_t(n); c < allowed.size() * size_t(i + 1) / size_t(n); c++ )
+                        nd.cpus.push_back(allowed[c]);
+                    t.mNodes.push_back(std::move(nd));
+                }
+                t.mFake = true;
+                return t;
+            }
+
+            if( DIR *dir = opendir("/sys/devices/system/node") ) {
+                while( auto *ent = readdir(dir) ) {
+                    int id;
+                    char tail;
+                    if( sscanf(ent->d_name, "node%d%c", &id, &tail) != 1 )
+                        continue;
+                    std::string path = std::string("/sys/devices/system/node/") + ent->d_name + "/cpulist";
+                    FILE *f = fopen(path.c_str(), "r");
+                    if( !f )
+                        continue;
+                    char buf[4096] = {0};
+                    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+                    fclose(f);
+                    buf[n] = 0;
+                    node nd{id, {}};
+                    // 只有内存没有CPU的节点，和不让用的CPU，都不要
+                    for( int c : detail::parse_cpulist(buf) )
+                        if( std::binary_search(allowed.begin(), allowed.end(), c) )
+                            nd.cpus.push_back(c);
+                    if( !nd.cpus.empty() )
+                        t.mNodes.push_back(std::move(nd));
+                }
+                closedir(dir);
+            }
+            std::sort(t.mNodes.begin(), t.mNodes.end(), [](const node &a, const node &b) { return a.id < b.id; });
+            if( t.mNodes.empty() )
+                t.mNodes.push_back(node{0, allowed});
+            return t;
+        }
+
+        int size() const { return int(mNodes.size()); }
+        const node &at(int i) const { return mNodes[size_t(i)]; }
+        const std::vector<node> &nodes() const { return mNodes; }
+
+        /// SIMPLEGAMES_NUMA=fake:N分出来的节点，内存其实还在同一处
+        bool fake() const { return mFake; }
+
+        /// 所有节点的CPU数
+        int cpus() const {
+            int n = 0;
+            for( auto &nd : mNodes )
+                n += int(nd.cpus.size());
+            return n;
+        }
+
+        /// 把调用的线程绑到第i个节点上，之后在这个线程里分配的内存优先放在这个节点上
+        /// 只有一个节点时什么也不绑
+        bool bind(int i) const {
+            detail::current_node() = i;
+            if( mNodes.size() <= 1 )
+                return true;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for( int c : mNodes[size_t(i)].cpus )
+                CPU_SET(c, &set);
+            bool ok = sched_setaffinity(0, sizeof(set), &set) == 0;
+#ifdef SYS_set_mempolicy
+            // MPOL_LOCAL(4): 在分配时所在的节点上，本来就是默认值，但numactl可能改过
+            if( !mFake )
+                syscall(SYS_set_mempolicy, 4, nullptr, 0);
+#endif
+            return ok;
+        }
+
+    private:
+        std::vector<node> mNodes;
+        bool mFake = false;
+    };
+
+    /// 调用的线程绑在哪个节点上(topology里的下标)，没有绑过时是-1
+    inline int current_node() {
+        return detail::current_node();
+    }
+
+    /// 每个节点一份的只读数据
+    template <class T>
+    class replicated {
+    public:
+        /// make(i)在绑到第i个节点上的临时线程里调用，返回std::unique_ptr<T>
+        template <class Make>
+        replicated(const topology &topo, Make make) : mReplicas(size_t(topo.size())) {
+            std::vector<std::thread> threads;
+            for( int i = 0; i < topo.size(); i++ ) {
+                threads.emplace_back([this, &topo, &make, i] {
+                    topo.bind(i);
+                    mReplicas[size_t(i)] = make(i);
+                });
+            }
+            for( auto &t : threads )
+                t.join();
+        }
+
+        /// 调用线程所在节点的那一份，没有绑过的线程用第0份
+        const T &local() const {
+            int n = current_node();
+            return *mReplicas[n >= 0 && size_t(n) < mReplicas.size() ? size_t(n) : 0];
+        }
+
+        const T &on(int node) const {
+            return *mReplicas[size_t(node)];
+        }
+
+    private:
+        std::vector<std::unique_ptr<T>> mReplicas;
+    };
+
+    struct worker {
+        int node;       // topology里的下标
+        int rank;       // 在这个节点上是第几个
+        int index;      // 全局的编号
+    };
+
+    /// 起threads个线程，按节点轮流分，每个线程绑好节点后调用fn(worker)，都返回后才返回
+    inline std::vector<worker> run(const topology &topo, int threads, const std::function<void(const worker &)> &fn) {
+        std::vector<worker> placed;
+        std::vector<int> per_node(size_t(topo.size()), 0);
+        for( int i = 0; i < threads; i++ ) {
+            int n = i % topo.size();
+            placed.push_back(worker{n, per_node[size_t(n)]++, i});
+        }
+        std::vector<std::thread> pool;
+        for( auto &w : placed ) {
+            pool.emplace_back([&topo, &fn, w] {
+                topo.bind(w.node);
+                fn(w);
+            });
+        }
+        for( auto &t : pool )
+            t.join();
+        return placed;
+    }
+
+} // namespace numa
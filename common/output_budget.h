@@ -0,0 +1,223 @@
+#pragma once
+
+// 慢速链路(比如高延迟的SSH)上的输出预算: 终端来不及收的时候跳过中间的帧
+//
+// 链路看成一个按固定速度排空的漏桶，每次刷新写进去的字节减去按速度已经发走的，就是还积压着
+// 没发出去的。ncurses直接write()到终端，没法从中间接过来数，所以读/proc/thread-self/io的wchar，
+// 只算admit()和sent()之间(也就是doupdate())写出去的: 存档、记录对局这些别的写在刷新之外，
+// 其他线程写的在别的线程的计数里，都不算进链路。要在构造预算的线程里刷新。积压的输出超过
+// SIMPLEGAMES_OUTPUT_LAG_MS能发完的量时跳过这次刷新: 窗口里的变化留着，下次刷新时ncurses
+// 只发合起来的差异，中间的帧就丢掉了，按键的响应不会排在一大堆旧画面后面。
+//
+// 链路速度:
+//   SIMPLEGAMES_OUTPUT_BPS=56k  直接指定，比特每秒，可以带k/m
+//   SIMPLEGAMES_OUTPUT_BPS=auto 默认，自己测: 真实的串口终端看TIOCOUTQ(输出队列)排空的速度;
+//                               伪终端(SSH、终端模拟器)的TIOCOUTQ总是0，只能等它的缓冲区写满:
+//                               两次刷新都被阻塞时缓冲区两次都是满的，中间写的字节都已经发走了。
+//                               伪终端的缓冲区能装下几十KB，SSH自己还有缓冲，所以只有严重拥塞
+//                               时才测得到，已知链路慢时最好直接指定。测到以后每秒放宽一点，链路变快了
+//                               会慢慢恢复成不限制。没测到时不限制，和以前一样
+//   SIMPLEGAMES_OUTPUT_BPS=0    关闭
+//   SIMPLEGAMES_OUTPUT_LAG_MS   允许积压多久的输出，默认100
+//
+// 链路慢(constrained())时游戏还应该少画，比如不播放动画，见各个游戏。
+// 光标移动和属性切换由ncurses按终端的能力挑最短的写法，游戏这边要做的是每帧只调用一次
+// doupdate()，不要先整屏擦掉再画(那样ncurses只能真的发一遍清屏)。
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace pacing {
+
+    class output_budget {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// 低于这个速度(字节每秒，大约128kbit/s)时算链路慢
+        static constexpr double CONSTRAINED_RATE = 16000;
+
+        explicit output_budget(int fd = STDOUT_FILENO) : mFd(fd) {
+            const char *s = getenv("SIMPLEGAMES_OUTPUT_BPS");
+            if( s && strcmp(s, "auto") != 0 && *s ) {
+                char *end;
+                double bps = strtod(s, &end);
+                if( *end == 'k' || *end == 'K' )
+                    bps *= 1e3;
+                else if( *end == 'm' || *end == 'M' )
+                    bps *= 1e6;
+                mAuto = false;
+                mEnabled = bps > 0;
+                mRate = bps / 8;
+            }
+            const char *lag = getenv("SIMPLEGAMES_OUTPUT_LAG_MS");
+            mLag = (lag ? atof(lag) : 100) / 1000;
+
+            if( mEnabled ) {
+                // 没有thread-self(3.17以前的内核)时退回整个进程的计数，刷新时别的线程写的也会算进去
+                mIo = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+                if( mIo < 0 )
+                    mIo = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+                if( mIo < 0 )
+                    mEnabled = false;
+            }
+            mLastUpdate = clock::now();
+        }
+
+        ~output_budget() {
+            if( mIo >= 0 )
+                close(mIo);
+        }
+
+        output_budget(const output_budget &) = delete;
+        output_budget &operator=(const output_budget &) = delete;
+
+        bool enabled() const { return mEnabled; }
+
+        /// 估计的链路速度(字节每秒)，0表示不限制
+        double rate() const { return mRate; }
+
+        bool constrained() const { return mRate > 0 && mRate < CONSTRAINED_RATE; }
+
+        /// 刷新之前调用，返回false时跳过这次刷新，最晚在retry_at()再试
+        /// 返回true时接着doupdate()，然后调用sent()
+        bool admit(clock::time_point now) {
+            if( !mEnabled )
+                return true;
+            update(now);
+            if( mRate <= 0 || mBacklog <= mRate * mLag ) {
+                mBeforeRefresh = written();
+                return true;
+            }
+            mDropped += 1;
+            return false;
+        }
+
+        /// 刷新之后调用，begin是开始刷新的时间
+        void sent(clock::time_point begin, clock::time_point end) {
+            if( !mEnabled )
+                return;
+            update(begin);
+            unsigned long long w = written();
+            unsigned long long n = w > mBeforeRefresh ? w - mBeforeRefresh : 0;
+            double bytes = double(n);
+            mBytes += n;
+            mFrames += 1;
+
+            // 写满了伪终端的缓冲区才会阻塞，两次阻塞之间写的都被终端收走了
+            if( mAuto && bytes > 0 && end - begin >= std::chrono::milliseconds(20) ) {
+                double since = std::chrono::duration<double>(end - mBlockedAt).count();
+                if( mBlockedBytes > 0 && since < 5 )
+                    sample(double(mBytes - mBlockedBytes) / since);
+                mBlockedAt = end;
+                mBlockedBytes = mBytes;
+            }
+
+            // 不知道速度时不限制，也不用记积压
+            if( mRate > 0 )
+                mBacklog += bytes;
+            update(end);
+        }
+
+        /// 跳过的刷新什么时候再试: 积压降到允许的量以下的时候
+        clock::time_point retry_at() const {
+            if( mRate <= 0 )
+                return mLastUpdate;
+            double wait = (mBacklog - mRate * mLag) / mRate;
+            if( wait < 0.001 )
+                wait = 0.001;
+            return mLastUpdate + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(wait));
+        }
+
+        unsigned long long dropped() const { return mDropped; }
+
+        int format_stats(char *buf, size_t size) const {
+            if( !mEnabled )
+                return snprintf(buf, size, "output budget off");
+            if( mRate <= 0 )
+                return snprintf(buf, size, "output %s: unlimited, %llu bytes", mAuto ? "auto" : "fixed", mBytes);
+            return snprintf(buf, size, "output %s: %.1fkbit/s backlog=%.0fB dropped=%llu", mAuto ? "auto" : "fixed",
+                            mRate * 8 / 1000, mBacklog, mDropped);
+        }
+
+        /// 退出时输出，需在endwin()之后调用
+        void report(FILE *out, const char *who) const {
+            if( !mEnabled )
+                return;
+            fprintf(out, "[%s] output: %llu bytes in %llu refreshes, %llu refreshes skipped, rate %s%.1fkbit/s\n", who,
+                    mBytes, mFrames, mDropped, mAuto ? "estimated " : "", mRate * 8 / 1000);
+        }
+
+    private:
+        /// 刷新的线程到目前为止write()出去的字节数，读不出来时返回admit()时的值(这次刷新算0)
+        unsigned long long written() const {
+            if( mIo < 0 )
+                return mBeforeRefresh;
+            char buf[512];
+            ssize_t n = pread(mIo, buf, sizeof(buf) - 1, 0);
+            if( n <= 0 )
+                return mBeforeRefresh;
+            buf[n] = 0;
+            const char *p = strstr(buf, "wchar:");
+            return p ? strtoull(p + 6, nullptr, 10) : mBeforeRefresh;
+        }
+
+        void sample(double rate) {
+            mRate = mRate <= 0 ? rate : mRate * 0.7 + rate * 0.3;
+        }
+
+        /// 按速度排空积压，真实终端的输出队列更准时以它为准
+        void update(clock::time_point now) {
+            double dt = std::chrono::duration<double>(now - mLastUpdate).count();
+            if( dt <= 0 )
+                return;
+            mLastUpdate = now;
+
+            int queued = 0;
+            if( ioctl(mFd, TIOCOUTQ, &queued) == 0 && queued > 0 ) {
+                if( mAuto && mQueued > queued )
+                    sample((mQueued - queued) / dt);
+                mBacklog = queued;
+                mQueued = queued;
+                return;
+            }
+            mQueued = 0;
+
+            if( mRate > 0 ) {
+                mBacklog -= mRate * dt;
+                if( mBacklog < 0 )
+                    mBacklog = 0;
+                // 自己测的速度每秒放宽10%，放宽到不像慢速链路时不再限制
+                if( mAuto ) {
+                    mRate *= 1 + 0.1 * dt;
+                    if( mRate > CONSTRAINED_RATE * 16 ) {
+                        mRate = 0;
+                        mBacklog = 0;
+                    }
+                }
+            }
+        }
+
+        int mFd;
+        int mIo = -1;
+        bool mEnabled = true;
+        bool mAuto = true;
+        double mRate = 0;           // 字节每秒，0表示不限制
+        double mLag;                // 秒
+        double mBacklog = 0;        // 估计的还没发出去的字节数
+        int mQueued = 0;            // 上次看到的TIOCOUTQ
+        clock::time_point mBlockedAt;       // 上次刷新被阻塞
+        unsigned long long mBlockedBytes = 0;   // 那时的mBytes
+        clock::time_point mLastUpdate;
+        unsigned long long mBeforeRefresh = 0;  // admit()时的wchar
+        unsigned long long mBytes = 0;          // 刷新时写给终端的字节数
+        unsigned long long mFrames = 0;
+        unsigned long long mDropped = 0;
+    };
+
+} // namespace pacing
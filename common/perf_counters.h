@@ -0,0 +1,303 @@
+#pragma once
+
+// 用perf_event_open读硬件性能计数器，给基准测试算IPC和每次操作的缓存/分支缺失
+//
+//   perfctr::counters c("default");
+//   c.start();
+//   ... 跑n次 ...
+//   c.stop();
+//   c.format(buf, sizeof(buf), n);   // "IPC 2.31  cycles 11.2/op  L1-dcache-load-misses 0.01/op ..."
+//
+// 事件的写法: 逗号隔开的事件是一组，分号隔开多组，也可以用预设的名字(见PRESETS):
+//   "cycles,instructions;L1-dcache-loads,L1-dcache-load-misses"
+// 同一组的计数器一起开一起停，读出来的是同一段时间的值(算IPC的两个要在同一组)。
+// 硬件计数器不够时内核轮流地数各组，读出来的值按实际数了的时间比例放大，
+// format()里标出放大过的。不指定时用环境变量SIMPLEGAMES_PERF_EVENTS，再没有就用"default"。
+//
+// 容器、虚拟机里经常没有硬件计数器(ENOENT)或者不让用(EACCES，看
+// /proc/sys/kernel/perf_event_paranoid)，这时打不开的事件跳过，problems()说明原因，
+// 一个都打不开时available()为false，基准测试照常只输出时间。只数用户态。
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace perfctr {
+
+    struct event_desc {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+    };
+
+    /// 缓存事件的config: 哪一级缓存 | 操作 << 8 | 结果 << 16
+    constexpr uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    /// 名字和perf list里的一样
+    inline const std::vector<event_desc> &known_events() {
+        static const std::vector<event_desc> events = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {"L1-dcache-loads", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS)},
+            {"L1-dcache-load-misses", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"LLC-loads", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS)},
+            {"LLC-load-misses", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"dTLB-load-misses", PERF_TYPE_HW_CACHE,
+             cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+        };
+        return events;
+    }
+
+    struct preset {
+        const char *name;
+        const char *events;
+    };
+
+    /// 预设的事件组，一个硬件组最好不超过4个事件，否则在很多CPU上要轮流数
+    static constexpr preset PRESETS[] = {
+        {"default", "cycles,instructions,branch-misses;L1-dcache-load-misses,LLC-load-misses;task-clock,page-faults"},
+        {"ipc", "cycles,instructions"},
+        {"cache", "L1-dcache-loads,L1-dcache-load-misses;LLC-loads,LLC-load-misses"},
+        {"branch", "branches,branch-misses"},
+        {"sw", "task-clock,page-faults,context-switches,cpu-migrations"},
+    };
+
+    class counters {
+    public:
+        explicit counters(const char *spec = nullptr) {
+            if( !spec || !*spec )
+                spec = getenv("SIMPLEGAMES_PERF_EVENTS");
+            if( !spec || !*spec )
+                spec = "default";
+            open_all(expand(spec));
+        }
+
+        ~counters() {
+            for( auto &e : mEvents )
+                if( e.fd >= 0 )
+                    close(e.fd);
+        }
+
+        counters(const counters &) = delete;
+        counters &operator=(const counters &) = delete;
+
+        /// 至少打开了一个计数器
+        bool available() const {
+            for( auto &e : mEvents )
+                if( e.fd >= 0 )
+                    return true;
+            return false;
+        }
+
+        /// 打不开的事件和原因，都打开了时是空的
+        const std::string &problems() const { return mProblems; }
+
+        void start() {
+            for( auto &g : mGroups ) {
+                ioctl(g.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(g.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+
+        void stop() {
+            for( auto &g : mGroups )
+                ioctl(g.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            for( auto &g : mGroups )
+                read_group(g);
+        }
+
+        /// 上一次start()到stop()之间的值，没打开或者没数到时返回负数
+        double value(const char *name) const {
+            for( auto &e : mEvents )
+                if( e.fd >= 0 && e.running > 0 && strcmp(e.desc.name, name) == 0 )
+                    return e.value;
+            return -1;
+        }
+
+        /// 一行结果，ops是这段时间里做了多少次操作
+        int format(char *buf, size_t size, double ops) const {
+            int n = 0;
+            auto put = [&](const char *fmt, auto... args) {
+                if( n >= 0 && size_t(n) < size )
+                    n += snprintf(buf + n, size - size_t(n), fmt, args...);
+            };
+            if( !available() ) {
+                put("counters unavailable");
+                return n;
+            }
+            double cycles = value("cycles"), instructions = value("instructions");
+            if( cycles > 0 && instructions >= 0 )
+                put("IPC %.2f  ", instructions / cycles);
+            for( auto &e : mEvents ) {
+                if( e.fd < 0 )
+                    continue;
+                if( e.running == 0 ) {
+                    put("%s n/a  ", e.desc.name);
+                } else if( e.desc.type == PERF_TYPE_SOFTWARE && e.desc.config == PERF_COUNT_SW_TASK_CLOCK ) {
+                    put("%s %.1fns/op  ", e.desc.name, e.value / ops);
+                } else {
+                    put("%s %.3g/op%s  ", e.desc.name, e.value / ops, e.running < e.enabled ? "*" : "");
+                }
+            }
+            // 去掉最后的空格
+            while( n > 0 && size_t(n) <= size && buf[n - 1] == ' ' )
+                buf[--n] = 0;
+            return n;
+        }
+
+    private:
+        struct event {
+            event_desc desc;
+            int group;
+            int fd = -1;
+            double value = 0;
+            uint64_t enabled = 0;
+            uint64_t running = 0;
+        };
+
+        struct group {
+            int leader;
+            std::vector<size_t> members;    // 按读出来的顺序
+        };
+
+        /// 把预设的名字换成事件
+        static std::string expand(const char *spec) {
+            std::string out;
+            std::string s(spec);
+            size_t pos = 0;
+            while( pos <= s.size() ) {
+                size_t end = s.find(';', pos);
+                if( end == std::string::npos )
+                    end = s.size();
+                std::string item = s.substr(pos, end - pos);
+                for( auto &p : PRESETS ) {
+                    if( item == p.name ) {
+                        item = p.events;
+                        break;
+                    }
+                }
+                if( !item.empty() ) {
+                    if( !out.empty() )
+                        out += ';';
+                    out += item;
+                }
+                pos = end + 1;
+            }
+            return out;
+        }
+
+        void problem(const std::string &name, const char *why) {
+            if( !mProblems.empty() )
+                mProblems += ", ";
+            mProblems += name + ": " + why;
+        }
+
+        void open_all(const std::string &spec) {
+            int group_no = 0;
+            size_t pos = 0;
+            while( pos <= spec.size() ) {
+                size_t end = spec.find_first_of(",;", pos);
+                if( end == std::string::npos )
+                    end = spec.size();
+                std::string name = spec.substr(pos, end - pos);
+                if( !name.empty() )
+                    open_one(name, group_no);
+                if( end < spec.size() && spec[end] == ';' )
+                    group_no += 1;
+                pos = end + 1;
+            }
+        }
+
+        void open_one(const std::string &name, int group_no) {
+            const event_desc *desc = nullptr;
+            for( auto &d : known_events() )
+                if( name == d.name )
+                    desc = &d;
+            if( !desc ) {
+                problem(name, "unknown event");
+                return;
+            }
+
+            // 组里第一个打开了的事件是组长，后面的跟着它一起开关
+            group *g = nullptr;
+            if( group_no < int(mGroupOf.size()) && mGroupOf[size_t(group_no)] >= 0 )
+                g = &mGroups[size_t(mGroupOf[size_t(group_no)])];
+
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = desc->type;
+            attr.config = desc->config;
+            attr.disabled = g ? 0 : 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, g ? g->leader : -1, PERF_FLAG_FD_CLOEXEC));
+            if( fd < 0 ) {
+                problem(name, errno == ENOENT || errno == EOPNOTSUPP ? "not supported"
+                              : errno == EACCES || errno == EPERM ? "permission denied (perf_event_paranoid)"
+                              : strerror(errno));
+                return;
+            }
+
+            event e;
+            e.desc = *desc;
+            e.fd = fd;
+            if( !g ) {
+                if( group_no >= int(mGroupOf.size()) )
+                    mGroupOf.resize(size_t(group_no) + 1, -1);
+                mGroupOf[size_t(group_no)] = int(mGroups.size());
+                mGroups.push_back(group{fd, {}});
+                g = &mGroups.back();
+            }
+            e.group = mGroupOf[size_t(group_no)];
+            g->members.push_back(mEvents.size());
+            mEvents.push_back(e);
+        }
+
+        /// 一次读出整组: nr, time_enabled, time_running, value[nr]
+        void read_group(group &g) {
+            uint64_t buf[3 + 16];
+            ssize_t n = read(g.leader, buf, sizeof(buf));
+            if( n < ssize_t(3 * sizeof(uint64_t)) )
+                return;
+            uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+            for( size_t i = 0; i < g.members.size() && i < nr && 3 + i < size_t(n) / sizeof(uint64_t); i++ ) {
+                event &e = mEvents[g.members[i]];
+                e.enabled = enabled;
+                e.running = running;
+                // 轮流数的时候只数了running这么长时间，按比例放大
+                e.value = running > 0 ? double(buf[3 + i]) * double(enabled) / double(running) : 0;
+            }
+        }
+
+        std::vector<event> mEvents;
+        std::vector<group> mGroups;
+        std::vector<int> mGroupOf;      // 第几组 -> mGroups的下标，整组都打不开时是-1
+        std::string mProblems;
+    };
+
+} // namespace perfctr
@@ -0,0 +1,631 @@
+// 在伪终端里运行游戏，按脚本定时发送按键，测渲染输出的字节数、帧率和按键延迟
+// compile with: c++ -O2 -std=c++17 ptybench.cc -o pty-bench
+//
+// 用法:
+//   pty-bench [--size 80x24] [--term NAME] [--gap MS] [--linger MS] [--bandwidth BPS] [--capture FILE] --script FILE -- ./x2048-cc
+//   pty-bench [--size 80x24] [--term NAME] --record FILE -- ./x2048-cc
+//
+// 第一种按脚本发送按键，结束后输出统计; 第二种把当前终端接到游戏上自己玩，同时把按键和
+// 时间写成脚本，之后可以用第一种重放。common/ptybench/下有几个游戏的示例脚本。
+//
+// 脚本每行一个事件: 等多少毫秒，然后一次性写入后面的所有按键，行尾的xN表示重复N次:
+//   # 注释
+//   500 a              等500ms后按a
+//   40 Up Right x25    每隔40ms按一次Up和Right，一共25次
+//   100 "hello" ^C     字符串原样发送，^C是Ctrl+C
+//   repeat 10          repeat和end之间的几行重复10次，可以嵌套
+//   60 Up
+//   60 Left
+//   end
+// 按键名: Up Down Left Right Home End PgUp PgDn Insert Delete F1-F12 Enter Esc Space Tab Backspace，
+// 单个字符，^X，\xHH(任意字节)，"字符串"。时间从上一个事件开始算，不会因为发送晚了而累积误差。
+//
+// 统计:
+//   - 输出按间隔分帧: 两次读到输出的间隔小于--gap(默认2ms)的算同一帧
+//   - bytes/frame和frames/s，第一个按键之前的输出(启动画面)单独算
+//   - 按键延迟: 从写入按键到读到第一个字节(first byte)，和到这一帧写完(frame end)，
+//     下一个按键之前都没有输出的算没有响应
+//   - --capture把原始输出写到文件，可以用cat重放或者和另一次的输出比较
+//   - --bandwidth 56k按这个速度(比特每秒)从伪终端读，模拟慢速链路，程序写得太多时输出会积压在
+//     伪终端的缓冲区里。这时按键后读到的第一个字节可能还是旧的画面，看最后一个按键之后多久
+//     输出才停下来(settled)更准，--linger要设得够长
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+using clock_type = std::chrono::steady_clock;
+
+struct key_event {
+    double delay_ms;        // 距上一个事件
+    std::string bytes;
+};
+
+struct chunk {
+    clock_type::time_point t;
+    size_t size;
+};
+
+static const struct {
+    const char *name;
+    const char *seq;
+} KEY_NAMES[] = {
+    // 光标键按普通模式写，程序打开了应用模式(keypad)时发送前换成\eO
+    {"Up", "\x1b[A"}, {"Down", "\x1b[B"}, {"Right", "\x1b[C"}, {"Left", "\x1b[D"},
+    {"Home", "\x1b[H"}, {"End", "\x1b[F"},
+    {"Insert", "\x1b[2~"}, {"Delete", "\x1b[3~"}, {"PgUp", "\x1b[5~"}, {"PgDn", "\x1b[6~"},
+    {"F1", "\x1bOP"}, {"F2", "\x1bOQ"}, {"F3", "\x1bOR"}, {"F4", "\x1bOS"},
+    {"F5", "\x1b[15~"}, {"F6", "\x1b[17~"}, {"F7", "\x1b[18~"}, {"F8", "\x1b[19~"},
+    {"F9", "\x1b[20~"}, {"F10", "\x1b[21~"}, {"F11", "\x1b[23~"}, {"F12", "\x1b[24~"},
+    {"Enter", "\r"}, {"Esc", "\x1b"}, {"Space", " "}, {"Tab", "\t"}, {"Backspace", "\x7f"},
+};
+
+static bool parse_key(const std::string &tok, std::string &out) {
+    for( auto &k : KEY_NAMES ) {
+        if( tok == k.name ) {
+            out += k.seq;
+            return true;
+        }
+    }
+    if( tok.size() == 1 ) {
+        out += tok;
+    } else if( tok.size() == 2 && tok[0] == '^' && (tok[1] == '?' || (toupper(tok[1]) >= '@' && toupper(tok[1]) <= '_')) ) {
+        out += tok[1] == '?' ? '\x7f' : char(toupper(tok[1]) & 0x1f);
+    } else if( tok.size() == 4 && tok[0] == '\\' && tok[1] == 'x' && isxdigit(tok[2]) && isxdigit(tok[3]) ) {
+        out += char(strtol(tok.c_str() + 2, nullptr, 16));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool load_script(const char *path, std::vector<key_event> &events) {
+    std::ifstream in(path);
+    if( !in ) {
+        fprintf(stderr, "pty-bench: cannot open %s\n", path);
+        return false;
+    }
+    // 每层repeat块开始的位置和次数
+    std::vector<std::pair<size_t, long>> blocks;
+    std::string line;
+    int lineno = 1;
+    for( ; std::getline(in, line); lineno++ ) {
+        size_t i = line.find_first_not_of(" \t\r");
+        if( i == std::string::npos || line[i] == '#' )
+            continue;
+        if( line.compare(i, 7, "repeat ") == 0 ) {
+            blocks.emplace_back(events.size(), atol(line.c_str() + i + 7));
+            continue;
+        }
+        if( line.compare(i, 3, "end") == 0 && line.find_first_not_of(" \t\r", i + 3) == std::string::npos ) {
+            if( blocks.empty() ) {
+                fprintf(stderr, "pty-bench: %s:%d: end without repeat\n", path, lineno);
+                return false;
+            }
+            auto [begin, times] = blocks.back();
+            blocks.pop_back();
+            std::vector<key_event> body(events.begin() + long(begin), events.end());
+            events.resize(begin);
+            for( long r = 0; r < times; r++ )
+                events.insert(events.end(), body.begin(), body.end());
+            continue;
+        }
+
+        char *end;
+        double delay = strtod(line.c_str() + i, &end);
+        if( end == line.c_str() + i || delay < 0 ) {
+            fprintf(stderr, "pty-bench: %s:%d: expected a delay in ms\n", path, lineno);
+            return false;
+        }
+        i = size_t(end - line.c_str());
+
+        key_event ev{delay, {}};
+        long repeat = 1;
+        while( true ) {
+            i = line.find_first_not_of(" \t\r", i);
+            if( i == std::string::npos )
+                break;
+            if( line[i] == '"' ) {
+                size_t close = line.find('"', i + 1);
+                if( close == std::string::npos ) {
+                    fprintf(stderr, "pty-bench: %s:%d: unterminated string\n", path, lineno);
+                    return false;
+                }
+                ev.bytes.append(line, i + 1, close - i - 1);
+                i = close + 1;
+                continue;
+            }
+            size_t j = line.find_first_of(" \t\r", i);
+            std::string tok = line.substr(i, j == std::string::npos ? std::string::npos : j - i);
+            i = j;
+            if( tok.size() > 1 && tok[0] == 'x' && tok.find_first_not_of("0123456789", 1) == std::string::npos ) {
+                repeat = atol(tok.c_str() + 1);
+            } else if( !parse_key(tok, ev.bytes) ) {
+                fprintf(stderr, "pty-bench: %s:%d: unknown key '%s'\n", path, lineno, tok.c_str());
+                return false;
+            }
+            if( i == std::string::npos )
+                break;
+        }
+        for( long r = 0; r < repeat; r++ )
+            events.push_back(ev);
+    }
+    if( !blocks.empty() ) {
+        fprintf(stderr, "pty-bench: %s:%d: repeat without end\n", path, lineno);
+        return false;
+    }
+    return true;
+}
+
+/// 把录下的一次输入写成脚本里的按键，认不出的字节写成\xHH
+static std::string describe_keys(const char *buf, size_t n) {
+    std::string out;
+    size_t i = 0;
+    while( i < n ) {
+        if( !out.empty() )
+            out += ' ';
+        bool named = false;
+        for( auto &k : KEY_NAMES ) {
+            std::string seq = k.seq;
+            // 应用模式下的光标键
+            std::string alt = seq;
+            if( alt.size() == 3 && alt[1] == '[' )
+                alt[1] = 'O';
+            for( auto *s : {&seq, &alt} ) {
+                if( s->size() <= n - i && memcmp(buf + i, s->data(), s->size()) == 0 ) {
+                    out += k.name;
+                    i += s->size();
+                    named = true;
+                    break;
+                }
+            }
+            if( named )
+                break;
+        }
+        if( named )
+            continue;
+        unsigned char c = (unsigned char)buf[i++];
+        char tmp[8];
+        if( c < 0x20 ) {
+            snprintf(tmp, sizeof(tmp), "^%c", c + '@');
+        } else if( c < 0x7f && c != '"' && c != '\\' ) {
+            snprintf(tmp, sizeof(tmp), "%c", c);
+        } else {
+            snprintf(tmp, sizeof(tmp), "\\x%02x", c);
+        }
+        out += tmp;
+    }
+    return out;
+}
+
+/// 程序是否打开了光标键的应用模式(DECCKM)，跨读取边界地找\e[?1h和\e[?1l
+class cursor_mode_tracker {
+public:
+    void feed(const char *buf, size_t n) {
+        mTail.append(buf, n);
+        size_t on = mTail.rfind("\x1b[?1h"), off = mTail.rfind("\x1b[?1l");
+        if( on != std::string::npos && (off == std::string::npos || on > off) )
+            mApplication = true;
+        else if( off != std::string::npos )
+            mApplication = false;
+        // 只留下可能是半个序列的结尾
+        if( mTail.size() > 4 )
+            mTail.erase(0, mTail.size() - 4);
+    }
+
+    std::string translate(const std::string &keys) const {
+        if( !mApplication )
+            return keys;
+        std::string out = keys;
+        for( size_t i = 0; i + 2 < out.size(); i++ ) {
+            if( out[i] == '\x1b' && out[i + 1] == '[' && strchr("ABCDHF", out[i + 2]) )
+                out[i + 1] = 'O';
+        }
+        return out;
+    }
+
+private:
+    std::string mTail;
+    bool mApplication = false;
+};
+
+static pid_t spawn_in_pty(char **argv, int cols, int rows, const char *term, int &master) {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if( master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ) {
+        perror("pty-bench: posix_openpt");
+        return -1;
+    }
+    struct winsize ws;
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_col = (unsigned short)cols;
+    ws.ws_row = (unsigned short)rows;
+    ioctl(master, TIOCSWINSZ, &ws);
+    std::string slave_name = ptsname(master);
+
+    pid_t pid = fork();
+    if( pid < 0 ) {
+        perror("pty-bench: fork");
+        return -1;
+    }
+    if( pid == 0 ) {
+        setsid();
+        int slave = open(slave_name.c_str(), O_RDWR);
+        if( slave < 0 )
+            _exit(127);
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, 0);
+        dup2(slave, 1);
+        dup2(slave, 2);
+        if( slave > 2 )
+            close(slave);
+        close(master);
+        setenv("TERM", term, 1);
+        unsetenv("LINES");
+        unsetenv("COLUMNS");
+        execvp(argv[0], argv);
+        fprintf(stderr, "pty-bench: cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    return pid;
+}
+
+/// 关掉伪终端(程序会收到SIGHUP)，等它退出，1秒后还没退出就杀掉
+static int reap(pid_t pid, int master) {
+    close(master);
+    int status = 0;
+    auto deadline = clock_type::now() + std::chrono::seconds(1);
+    while( waitpid(pid, &status, WNOHANG) == 0 ) {
+        if( clock_type::now() > deadline ) {
+            kill(-pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            break;
+        }
+        usleep(1000);
+    }
+    return status;
+}
+
+static void describe_status(int status) {
+    if( WIFEXITED(status) )
+        printf("exit %d", WEXITSTATUS(status));
+    else if( WIFSIGNALED(status) )
+        printf("killed by signal %d", WTERMSIG(status));
+}
+
+static double ms(clock_type::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+static struct timespec to_timespec(clock_type::duration d) {
+    if( d < clock_type::duration::zero() )
+        d = clock_type::duration::zero();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    struct timespec ts;
+    ts.tv_sec = time_t(ns / 1000000000);
+    ts.tv_nsec = long(ns % 1000000000);
+    return ts;
+}
+
+static void print_distribution(const char *label, std::vector<double> v, const char *unit) {
+    if( v.empty() ) {
+        printf("%-22s -\n", label);
+        return;
+    }
+    std::sort(v.begin(), v.end());
+    auto pct = [&v](double p) {
+        size_t i = size_t(p * double(v.size() - 1) + 0.5);
+        return v[std::min(i, v.size() - 1)];
+    };
+    double sum = 0;
+    for( double x : v )
+        sum += x;
+    printf("%-22s mean %.2f%s  p50 %.2f%s  p90 %.2f%s  p99 %.2f%s  max %.2f%s\n", label, sum / double(v.size()), unit,
+           pct(0.5), unit, pct(0.9), unit, pct(0.99), unit, v.back(), unit);
+}
+
+static int run_script(char **argv, int cols, int rows, const char *term, const std::vector<key_event> &events,
+                      double gap_ms, double linger_ms, double bandwidth, const char *capture_path) {
+    FILE *capture = nullptr;
+    if( capture_path && !(capture = fopen(capture_path, "wb")) ) {
+        perror("pty-bench: capture");
+        return 1;
+    }
+    int master;
+    pid_t pid = spawn_in_pty(argv, cols, rows, term, master);
+    if( pid < 0 )
+        return 1;
+
+    std::vector<chunk> chunks;
+    std::vector<clock_type::time_point> sent;
+    cursor_mode_tracker mode;
+    static char buf[1 << 16];
+    size_t total = 0;
+    bool child_gone = false;
+
+    auto start = clock_type::now();
+    auto due = start;
+    size_t next = 0;
+    if( !events.empty() )
+        due += std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::milli>(events[0].delay_ms));
+    auto linger = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::milli>(linger_ms));
+    auto finish = events.empty() ? start + linger : clock_type::time_point::max();
+
+    // 限速时用令牌桶，最多攒一小段，空闲时不会攒出一大口
+    double rate = bandwidth / 8, burst = 256, tokens = burst;
+    auto refilled = start;
+
+    while( true ) {
+        auto now = clock_type::now();
+        if( next < events.size() && now >= due ) {
+            std::string keys = mode.translate(events[next].bytes);
+            sent.push_back(clock_type::now());
+            if( write(master, keys.data(), keys.size()) < 0 )
+                break;
+            next += 1;
+            if( next < events.size() )
+                due += std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double, std::milli>(events[next].delay_ms));
+            else
+                finish = sent.back() + linger;
+            continue;
+        }
+        if( now >= finish )
+            break;
+
+        size_t allow = sizeof(buf);
+        auto wake = std::min(next < events.size() ? due : finish, finish);
+        if( rate > 0 ) {
+            tokens = std::min(burst, tokens + rate * std::chrono::duration<double>(now - refilled).count());
+            refilled = now;
+            if( tokens < 1 )
+                wake = std::min(wake, now + std::chrono::duration_cast<clock_type::duration>(
+                                          std::chrono::duration<double>((1 - tokens) / rate)));
+            allow = size_t(tokens);
+        }
+
+        struct pollfd pfd = {allow > 0 ? master : -1, POLLIN, 0};
+        struct timespec ts = to_timespec(wake - now);
+        int rc = ppoll(&pfd, 1, &ts, nullptr);
+        if( rc < 0 && errno != EINTR )
+            break;
+        if( rc > 0 ) {
+            ssize_t n = read(master, buf, allow);
+            tokens -= double(std::max(n, ssize_t(0)));
+            auto t = clock_type::now();
+            if( n <= 0 ) {
+                // 从机一端都关掉了(EIO)，程序已经退出
+                child_gone = true;
+                break;
+            }
+            chunks.push_back(chunk{t, size_t(n)});
+            total += size_t(n);
+            mode.feed(buf, size_t(n));
+            if( capture )
+                fwrite(buf, 1, size_t(n), capture);
+        }
+    }
+    auto stop = clock_type::now();
+    int status = reap(pid, master);
+    if( capture )
+        fclose(capture);
+
+    // 分帧
+    struct frame {
+        clock_type::time_point begin, end;
+        size_t bytes;
+    };
+    auto gap = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::milli>(gap_ms));
+    std::vector<frame> frames;
+    for( auto &c : chunks ) {
+        if( !frames.empty() && c.t - frames.back().end < gap ) {
+            frames.back().end = c.t;
+            frames.back().bytes += c.size;
+        } else {
+            frames.push_back(frame{c.t, c.t, c.size});
+        }
+    }
+
+    auto first_key = sent.empty() ? stop : sent.front();
+    size_t startup_frames = 0, startup_bytes = 0;
+    while( startup_frames < frames.size() && frames[startup_frames].begin < first_key )
+        startup_bytes += frames[startup_frames++].bytes;
+
+    std::vector<double> frame_bytes;
+    for( size_t i = startup_frames; i < frames.size(); i++ )
+        frame_bytes.push_back(double(frames[i].bytes));
+
+    // 每个按键之后的第一帧
+    std::vector<double> first_byte, frame_end;
+    size_t f = startup_frames;
+    for( size_t k = 0; k < sent.size(); k++ ) {
+        auto limit = k + 1 < sent.size() ? sent[k + 1] : stop;
+        auto c = std::lower_bound(chunks.begin(), chunks.end(), sent[k],
+                                  [](const chunk &a, clock_type::time_point t) { return a.t < t; });
+        if( c == chunks.end() || c->t >= limit )
+            continue;
+        first_byte.push_back(ms(c->t - sent[k]));
+        while( f < frames.size() && frames[f].end < c->t )
+            f++;
+        if( f < frames.size() )
+            frame_end.push_back(ms(frames[f].end - sent[k]));
+    }
+
+    printf("command:               ");
+    for( char **a = argv; *a; a++ )
+        printf("%s%s", *a, a[1] ? " " : "");
+    printf(" (%dx%d, TERM=%s)\n", cols, rows, term);
+    printf("duration:              %.3fs, ", ms(stop - start) / 1000);
+    describe_status(status);
+    printf("%s\n", child_gone ? "" : " after the script");
+    printf("output:                %zu bytes, %zu frames\n", total, frames.size());
+    if( startup_frames > 0 )
+        printf("startup:               %zu bytes in %zu frames, first output after %.2fms\n", startup_bytes,
+               startup_frames, ms(frames.front().begin - start));
+    if( frame_bytes.size() > 1 ) {
+        double span = ms(frames.back().begin - frames[startup_frames].begin) / 1000;
+        printf("frames/s:              %.1f over %.3fs\n", double(frame_bytes.size() - 1) / span, span);
+    }
+    print_distribution("bytes/frame:", frame_bytes, "");
+    printf("keys:                  %zu of %zu sent, %zu answered before the next key\n", sent.size(), events.size(),
+           first_byte.size());
+    print_distribution("latency (first byte):", first_byte, "ms");
+    print_distribution("latency (frame end):", frame_end, "ms");
+    if( !sent.empty() && !chunks.empty() && chunks.back().t > sent.back() && stop - chunks.back().t >= gap )
+        printf("settled:               %.2fms after the last key\n", ms(chunks.back().t - sent.back()));
+    return 0;
+}
+
+static int run_record(char **argv, int cols, int rows, const char *term, const char *path) {
+    FILE *out = fopen(path, "w");
+    if( !out ) {
+        perror("pty-bench: record");
+        return 1;
+    }
+    struct termios saved;
+    bool tty = tcgetattr(0, &saved) == 0;
+    if( tty && cols == 0 ) {
+        struct winsize ws;
+        if( ioctl(0, TIOCGWINSZ, &ws) == 0 ) {
+            cols = ws.ws_col;
+            rows = ws.ws_row;
+        }
+    }
+    if( cols == 0 ) {
+        cols = 80;
+        rows = 24;
+    }
+    int master;
+    pid_t pid = spawn_in_pty(argv, cols, rows, term, master);
+    if( pid < 0 )
+        return 1;
+    if( tty ) {
+        struct termios raw = saved;
+        cfmakeraw(&raw);
+        tcsetattr(0, TCSANOW, &raw);
+    }
+
+    fprintf(out, "# recorded by pty-bench at %dx%d:", cols, rows);
+    for( char **a = argv; *a; a++ )
+        fprintf(out, " %s", *a);
+    fprintf(out, "\n");
+
+    static char buf[1 << 16];
+    auto last = clock_type::now();
+    bool stdin_open = true;
+    while( true ) {
+        struct pollfd pfd[2] = {{master, POLLIN, 0}, {stdin_open ? 0 : -1, POLLIN, 0}};
+        if( poll(pfd, 2, -1) < 0 ) {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+        if( pfd[0].revents ) {
+            ssize_t n = read(master, buf, sizeof(buf));
+            if( n <= 0 )
+                break;
+            if( write(1, buf, size_t(n)) < 0 )
+                break;
+        }
+        if( pfd[1].revents ) {
+            ssize_t n = read(0, buf, sizeof(buf));
+            if( n <= 0 ) {
+                stdin_open = false;
+                continue;
+            }
+            auto now = clock_type::now();
+            fprintf(out, "%.0f %s\n", ms(now - last), describe_keys(buf, size_t(n)).c_str());
+            last = now;
+            if( write(master, buf, size_t(n)) < 0 )
+                break;
+        }
+    }
+
+    if( tty )
+        tcsetattr(0, TCSANOW, &saved);
+    int status = reap(pid, master);
+    fclose(out);
+    printf("pty-bench: ");
+    describe_status(status);
+    printf(", script written to %s\n", path);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s [--size WxH] [--term NAME] [--gap MS] [--linger MS] [--bandwidth BPS] [--capture FILE]\n"
+            "          --script FILE -- COMMAND...\n"
+            "       %s [--size WxH] [--term NAME] --record FILE -- COMMAND...\n",
+            argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+    int cols = 0, rows = 0;
+    const char *term = "xterm-256color";
+    const char *script = nullptr, *record = nullptr, *capture = nullptr;
+    double gap_ms = 2, linger_ms = 1000, bandwidth = 0;
+    int i = 1;
+    for( ; i < argc; i++ ) {
+        if( strcmp(argv[i], "--") == 0 ) {
+            i += 1;
+            break;
+        } else if( strcmp(argv[i], "--size") == 0 && i + 1 < argc ) {
+            if( sscanf(argv[++i], "%dx%d", &cols, &rows) != 2 || cols <= 0 || rows <= 0 ) {
+                fprintf(stderr, "pty-bench: bad size %s\n", argv[i]);
+                return 2;
+            }
+        } else if( strcmp(argv[i], "--term") == 0 && i + 1 < argc ) {
+            term = argv[++i];
+        } else if( strcmp(argv[i], "--gap") == 0 && i + 1 < argc ) {
+            gap_ms = atof(argv[++i]);
+        } else if( strcmp(argv[i], "--linger") == 0 && i + 1 < argc ) {
+            linger_ms = atof(argv[++i]);
+        } else if( strcmp(argv[i], "--bandwidth") == 0 && i + 1 < argc ) {
+            char *end;
+            bandwidth = strtod(argv[++i], &end);
+            if( *end == 'k' || *end == 'K' )
+                bandwidth *= 1e3;
+            else if( *end == 'm' || *end == 'M' )
+                bandwidth *= 1e6;
+        } else if( strcmp(argv[i], "--capture") == 0 && i + 1 < argc ) {
+            capture = argv[++i];
+        } else if( strcmp(argv[i], "--script") == 0 && i + 1 < argc ) {
+            script = argv[++i];
+        } else if( strcmp(argv[i], "--record") == 0 && i + 1 < argc ) {
+            record = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if( i >= argc || !script == !record ) {
+        usage(argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if( record )
+        return run_record(argv + i, cols, rows, term, record);
+
+    std::vector<key_event> events;
+    if( !load_script(script, events) )
+        return 2;
+    if( cols == 0 ) {
+        cols = 80;
+        rows = 24;
+    }
+    return run_script(argv + i, cols, rows, term, events, gap_ms, linger_ms, bandwidth, capture);
+}
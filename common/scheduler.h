@@ -0,0 +1,554 @@
+#pragma once
+
+// 各个游戏共用的任务调度器: 每个工作线程一个Chase-Lev双端队列，空闲时去别的线程偷任务
+//
+// 用法:
+//   sched::scheduler pool(3);               // 3个工作线程，等待的线程自己也干活，一共4个
+//   sched::task_group g(pool);
+//   g.run([&] { ... });                     // 派生任务
+//   g.wait();                               // 等这一组的任务做完，等的时候帮着做别的任务
+//   sched::parallel_for(pool, 0, n, 64, [&](size_t i) { ... });
+//
+// - 工作线程派生的任务压进自己的队列底部，自己从底部取(后进先出，缓存是热的)，
+//   别的线程从顶部偷(先进先出，偷到的一般是大块的工作)。不在工作线程上派生的任务
+//   (主线程、界面线程)放进一个加锁的公共队列。
+// - 两个优先级: 界面要等结果的任务用priority::high，每个线程找任务时先把所有的
+//   high任务找一遍再找normal的。任务不会被中途打断，所以后台任务要切得足够小
+//   (parallel_for的grain)，high任务最多等一个后台任务做完。
+// - 取消是协作式的: cancel_token被取消后，还没开始的任务直接跳过，已经在做的任务
+//   自己看cancelled()提前返回。
+// - 0个工作线程时所有任务都在wait()里由等待的线程做完，相当于单线程。
+//
+// 任务对象在线程自己的空闲链表里分配，小的可调用对象直接放在任务里，不再另外分配，
+// 派生一个任务再做完大概几十纳秒，见scheduler_bench.cc。
+//
+// 环境变量:
+//   SIMPLEGAMES_THREADS  shared()的总线程数(包括等待的线程)，默认hardware_concurrency()
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sched {
+
+    enum class priority { high = 0, normal = 1 };
+
+    constexpr int PRIORITIES = 2;
+
+    class task_group;
+
+    /// 协作式的取消标志，复制出来的token共用同一个标志
+    class cancel_token {
+    public:
+        cancel_token() : mFlag(std::make_shared<std::atomic<bool>>(false)) {}
+
+        void cancel() const { mFlag->store(true, std::memory_order_relaxed); }
+        bool cancelled() const { return mFlag->load(std::memory_order_relaxed); }
+
+    private:
+        friend class task_group;
+        std::shared_ptr<std::atomic<bool>> mFlag;
+    };
+
+    class scheduler;
+
+    namespace detail {
+
+        /// 一个任务: 函数指针加上放在里面的可调用对象，太大的可调用对象放在堆上
+        struct task {
+            static constexpr size_t STORAGE = 48;
+
+            void (*invoke)(task *, bool run);   // 调用(run为false时只析构)
+            task_group *group;
+            alignas(std::max_align_t) unsigned char storage[STORAGE];
+        };
+
+        /// 每个线程的任务空闲链表，做完的任务还给做它的线程
+        class task_pool {
+        public:
+            ~task_pool() {
+                for( task *t : mFree )
+                    ::operator delete(t);
+            }
+
+            task *get() {
+                if( mFree.empty() )
+                    return static_cast<task *>(::operator new(sizeof(task)));
+                task *t = mFree.back();
+                mFree.pop_back();
+                return t;
+            }
+
+            void put(task *t) {
+                if( mFree.size() >= MAX_FREE ) {
+                    ::operator delete(t);
+                    return;
+                }
+                mFree.push_back(t);
+            }
+
+            static task_pool &local() {
+                static thread_local task_pool pool;
+                return pool;
+            }
+
+        private:
+            static constexpr size_t MAX_FREE = 4096;
+            std::vector<task *> mFree;
+        };
+
+        /// Chase-Lev工作窃取队列(按Lê等人2013年的C11内存模型版本)
+        /// 只有拥有者push()/pop()，任何线程都可以steal()
+        class work_deque {
+        public:
+            explicit work_deque(size_t capacity = 1024) : mTop(0), mBottom(0) {
+                mRings.emplace_back(new ring(capacity));
+                mRing.store(mRings.back().get(), std::memory_order_relaxed);
+            }
+
+            void push(task *t) {
+                int64_t b = mBottom.load(std::memory_order_relaxed);
+                int64_t top = mTop.load(std::memory_order_acquire);
+                ring *r = mRing.load(std::memory_order_relaxed);
+                if( b - top > int64_t(r->mask) ) {
+                    r = grow(r, top, b);
+                }
+                r->put(b, t);
+                mBottom.store(b + 1, std::memory_order_release);
+            }
+
+            task *pop() {
+                int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+                ring *r = mRing.load(std::memory_order_relaxed);
+                mBottom.store(b, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t top = mTop.load(std::memory_order_relaxed);
+                if( top > b ) {
+                    mBottom.store(b + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                task *t = r->get(b);
+                if( top == b ) {
+                    // 只剩最后一个，和偷的线程抢
+                    if( !mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+                        t = nullptr;
+                    mBottom.store(b + 1, std::memory_order_relaxed);
+                }
+                return t;
+            }
+
+            task *steal() {
+                int64_t top = mTop.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t b = mBottom.load(std::memory_order_acquire);
+                if( top >= b )
+                    return nullptr;
+                ring *r = mRing.load(std::memory_order_acquire);
+                task *t = r->get(top);
+                if( !mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) )
+                    return nullptr;
+                return t;
+            }
+
+            bool empty() const {
+                return mTop.load(std::memory_order_relaxed) >= mBottom.load(std::memory_order_relaxed);
+            }
+
+        private:
+            struct ring {
+                explicit ring(size_t capacity) : mask(capacity - 1), slots(new std::atomic<task *>[capacity]) {}
+
+                task *get(int64_t i) const { return slots[size_t(i) & mask].load(std::memory_order_relaxed); }
+                void put(int64_t i, task *t) { slots[size_t(i) & mask].store(t, std::memory_order_relaxed); }
+
+                size_t mask;
+                std::unique_ptr<std::atomic<task *>[]> slots;
+            };
+
+            /// 满了时换一个两倍大的环，旧的环留到析构时再释放，偷的线程可能还在读
+            ring *grow(ring *old, int64_t top, int64_t bottom) {
+                mRings.emplace_back(new ring((old->mask + 1) * 2));
+                ring *r = mRings.back().get();
+                for( int64_t i = top; i < bottom; i++ )
+                    r->put(i, old->get(i));
+                mRing.store(r, std::memory_order_release);
+                return r;
+            }
+
+            alignas(64) std::atomic<int64_t> mTop;
+            alignas(64) std::atomic<int64_t> mBottom;
+            std::atomic<ring *> mRing;
+            std::vector<std::unique_ptr<ring>> mRings;  // 只有拥有者碰
+        };
+
+        /// 当前线程是哪个调度器的第几个工作线程
+        struct worker_slot {
+            scheduler *owner = nullptr;
+            int index = -1;
+        };
+
+        inline worker_slot &current() {
+            static thread_local worker_slot slot;
+            return slot;
+        }
+
+    } // namespace detail
+
+    class scheduler {
+    public:
+
+        /// workers个工作线程，0个时所有任务都由wait()的线程做
+        explicit scheduler(int workers) : mThreads(std::max(workers, 0)), mStop(false), mSleepers(0) {
+            // 最后一个队列没有线程，给正在wait()的外部线程用
+            for( int i = 0; i <= mThreads; i++ )
+                mWorkers.emplace_back(new worker());
+            for( int i = 0; i < mThreads; i++ )
+                mWorkers[i]->thread = std::thread(&scheduler::loop, this, i);
+        }
+
+        ~scheduler() {
+            {
+                std::lock_guard<std::mutex> lock(mSleepMutex);
+                mStop.store(true, std::memory_order_relaxed);
+            }
+            mWake.notify_all();
+            for( auto &w : mWorkers )
+                if( w->thread.joinable() )
+                    w->thread.join();
+            // 没人等的任务(比如取消了但没有wait()的)直接析构
+            for( auto &w : mWorkers )
+                for( auto &q : w->queues )
+                    while( detail::task *t = q.pop() )
+                        discard(t);
+            for( auto &q : mInject )
+                for( detail::task *t : q )
+                    discard(t);
+        }
+
+        scheduler(const scheduler &) = delete;
+        scheduler &operator=(const scheduler &) = delete;
+
+        int workers() const { return mThreads; }
+
+        /// 包括等待的线程在内一共有几个线程能干活
+        int concurrency() const { return workers() + 1; }
+
+        /// 当前线程在这个调度器里的编号: 工作线程是0..workers()-1，其他线程是workers()
+        int worker_index() const {
+            auto &slot = detail::current();
+            return slot.owner == this ? slot.index : workers();
+        }
+
+        /// 进程共用的调度器，第一次调用时创建
+        static scheduler &shared() {
+            static scheduler pool(default_threads() - 1);
+            return pool;
+        }
+
+        static int default_threads() {
+            if( const char *env = getenv("SIMPLEGAMES_THREADS") ) {
+                int n = atoi(env);
+                if( n > 0 )
+                    return n;
+            }
+            return int(std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+    private:
+        friend class task_group;
+
+        struct worker {
+            detail::work_deque queues[PRIORITIES];
+            std::thread thread;
+        };
+
+        void spawn(detail::task *t, priority prio) {
+            auto &slot = detail::current();
+            if( slot.owner == this ) {
+                mWorkers[slot.index]->queues[int(prio)].push(t);
+            } else {
+                std::lock_guard<std::mutex> lock(mInjectMutex);
+                mInject[int(prio)].push_back(t);
+                mInjected.fetch_add(1, std::memory_order_relaxed);
+            }
+            if( mThreads == 0 )
+                return;
+            // 和睡觉前的检查配对: 要么这里看到有人在睡，要么睡的人看到这个任务
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if( mSleepers.load(std::memory_order_relaxed) > 0 ) {
+                std::lock_guard<std::mutex> lock(mSleepMutex);
+                mWake.notify_one();
+            }
+        }
+
+        /// 找一个任务: 先找所有的high任务，再找normal的; 每一级先自己的队列，再公共队列，再偷
+        /// self是当前线程拥有的队列，-1表示没有
+        detail::task *find(int self) {
+            for( int p = 0; p < PRIORITIES; p++ ) {
+                if( self >= 0 && !mWorkers[self]->queues[p].empty() ) {
+                    if( detail::task *t = mWorkers[self]->queues[p].pop() )
+                        return t;
+                }
+                if( mInjected.load(std::memory_order_relaxed) > 0 ) {
+                    std::lock_guard<std::mutex> lock(mInjectMutex);
+                    if( !mInject[p].empty() ) {
+                        // 工作线程拿最早的(一般是大块的工作)，不是工作线程的等待者拿最新的，
+                        // 一般就是它自己刚派生的，相当于深度优先，递归派生时栈不会越来越深
+                        detail::task *t;
+                        if( self >= 0 && self < mThreads ) {
+                            t = mInject[p].front();
+                            mInject[p].pop_front();
+                        } else {
+                            t = mInject[p].back();
+                            mInject[p].pop_back();
+                        }
+                        mInjected.fetch_sub(1, std::memory_order_relaxed);
+                        return t;
+                    }
+                }
+                int n = int(mWorkers.size());
+                int start = self + 1;
+                for( int k = 0; k < n; k++ ) {
+                    int victim = (start + k) % n;
+                    if( victim == self || mWorkers[victim]->queues[p].empty() )
+                        continue;
+                    if( detail::task *t = mWorkers[victim]->queues[p].steal() )
+                        return t;
+                }
+            }
+            return nullptr;
+        }
+
+        bool maybe_has_work() const {
+            if( mInjected.load(std::memory_order_relaxed) > 0 )
+                return true;
+            for( auto &w : mWorkers )
+                for( auto &q : w->queues )
+                    if( !q.empty() )
+                        return true;
+            return false;
+        }
+
+        void loop(int self) {
+            auto &slot = detail::current();
+            slot.owner = this;
+            slot.index = self;
+            int idle = 0;
+            while( !mStop.load(std::memory_order_relaxed) ) {
+                if( detail::task *t = find(self) ) {
+                    execute(t);
+                    idle = 0;
+                    continue;
+                }
+                if( ++idle < 64 ) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mSleepMutex);
+                mSleepers.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                // 超时只是兜底，正常情况下spawn()会叫醒
+                if( !maybe_has_work() && !mStop.load(std::memory_order_relaxed) )
+                    mWake.wait_for(lock, std::chrono::milliseconds(50));
+                mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                idle = 0;
+            }
+        }
+
+        inline void execute(detail::task *t);
+        inline void discard(detail::task *t);
+
+        int mThreads;
+        std::vector<std::unique_ptr<worker>> mWorkers;  // mThreads个工作线程的，加上外部线程用的一个
+        std::atomic<bool> mCallerBusy{false};           // 外部线程的队列是不是已经有人在用
+        std::atomic<bool> mStop;
+
+        std::mutex mInjectMutex;
+        std::deque<detail::task *> mInject[PRIORITIES];
+        std::atomic<int> mInjected{0};
+
+        std::mutex mSleepMutex;
+        std::condition_variable mWake;
+        std::atomic<int> mSleepers;
+    };
+
+    /// 一组任务，wait()等它们全部做完
+    /// 析构前必须wait()过(或者没有派生过任务)
+    class task_group {
+    public:
+        explicit task_group(scheduler &s, priority prio = priority::normal)
+            : mScheduler(s), mPriority(prio), mPending(0) {}
+
+        task_group(scheduler &s, cancel_token token, priority prio = priority::normal)
+            : mScheduler(s), mPriority(prio), mPending(0), mCancel(std::move(token.mFlag)) {}
+
+        ~task_group() { wait(); }
+
+        task_group(const task_group &) = delete;
+        task_group &operator=(const task_group &) = delete;
+
+        template <class Fn>
+        void run(Fn &&fn) {
+            using F = std::decay_t<Fn>;
+            detail::task *t = detail::task_pool::local().get();
+            t->group = this;
+            if constexpr( sizeof(F) <= detail::task::STORAGE && alignof(F) <= alignof(std::max_align_t) ) {
+                new (t->storage) F(std::forward<Fn>(fn));
+                t->invoke = [](detail::task *self, bool run) {
+                    F *f = std::launder(reinterpret_cast<F *>(self->storage));
+                    if( run )
+                        (*f)();
+                    f->~F();
+                };
+            } else {
+                F *heap = new F(std::forward<Fn>(fn));
+                new (t->storage) F *(heap);
+                t->invoke = [](detail::task *self, bool run) {
+                    F *f = *std::launder(reinterpret_cast<F **>(self->storage));
+                    if( run )
+                        (*f)();
+                    delete f;
+                };
+            }
+            mPending.fetch_add(1, std::memory_order_relaxed);
+            mScheduler.spawn(t, mPriority);
+        }
+
+        /// 等这一组的任务做完，等的时候做调度器里别的任务(包括别的组的)
+        /// 外部线程等的时候占用调度器里多出来的那个队列，这期间它派生的任务也不用加锁
+        void wait() {
+            if( mPending.load(std::memory_order_acquire) == 0 )
+                return;
+            scheduler &s = mScheduler;
+            auto &slot = detail::current();
+            detail::worker_slot saved = slot;
+            bool claimed = false;
+            if( slot.owner != &s && !s.mCallerBusy.exchange(true, std::memory_order_acquire) ) {
+                slot.owner = &s;
+                slot.index = s.mThreads;
+                claimed = true;
+            }
+            int self = slot.owner == &s ? slot.index : -1;
+            int idle = 0;
+            while( mPending.load(std::memory_order_acquire) > 0 ) {
+                if( detail::task *t = s.find(self) ) {
+                    s.execute(t);
+                    idle = 0;
+                } else if( ++idle > 64 ) {
+                    std::this_thread::yield();
+                }
+            }
+            if( claimed ) {
+                slot = saved;
+                s.mCallerBusy.store(false, std::memory_order_release);
+            }
+        }
+
+        bool cancelled() const { return mCancel && mCancel->load(std::memory_order_relaxed); }
+
+        scheduler &owner() const { return mScheduler; }
+
+    private:
+        friend class scheduler;
+
+        scheduler &mScheduler;
+        priority mPriority;
+        std::atomic<int64_t> mPending;
+        std::shared_ptr<std::atomic<bool>> mCancel;    // 没有cancel_token时为空
+    };
+
+    inline void scheduler::execute(detail::task *t) {
+        task_group *g = t->group;
+        t->invoke(t, !g->cancelled());
+        detail::task_pool::local().put(t);
+        g->mPending.fetch_sub(1, std::memory_order_release);
+    }
+
+    inline void scheduler::discard(detail::task *t) {
+        task_group *g = t->group;
+        t->invoke(t, false);
+        ::operator delete(t);
+        g->mPending.fetch_sub(1, std::memory_order_release);
+    }
+
+    namespace detail {
+        template <class Fn>
+        void split_for(task_group &g, size_t begin, size_t end, size_t grain, const Fn &fn) {
+            // 右半边交给别人，自己接着切左半边，最后剩下不超过grain个自己做
+            while( end - begin > grain ) {
+                size_t mid = begin + (end - begin) / 2;
+                g.run([&g, mid, end, grain, &fn] { split_for(g, mid, end, grain, fn); });
+                end = mid;
+            }
+            if( !g.cancelled() )
+                fn(begin, end);
+        }
+    } // namespace detail
+
+    /// 并行地对[begin, end)里的每个区间调用fn(first, last)，每个区间不超过grain个
+    template <class Fn>
+    void parallel_for_range(scheduler &s, size_t begin, size_t end, size_t grain, const Fn &fn,
+                            const cancel_token *token = nullptr, priority prio = priority::normal) {
+        if( begin >= end )
+            return;
+        grain = std::max<size_t>(grain, 1);
+        if( s.workers() == 0 || end - begin <= grain ) {
+            for( size_t i = begin; i < end && !(token && token->cancelled()); i += grain )
+                fn(i, std::min(end, i + grain));
+            return;
+        }
+        if( token ) {
+            task_group g(s, *token, prio);
+            detail::split_for(g, begin, end, grain, fn);
+            g.wait();
+        } else {
+            task_group g(s, prio);
+            detail::split_for(g, begin, end, grain, fn);
+            g.wait();
+        }
+    }
+
+    /// 并行地对[begin, end)里的每个i调用fn(i)
+    template <class Fn>
+    void parallel_for(scheduler &s, size_t begin, size_t end, size_t grain, const Fn &fn,
+                      const cancel_token *token = nullptr, priority prio = priority::normal) {
+        parallel_for_range(s, begin, end, grain, [&fn](size_t first, size_t last) {
+            for( size_t i = first; i < last; i++ )
+                fn(i);
+        }, token, prio);
+    }
+
+    /// 并行归约: 把[begin, end)按grain切块，每块算map(first, last)，再按块的顺序用combine合并
+    /// 合并的顺序和线程数无关，浮点数的结果每次都一样; 被取消时没做的块是identity
+    template <class T, class Map, class Combine>
+    T parallel_reduce(scheduler &s, size_t begin, size_t end, size_t grain, T identity,
+                      const Map &map, const Combine &combine,
+                      const cancel_token *token = nullptr, priority prio = priority::normal) {
+        if( begin >= end )
+            return identity;
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (end - begin + grain - 1) / grain;
+        std::vector<T> partial(chunks, identity);
+        parallel_for(s, 0, chunks, 1, [&](size_t c) {
+            size_t first = begin + c * grain;
+            partial[c] = map(first, std::min(end, first + grain));
+        }, token, prio);
+        T result = identity;
+        for( auto &p : partial )
+            result = combine(result, p);
+        return result;
+    }
+
+} // namespace sched
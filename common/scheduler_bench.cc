@@ -0,0 +1,155 @@
+// 任务调度器(scheduler.h)的开销测试
+// compile with: c++ -O2 -pthread scheduler_bench.cc -o scheduler-bench
+//
+// 用法:
+//   scheduler-bench [-j N] [--tasks N]
+// 输出:
+//   - spawn: 每次派生256个空任务再等它们做完，一共N个，每个任务的平均开销
+//   - fib: 递归地派生任务算斐波那契数，几乎全是调度开销，看偷任务的效率
+//   - parallel_for: 对一个大数组求和，和单线程比较
+//   - high latency: 后台任务占满所有线程时，一个high任务从派生到开始执行等了多久
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+using clock_type = std::chrono::steady_clock;
+
+static double since(clock_type::time_point t) {
+    return std::chrono::duration<double>(clock_type::now() - t).count();
+}
+
+static long fib(sched::scheduler &s, int n) {
+    if( n < 2 )
+        return n;
+    long a = 0, b;
+    {
+        sched::task_group g(s);
+        g.run([&s, &a, n] { a = fib(s, n - 1); });
+        b = fib(s, n - 2);
+        g.wait();
+    }
+    return a + b;
+}
+
+static long fib_serial(int n) {
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+int main(int argc, char **argv) {
+    int threads = sched::scheduler::default_threads();
+    size_t tasks = 1000000;
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp(argv[i], "-j") == 0 && i + 1 < argc ) {
+            threads = atoi(argv[++i]);
+        } else if( strcmp(argv[i], "--tasks") == 0 && i + 1 < argc ) {
+            tasks = strtoull(argv[++i], nullptr, 10);
+        } else {
+            fprintf(stderr, "usage: %s [-j N] [--tasks N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if( threads <= 0 || tasks == 0 )
+        return 2;
+
+    sched::scheduler pool(threads - 1);
+    printf("%d thread(s)\n", pool.concurrency());
+
+    // 在一个任务里派生，不管这个任务在哪个线程上做，走的都是不加锁的队列
+    {
+        std::atomic<size_t> ran(0);
+        auto beg = clock_type::now();
+        sched::task_group outer(pool);
+        outer.run([&] {
+            for( size_t i = 0; i < tasks; i += 256 ) {
+                sched::task_group g(pool);
+                for( size_t k = i; k < std::min(tasks, i + 256); k++ )
+                    g.run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); });
+                g.wait();
+            }
+        });
+        outer.wait();
+        double secs = since(beg);
+        printf("spawn:        %zu tasks in %.3fs, %.1f ns/task\n", ran.load(), secs, secs * 1e9 / double(tasks));
+    }
+
+    {
+        int n = 30;
+        auto beg = clock_type::now();
+        long serial = fib_serial(n);
+        double serial_secs = since(beg);
+        beg = clock_type::now();
+        long r = fib(pool, n);
+        double secs = since(beg);
+        // fib(n)派生了fib(n+1) - 1个任务
+        double spawned = double(fib_serial(n + 1) - 1);
+        printf("fib(%d):      %ld in %.3fs (serial %.3fs), %.1f ns/task%s\n", n, r, secs, serial_secs,
+               secs * 1e9 / spawned * pool.concurrency(), r == serial ? "" : " WRONG");
+    }
+
+    {
+        std::vector<uint32_t> data(size_t(1) << 26);
+        for( size_t i = 0; i < data.size(); i++ )
+            data[i] = uint32_t(i * 2654435761u);
+        auto beg = clock_type::now();
+        uint64_t serial = 0;
+        for( uint32_t v : data )
+            serial += v;
+        double serial_secs = since(beg);
+        beg = clock_type::now();
+        uint64_t sum = sched::parallel_reduce(pool, 0, data.size(), 1 << 16, uint64_t(0),
+            [&](size_t first, size_t last) {
+                uint64_t s = 0;
+                for( size_t i = first; i < last; i++ )
+                    s += data[i];
+                return s;
+            },
+            [](uint64_t a, uint64_t b) { return a + b; });
+        double secs = since(beg);
+        printf("parallel_for: sum of %zu in %.1fms (serial %.1fms)%s\n", data.size(), secs * 1e3, serial_secs * 1e3,
+               sum == serial ? "" : " WRONG");
+    }
+
+    // 后台任务每个大约100us，high任务最多等这么久
+    if( pool.workers() > 0 ) {
+        sched::cancel_token stop;
+        sched::task_group background(pool, stop);
+        std::atomic<uint64_t> spin(0);
+        for( int i = 0; i < pool.workers() * 4; i++ ) {
+            background.run([&pool, &spin, stop] {
+                sched::parallel_for(pool, 0, 1 << 30, 1, [&spin](size_t) {
+                    auto until = clock_type::now() + std::chrono::microseconds(100);
+                    while( clock_type::now() < until )
+                        spin.fetch_add(1, std::memory_order_relaxed);
+                }, &stop);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        double worst = 0, total = 0;
+        int rounds = 200;
+        for( int i = 0; i < rounds; i++ ) {
+            std::atomic<double> waited(-1);
+            auto beg = clock_type::now();
+            sched::task_group g(pool, sched::priority::high);
+            g.run([&waited, beg] { waited.store(since(beg)); });
+            // 不帮忙做，只等工作线程把它拿走
+            while( waited.load() < 0 )
+                std::this_thread::yield();
+            g.wait();
+            worst = std::max(worst, waited.load());
+            total += waited.load();
+        }
+        stop.cancel();
+        background.wait();
+        printf("high latency: mean %.1fus, worst %.1fus while all workers are busy\n",
+               total / rounds * 1e6, worst * 1e6);
+    }
+    return 0;
+}
@@ -0,0 +1,511 @@
+#pragma once
+
+// 本地观战: 游戏把每一帧的变化写进共享内存，观战进程只读地挂上去自己渲染
+//
+// 共享内存(/dev/shm/simplegames-<名字>)里有两部分:
+//   - 一个环形缓冲区，按帧存放变化的格子(帧差)
+//   - 一份完整的屏幕镜像(关键帧)，由seqlock保护，随每一帧的差量一起更新
+// 游戏每帧只读这一帧改过的行，发布开销只和变化有关，和屏幕大小、观战的人数无关；
+// 观战进程先复制关键帧，再从关键帧对应的位置开始重放环形缓冲区，
+// 落后太多(被写入者追上一圈)时重新复制关键帧。
+//
+// 游戏在设置了环境变量SIMPLEGAMES_SPECTATE时才会发布:
+//   SIMPLEGAMES_SPECTATE=1       使用游戏自己的名字，如simplegames-x2048
+//   SIMPLEGAMES_SPECTATE=<名字>  使用simplegames-<名字>
+// 同一个名字同时只有一个游戏能发布: 共享内存已经存在时，里面记的游戏进程还活着就不发布，
+// 进程已经退出(比如崩溃了)才删掉旧的再新建，已经挂着旧共享内存的观战进程不受影响。
+// 观战见common/spectator.cc
+
+#ifndef NCURSES_WIDECHAR
+#define NCURSES_WIDECHAR 1
+#endif
+
+#include <curses.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace spectate {
+
+    constexpr uint32_t MAGIC = 0x50534753; // "SGSP"
+    constexpr uint32_t VERSION = 1;
+    constexpr uint32_t RECORD_MAGIC = 0x4d415246; // "FRAM"
+
+    constexpr int MAX_ROWS = 256;
+    constexpr int MAX_COLS = 512;
+    constexpr int MAX_PAIRS = 256;
+    constexpr int MAX_COLORS = 256;
+    constexpr uint64_t RING_SIZE = uint64_t(1) << 24;
+
+    /// 一个屏幕格子，ch为0表示宽字符的后半部分
+    struct cell {
+        uint32_t ch;
+        uint32_t attr;
+        uint32_t pair;
+
+        bool operator==(const cell &rhs) const {
+            return ch == rhs.ch && attr == rhs.attr && pair == rhs.pair;
+        }
+        bool operator!=(const cell &rhs) const {
+            return !(*this == rhs);
+        }
+    };
+
+    struct change {
+        uint16_t y;
+        uint16_t x;
+        cell c;
+    };
+
+    struct record_header {
+        uint32_t magic;
+        uint32_t count;
+        uint64_t frame;
+        uint16_t rows;
+        uint16_t cols;
+        uint32_t reserved;
+    };
+
+    struct pair_def {
+        int16_t fg;
+        int16_t bg;
+        int32_t valid;
+    };
+
+    struct color_def {
+        int16_t r;
+        int16_t g;
+        int16_t b;
+        int16_t valid;
+    };
+
+    struct shared_state {
+        uint32_t magic;
+        uint32_t version;
+
+        std::atomic<uint64_t> reserve_pos; // 写入者正在写的位置的末尾
+        std::atomic<uint64_t> write_pos;   // 已经写完的位置的末尾
+        std::atomic<uint64_t> frame;
+        std::atomic<uint32_t> alive;       // 游戏退出时清零
+        std::atomic<uint32_t> palette_version;
+
+        // 以下由seq保护
+        std::atomic<uint32_t> seq;
+        uint32_t rows;
+        uint32_t cols;
+        uint64_t screen_frame;
+        uint64_t screen_pos; // 关键帧之后的第一条记录在环形缓冲区中的位置
+
+        pair_def pairs[MAX_PAIRS];
+        color_def colors[MAX_COLORS];
+        cell screen[MAX_ROWS * MAX_COLS];
+        unsigned char ring[RING_SIZE];
+    };
+
+    inline std::string shm_name(const char *name) {
+        return std::string("/simplegames-") + name;
+    }
+
+    /// alive里记的进程是否还在，没有权限发信号(EPERM)也说明进程在
+    inline bool pid_alive(uint32_t pid) {
+        return pid != 0 && (kill(pid_t(pid), 0) == 0 || errno == EPERM);
+    }
+
+    inline void ring_copy_in(shared_state *st, uint64_t pos, const void *src, size_t n) {
+        size_t off = pos % RING_SIZE;
+        size_t first = n < RING_SIZE - off ? n : RING_SIZE - off;
+        memcpy(st->ring + off, src, first);
+        if( first < n )
+            memcpy(st->ring, static_cast<const char*>(src) + first, n - first);
+    }
+
+    inline void ring_copy_out(const shared_state *st, uint64_t pos, void *dst, size_t n) {
+        size_t off = pos % RING_SIZE;
+        size_t first = n < RING_SIZE - off ? n : RING_SIZE - off;
+        memcpy(dst, st->ring + off, first);
+        if( first < n )
+            memcpy(static_cast<char*>(dst) + first, st->ring, n - first);
+    }
+
+    /// 游戏端，每帧在wnoutrefresh()之后、doupdate()之前调用publish()
+    /// 读取的是newscr(所有窗口合成后的虚拟屏幕)，所以不管游戏用了几个WINDOW都能正确发布;
+    /// 只看这一帧被改过的行(is_linetouched)，doupdate()会清掉这些标记，所以要在它之前调用。
+    /// 输出预算不让发时观战的人也能看到这一帧
+    class publisher {
+    public:
+        explicit publisher(const char *game) {
+            const char *env = getenv("SIMPLEGAMES_SPECTATE");
+            if( !env || !env[0] || (env[0] == '0' && !env[1]) )
+                return;
+            mName = shm_name(strcmp(env, "1") == 0 ? game : env);
+
+            int fd = shm_open(mName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if( fd < 0 && errno == EEXIST && remove_stale() )
+                fd = shm_open(mName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if( fd < 0 )
+                return;
+            struct stat st;
+            if( fstat(fd, &st) == 0 )
+                mIno = st.st_ino;
+            if( ftruncate(fd, sizeof(shared_state)) != 0 ) {
+                close(fd);
+                shm_unlink(mName.c_str());
+                return;
+            }
+            void *p = mmap(nullptr, sizeof(shared_state), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if( p == MAP_FAILED ) {
+                shm_unlink(mName.c_str());
+                return;
+            }
+
+            // 新建的共享内存全是0，只需要填头部
+            mState = static_cast<shared_state*>(p);
+            mState->version = VERSION;
+            mState->alive.store(uint32_t(getpid()), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            mState->magic = MAGIC;
+        }
+
+        publisher(const publisher &) = delete;
+        publisher &operator=(const publisher &) = delete;
+
+        ~publisher() {
+            if( !mState )
+                return;
+            mState->alive.store(0, std::memory_order_release);
+            munmap(mState, sizeof(shared_state));
+            // 名字已经被别的游戏接管时不能删
+            if( inode_of(mName) == mIno )
+                shm_unlink(mName.c_str());
+        }
+
+        bool active() const {
+            return mState != nullptr;
+        }
+
+        const std::string &name() const {
+            return mName;
+        }
+
+        /// 把newscr里改过的行和上一帧比较，只把变化的格子写进共享内存
+        void publish() {
+            if( !mState )
+                return;
+
+            int rows = getmaxy(newscr), cols = getmaxx(newscr);
+            if( rows > MAX_ROWS ) rows = MAX_ROWS;
+            if( cols > MAX_COLS ) cols = MAX_COLS;
+
+            bool resized = rows != mRows || cols != mCols;
+            if( resized ) {
+                mRows = rows;
+                mCols = cols;
+                mShadow.assign(size_t(rows) * cols, cell{0xffffffffu, 0, 0});
+                mChanges.reserve(size_t(rows) * cols);
+            }
+
+            mChanges.clear();
+            for( int y = 0; y < rows; y++ ) {
+                // 上次doupdate()以后没碰过的行一定没变，不用一个个格子读
+                if( !resized && !is_linetouched(newscr, y) )
+                    continue;
+                bool after_wide = false;
+                cell *line = mShadow.data() + size_t(y) * cols;
+                for( int x = 0; x < cols; x++ ) {
+                    cell c = read_cell(y, x, after_wide);
+                    if( c != line[x] ) {
+                        line[x] = c;
+                        mChanges.push_back(change{uint16_t(y), uint16_t(x), c});
+                        if( c.pair < MAX_PAIRS && !mPairSeen[c.pair] )
+                            export_pair(c.pair);
+                    }
+                }
+            }
+
+            if( mChanges.empty() )
+                return;
+
+            mFrame += 1;
+
+            record_header h;
+            h.magic = RECORD_MAGIC;
+            h.count = uint32_t(mChanges.size());
+            h.frame = mFrame;
+            h.rows = uint16_t(rows);
+            h.cols = uint16_t(cols);
+            h.reserved = 0;
+
+            size_t bytes = sizeof(h) + mChanges.size() * sizeof(change);
+            uint64_t pos = mState->write_pos.load(std::memory_order_relaxed);
+
+            // 先声明要覆盖的区域，读者据此判断自己读到的数据是否被覆盖
+            mState->reserve_pos.store(pos + bytes, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            ring_copy_in(mState, pos, &h, sizeof(h));
+            ring_copy_in(mState, pos + sizeof(h), mChanges.data(), mChanges.size() * sizeof(change));
+            mState->write_pos.store(pos + bytes, std::memory_order_release);
+
+            // 更新关键帧
+            uint32_t s = mState->seq.load(std::memory_order_relaxed);
+            mState->seq.store(s + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            mState->rows = rows;
+            mState->cols = cols;
+            for( auto &ch : mChanges )
+                mState->screen[size_t(ch.y) * MAX_COLS + ch.x] = ch.c;
+            mState->screen_frame = mFrame;
+            mState->screen_pos = pos + bytes;
+            mState->seq.store(s + 2, std::memory_order_release);
+
+            mState->frame.store(mFrame, std::memory_order_release);
+        }
+
+    private:
+        static ino_t inode_of(const std::string &name) {
+            int fd = shm_open(name.c_str(), O_RDONLY, 0);
+            if( fd < 0 )
+                return 0;
+            struct stat st;
+            ino_t ino = fstat(fd, &st) == 0 ? st.st_ino : 0;
+            close(fd);
+            return ino;
+        }
+
+        /// 已经存在的共享内存是不是没人用了，是的话删掉它，返回true
+        /// 还没初始化完(magic为0)的算作别的游戏刚建好的，不删
+        bool remove_stale() {
+            int fd = shm_open(mName.c_str(), O_RDONLY, 0);
+            if( fd < 0 )
+                return errno == ENOENT;
+            struct stat st;
+            bool stale = false;
+            if( fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(shared_state) ) {
+                void *p = mmap(nullptr, sizeof(shared_state), PROT_READ, MAP_SHARED, fd, 0);
+                if( p != MAP_FAILED ) {
+                    auto *old = static_cast<const shared_state*>(p);
+                    stale = old->magic == MAGIC && !pid_alive(old->alive.load(std::memory_order_acquire));
+                    munmap(p, sizeof(shared_state));
+                }
+            }
+            close(fd);
+            // 检查之后名字又被别人换过的话不删
+            if( !stale || inode_of(mName) != st.st_ino )
+                return false;
+            return shm_unlink(mName.c_str()) == 0 || errno == ENOENT;
+        }
+
+        cell read_cell(int y, int x, bool &after_wide) {
+            cchar_t cc;
+            wchar_t wch[CCHARW_MAX + 1] = {0};
+            attr_t attrs = 0;
+            short pair = 0;
+            cell c{0, 0, 0};
+
+            if( mvwin_wch(newscr, y, x, &cc) == ERR )
+                return c;
+            getcchar(&cc, wch, &attrs, &pair, nullptr);
+
+            if( after_wide ) {
+                // 宽字符的后半部分
+                after_wide = false;
+                c.attr = uint32_t(attrs & A_ATTRIBUTES & ~A_COLOR);
+                c.pair = uint32_t(pair);
+                return c;
+            }
+
+            c.ch = uint32_t(wch[0] ? wch[0] : L' ');
+            c.attr = uint32_t(attrs & A_ATTRIBUTES & ~A_COLOR);
+            c.pair = uint32_t(pair);
+            after_wide = wcwidth(wchar_t(c.ch)) == 2;
+            return c;
+        }
+
+        void export_color(short color) {
+            if( color < 8 || color >= MAX_COLORS )
+                return;
+            short r = 0, g = 0, b = 0;
+            if( color_content(color, &r, &g, &b) == ERR )
+                return;
+            auto &def = mState->colors[color];
+            def.r = r;
+            def.g = g;
+            def.b = b;
+            def.valid = 1;
+        }
+
+        void export_pair(uint32_t pair) {
+            mPairSeen[pair] = true;
+            if( pair == 0 )
+                return;
+            short fg = -1, bg = -1;
+            if( pair_content(short(pair), &fg, &bg) == ERR )
+                return;
+            export_color(fg);
+            export_color(bg);
+            auto &def = mState->pairs[pair];
+            def.fg = fg;
+            def.bg = bg;
+            def.valid = 1;
+            mState->palette_version.fetch_add(1, std::memory_order_release);
+        }
+
+        shared_state *mState = nullptr;
+        std::string mName;
+        ino_t mIno = 0;
+
+        int mRows = 0;
+        int mCols = 0;
+        uint64_t mFrame = 0;
+        std::vector<cell> mShadow;
+        std::vector<change> mChanges;
+        bool mPairSeen[MAX_PAIRS] = {};
+    };
+
+    /// 观战端，只读挂载
+    class viewer {
+    public:
+        viewer() = default;
+        viewer(const viewer &) = delete;
+        viewer &operator=(const viewer &) = delete;
+
+        ~viewer() {
+            if( mState )
+                munmap(const_cast<shared_state*>(mState), sizeof(shared_state));
+        }
+
+        /// @return 挂载是否成功
+        bool attach(const char *name) {
+            std::string n = shm_name(name);
+            int fd = shm_open(n.c_str(), O_RDONLY, 0);
+            if( fd < 0 )
+                return false;
+            struct stat st;
+            if( fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(shared_state) ) {
+                close(fd);
+                return false;
+            }
+            void *p = mmap(nullptr, sizeof(shared_state), PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if( p == MAP_FAILED )
+                return false;
+            mState = static_cast<const shared_state*>(p);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if( mState->magic != MAGIC || mState->version != VERSION ) {
+                munmap(p, sizeof(shared_state));
+                mState = nullptr;
+                return false;
+            }
+            return true;
+        }
+
+        /// 游戏正常退出时会清掉alive，崩溃了的话看记下的进程还在不在
+        bool publisher_alive() const {
+            return mState && pid_alive(mState->alive.load(std::memory_order_acquire));
+        }
+
+        /// 复制关键帧到screen中(MAX_COLS为行距)，成功时返回true
+        bool sync(std::vector<cell> &screen, int &rows, int &cols) {
+            screen.resize(size_t(MAX_ROWS) * MAX_COLS);
+            for( int tries = 0; tries < 1000; tries++ ) {
+                uint32_t s1 = mState->seq.load(std::memory_order_acquire);
+                if( s1 & 1 )
+                    continue;
+                rows = int(mState->rows);
+                cols = int(mState->cols);
+                if( rows > MAX_ROWS ) rows = MAX_ROWS;
+                if( cols > MAX_COLS ) cols = MAX_COLS;
+                for( int y = 0; y < rows; y++ )
+                    memcpy(&screen[size_t(y) * MAX_COLS], &mState->screen[size_t(y) * MAX_COLS], sizeof(cell) * cols);
+                uint64_t pos = mState->screen_pos;
+                uint64_t frame = mState->screen_frame;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if( mState->seq.load(std::memory_order_relaxed) != s1 )
+                    continue;
+                mPos = pos;
+                mFrame = frame;
+                return true;
+            }
+            return false;
+        }
+
+        enum poll_result {
+            POLL_OK,
+            POLL_LAPPED, // 落后太多，需要重新sync()
+        };
+
+        /// 读取关键帧之后的所有新帧，把变化追加到out
+        /// rows/cols在发布者改变屏幕尺寸时更新
+        poll_result poll(std::vector<change> &out, int &rows, int &cols) {
+            uint64_t end = mState->write_pos.load(std::memory_order_acquire);
+            size_t old_size = out.size();
+            uint64_t pos = mPos;
+            uint64_t frame = mFrame;
+            int r = rows, c = cols;
+
+            if( end - pos > RING_SIZE )
+                return POLL_LAPPED;
+
+            while( pos < end ) {
+                record_header h;
+                ring_copy_out(mState, pos, &h, sizeof(h));
+                if( h.magic != RECORD_MAGIC || h.count > uint32_t(MAX_ROWS) * MAX_COLS ) {
+                    out.resize(old_size);
+                    return POLL_LAPPED;
+                }
+                size_t n = out.size();
+                out.resize(n + h.count);
+                ring_copy_out(mState, pos + sizeof(h), &out[n], h.count * sizeof(change));
+                pos += sizeof(h) + h.count * sizeof(change);
+                frame = h.frame;
+                r = h.rows;
+                c = h.cols;
+            }
+
+            // 复制完成后写入者如果已经覆盖了我们读过的区域，这些数据就不可信了
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if( mState->reserve_pos.load(std::memory_order_relaxed) - mPos > RING_SIZE ) {
+                out.resize(old_size);
+                return POLL_LAPPED;
+            }
+
+            mPos = pos;
+            mFrame = frame;
+            rows = r;
+            cols = c;
+            return POLL_OK;
+        }
+
+        uint64_t frame() const {
+            return mFrame;
+        }
+
+        uint32_t palette_version() const {
+            return mState->palette_version.load(std::memory_order_acquire);
+        }
+
+        const pair_def &pair(int i) const {
+            return mState->pairs[i];
+        }
+
+        const color_def &color(int i) const {
+            return mState->colors[i];
+        }
+
+    private:
+        const shared_state *mState = nullptr;
+        uint64_t mPos = 0;
+        uint64_t mFrame = 0;
+    };
+
+} // namespace spectate
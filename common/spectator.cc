@@ -0,0 +1,192 @@
+// 观战程序，只读地挂到正在运行的游戏上
+// compile with: c++ spectator.cc -o spectator -lncursesw -lrt
+//
+// 用法:
+//   SIMPLEGAMES_SPECTATE=1 ./x2048-cc     (在另一个终端里)
+//   ./spectator x2048 [--fps 30]
+// 不带名字时列出所有可以观战的游戏
+
+#define NCURSES_WIDECHAR 1
+
+#include <clocale>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+#include "spectate.h"
+
+static std::vector<std::string> list_games() {
+    std::vector<std::string> result;
+    DIR *dir = opendir("/dev/shm");
+    if (!dir)
+        return result;
+    const char *prefix = "simplegames-";
+    size_t plen = strlen(prefix);
+    while (auto *ent = readdir(dir)) {
+        if (strncmp(ent->d_name, prefix, plen) == 0)
+            result.emplace_back(ent->d_name + plen);
+    }
+    closedir(dir);
+    return result;
+}
+
+class spectator {
+public:
+    spectator(spectate::viewer &v) : _viewer(v), _palette_version(0xffffffffu), _rows(0), _cols(0), _synced(false) {}
+
+    void run(int fps) {
+        auto frame_time = std::chrono::microseconds(1000000 / (fps > 0 ? fps : 30));
+
+        _synced = resync();
+
+        while (true) {
+            auto beg = std::chrono::steady_clock::now();
+
+            int k = getch();
+            if (k == 'q' || k == 'Q')
+                break;
+
+            if (_viewer.palette_version() != _palette_version)
+                load_palette();
+
+            int rows = _rows, cols = _cols;
+            _changes.clear();
+            if (!_synced || _viewer.poll(_changes, rows, cols) == spectate::viewer::POLL_LAPPED) {
+                // 关键帧一直在被改(或者游戏改到一半崩溃了)时复制不到，下一帧再试
+                _synced = resync();
+                if (!_synced)
+                    mvaddstr(LINES - 1, 0, "[正在同步...]");
+            } else {
+                if (rows != _rows || cols != _cols) {
+                    _rows = rows;
+                    _cols = cols;
+                    erase();
+                }
+                for (auto &ch : _changes)
+                    draw_cell(ch.y, ch.x, ch.c);
+            }
+
+            if (!_viewer.publisher_alive()) {
+                mvaddstr(LINES - 1, 0, "[游戏已结束，按q退出]");
+                nodelay(stdscr, FALSE);
+                refresh();
+                while (getch() != 'q') {}
+                break;
+            }
+
+            refresh();
+
+            auto used = std::chrono::steady_clock::now() - beg;
+            if (used < frame_time)
+                std::this_thread::sleep_for(frame_time - used);
+        }
+    }
+
+private:
+    /// 复制关键帧并重画整个屏幕，复制失败时返回false
+    bool resync() {
+        if (!_viewer.sync(_screen, _rows, _cols))
+            return false;
+        load_palette();
+        erase();
+        for (int y = 0; y < _rows; y++)
+            for (int x = 0; x < _cols; x++)
+                draw_cell(y, x, _screen[size_t(y) * spectate::MAX_COLS + x]);
+        return true;
+    }
+
+    void load_palette() {
+        _palette_version = _viewer.palette_version();
+        if (!has_colors())
+            return;
+        for (int i = 1; i < spectate::MAX_PAIRS && i < COLOR_PAIRS; i++) {
+            auto &p = _viewer.pair(i);
+            if (!p.valid)
+                continue;
+            load_color(p.fg);
+            load_color(p.bg);
+            init_pair(i, p.fg, p.bg);
+        }
+    }
+
+    void load_color(short color) {
+        if (color < 8 || color >= spectate::MAX_COLORS || color >= COLORS || !can_change_color())
+            return;
+        auto &c = _viewer.color(color);
+        if (c.valid)
+            init_color(color, c.r, c.g, c.b);
+    }
+
+    void draw_cell(int y, int x, const spectate::cell &c) {
+        // 宽字符的后半部分已经由前一个格子画出来了
+        if (c.ch == 0 || y >= LINES || x >= COLS)
+            return;
+        wchar_t wch[2] = { wchar_t(c.ch), 0 };
+        cchar_t cc;
+        setcchar(&cc, wch, attr_t(c.attr), short(c.pair), nullptr);
+        mvadd_wch(y, x, &cc);
+    }
+
+    spectate::viewer &_viewer;
+    uint32_t _palette_version;
+    int _rows;
+    int _cols;
+    bool _synced;
+    std::vector<spectate::cell> _screen;
+    std::vector<spectate::change> _changes;
+};
+
+int main(int argc, char **argv) {
+    const char *name = nullptr;
+    int fps = 30;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else {
+            name = argv[i];
+        }
+    }
+
+    if (!name) {
+        auto games = list_games();
+        if (games.size() != 1) {
+            fprintf(stderr, "usage: %s <name> [--fps N]\n", argv[0]);
+            for (auto &g : games)
+                fprintf(stderr, "  %s\n", g.c_str());
+            return games.empty() ? 1 : 2;
+        }
+        static std::string only;
+        only = games.front();
+        name = only.c_str();
+    }
+
+    spectate::viewer v;
+    if (!v.attach(name)) {
+        fprintf(stderr, "cannot attach to %s\n", name);
+        return 1;
+    }
+
+    setlocale(LC_ALL, "");
+    initscr();
+    cbreak();
+    noecho();
+    nodelay(stdscr, TRUE);
+    curs_set(0);
+    if (has_colors()) {
+        start_color();
+        use_default_colors();
+    }
+
+    spectator s(v);
+    s.run(fps);
+
+    endwin();
+    return 0;
+}
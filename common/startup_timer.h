@@ -0,0 +1,90 @@
+#pragma once
+
+// 启动时间: 从exec到画完第一帧的各个阶段
+//
+// 游戏加上--measure-startup参数时，画完第一帧就退出，然后输出每个阶段的用时:
+//   [X2048] startup: pre-main 1.10ms, setlocale 0.02ms, initscr 0.61ms, ... total 2.30ms
+// pre-main是进入main()之前用掉的CPU时间(加载动态库、重定位、静态初始化)，exec之前的
+// 时间不算; 从外面量exec到第一个字节可以用common/ptybench.cc。
+// 目标是5ms以内画出第一帧，所以terminfo以外的东西(颜色、ICU、开局库等)都不要在第一帧之前做。
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace startup {
+
+    class timer {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /// 在main()一开始调用
+        void enable() {
+            struct timespec ts;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+            mPreMain = double(ts.tv_sec) * 1e3 + double(ts.tv_nsec) / 1e6;
+            mLast = clock::now();
+            mEnabled = true;
+        }
+
+        bool enabled() const { return mEnabled; }
+
+        /// 记下从上一个点到现在的阶段，没有开启时什么也不做
+        void mark(const char *phase) {
+            if( !mEnabled || mCount == MAX_PHASES )
+                return;
+            auto now = clock::now();
+            mPhases[mCount].name = phase;
+            mPhases[mCount].ms = std::chrono::duration<double, std::milli>(now - mLast).count();
+            mCount += 1;
+            mLast = now;
+        }
+
+        /// 第一帧画完时调用，返回true表示在测启动时间，应该退出了
+        bool first_frame() {
+            if( !mEnabled || mDone )
+                return false;
+            mark("first frame");
+            mDone = true;
+            return true;
+        }
+
+        bool done() const { return mDone; }
+
+        /// 需在endwin()之后调用
+        void report(FILE *out, const char *who) const {
+            if( !mEnabled )
+                return;
+            double total = mPreMain;
+            fprintf(out, "[%s] startup: pre-main %.2fms", who, mPreMain);
+            for( int i = 0; i < mCount; i++ ) {
+                fprintf(out, ", %s %.2fms", mPhases[i].name, mPhases[i].ms);
+                total += mPhases[i].ms;
+            }
+            fprintf(out, ", total %.2fms%s\n", total, mDone ? "" : " (no frame drawn)");
+        }
+
+    private:
+        static constexpr int MAX_PHASES = 16;
+
+        struct phase {
+            const char *name;
+            double ms;
+        };
+
+        bool mEnabled = false;
+        bool mDone = false;
+        double mPreMain = 0;
+        clock::time_point mLast;
+        phase mPhases[MAX_PHASES];
+        int mCount = 0;
+    };
+
+    /// 全局的一个，游戏各处都可以打点
+    inline timer &global() {
+        static timer t;
+        return t;
+    }
+
+} // namespace startup
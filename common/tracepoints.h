@@ -0,0 +1,110 @@
+#pragma once
+
+// USDT静态探针: 不开启时每个探针只是一条nop，可以一直编进发布的版本里，
+// 出问题时不用重新编译就能用perf或bpftrace挂上去看
+//
+//   sudo bpftrace -l 'usdt:./x2048-cc:*'                      列出探针
+//   sudo bpftrace -e 'usdt:./x2048-cc:simplegames:move { @moved = hist(arg2); }'
+//   sudo perf buildid-cache --add ./x2048-cc && sudo perf list sdt_simplegames:*
+//
+// 探针都属于simplegames这个provider，参数都按64位有符号整数传:
+//   move(direction, cells, moved, increase)     2048滑动一次: 方向(0上1下2右3左)、网格格子数、
+//                                               移动或合并了的格子数、加的分数(没有动是-1)
+//   spawn(index, value, cells)                  2048出子: 下标x + y * width、数字、网格格子数
+//                                               (这两个只在2048.cc里玩家的棋盘上触发，提示、困难模式、
+//                                               MCTS和离线工具里搜索或模拟的Grid都不会)
+//   tick(score, cells, ate)                     贪吃蛇走一步: 分数(吃过的苹果数)、网格格子数、这一步是否吃到苹果
+//   flood_fill(cells, touched)                  重新算连通性(贪吃蛇)或者连开一片空白(扫雷):
+//                                               网格格子数、这次访问或打开的格子数
+//   solver_step(tile, cells, safe, mines)       扫雷求解器做完一块: 块的编号、块里的格子数、
+//                                               推出来的安全格子数和地雷数
+//   frame_begin(width, height)                  开始画一帧，参数是终端的大小
+//   frame_end(width, height)                    这一帧交给了ncurses(输出预算允许时已经发出去了)
+//   input(key)                                  收到一个键，ncurses的键值
+// 用时不作为参数传: 要算时间就得在没人看的时候也读时钟。成对的探针(frame_begin和frame_end)
+// 在bpftrace里用nsecs相减，单个的探针可以和它前后的探针相减。
+//
+// 有<sys/sdt.h>(systemtap-sdt-dev)时用它的STAP_PROBEn; 没有时在x86-64和aarch64上
+// 按同样的格式自己写.note.stapsdt; 其他平台，或者定义了SIMPLEGAMES_NO_PROBES时，探针什么也不做。
+
+#if defined(SIMPLEGAMES_NO_PROBES)
+#define SIMPLEGAMES_PROBE_IMPL 0
+#elif defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SIMPLEGAMES_PROBE_IMPL 1
+#endif
+#endif
+
+#if !defined(SIMPLEGAMES_PROBE_IMPL)
+#if defined(__GNUC__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define SIMPLEGAMES_PROBE_IMPL 2
+#else
+#define SIMPLEGAMES_PROBE_IMPL 0
+#endif
+#endif
+
+#if SIMPLEGAMES_PROBE_IMPL == 1
+
+#define SIMPLEGAMES_PROBE(name) STAP_PROBE(simplegames, name)
+#define SIMPLEGAMES_PROBE1(name, a) STAP_PROBE1(simplegames, name, a)
+#define SIMPLEGAMES_PROBE2(name, a, b) STAP_PROBE2(simplegames, name, a, b)
+#define SIMPLEGAMES_PROBE3(name, a, b, c) STAP_PROBE3(simplegames, name, a, b, c)
+#define SIMPLEGAMES_PROBE4(name, a, b, c, d) STAP_PROBE4(simplegames, name, a, b, c, d)
+
+#elif SIMPLEGAMES_PROBE_IMPL == 2
+
+// 和sys/sdt.h写出来的一样: 探针的位置放一条nop，.note.stapsdt里记下它的地址、
+// provider、名字和每个参数在哪里("-8@%rax"表示8字节有符号数，在rax里)，
+// 调试器和perf按这个把nop换成断点再读参数。不用信号量(semaphore)，地址填0。
+#define SIMPLEGAMES_PROBE_ASM(name, args)                                           \
+    "990: nop\n"                                                                    \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                   \
+    ".balign 4\n"                                                                   \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                              \
+    "991: .asciz \"stapsdt\"\n"                                                     \
+    "992: .balign 4\n"                                                              \
+    "993: .8byte 990b\n"                                                            \
+    ".8byte _.stapsdt.base\n"                                                       \
+    ".8byte 0\n"                                                                    \
+    ".asciz \"simplegames\"\n"                                                      \
+    ".asciz \"" #name "\"\n"                                                        \
+    ".asciz \"" args "\"\n"                                                         \
+    "994: .balign 4\n"                                                              \
+    ".popsection\n"                                                                 \
+    ".ifndef _.stapsdt.base\n"                                                      \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"         \
+    ".weak _.stapsdt.base\n"                                                        \
+    ".hidden _.stapsdt.base\n"                                                      \
+    "_.stapsdt.base: .space 1\n"                                                    \
+    ".size _.stapsdt.base, 1\n"                                                     \
+    ".popsection\n"                                                                 \
+    ".endif\n"
+
+#define SIMPLEGAMES_PROBE_ARG(x) "nor"(static_cast<long long>(x))
+
+#define SIMPLEGAMES_PROBE(name) \
+    __asm__ __volatile__(SIMPLEGAMES_PROBE_ASM(name, ""))
+#define SIMPLEGAMES_PROBE1(name, a) \
+    __asm__ __volatile__(SIMPLEGAMES_PROBE_ASM(name, "-8@%0") :: SIMPLEGAMES_PROBE_ARG(a))
+#define SIMPLEGAMES_PROBE2(name, a, b)                                   \
+    __asm__ __volatile__(SIMPLEGAMES_PROBE_ASM(name, "-8@%0 -8@%1")      \
+                         :: SIMPLEGAMES_PROBE_ARG(a), SIMPLEGAMES_PROBE_ARG(b))
+#define SIMPLEGAMES_PROBE3(name, a, b, c)                                \
+    __asm__ __volatile__(SIMPLEGAMES_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2") \
+                         :: SIMPLEGAMES_PROBE_ARG(a), SIMPLEGAMES_PROBE_ARG(b), SIMPLEGAMES_PROBE_ARG(c))
+#define SIMPLEGAMES_PROBE4(name, a, b, c, d)                                        \
+    __asm__ __volatile__(SIMPLEGAMES_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2 -8@%3")     \
+                         :: SIMPLEGAMES_PROBE_ARG(a), SIMPLEGAMES_PROBE_ARG(b),     \
+                            SIMPLEGAMES_PROBE_ARG(c), SIMPLEGAMES_PROBE_ARG(d))
+
+#else
+
+// 参数照样求值一次(一般都是现成的变量)，免得开关探针时出现未使用变量的警告
+#define SIMPLEGAMES_PROBE(name) ((void)0)
+#define SIMPLEGAMES_PROBE1(name, a) ((void)(a))
+#define SIMPLEGAMES_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define SIMPLEGAMES_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#define SIMPLEGAMES_PROBE4(name, a, b, c, d) ((void)(a), (void)(b), (void)(c), (void)(d))
+
+#endif
@@ -0,0 +1,364 @@
+#pragma once
+
+// 扫雷的存档: 网格的布局和进行到一半的对局
+//
+// 文件(小端序，位平面按本机的字节序存，只在小端机器上用):
+//    0  u32 magic "MSWB"
+//    4  u8  版本(1)
+//    5  u8  flags，FILE_RLE表示位平面做了游程压缩
+//    6  u8  压缩时已打开和旗子的平面是怎么存的，见PLANE_OPENED_XOR和PLANE_FLAGS_XOR
+//    7  u8  保留
+//    8  u32 网格宽度
+//   12  u32 网格高度
+//   16  u64 放地雷用的种子
+//   24  u64 已经用掉的时间(毫秒)
+//   32  u64 地雷数
+//   40  u64 每个位平面的字数(u64)
+//   48  u64 头后面的字节数
+//   56  u64 保留
+//   64  地雷、已打开、旗子三个位平面
+//
+// 不压缩时三个平面和grid::planes()的内存一模一样，保存时直接从网格写出去，
+// 读取时把整个文件MAP_PRIVATE地映射进来让网格直接用，10000x10000的网格也不用解析，
+// 改动只落在进程自己的页上，不会写回文件。
+// 压缩时每个平面是一串记录，每条记录先是一个u32: 最高位是1时后面跟一个字，重复低31位那么多次;
+// 是0时后面跟低31位那么多个字，原样照抄。刚开始的对局已打开和旗子的平面几乎全是0，压缩得很好;
+// 推完的区域里已打开的格子正好是不是地雷的格子，旗子正好是地雷，这时和地雷的平面异或一下
+// 就几乎全是0了，两种存法哪个小用哪个。地雷的平面基本压不动。
+// 读压缩的存档要解压到网格自己的内存里。
+// 环境变量:
+//   SIMPLEGAMES_MINESWEEPER_SAVE  游戏中Ctrl+S保存的位置，
+//                                 默认$XDG_DATA_HOME/simplegames/minesweeper.board($HOME/.local/share/...)
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "grid.h"
+
+namespace board_file {
+
+    constexpr uint32_t MAGIC = 0x42575357; // "MSWB"
+    constexpr uint8_t VERSION = 1;
+    constexpr size_t HEADER_SIZE = 64;
+    constexpr uint8_t FILE_RLE = 1;
+    constexpr uint8_t PLANE_OPENED_XOR = 1; // 存的是已打开 ^ ~地雷
+    constexpr uint8_t PLANE_FLAGS_XOR = 2;  // 存的是旗子 ^ 地雷
+
+    struct header {
+        uint8_t flags = 0;
+        uint8_t planes = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint64_t seed = 0;
+        uint64_t elapsed_ms = 0;
+        uint64_t mines = 0;
+        uint64_t plane_words = 0;
+        uint64_t payload = 0;
+    };
+
+    inline void put_le(uint8_t *p, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++)
+            p[i] = uint8_t(v >> (i * 8));
+    }
+
+    inline uint64_t get_le(const uint8_t *p, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; i++)
+            v |= uint64_t(p[i]) << (i * 8);
+        return v;
+    }
+
+    inline void encode_header(const header &h, uint8_t *out) {
+        memset(out, 0, HEADER_SIZE);
+        put_le(out, MAGIC, 4);
+        out[4] = VERSION;
+        out[5] = h.flags;
+        out[6] = h.planes;
+        put_le(out + 8, h.width, 4);
+        put_le(out + 12, h.height, 4);
+        put_le(out + 16, h.seed, 8);
+        put_le(out + 24, h.elapsed_ms, 8);
+        put_le(out + 32, h.mines, 8);
+        put_le(out + 40, h.plane_words, 8);
+        put_le(out + 48, h.payload, 8);
+    }
+
+    /// 检查并解出文件头，size是整个文件的大小
+    inline std::optional<header> decode_header(const uint8_t *in, size_t size) {
+        if (size < HEADER_SIZE || get_le(in, 4) != MAGIC || in[4] != VERSION)
+            return std::nullopt;
+        header h;
+        h.flags = in[5];
+        h.planes = in[6];
+        h.width = uint32_t(get_le(in + 8, 4));
+        h.height = uint32_t(get_le(in + 12, 4));
+        h.seed = get_le(in + 16, 8);
+        h.elapsed_ms = get_le(in + 24, 8);
+        h.mines = get_le(in + 32, 8);
+        h.plane_words = get_le(in + 40, 8);
+        h.payload = get_le(in + 48, 8);
+        // 宽高各自不超过int还不够，格子数也不能超过int，否则网格分配不了、下标也会溢出
+        if (h.width == 0 || h.height == 0 || uint64_t(h.width) * h.height > grid::MAX_CELLS
+            || h.mines > uint64_t(h.width) * h.height
+            || h.plane_words != grid::words_for(int(h.width), int(h.height))
+            || h.payload != size - HEADER_SIZE)
+            return std::nullopt;
+        if (!(h.flags & FILE_RLE) && h.payload != h.plane_words * 3 * sizeof(grid::word))
+            return std::nullopt;
+        return h;
+    }
+
+    /// 游程压缩一个平面，第i个字是at(i)，接在out后面
+    template <class At>
+    inline void rle_encode(At at, size_t words, std::vector<uint8_t> &out) {
+        constexpr size_t MAX_COUNT = 0x7fffffff;
+        auto put = [&](grid::word w) {
+            auto b = reinterpret_cast<const uint8_t *>(&w);
+            out.insert(out.end(), b, b + sizeof(w));
+        };
+        auto put_u32 = [&](uint32_t v) {
+            uint8_t b[4];
+            put_le(b, v, 4);
+            out.insert(out.end(), b, b + 4);
+        };
+
+        size_t i = 0;
+        while (i < words) {
+            size_t run = 1;
+            grid::word w = at(i);
+            while (i + run < words && run < MAX_COUNT && at(i + run) == w)
+                run += 1;
+            if (run >= 2) {
+                put_u32(uint32_t(run) | 0x80000000u);
+                put(w);
+                i += run;
+                continue;
+            }
+            // 照抄到下一段至少重复两次的字为止
+            size_t lit = 1;
+            while (i + lit < words && lit < MAX_COUNT
+                   && !(i + lit + 1 < words && at(i + lit) == at(i + lit + 1)))
+                lit += 1;
+            put_u32(uint32_t(lit));
+            for (size_t k = 0; k < lit; k++)
+                put(at(i + k));
+            i += lit;
+        }
+    }
+
+    /// 解压一个平面，返回读掉的字节数，数据不对时返回0
+    inline size_t rle_decode(const uint8_t *in, size_t size, grid::word *plane, size_t words) {
+        size_t pos = 0, i = 0;
+        while (i < words) {
+            if (pos + 4 > size)
+                return 0;
+            uint32_t rec = uint32_t(get_le(in + pos, 4));
+            pos += 4;
+            size_t count = rec & 0x7fffffffu;
+            if (count == 0 || count > words - i)
+                return 0;
+            if (rec & 0x80000000u) {
+                if (pos + sizeof(grid::word) > size)
+                    return 0;
+                grid::word w;
+                memcpy(&w, in + pos, sizeof(w));
+                pos += sizeof(w);
+                std::fill(plane + i, plane + i + count, w);
+            } else {
+                if (pos + count * sizeof(grid::word) > size)
+                    return 0;
+                memcpy(plane + i, in + pos, count * sizeof(grid::word));
+                pos += count * sizeof(grid::word);
+            }
+            i += count;
+        }
+        return pos;
+    }
+
+    /// 把网格存到path，先写临时文件再改名，失败时设置errno并返回false
+    inline bool save(const std::string &path, const grid &g, uint64_t elapsed_ms, bool rle = false) {
+        header h;
+        h.flags = rle ? FILE_RLE : 0;
+        h.width = uint32_t(g.width());
+        h.height = uint32_t(g.height());
+        h.seed = g.seed();
+        h.elapsed_ms = elapsed_ms;
+        h.mines = g.num_mines();
+        h.plane_words = g.plane_words();
+
+        std::vector<uint8_t> packed;
+        iovec iov[2];
+        uint8_t head[HEADER_SIZE];
+        if (rle) {
+            size_t words = g.plane_words();
+            const grid::word *mines = g.mine_plane();
+            rle_encode([&](size_t i) { return mines[i]; }, words, packed);
+
+            // 已打开和旗子的平面各试两种存法，留下小的那个
+            std::vector<uint8_t> plain, xored;
+            const grid::word *opened = g.opened_plane(), *flags = g.flag_plane();
+            rle_encode([&](size_t i) { return opened[i]; }, words, plain);
+            rle_encode([&](size_t i) { return opened[i] ^ ~mines[i]; }, words, xored);
+            if (xored.size() < plain.size())
+                h.planes |= PLANE_OPENED_XOR, plain.swap(xored);
+            packed.insert(packed.end(), plain.begin(), plain.end());
+
+            plain.clear();
+            xored.clear();
+            rle_encode([&](size_t i) { return flags[i]; }, words, plain);
+            rle_encode([&](size_t i) { return flags[i] ^ mines[i]; }, words, xored);
+            if (xored.size() < plain.size())
+                h.planes |= PLANE_FLAGS_XOR, plain.swap(xored);
+            packed.insert(packed.end(), plain.begin(), plain.end());
+
+            iov[1].iov_base = packed.data();
+            iov[1].iov_len = packed.size();
+        } else {
+            // 直接从网格的内存写出去
+            iov[1].iov_base = const_cast<grid::word *>(g.planes());
+            iov[1].iov_len = g.plane_words() * 3 * sizeof(grid::word);
+        }
+        h.payload = iov[1].iov_len;
+        encode_header(h, head);
+        iov[0].iov_base = head;
+        iov[0].iov_len = HEADER_SIZE;
+
+        std::string tmp = path + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+        size_t total = iov[0].iov_len + iov[1].iov_len, done = 0;
+        while (done < total) {
+            // writev一次最多写2GiB左右，写不完时接着写剩下的
+            iovec rest[2];
+            int n = 0;
+            size_t skip = done;
+            for (auto &v : iov) {
+                if (skip >= v.iov_len) {
+                    skip -= v.iov_len;
+                    continue;
+                }
+                rest[n].iov_base = static_cast<uint8_t *>(v.iov_base) + skip;
+                rest[n].iov_len = v.iov_len - skip;
+                skip = 0;
+                n += 1;
+            }
+            ssize_t w = writev(fd, rest, n);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                int err = errno;
+                close(fd);
+                unlink(tmp.c_str());
+                errno = err;
+                return false;
+            }
+            done += size_t(w);
+        }
+        if (close(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+            int err = errno;
+            unlink(tmp.c_str());
+            errno = err;
+            return false;
+        }
+        return true;
+    }
+
+    /// 读存档，不压缩的存档直接映射给网格用，失败时设置errno(格式不对时是EINVAL)
+    inline std::optional<grid> load(const std::string &path, header *out = nullptr) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return std::nullopt;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE) {
+            close(fd);
+            errno = EINVAL;
+            return std::nullopt;
+        }
+        size_t size = size_t(st.st_size);
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        int err = errno;
+        close(fd);
+        if (base == MAP_FAILED) {
+            errno = err;
+            return std::nullopt;
+        }
+        std::shared_ptr<void> mapping(base, [size](void *p) { munmap(p, size); });
+
+        auto bytes = static_cast<uint8_t *>(base);
+        auto h = decode_header(bytes, size);
+        if (!h.has_value()) {
+            errno = EINVAL;
+            return std::nullopt;
+        }
+        if (out)
+            *out = *h;
+
+        if (!(h->flags & FILE_RLE)) {
+            auto planes = reinterpret_cast<grid::word *>(bytes + HEADER_SIZE);
+            return grid(int(h->width), int(h->height), planes, std::move(mapping), h->seed);
+        }
+
+        // 压缩的存档很小也能声明很大的网格，分配不了时和坏文件一样返回空
+        std::optional<grid> decoded;
+        try {
+            decoded.emplace(int(h->width), int(h->height));
+        } catch (const std::exception &) {
+            errno = ENOMEM;
+            return std::nullopt;
+        }
+        grid &g = *decoded;
+        size_t pos = HEADER_SIZE;
+        for (int p = 0; p < 3; p++) {
+            size_t n = rle_decode(bytes + pos, size - pos, g.planes() + p * g.plane_words(), g.plane_words());
+            if (n == 0) {
+                errno = EINVAL;
+                return std::nullopt;
+            }
+            pos += n;
+        }
+        const grid::word *mines = g.mine_plane();
+        grid::word *opened = g.opened_plane(), *flags = g.flag_plane();
+        for (size_t i = 0; i < g.plane_words(); i++) {
+            if (h->planes & PLANE_OPENED_XOR)
+                opened[i] ^= ~mines[i];
+            if (h->planes & PLANE_FLAGS_XOR)
+                flags[i] ^= mines[i];
+        }
+        g.set_seed(h->seed);
+        g.recount();
+        return decoded;
+    }
+
+    inline std::string save_path() {
+        if (const char *p = getenv("SIMPLEGAMES_MINESWEEPER_SAVE"))
+            return p;
+        std::string dir;
+        if (const char *xdg = getenv("XDG_DATA_HOME")) {
+            dir = xdg;
+        } else if (const char *home = getenv("HOME")) {
+            dir = std::string(home) + "/.local/share";
+            mkdir(dir.c_str(), 0755);
+        } else {
+            return std::string();
+        }
+        dir += "/simplegames";
+        mkdir(dir.c_str(), 0755);
+        return dir + "/minesweeper.board";
+    }
+
+} // namespace board_file
@@ -0,0 +1,527 @@
+#pragma once
+
+// 扫雷的网格
+//
+// 地雷、已打开、旗子各是一个位平面，按行存(第y行第x列是第y * width + x位)，
+// 周围的地雷数用到的时候再从地雷的位平面数出来，一个格子只占3位，上千万个格子的网格也放得下。
+// 三个平面按地雷、已打开、旗子的顺序连续地放在一起(见planes())，可以是自己分配的，
+// 也可以是别人的内存(比如board_file.h映射进来的存档)，这时由backing保证它活着。
+// 求解器(solver.h)会在多个线程里同时改打开和旗子的位平面，所以这两个平面的读写都可以用
+// std::atomic_ref按字做，见atomic_set()。
+// 每个平面按CHUNK_WORDS个字分块，track_changes()打开后，place_mines()、open_unchecked()和
+// set_flag()把改过的块记下来，撤销用的快照(history.h)只复制这些块。直接写位平面的(求解器、
+// 存档)不记，之后要调用mark_all_changed()。
+// track_frontier()打开后还维护边界: 打开了、周围还有没打开也没插旗的格子(未定的格子)的格子，
+// 和每个边界格子周围未定的格子数。打开和插旗时只更新周围的8个格子，提示、概率这样的分析
+// 每一步只看边界，不用扫整个网格。边界只存在边界上的格子，不按格子数占内存。
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../common/tracepoints.h"
+
+const int ERR_TOO_MANY_MINES = 2;
+
+const int OPEN_RESULT_BOMW = -1;
+const int OPEN_RESULT_HAS_FLAG = 1;
+
+/// 一个格子的状态，locate()返回的是一份拷贝
+class block {
+public:
+
+    block() {
+        is_opened = false;
+        has_flag = false;
+        type = TYPE_EMPTY;
+        num = 0;
+    }
+
+    enum inner_type {
+        TYPE_EMPTY,
+        TYPE_MINE,
+    };
+
+    bool has_flag;
+    bool is_opened;
+    int type;
+    uint8_t num;
+};
+
+class grid {
+public:
+
+    using word = uint64_t;
+
+    /// 边界上的一个格子
+    struct frontier_cell {
+        size_t index;           // index(x, y)
+        uint8_t unresolved;     // 周围没打开也没插旗的格子数，总是大于0
+    };
+
+    grid(int width, int height) : _width(0), _height(0), _num_mines(0), _num_opened(0), _seed(0) {
+        resize(width, height);
+    }
+
+    /// 直接用planes开始的3 * words_for(width, height)个字，不拷贝
+    grid(int width, int height, word *planes, std::shared_ptr<void> backing, uint64_t seed = 0)
+        : _width(width), _height(height), _num_mines(0), _num_opened(0), _seed(seed), _backing(std::move(backing)) {
+        attach(planes);
+        recount();
+    }
+
+    /// 拷贝出来的网格不记改过的块，也不维护边界
+    grid(const grid &other)
+        : _width(other._width), _height(other._height), _num_mines(other._num_mines),
+          _num_opened(other._num_opened), _seed(other._seed),
+          _store(other._mines, other._mines + other.plane_words() * 3) {
+        attach(_store.data());
+    }
+
+    grid(grid &&other) noexcept
+        : _width(other._width), _height(other._height), _num_mines(other._num_mines),
+          _num_opened(other._num_opened), _seed(other._seed),
+          _store(std::move(other._store)), _backing(std::move(other._backing)),
+          _changed(std::move(other._changed)), _changed_bits(std::move(other._changed_bits)),
+          _tracking(other._tracking), _frontier(std::move(other._frontier)),
+          _frontier_pos(std::move(other._frontier_pos)), _tracking_frontier(other._tracking_frontier) {
+        _words = other._words;
+        _mines = other._mines, _opened = other._opened, _flags = other._flags;
+        other._tracking = false;
+        other._tracking_frontier = false;
+        other.resize(0, 0);
+    }
+
+    grid &operator=(grid other) noexcept {
+        std::swap(_width, other._width);
+        std::swap(_height, other._height);
+        std::swap(_num_mines, other._num_mines);
+        std::swap(_num_opened, other._num_opened);
+        std::swap(_seed, other._seed);
+        std::swap(_store, other._store);
+        std::swap(_backing, other._backing);
+        std::swap(_words, other._words);
+        std::swap(_mines, other._mines);
+        std::swap(_opened, other._opened);
+        std::swap(_flags, other._flags);
+        std::swap(_changed, other._changed);
+        std::swap(_changed_bits, other._changed_bits);
+        std::swap(_tracking, other._tracking);
+        std::swap(_frontier, other._frontier);
+        std::swap(_frontier_pos, other._frontier_pos);
+        std::swap(_tracking_frontier, other._tracking_frontier);
+        return *this;
+    }
+
+    /// 最多的格子数: place_mines()和count()里的坐标、格子数都是int
+    static constexpr size_t MAX_CELLS = 0x7fffffff;
+
+    static size_t words_for(int width, int height) {
+        return (size_t(width) * size_t(height) + 63) / 64;
+    }
+
+    int width() const { return _width; }
+    int height() const { return _height; }
+    size_t cells() const { return size_t(_width) * size_t(_height); }
+    size_t index(int x, int y) const { return size_t(y) * size_t(_width) + size_t(x); }
+
+    bool is_mine(int x, int y) const { return test(_mines, index(x, y)); }
+    bool is_opened(int x, int y) const { return test(_opened, index(x, y)); }
+    bool has_flag(int x, int y) const { return test(_flags, index(x, y)); }
+
+    /// 周围8个格子里的地雷数
+    uint8_t count(int x, int y) const {
+        uint8_t n = 0;
+        for (int dy = -1; dy <= 1; dy += 1) {
+            int ny = y + dy;
+            if (ny < 0 || ny >= _height)
+                continue;
+            for (int dx = -1; dx <= 1; dx += 1) {
+                int nx = x + dx;
+                if (nx < 0 || nx >= _width || (dx == 0 && dy == 0))
+                    continue;
+                n += test(_mines, index(nx, ny));
+            }
+        }
+        return n;
+    }
+
+    block locate(int x, int y) const {
+        block b;
+        size_t i = index(x, y);
+        b.is_opened = test(_opened, i);
+        b.has_flag = test(_flags, i);
+        b.type = test(_mines, i) ? block::TYPE_MINE : block::TYPE_EMPTY;
+        b.num = b.is_opened ? count(x, y) : 0;
+        return b;
+    }
+
+    void set_flag(int x, int y, bool flag) {
+        size_t i = index(x, y);
+        bool was = test(_flags, i);
+        assign(_flags, i, flag);
+        note_change(2, i);
+        if (_tracking_frontier && was != flag && !test(_opened, i))
+            neighbours_resolved(x, y, flag ? -1 : 1);
+    }
+
+    void resize(int width, int height) {
+        _width = width;
+        _height = height;
+        _backing.reset();
+        _store.assign(words_for(width, height) * 3, 0);
+        attach(_store.data());
+        _num_mines = 0;
+        _num_opened = 0;
+        if (_tracking)
+            track_changes(true);
+        _frontier.clear();
+        _frontier_pos.clear();
+    }
+
+    /// 随机放mine_number个地雷，exclude_pos周围3x3的格子不放
+    /// seed为空时随机选一个种子，用过的种子见seed()
+    int place_mines(
+        int mine_number,
+        std::optional<std::pair<int, int>> exclude_pos = std::optional<std::pair<int, int>>(),
+        std::optional<uint64_t> seed = std::optional<uint64_t>()
+    ) {
+        int width = this->width();
+        int height = this->height();
+
+        if (mine_number > width * height - 9) {
+            return ERR_TOO_MANY_MINES;
+        }
+
+        if (seed.has_value()) {
+            _seed = *seed;
+        } else {
+            std::random_device rd;
+            _seed = (uint64_t(rd()) << 32) ^ rd();
+        }
+        std::mt19937_64 rng(_seed);
+        std::uniform_int_distribution
+            dist_x(0, width - 1), dist_y(0, height - 1);
+
+        for (int i = 0; i < mine_number; i++) {
+            int x = dist_x(rng);
+            int y = dist_y(rng);
+
+            int dx = 0;
+            int dy = 0;
+            if (exclude_pos.has_value()) {
+                dx = std::abs(x - exclude_pos->first);
+                dy = std::abs(y - exclude_pos->second);
+            }
+
+            if ((dx <= 1 && dy <= 1) || is_mine(x, y)) {
+                i -= 1;
+                continue;
+            } else {
+                assign(_mines, index(x, y), true);
+                note_change(0, index(x, y));
+                _num_mines += 1;
+            }
+        }
+
+        return 0;
+    }
+
+    /// 打开一个格子，周围没有地雷时继续打开周围的格子(有旗子的格子不打开)
+    int try_open(int in_x, int in_y) {
+        if (has_flag(in_x, in_y)) {
+            return OPEN_RESULT_HAS_FLAG;
+        } else if (is_opened(in_x, in_y)) {
+            return 0;
+        }
+
+        if (is_mine(in_x, in_y)) {
+            return OPEN_RESULT_BOMW;
+        }
+
+        std::vector<std::pair<int, int>> waitlist{ std::make_pair(in_x, in_y) };
+        open_unchecked(in_x, in_y);
+        int touched = 1;
+
+        while (!waitlist.empty()) {
+            auto [origin_x, origin_y] = waitlist.back();
+            waitlist.pop_back();
+            if (count(origin_x, origin_y) != 0)
+                continue;
+
+            for (int offset_y = -1; offset_y <= 1; offset_y += 1) {
+                int y = origin_y + offset_y;
+                if (y < 0 || _height <= y)
+                    continue;
+
+                for (int offset_x = -1; offset_x <= 1; offset_x += 1) {
+                    int x = origin_x + offset_x;
+                    if (x < 0 || _width <= x)
+                        continue;
+
+                    if (is_opened(x, y) || has_flag(x, y))
+                        continue;
+
+                    open_unchecked(x, y);
+                    waitlist.emplace_back(x, y);
+                    touched += 1;
+                }
+            }
+        }
+
+        SIMPLEGAMES_PROBE2(flood_fill, cells(), touched);
+        return 0;
+    }
+
+    void open_unchecked(int x, int y) {
+        size_t i = index(x, y);
+        if (!test(_opened, i)) {
+            assign(_opened, i, true);
+            note_change(1, i);
+            _num_opened += 1;
+            if (_tracking_frontier) {
+                if (!test(_flags, i))
+                    neighbours_resolved(x, y, -1);
+                set_unresolved(i, count_unresolved(x, y));
+            }
+        }
+    }
+
+    bool is_succeed() const {
+        return _num_opened + _num_mines >= cells();
+    }
+
+    size_t num_mines() const { return _num_mines; }
+    size_t num_opened() const { return _num_opened; }
+    uint64_t seed() const { return _seed; }
+    void set_seed(uint64_t seed) { _seed = seed; }
+
+    /// 位平面，每个平面plane_words()个字
+    size_t plane_words() const { return _words; }
+    const word *mine_plane() const { return _mines; }
+    const word *opened_plane() const { return _opened; }
+    const word *flag_plane() const { return _flags; }
+    word *opened_plane() { return _opened; }
+    word *flag_plane() { return _flags; }
+
+    /// 连续的三个平面
+    const word *planes() const { return _mines; }
+    word *planes() { return _mines; }
+
+    /// 把三个平面按块改过以后(撤销)，直接设成改完的数目，不用recount()
+    void set_counts(size_t num_mines, size_t num_opened) {
+        _num_mines = num_mines;
+        _num_opened = num_opened;
+    }
+
+    /// 每块的字数(4096个格子)，块的编号是平面(0地雷，1打开，2旗子) * chunks_per_plane() + 平面里的第几块
+    static constexpr size_t CHUNK_WORDS = 64;
+
+    size_t chunks_per_plane() const { return (_words + CHUNK_WORDS - 1) / CHUNK_WORDS; }
+
+    /// 开始或者停止记改过的块，开始时之前的改动都不算
+    void track_changes(bool on) {
+        _tracking = on;
+        _changed.clear();
+        _changed_bits.assign(on ? (chunks_per_plane() * 3 + 63) / 64 : 0, 0);
+    }
+
+    bool tracking_changes() const { return _tracking; }
+
+    /// 直接改过位平面以后，把所有的块都算成改过的
+    void mark_all_changed() {
+        if (!_tracking)
+            return;
+        _changed.clear();
+        for (uint32_t c = 0; c < chunks_per_plane() * 3; c += 1)
+            _changed.push_back(c);
+        std::fill(_changed_bits.begin(), _changed_bits.end(), ~word(0));
+    }
+
+    /// 上次取走以后改过的块(不重复，顺序不定)，取走后清空; out原来的内容丢掉，容量留着重用
+    void take_changes(std::vector<uint32_t> &out) {
+        out.swap(_changed);
+        _changed.clear();
+        for (uint32_t c : out)
+            _changed_bits[c / 64] &= ~(word(1) << (c % 64));
+    }
+
+    /// 开始或者停止维护边界，开始时扫一遍整个网格
+    void track_frontier(bool on) {
+        _tracking_frontier = on;
+        _frontier.clear();
+        _frontier_pos.clear();
+        if (on)
+            refresh_frontier(0, cells());
+    }
+
+    bool tracking_frontier() const { return _tracking_frontier; }
+
+    /// 边界上的格子，顺序不定，打开和插旗以后会变
+    const std::vector<frontier_cell> &frontier() const { return _frontier; }
+
+    bool on_frontier(int x, int y) const {
+        return _frontier_pos.count(index(x, y)) != 0;
+    }
+
+    /// 周围没打开也没插旗的格子数，维护边界时打开的格子直接查出来
+    uint8_t unresolved(int x, int y) const {
+        if (_tracking_frontier && is_opened(x, y)) {
+            auto it = _frontier_pos.find(index(x, y));
+            return it == _frontier_pos.end() ? 0 : _frontier[it->second].unresolved;
+        }
+        return count_unresolved(x, y);
+    }
+
+    /// 第first到last - 1个格子的打开和旗子被直接改过以后(撤销)，重新算它们和周围格子在不在边界上
+    void refresh_frontier(size_t first, size_t last) {
+        if (!_tracking_frontier || first >= last)
+            return;
+        size_t w = size_t(_width);
+        first = first > w + 1 ? first - w - 1 : 0;
+        last = std::min(cells(), last + w + 1);
+        for (size_t i = first; i < last; i += 1) {
+            int x = int(i % w), y = int(i / w);
+            set_unresolved(i, test(_opened, i) ? count_unresolved(x, y) : 0);
+        }
+    }
+
+    /// 位平面被直接改过以后重新数打开的格子
+    void recount() {
+        _num_opened = 0;
+        _num_mines = 0;
+        for (size_t w = 0; w < _words; w += 1) {
+            _num_opened += __builtin_popcountll(_opened[w]);
+            _num_mines += __builtin_popcountll(_mines[w]);
+        }
+    }
+
+    static bool test(const word *plane, size_t i) {
+        return (plane[i / 64] >> (i % 64)) & 1;
+    }
+
+    /// 多线程下原子地置位，返回这一位原来是不是0
+    static bool atomic_set(word *plane, size_t i, std::memory_order order = std::memory_order_relaxed) {
+        word bit = word(1) << (i % 64);
+        return !(std::atomic_ref<word>(plane[i / 64]).fetch_or(bit, order) & bit);
+    }
+
+    static void atomic_reset(word *plane, size_t i, std::memory_order order = std::memory_order_relaxed) {
+        std::atomic_ref<word>(plane[i / 64]).fetch_and(~(word(1) << (i % 64)), order);
+    }
+
+    /// 多线程下读一位，可能读到旧的值
+    static bool atomic_test(const word *plane, size_t i) {
+        return (std::atomic_ref<const word>(plane[i / 64]).load(std::memory_order_relaxed) >> (i % 64)) & 1;
+    }
+
+protected:
+
+    void attach(word *planes) {
+        _words = words_for(_width, _height);
+        _mines = planes;
+        _opened = planes + _words;
+        _flags = planes + _words * 2;
+    }
+
+    void note_change(int plane, size_t i) {
+        if (!_tracking)
+            return;
+        uint32_t c = uint32_t(plane * chunks_per_plane() + i / 64 / CHUNK_WORDS);
+        word bit = word(1) << (c % 64);
+        if (!(_changed_bits[c / 64] & bit)) {
+            _changed_bits[c / 64] |= bit;
+            _changed.push_back(c);
+        }
+    }
+
+    uint8_t count_unresolved(int x, int y) const {
+        uint8_t n = 0;
+        for (int dy = -1; dy <= 1; dy += 1) {
+            int ny = y + dy;
+            if (ny < 0 || ny >= _height)
+                continue;
+            for (int dx = -1; dx <= 1; dx += 1) {
+                int nx = x + dx;
+                if (nx < 0 || nx >= _width || (dx == 0 && dy == 0))
+                    continue;
+                size_t j = index(nx, ny);
+                n += !test(_opened, j) && !test(_flags, j);
+            }
+        }
+        return n;
+    }
+
+    /// (x, y)变成了打开或者插旗(delta是-1)，或者拔了旗(delta是1)，改周围打开的格子的计数
+    void neighbours_resolved(int x, int y, int delta) {
+        for (int dy = -1; dy <= 1; dy += 1) {
+            int ny = y + dy;
+            if (ny < 0 || ny >= _height)
+                continue;
+            for (int dx = -1; dx <= 1; dx += 1) {
+                int nx = x + dx;
+                if (nx < 0 || nx >= _width || (dx == 0 && dy == 0))
+                    continue;
+                size_t j = index(nx, ny);
+                if (!test(_opened, j))
+                    continue;
+                auto it = _frontier_pos.find(j);
+                uint8_t n = it == _frontier_pos.end() ? 0 : _frontier[it->second].unresolved;
+                set_unresolved(j, uint8_t(n + delta));
+            }
+        }
+    }
+
+    /// 设第i个格子周围未定的格子数，是0时从边界上拿掉
+    void set_unresolved(size_t i, uint8_t n) {
+        auto it = _frontier_pos.find(i);
+        if (it != _frontier_pos.end()) {
+            if (n != 0) {
+                _frontier[it->second].unresolved = n;
+                return;
+            }
+            size_t pos = it->second;
+            _frontier_pos.erase(it);
+            if (pos + 1 != _frontier.size()) {
+                _frontier[pos] = _frontier.back();
+                _frontier_pos[_frontier[pos].index] = pos;
+            }
+            _frontier.pop_back();
+        } else if (n != 0) {
+            _frontier_pos.emplace(i, _frontier.size());
+            _frontier.push_back(frontier_cell{i, n});
+        }
+    }
+
+    static void assign(word *plane, size_t i, bool v) {
+        word bit = word(1) << (i % 64);
+        if (v)
+            plane[i / 64] |= bit;
+        else
+            plane[i / 64] &= ~bit;
+    }
+
+    int _width;
+    int _height;
+    size_t _num_mines;
+    size_t _num_opened;
+    uint64_t _seed;
+    std::vector<word> _store;       // 自己分配的平面
+    std::shared_ptr<void> _backing; // 或者别人的内存
+    size_t _words;
+    word *_mines;
+    word *_opened;
+    word *_flags;
+    std::vector<uint32_t> _changed;     // 改过的块
+    std::vector<word> _changed_bits;    // 每块一位，免得重复记
+    bool _tracking = false;
+    std::vector<frontier_cell> _frontier;
+    std::unordered_map<size_t, size_t> _frontier_pos;   // 格子在_frontier里的位置
+    bool _tracking_frontier = false;
+};
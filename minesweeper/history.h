@@ -0,0 +1,238 @@
+#pragma once
+
+// 扫雷的撤销历史: 网格的写时复制快照
+//
+// 快照把grid::planes()的三个平面按grid::CHUNK_WORDS个字切成块，块是只读的、带引用计数，
+// 没改过的块在前后两个快照之间共用。块的指针每PAGE_CHUNKS个放一页，页也带引用计数，
+// 一次点击只改到的那几页会复制一份，其余的页也共用。全是0的块(刚开始的旗子和打开的平面)
+// 都指向同一个zero块，不占内存。
+// 所以commit()只复制grid::take_changes()报告改过的块，花的时间和内存跟这一步改了多少格子成正比
+// (外加每个快照一个页指针的数组，10000x10000的网格约300个指针)，跟网格多大无关。
+// 撤销时比较前后两个快照的页和块的指针，只把不一样的块拷回网格，网格的边界(grid::frontier())
+// 也只在这些块附近重新算。
+// 总共用的内存超过max_bytes时从最老的快照开始扔，撤销的步数只受这个限制。
+//
+//   board_history<State> history(64 << 20);
+//   g.track_changes(true);
+//   history.commit(g, state);      // 开局
+//   ... g.try_open(x, y); history.commit(g, state);
+//   history.undo(g, state);        // 回到上一个快照
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "grid.h"
+
+template <class State>
+class board_history {
+public:
+
+    static constexpr size_t PAGE_CHUNKS = 256;
+
+    explicit board_history(size_t max_bytes) : _max_bytes(max_bytes), _bytes(0), _chunks(0) {
+        _zero.refs = 0;
+        memset(_zero.data, 0, sizeof(_zero.data));
+    }
+
+    board_history(const board_history &) = delete;
+    board_history &operator=(const board_history &) = delete;
+
+    ~board_history() {
+        clear();
+    }
+
+    /// 快照的个数，大于1时才能撤销
+    size_t depth() const { return _snapshots.size(); }
+
+    /// 块、页和快照一共用的内存
+    size_t bytes() const { return _bytes; }
+
+    size_t max_bytes() const { return _max_bytes; }
+
+    void clear() {
+        while (!_snapshots.empty()) {
+            drop(_snapshots.back());
+            _snapshots.pop_back();
+        }
+    }
+
+    /// 记下网格现在的样子和state，网格要先track_changes(true)
+    /// 第一次(或者网格的大小变了)复制整个网格，之后只复制上次以来改过的块;
+    /// 网格没变(比如踩雷)也记一个快照，只有页指针和state，撤销时只换回state
+    void commit(grid &g, const State &state) {
+        size_t chunks = g.chunks_per_plane() * 3;
+        g.take_changes(_changed);
+        if (chunks != _chunks || _snapshots.empty()) {
+            clear();
+            _chunks = chunks;
+            _changed.clear();
+            for (size_t c = 0; c < chunks; c += 1)
+                _changed.push_back(uint32_t(c));
+
+            snapshot s;
+            s.pages.resize((chunks + PAGE_CHUNKS - 1) / PAGE_CHUNKS);
+            for (auto &p : s.pages) {
+                p = new_page();
+                std::fill(p->chunks, p->chunks + PAGE_CHUNKS, &_zero);
+            }
+            fill(g, s, state);
+            return;
+        }
+        snapshot s;
+        s.pages = _snapshots.back().pages;
+        for (page *p : s.pages)
+            p->refs += 1;
+        fill(g, s, state);
+    }
+
+    /// 回到上一个快照，包括上次commit()以后还没记下的改动，没有可以回去的快照时返回false
+    bool undo(grid &g, State &state) {
+        if (_snapshots.size() < 2 || g.chunks_per_plane() * 3 != _chunks)
+            return false;
+
+        snapshot &cur = _snapshots.back();
+        snapshot &prev = _snapshots[_snapshots.size() - 2];
+
+        g.take_changes(_changed);
+        for (uint32_t c : _changed)
+            restore(g, c, prev.pages[c / PAGE_CHUNKS]->chunks[c % PAGE_CHUNKS]);
+
+        for (size_t pi = 0; pi < cur.pages.size(); pi += 1) {
+            page *a = cur.pages[pi], *b = prev.pages[pi];
+            if (a == b)
+                continue;
+            for (size_t k = 0; k < PAGE_CHUNKS && pi * PAGE_CHUNKS + k < _chunks; k += 1) {
+                if (a->chunks[k] != b->chunks[k])
+                    restore(g, pi * PAGE_CHUNKS + k, b->chunks[k]);
+            }
+        }
+        g.set_counts(prev.num_mines, prev.num_opened);
+        state = prev.state;
+
+        drop(cur);
+        _snapshots.pop_back();
+        return true;
+    }
+
+private:
+
+    struct chunk {
+        uint32_t refs;
+        grid::word data[grid::CHUNK_WORDS];
+    };
+
+    struct page {
+        uint32_t refs;
+        chunk *chunks[PAGE_CHUNKS];
+    };
+
+    struct snapshot {
+        std::vector<page *> pages;
+        size_t num_mines;
+        size_t num_opened;
+        State state;
+    };
+
+    /// 第c块在planes()里从哪个字开始，有几个字(每个平面最后一块可能不满)
+    static std::pair<size_t, size_t> span(const grid &g, size_t c) {
+        size_t cpp = g.chunks_per_plane();
+        size_t first = (c % cpp) * grid::CHUNK_WORDS;
+        size_t n = std::min(grid::CHUNK_WORDS, g.plane_words() - first);
+        return { (c / cpp) * g.plane_words() + first, n };
+    }
+
+    /// 把s里改过的块换成网格里现在的内容，s的页都已经加过引用
+    void fill(const grid &g, snapshot &s, const State &state) {
+        for (uint32_t c : _changed) {
+            page *&p = s.pages[c / PAGE_CHUNKS];
+            if (p->refs > 1) {
+                page *copy = new_page();
+                for (size_t k = 0; k < PAGE_CHUNKS; k += 1) {
+                    copy->chunks[k] = p->chunks[k];
+                    if (copy->chunks[k] != &_zero)
+                        copy->chunks[k]->refs += 1;
+                }
+                p->refs -= 1;
+                p = copy;
+            }
+            chunk *&slot = p->chunks[c % PAGE_CHUNKS];
+            release(slot);
+            slot = capture(g, c);
+        }
+        s.num_mines = g.num_mines();
+        s.num_opened = g.num_opened();
+        s.state = state;
+        _bytes += sizeof(snapshot) + s.pages.capacity() * sizeof(page *);
+        _snapshots.push_back(std::move(s));
+
+        while (_bytes > _max_bytes && _snapshots.size() > 1) {
+            drop(_snapshots.front());
+            _snapshots.pop_front();
+        }
+    }
+
+    chunk *capture(const grid &g, size_t c) {
+        auto [first, n] = span(g, c);
+        const grid::word *src = g.planes() + first;
+        bool zero = true;
+        for (size_t w = 0; w < n && zero; w += 1)
+            zero = src[w] == 0;
+        if (zero)
+            return &_zero;
+
+        chunk *ch = new chunk;
+        ch->refs = 1;
+        memcpy(ch->data, src, n * sizeof(grid::word));
+        memset(ch->data + n, 0, (grid::CHUNK_WORDS - n) * sizeof(grid::word));
+        _bytes += sizeof(chunk);
+        return ch;
+    }
+
+    static void restore(grid &g, size_t c, const chunk *ch) {
+        auto [first, n] = span(g, c);
+        memcpy(g.planes() + first, ch->data, n * sizeof(grid::word));
+        // 打开和旗子的平面变了，网格维护着边界时重新算这一块附近的格子
+        if (c >= g.chunks_per_plane()) {
+            size_t cell = (c % g.chunks_per_plane()) * grid::CHUNK_WORDS * 64;
+            g.refresh_frontier(cell, cell + n * 64);
+        }
+    }
+
+    page *new_page() {
+        page *p = new page;
+        p->refs = 1;
+        _bytes += sizeof(page);
+        return p;
+    }
+
+    void release(chunk *ch) {
+        if (ch == &_zero || --ch->refs != 0)
+            return;
+        delete ch;
+        _bytes -= sizeof(chunk);
+    }
+
+    void drop(snapshot &s) {
+        for (page *p : s.pages) {
+            if (--p->refs != 0)
+                continue;
+            for (chunk *ch : p->chunks)
+                release(ch);
+            delete p;
+            _bytes -= sizeof(page);
+        }
+        _bytes -= sizeof(snapshot) + s.pages.capacity() * sizeof(page *);
+        s.pages.clear();
+    }
+
+    size_t _max_bytes;
+    size_t _bytes;
+    size_t _chunks;                 // 三个平面一共的块数
+    chunk _zero;
+    std::deque<snapshot> _snapshots;
+    std::vector<uint32_t> _changed;
+};
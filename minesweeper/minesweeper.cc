@@ -1,9 +1,14 @@
 // compile with: c++ minesweeper.cc -o minesweeper-cc -lncursesw -std=c++20
+// allocation stats (Ctrl+D overlay): add -DSIMPLEGAMES_ALLOC_STATS
 
 #define NCURSES_WIDECHAR 1
 
 #include <curses.h>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <vector>
 #include <sstream>
@@ -16,16 +21,22 @@
 #include <exception>
 #include <algorithm>
 
-const int ERR_TOO_MANY_MINES = 2;
+#include "../common/alloc_stats.h"
+#include "../common/frame_arena.h"
+#include "../common/spectate.h"
+#include "../common/frame_pacer.h"
+#include "../common/output_budget.h"
+#include "../common/startup_timer.h"
+#include "../common/tracepoints.h"
+#include "grid.h"
+#include "board_file.h"
+#include "history.h"
 
 const char *EVENT_ID_NONE = "none";
 const char *EVENT_ID_KEYBOARD = "keyboard";
 const char *EVENT_ID_INTERRUPT = "interrupt";
 const char *EVENT_ID_REDRAW_ALL = "redraw_all";
 
-const int OPEN_RESULT_BOMW = -1;
-const int OPEN_RESULT_HAS_FLAG = 1;
-
 const short COLOR_OPENED = 20;
 const short COLOR_UNOPENED = 21;
 const short COLOR_OPENED_SELECTED = 22;
@@ -45,6 +56,9 @@ const short COLOR_ARRAY[9] = {
 
 const int LIM_MAX_WIDTH = 128;
 
+// --practice: u / Ctrl+Z takes back the last open or flag, even after stepping on a mine
+bool practice_mode = false;
+
 const short PAIR_UNOPENED = 20;
 const short PAIR_UNOPENED_SELECTED = 21;
 const short PAIR_OPENED_BASE = 22;
@@ -98,12 +112,13 @@ inline void limited_add(T &target, T max, T min = 0) {
     }
 }
 
-std::wstring fmt_duration(size_t dur_s) {
-    std::wstringstream s;
+// the string lives in the frame arena, so it is gone after the frame
+frame_mem::wstring fmt_duration(frame_mem::arena &arena, size_t dur_s) {
+    frame_mem::wstring s(arena);
 
 #define tier(num, suffix) \
     if (dur_s >= (num)) { \
-        s << (size_t)((float)dur_s / (num)) << (suffix); \
+        frame_mem::append_int(s, dur_s / (num)) += (suffix); \
         dur_s %= num; \
     }
 
@@ -111,212 +126,13 @@ std::wstring fmt_duration(size_t dur_s) {
     tier(3600, L"时");
     tier(60, L"分");
 
-    s << dur_s << L"秒";
+    frame_mem::append_int(s, dur_s) += L"秒";
 
 #undef tier
 
-    return s.str();
+    return s;
 }
 
-class block {
-public:
-
-    block() {
-        is_opened = false;
-        has_flag = false;
-        type = TYPE_EMPTY;
-    }
-
-    enum inner_type {
-        TYPE_EMPTY,
-        TYPE_MINE,
-    };
-
-    bool has_flag;
-    bool is_opened;
-    int type;
-    uint8_t num;
-};
-
-class grid {
-public:
-
-    grid(int width, int height) {
-        resize(width, height);
-    }
-
-    int width() const { return _storage.size(); }
-    int height() const { return _storage.at(0).size(); }
-
-    block& locate(int x, int y) {
-        return _storage.at(x).at(y);
-    }
-
-    const block& locate(int x, int y) const {
-        return _storage.at(x).at(y);
-    }
-
-    void resize(int width, int height) {
-        std::vector<std::vector<block>> outer_tmp;
-        outer_tmp.reserve(width);
-
-        for (int i1 = 0; i1 < width; i1++) {
-            std::vector<block> tmp;
-            tmp.reserve(height);
-            for (int i2 = 0; i2 < height; i2++)
-                tmp.emplace_back();
-            outer_tmp.push_back(std::move(tmp));
-        }
-
-        _storage = outer_tmp;
-    }
-
-    int place_mines(
-        int mine_number,
-        std::optional<std::pair<int, int>> exclude_pos = std::optional<std::pair<int, int>>()
-    ) {
-        int width = this->width();
-        int height = this->height();
-
-        if (mine_number > width * height - 9) {
-            return ERR_TOO_MANY_MINES;
-        }
-
-        std::random_device rd;
-        std::default_random_engine rng(rd());
-        std::uniform_int_distribution
-            dist_x(0, width - 1), dist_y(0, height - 1);
-
-        for (int i = 0; i < mine_number; i++) {
-            int x = dist_x(rng);
-            int y = dist_y(rng);
-            auto &target = locate(x, y);
-
-            int dx = 0;
-            int dy = 0;
-            if (exclude_pos.has_value()) {
-                dx = std::abs(x - exclude_pos->first);
-                dy = std::abs(y - exclude_pos->second);
-            }
-
-            if ((dx <= 1 && dy <= 1) || target.type != block::TYPE_EMPTY) {
-                i -= 1;
-                continue;
-            } else {
-                target.type = block::TYPE_MINE;
-            }
-        }
-
-        return 0;
-    }
-
-    int try_open(int in_x, int in_y) {
-        int width = this->width();
-        int height = this->height();
-        std::vector<std::pair<int, int>>
-            waitlist{ std::make_pair(in_x, in_y) },
-            tmp_waitlist;
-        auto &target = locate(in_x, in_y);
-        bool stop_spread = false;
-
-        auto check_duplication = [&waitlist](int x, int y) -> bool {
-            for (auto &pos : waitlist) {
-                if (pos.first == x && pos.second == y) {
-                    return true;
-                }
-            }
-            return false;
-        };
-
-        tmp_waitlist.reserve(8);
-
-        if (target.has_flag) {
-            return OPEN_RESULT_HAS_FLAG;
-        } else if (target.is_opened) {
-            return 0;
-        }
-
-        if (target.type == block::TYPE_MINE) {
-            return OPEN_RESULT_BOMW;
-        }
-
-        size_t index = 0;
-        while (index < waitlist.size()) {
-            auto &tmp1 = waitlist.at(index);
-            int origin_x = tmp1.first;
-            int origin_y = tmp1.second;
-            uint8_t num_nearby_mines = 0;
-            stop_spread = false;
-
-            tmp_waitlist.clear();
-
-            auto &tmp_t = locate(origin_x, origin_y);
-            if (!tmp_t.has_flag)
-                tmp_t.is_opened = true;
-
-            // check the blocks around it
-            for (int offset_x = -1; offset_x <= 1; offset_x += 1) {
-                int x = origin_x + offset_x;
-                if (x < 0 || width <= x)
-                    continue;
-
-                for (int offset_y = -1; offset_y <= 1; offset_y += 1) {
-                    int y = origin_y + offset_y;
-                    if (y < 0 || height <= y)
-                        continue;
-
-                    if (offset_x == 0 && offset_y == 0)
-                        continue;
-
-                    auto &t = locate(x, y);
-
-                    if (t.type == block::TYPE_MINE) {
-                        num_nearby_mines += 1;
-                        if (!stop_spread) {
-                            tmp_waitlist.clear();
-                            stop_spread = true;
-                        }
-                    } else if (!stop_spread && !check_duplication(x, y)) {
-                        tmp_waitlist.push_back(std::make_pair(x, y));
-                    }
-                }
-            }
-
-            tmp_t.num = num_nearby_mines;
-
-            if (!tmp_waitlist.empty()) {
-                waitlist.insert(waitlist.end(), tmp_waitlist.begin(), tmp_waitlist.end());
-            }
-
-            index += 1;
-        }
-
-        return 0;
-    }
-
-    void open_unchecked(int x, int y) {
-        locate(x, y).is_opened = true;
-    }
-
-    bool is_succeed() const {
-        int width = this->width();
-        int height = this->height();
-        for (int x = 0; x < width; x += 1) {
-            for (int y = 0; y < height; y += 1) {
-                auto &block = locate(x, y);
-                if (block.type == block::TYPE_EMPTY && !block.is_opened)
-                    return false;
-            }
-        }
-
-        return true;
-    }
-
-protected:
-
-    std::vector<std::vector<block>> _storage;
-};
-
 class event {
 public:
 
@@ -401,9 +217,10 @@ public:
 
 class render_context {
 public:
-    render_context(std::shared_ptr<context_stack> ctx_stack, WINDOW *win):
+    render_context(std::shared_ptr<context_stack> ctx_stack, WINDOW *win, frame_mem::arena &arena):
         ctx_stack(ctx_stack),
         win(win),
+        arena(arena),
         is_request_clear(false)
     {}
 
@@ -426,6 +243,8 @@ public:
 
     std::shared_ptr<context_stack> ctx_stack;
     WINDOW *win;
+    // scratch memory for the text of this frame, reset once it is on screen
+    frame_mem::arena &arena;
     bool is_request_clear;
 };
 
@@ -433,16 +252,45 @@ class game_context : public context {
 public:
 
     game_context(difficulty d) :
-        _game_grid(d.width, d.height),
         _cur_x(0), _cur_y(0),
         _base_x(0), _base_y(0),
+        _game_grid(d.width, d.height),
         _game_over(false),
-        _bottom_msg(nullptr),
+        _first_click(true),
         _last_redraw_time(myclock::now()),
         _difficulty(d),
         _num_flags(0),
-        _first_click(true)
-    {}
+        _bottom_msg(nullptr),
+        _view_x(0), _view_y(0)
+    {
+        start_history();
+    }
+
+    // continue a game loaded from board_file::load()
+    game_context(grid &&g, myclock::duration elapsed) :
+        _cur_x(0), _cur_y(0),
+        _base_x(0), _base_y(0),
+        _game_grid(std::move(g)),
+        _game_over(false),
+        _first_click(_game_grid.num_mines() == 0),
+        _last_redraw_time(myclock::now()),
+        _difficulty(_game_grid.width(), _game_grid.height(), int(_game_grid.num_mines())),
+        _num_flags(0),
+        _bottom_msg(nullptr),
+        _view_x(0), _view_y(0)
+    {
+        const grid::word *flags = _game_grid.flag_plane();
+        for (size_t w = 0; w < _game_grid.plane_words(); w += 1)
+            _num_flags += __builtin_popcountll(flags[w]);
+        if (!_first_click)
+            _begin_time = myclock::now() - elapsed;
+        if (!_first_click && _game_grid.is_succeed()) {
+            _game_over = true;
+            _bottom_msg = L"扫雷成功!";
+            _end_time = _begin_time;
+        }
+        start_history();
+    }
 
     virtual void update(render_context &rctx, const event &event) override {
         if (event.id == EVENT_ID_NONE && myclock::now() - _last_redraw_time < 400ms) {
@@ -453,7 +301,7 @@ public:
             handle_ch(kb_event.ch);
         }
 
-        redraw_all(rctx.win, _base_x, _base_y);
+        redraw_all(rctx.win, rctx.arena, _base_x, _base_y);
     }
 
     void handle_ch(wchar_t ch) {
@@ -486,6 +334,7 @@ public:
                 if (_game_over)
                     return;
 
+                size_t opened = _game_grid.num_opened();
                 if (_first_click) {
                     _begin_time = std::move(myclock::now());
                     _game_grid.place_mines(_difficulty.num_mines, std::optional(std::make_pair(x, y)));
@@ -511,9 +360,17 @@ public:
 
                 if (_game_over) {
                     _end_time = std::move(myclock::now());
+                    if (code == OPEN_RESULT_BOMW && _history)
+                        _bottom_msg = L"踩雷了，按u撤销这一步";
                 }
+                if (_game_grid.num_opened() != opened || code == OPEN_RESULT_BOMW)
+                    commit_history();
                 }
 
+                break;
+            case 19:
+                // Ctrl+S
+                save();
                 break;
             case L'f':
             case L'F':
@@ -521,29 +378,112 @@ public:
                 if (_game_over)
                     return;
 
-                auto &block = _game_grid.locate(x, y);
-                if (!block.is_opened) {
-                    block.has_flag = !block.has_flag;
-                }
-                if (block.has_flag) {
-                    _num_flags += 1;
-                } else {
-                    _num_flags -= 1;
+                if (!_game_grid.is_opened(x, y)) {
+                    _game_grid.set_flag(x, y, !_game_grid.has_flag(x, y));
+                    if (_game_grid.has_flag(x, y)) {
+                        _num_flags += 1;
+                    } else {
+                        _num_flags -= 1;
+                    }
+                    commit_history();
                 }
                 }
 
                 break;
+            case L'u':
+            case L'U':
+            case 26:
+                // Ctrl+Z
+                undo();
+                break;
+        }
+    }
+
+    // what a snapshot remembers besides the board itself
+    struct undo_state {
+        bool first_click;
+        bool game_over;
+        int num_flags;
+        const wchar_t *bottom_msg;
+    };
+
+    void start_history() {
+        if (!practice_mode)
+            return;
+        // SIMPLEGAMES_MINES_UNDO_MB caps the memory kept for undo, the oldest steps go first.
+        // Values that are not a plain number or overflow keep the default, the rest are clamped
+        // so that mb << 20 still fits in a size_t
+        size_t mb = 64;
+        if (const char *env = getenv("SIMPLEGAMES_MINES_UNDO_MB")) {
+            char *end = nullptr;
+            errno = 0;
+            unsigned long long v = strtoull(env, &end, 10);
+            if (errno == 0 && end != env && *end == 0 && env[0] != '-')
+                mb = size_t(std::clamp<unsigned long long>(v, 1, SIZE_MAX >> 20));
         }
+        _history = std::make_unique<board_history<undo_state>>(mb << 20);
+        _game_grid.track_changes(true);
+        commit_history();
+    }
+
+    void commit_history() {
+        if (_history)
+            _history->commit(_game_grid, undo_state{_first_click, _game_over, _num_flags, _bottom_msg});
     }
 
-    void redraw_all(WINDOW *win, int base_x, int base_y) {
+    void undo() {
+        undo_state st;
+        if (!_history || !_history->undo(_game_grid, st))
+            return;
+        _first_click = st.first_click;
+        _game_over = st.game_over;
+        _num_flags = st.num_flags;
+        _bottom_msg = st.bottom_msg;
+        if (_first_click)
+            _begin_time.reset();
+        if (!_game_over)
+            _end_time.reset();
+    }
+
+    void save() {
+        uint64_t elapsed_ms = 0;
+        if (_begin_time.has_value()) {
+            auto end = _end_time.value_or(myclock::now());
+            elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - *_begin_time).count();
+        }
+        std::string path = board_file::save_path();
+        if (!path.empty() && board_file::save(path, _game_grid, elapsed_ms)) {
+            _save_msg = L"已保存，用--load继续";
+        } else {
+            _save_msg = L"保存失败";
+        }
+    }
+
+    void redraw_all(WINDOW *win, frame_mem::arena &arena, int base_x, int base_y) {
         int width = _game_grid.width(), height = _game_grid.height();
         _last_redraw_time = myclock::now();
 
-        for (int y = 0; y < height; y++) {
-            wmove(win, base_y + y, base_x);
-            for (int x = 0; x < width; x++) {
-                auto &block = _game_grid.locate(x, y);
+        // only the part of the board that fits on screen is drawn,
+        // scrolled so that the cursor stays visible (loaded boards can be huge)
+        int rows = std::max(1, getmaxy(win) - base_y - 5);
+        int cols = std::max(1, (getmaxx(win) - base_x) / 2);
+        if (_cur_x < _view_x) {
+            _view_x = _cur_x;
+        } else if (_cur_x >= _view_x + cols) {
+            _view_x = _cur_x - cols + 1;
+        }
+        if (_cur_y < _view_y) {
+            _view_y = _cur_y;
+        } else if (_cur_y >= _view_y + rows) {
+            _view_y = _cur_y - rows + 1;
+        }
+        int x_end = std::min(width, _view_x + cols);
+        int y_end = std::min(height, _view_y + rows);
+
+        for (int y = _view_y; y < y_end; y++) {
+            wmove(win, base_y + y - _view_y, base_x);
+            for (int x = _view_x; x < x_end; x++) {
+                auto block = _game_grid.locate(x, y);
 
                 bool is_selected = false;
                 if (x == _cur_x && y == _cur_y) {
@@ -584,17 +524,17 @@ public:
             }
         }
 
-        int by = _base_y + _game_grid.height();
+        int by = _base_y + (y_end - _view_y);
 
-        std::wstringstream s;
+        frame_mem::wstring s(arena);
 
-        s << L"地雷数: " << _difficulty.num_mines;
-        s << L"\t旗子数: " << _num_flags;
-        s << L"\t剩余: " << _difficulty.num_mines - _num_flags;
+        frame_mem::append_int(s += L"地雷数: ", _difficulty.num_mines);
+        frame_mem::append_int(s += L"\t旗子数: ", _num_flags);
+        frame_mem::append_int(s += L"\t剩余: ", _difficulty.num_mines - _num_flags);
 
         wmove(win, by, _base_x);
         wclrtoeol(win);
-        waddnwstr(win, s.view().data(), s.view().size());
+        waddnwstr(win, s.data(), s.size());
 
         if (_begin_time.has_value()) {
             by += 1;
@@ -604,19 +544,42 @@ public:
                 time_now = *_end_time;
 
             auto dur = std::chrono::duration_cast<std::chrono::seconds>(time_now - *_begin_time);
-            auto time_str = fmt_duration(dur.count());
+            auto time_str = fmt_duration(arena, dur.count());
 
             wmove(win, by, _base_x);
             wclrtoeol(win);
             waddwstr(win, time_str.c_str());
         }
 
+        if (_history) {
+            by += 1;
+            frame_mem::wstring h(arena);
+            frame_mem::append_int(h += L"练习模式  可撤销: ", int(_history->depth() - 1));
+            frame_mem::append_int(h += L"步  ", int(_history->bytes() >> 10));
+            frame_mem::append_int(h += L"/", int(_history->max_bytes() >> 10));
+            h += L"KiB";
+            wmove(win, by, _base_x);
+            wclrtoeol(win);
+            waddnwstr(win, h.data(), h.size());
+        }
+
+        if (!_save_msg.empty()) {
+            by += 1;
+            wmove(win, by, _base_x);
+            wclrtoeol(win);
+            waddwstr(win, _save_msg.c_str());
+        }
+
         if (_game_over) {
             by += 1;
             mvwaddwstr(win, by, _base_x, _bottom_msg);
             by += 1;
             mvwaddwstr(win, by, _base_x, L"按下Ctrl+C退出");
         }
+
+        // an undo can take back the clock and the game over lines
+        wmove(win, by + 1, _base_x);
+        wclrtobot(win);
     }
 
 private:
@@ -633,6 +596,10 @@ private:
     difficulty _difficulty;
     int _num_flags;
     const wchar_t *_bottom_msg;
+    int _view_x;
+    int _view_y;
+    std::wstring _save_msg;
+    std::unique_ptr<board_history<undo_state>> _history;
 };
 
 class difficulty_context : public context {
@@ -708,10 +675,10 @@ public:
             rctx.request_clear();
         }
 
-        redraw_all(rctx.win);
+        redraw_all(rctx.win, rctx.arena);
     }
 
-    void redraw_all(WINDOW *win) {
+    void redraw_all(WINDOW *win, frame_mem::arena &arena) {
         int width = getmaxx(win);
 
         static const wchar_t *PRESET_NAMES[] = {
@@ -748,14 +715,14 @@ public:
         };
         int i;
 
-        auto fmt = [this, win](auto arg1) {
-            std::wstringstream s;
+        auto fmt = [this, win, &arena](auto arg1) {
+            frame_mem::wstring s(arena);
             if (index == N_PRESETS - 1) {
-                s << L"<- " << arg1 << L" ->";
+                frame_mem::append_int(s += L"<- ", arg1) += L" ->";
             } else {
-                s << arg1;
+                frame_mem::append_int(s, arg1);
             }
-            waddnwstr(win, s.view().data(), s.view().size());
+            waddnwstr(win, s.data(), s.size());
         };
 
         for (i = 0; i < 3; i += 1) {
@@ -861,32 +828,69 @@ protected:
 class game {
 public:
 
-    game() :
-        _ctx_stack(std::make_shared<context_stack>()), _win(stdscr),
-        //_debug_flag(true),
-        _last_size(1, 1)
+    game(std::shared_ptr<context> first = nullptr) :
+        _debug_flag(false),
+        _last_size(1, 1),
+        _ctx_stack(std::make_shared<context_stack>()), _win(stdscr)
     {
         _ctx_stack->emplace_back(std::make_shared<menu_context>());
+        if (first)
+            _ctx_stack->emplace_back(std::move(first));
+        _focus.enable();
+    }
+
+    ~game() {
+        _focus.disable();
     }
 
     int run() {
         bool need_clear = false;
 
         while (!_ctx_stack->empty()) {
-            render_context rctx(_ctx_stack, _win);
+            render_context rctx(_ctx_stack, _win, _frame_arena);
             auto ctx = _ctx_stack->back();
 
             int width, height;
             getmaxyx(_win, height, width);
 
+            _alloc_stats.begin();
+            _alloc_stats.phase("input");
+
+            // sleep until a key arrives or the next timed redraw is due
+            wint_t k = 0;
+            // output held back by the budget is retried once the link has drained
+            auto deadline = _output_pending ? _budget.retry_at() : myclock::time_point::max();
+            wtimeout(_win, _pacer.timeout_ms(myclock::now(), deadline));
+            int rc = wget_wch(_win, &k);
+            _pacer.wakeup();
+            if (rc != ERR)
+                SIMPLEGAMES_PROBE1(input, k);
+            if (rc == ERR) {
+                k = 0;
+            } else if (rc == KEY_CODE_YES && _focus.handle_key(k)) {
+                _pacer.set_focused(_focus.focused());
+                ctx->need_redraw = _focus.focused();
+                k = 0;
+            }
+
+            // Ctrl+D toggles the debug overlay
+            if (k == 4) {
+                _debug_flag = !_debug_flag;
+                need_clear = true;
+                k = 0;
+            }
+
+            // erased only after wget_wch(): an erased _win would make it refresh on its own,
+            // sending a blank screen and skipping the spectator feed
             if (need_clear) {
                 werase(_win);
                 ctx->need_redraw = true;
                 need_clear = false;
             }
 
-            wint_t k;
-            get_wch(&k);
+            _alloc_stats.phase("update");
+            // contexts draw while they handle the event, so the frame starts here
+            SIMPLEGAMES_PROBE2(frame_begin, width, height);
 /*
             if (_debug_flag) {
                 int height = getmaxy(_win);
@@ -922,8 +926,14 @@ public:
                     ctx->update(rctx, kb_event);
                 }
             } else {
-                event e(EVENT_ID_NONE);
-                ctx->update(rctx, e);
+                // timed redraws (the clock) follow the pacer, so they slow
+                // down or stop while the terminal is unfocused
+                auto now = myclock::now();
+                if (_pacer.frame_due(now)) {
+                    _pacer.frame_done(now);
+                    event e(EVENT_ID_NONE);
+                    ctx->update(rctx, e);
+                }
             }
 
             if (ctx->need_redraw) {
@@ -931,14 +941,50 @@ public:
                 ctx->update(rctx, event(EVENT_ID_REDRAW_ALL));
             }
 
-            need_clear = rctx.is_request_clear;
+            need_clear = need_clear || rctx.is_request_clear;
 
             if (_last_size.first != width || _last_size.second != height) {
                 _last_size = std::pair<int, int>(width, height);
                 need_clear = true;
             }
 
-            wrefresh(_win);
+            if (_debug_flag) {
+                // allocation stats of the previous frame, formatted on the stack
+                char buf[160];
+                _budget.format_stats(buf, sizeof(buf));
+                mvwaddstr(_win, height - 3, 0, buf);
+                wclrtoeol(_win);
+                _pacer.format_stats(buf, sizeof(buf));
+                mvwaddstr(_win, height - 2, 0, buf);
+                wclrtoeol(_win);
+                _frame_arena.format_stats(buf, sizeof(buf));
+                mvwaddstr(_win, height - 4, 0, buf);
+                wclrtoeol(_win);
+                _alloc_stats.format_overlay(buf, sizeof(buf));
+                mvwaddstr(_win, height - 1, 0, buf);
+                wclrtoeol(_win);
+            }
+
+            _alloc_stats.phase("refresh");
+
+            // over the output budget the changes stay in the window and go out
+            // merged with the next frame's
+            auto beg = myclock::now();
+            wnoutrefresh(_win);
+            // before doupdate() clears the touched-line marks it reads
+            _spectate.publish();
+            _output_pending = !_budget.admit(beg);
+            if (!_output_pending) {
+                doupdate();
+                _budget.sent(beg, myclock::now());
+                SIMPLEGAMES_PROBE2(frame_end, width, height);
+                // --measure-startup stops once the first frame is on screen
+                if (startup::global().first_frame())
+                    return 0;
+            }
+            _frame_arena.reset();
+
+            _alloc_stats.end(k == 0);
         }
 
         return 0;
@@ -946,15 +992,60 @@ public:
 
 protected:
 
-    //bool _debug_flag;
+public:
+
+    const alloc_stats::frame_stats &get_alloc_stats() const { return _alloc_stats; }
+    const frame_mem::arena &get_frame_arena() const { return _frame_arena; }
+    const pacing::frame_pacer &get_pacer() const { return _pacer; }
+    const pacing::output_budget &get_output_budget() const { return _budget; }
+
+protected:
+
+    bool _debug_flag;
     //std::wstring _keyboard_cache;
     std::pair<int, int> _last_size;
     std::shared_ptr<context_stack> _ctx_stack;
     WINDOW *_win;
+    alloc_stats::frame_stats _alloc_stats;
+    frame_mem::arena _frame_arena;
+    spectate::publisher _spectate{"minesweeper"};
+    pacing::focus_tracker _focus;
+    // the game clock is redrawn every 400ms while focused
+    pacing::frame_pacer _pacer{400ms};
+    pacing::output_budget _budget;
+    bool _output_pending = false;
 };
 
-int main() {
+int main(int argc, char **argv) {
+    // --load [FILE] continues a game saved with Ctrl+S
+    // --measure-startup exits after the first frame and prints how long each startup phase took
+    // --practice keeps an undo history (see history.h)
+    std::shared_ptr<context> loaded;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "--measure-startup") == 0) {
+        startup::global().enable();
+        argi += 1;
+    }
+    if (argi < argc && strcmp(argv[argi], "--practice") == 0) {
+        practice_mode = true;
+        argi += 1;
+    }
+    if (argi < argc && strcmp(argv[argi], "--load") == 0) {
+        std::string path = argi + 1 < argc ? argv[argi + 1] : board_file::save_path();
+        board_file::header h;
+        auto g = board_file::load(path, &h);
+        if (!g.has_value()) {
+            perror(path.c_str());
+            return 1;
+        }
+        loaded = std::make_shared<game_context>(std::move(*g), std::chrono::milliseconds(h.elapsed_ms));
+    } else if (argi < argc) {
+        fprintf(stderr, "usage: %s [--measure-startup] [--practice] [--load [FILE]]\n", argv[0]);
+        return 2;
+    }
+
     setlocale(LC_ALL, "");
+    startup::global().mark("setlocale");
 
     initscr();
     raw();
@@ -977,8 +1068,10 @@ int main() {
         init_pair(PAIR_OPENED_BASE + i, COLOR_ARRAY[i], COLOR_OPENED);
         init_pair(PAIR_OPENED_SELECTED_BASE + i, COLOR_ARRAY[i], COLOR_OPENED_SELECTED);
     }
+    startup::global().mark("initscr");
 
-    game g;
+    game g(std::move(loaded));
+    startup::global().mark("game");
     int result = g.run();
 
     curs_set(1);
@@ -988,5 +1081,17 @@ int main() {
     noraw();
     endwin();
 
+    if (startup::global().done()) {
+        startup::global().report(stderr, "minesweeper");
+        return result;
+    }
+    g.get_alloc_stats().report(stderr, "minesweeper");
+    if (alloc_stats::enabled)
+        g.get_frame_arena().report(stderr, "minesweeper");
+    if (getenv("SIMPLEGAMES_PACING_STATS")) {
+        g.get_pacer().report(stderr, "minesweeper");
+        g.get_output_budget().report(stderr, "minesweeper");
+    }
+
     return result;
 }
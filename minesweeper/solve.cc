@@ -0,0 +1,120 @@
+// 扫雷大网格的逻辑求解测试(solver.h)
+// compile with: c++ -O2 -pthread solve.cc -o minesweeper-solve -std=c++20
+//
+// 随机生成一个网格(或者用--load读board_file.h的存档)，从中间点开，然后用求解器推到不动点;
+// 卡住时每块偷看一次地雷打开一个安全格子再接着推，直到全部打开。--steps N只推N轮就停，
+// 用来存一个进行到一半的对局; --save把结果存下来，--rle时压缩。
+//
+// 用法:
+//   minesweeper-solve [--width W] [--height H] [--density D | --mines N] [--seed S] [--tile T] [-j N]
+//                     [--load FILE] [--save FILE] [--rle] [--steps N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#include "grid.h"
+#include "solver.h"
+#include "board_file.h"
+
+int main(int argc, char **argv) {
+    int width = 4096, height = 4096, tile = 256, threads = 0;
+    double density = 0.15;
+    long long mines = -1;
+    std::optional<uint64_t> seed;
+    std::string load_path, save_path;
+    bool rle = false;
+    int steps = -1;
+
+    for (int i = 1; i < argc; i++) {
+        auto arg = [&](const char *name) { return strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if (arg("--width")) {
+            width = atoi(argv[++i]);
+        } else if (arg("--height")) {
+            height = atoi(argv[++i]);
+        } else if (arg("--density")) {
+            density = atof(argv[++i]);
+        } else if (arg("--mines")) {
+            mines = atoll(argv[++i]);
+        } else if (arg("--seed")) {
+            seed = strtoull(argv[++i], nullptr, 0);
+        } else if (arg("--tile")) {
+            tile = atoi(argv[++i]);
+        } else if (arg("-j")) {
+            threads = atoi(argv[++i]);
+        } else if (arg("--load")) {
+            load_path = argv[++i];
+        } else if (arg("--save")) {
+            save_path = argv[++i];
+        } else if (arg("--steps")) {
+            steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rle") == 0) {
+            rle = true;
+        } else {
+            fprintf(stderr, "usage: %s [--width W] [--height H] [--density D | --mines N] [--seed S] [--tile T] [-j N]\n"
+                            "          [--load FILE] [--save FILE] [--rle] [--steps N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (width < 4 || height < 4 || size_t(width) * size_t(height) > grid::MAX_CELLS)
+        return 2;
+    if (mines < 0)
+        mines = (long long)(density * width * height);
+
+    auto beg = std::chrono::steady_clock::now();
+    std::optional<grid> loaded;
+    board_file::header h;
+    if (!load_path.empty()) {
+        loaded = board_file::load(load_path, &h);
+        if (!loaded.has_value()) {
+            perror(load_path.c_str());
+            return 1;
+        }
+    } else {
+        loaded.emplace(width, height);
+        int cx = width / 2, cy = height / 2;
+        if (mines > (long long)width * height - 9 || loaded->place_mines(int(mines), std::make_pair(cx, cy), seed) != 0) {
+            fprintf(stderr, "too many mines\n");
+            return 1;
+        }
+        loaded->try_open(cx, cy);
+    }
+    grid &g = *loaded;
+    width = g.width(), height = g.height();
+    double setup = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+
+    solver s(g, tile, threads);
+    int stalls = 0;
+    while (steps != 0) {
+        s.run();
+        steps -= 1;
+        if (g.is_succeed() || steps == 0 || s.hint() == 0)
+            break;
+        stalls += 1;
+    }
+
+    if (!save_path.empty()) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t elapsed_ms = h.elapsed_ms + uint64_t(s.stats().seconds * 1000);
+        if (!board_file::save(save_path, g, elapsed_ms, rle)) {
+            perror(save_path.c_str());
+            return 1;
+        }
+        printf("saved %s in %.2fs\n", save_path.c_str(),
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+    }
+
+    auto &st = s.stats();
+    printf("%dx%d, %zu mines, %zu opened, seed %llu, tile %d, %d thread(s), setup %.2fs\n", width, height,
+           g.num_mines(), g.num_opened(),
+           (unsigned long long)g.seed(), s.tile(), s.threads(), setup);
+    printf("logic: %llu safe + %llu mines in %llu rounds (%llu tile passes), %d stalls, %llu hints\n",
+           (unsigned long long)st.safe, (unsigned long long)st.mines, (unsigned long long)st.rounds,
+           (unsigned long long)st.tiles, stalls, (unsigned long long)st.hints);
+    printf("%s in %.2fs, %.2fM deductions/s\n", g.is_succeed() ? "solved" : "not solved", st.seconds,
+           st.seconds > 0 ? st.deductions() / st.seconds / 1e6 : 0.0);
+    return g.is_succeed() ? 0 : 1;
+}
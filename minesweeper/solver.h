@@ -0,0 +1,403 @@
+#pragma once
+
+// 扫雷的逻辑求解器，用来一口气解上百万格的大网格
+//
+// 网格按tile x tile切成块，每块有自己的工作队列，多个线程同时各做一块:
+//   - 已打开的格子周围的地雷数减去已知的地雷就是剩下的地雷数，
+//     剩0个时周围没打开的都安全，剩下的和没打开的一样多时全是地雷
+//   - 5x5范围内两个已打开的格子a、b: 只有b周围才有的格子比只有a周围才有的格子多出的地雷数
+//     等于只有b周围才有的格子数时，这些格子全是地雷，只有a周围才有的格子全安全
+// 推出来的安全格子直接打开(从地雷的位平面数出它的数字)，地雷记在求解器自己的位平面里，
+// 开始时网格上已经插着的旗子(比如读进来的存档)里真是地雷的先记进去，接着推的时候不用重新推一遍;
+// 两者都只会从0变1，所以别的线程读到旧的值只是少推出一些，不会推错。
+// 状态变了的格子周围的已打开格子要重新看，落在别的块里的投到那一块的收件箱，
+// 下一轮再做; 所有块都没有新的工作时就到了不动点。
+// 线程来自common/scheduler.h，求解器自己建一个调度器，每轮不用重新起线程。
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../common/scheduler.h"
+#include "../common/tracepoints.h"
+#include "grid.h"
+
+struct solver_stats {
+    uint64_t safe = 0;      // 推出来并打开的安全格子
+    uint64_t mines = 0;     // 推出来的地雷
+    uint64_t hints = 0;     // 卡住时偷看地雷打开的格子
+    uint64_t rounds = 0;
+    uint64_t tiles = 0;     // 做过的块数(同一块做几轮算几次)
+    double seconds = 0;
+
+    uint64_t deductions() const { return safe + mines; }
+};
+
+class solver {
+public:
+
+    solver(grid &g, int tile = 256, int threads = 0)
+        : _grid(g), _width(g.width()), _height(g.height()), _tile(std::max(tile, 8)) {
+        _threads = threads > 0 ? threads : sched::scheduler::default_threads();
+        _pool = std::make_unique<sched::scheduler>(_threads - 1);
+        _tiles_x = (_width + _tile - 1) / _tile;
+        _tiles_y = (_height + _tile - 1) / _tile;
+        _tiles = std::vector<tile_state>(size_t(_tiles_x) * _tiles_y);
+        // 插错的旗子不算，否则会推出错的结果
+        const grid::word *flags = g.flag_plane(), *mines = g.mine_plane();
+        _known.resize(g.plane_words());
+        for (size_t w = 0; w < _known.size(); w += 1)
+            _known[w] = flags[w] & mines[w];
+        for (size_t t = 0; t < _tiles.size(); t += 1)
+            _active.push_back(uint32_t(t));
+    }
+
+    /// 推到不动点，推出来的地雷插上旗子，返回这次推出来的格子数
+    uint64_t run() {
+        auto beg = std::chrono::steady_clock::now();
+        uint64_t before = _stats.deductions();
+        // hint()投进收件箱的块
+        for (auto t : _next)
+            _tiles[t].queued = false;
+        _active.insert(_active.end(), _next.begin(), _next.end());
+        _next.clear();
+
+        while (!_active.empty()) {
+            std::atomic<size_t> next(0);
+            std::mutex merge;
+            auto work = [&] {
+                solver_stats local;
+                std::vector<uint32_t> queue;
+                for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < _active.size(); ) {
+                    work_tile(_active[i], queue, local);
+                    local.tiles += 1;
+                }
+                std::lock_guard<std::mutex> lock(merge);
+                _stats.safe += local.safe;
+                _stats.mines += local.mines;
+                _stats.tiles += local.tiles;
+            };
+            run_parallel(work, _active.size());
+
+            // 每块在列表里只出现一次，一轮里同一块不会有两个线程在做
+            _active.swap(_next);
+            _next.clear();
+            for (auto t : _active)
+                _tiles[t].queued = false;
+            _stats.rounds += 1;
+        }
+
+        grid::word *flags = _grid.flag_plane();
+        for (size_t w = 0; w < _known.size(); w += 1)
+            flags[w] |= _known[w];
+        _grid.recount();
+
+        _stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+        return _stats.deductions() - before;
+    }
+
+    /// 卡住时每块偷看一次地雷，打开一个还没打开的安全格子(优先挨着已打开格子的)
+    /// 之后再run()就能接着推，返回打开的格子数，0表示已经全部打开了
+    uint64_t hint() {
+        std::vector<uint32_t> all;
+        for (size_t t = 0; t < _tiles.size(); t += 1)
+            if (!_tiles[t].done)
+                all.push_back(uint32_t(t));
+
+        std::atomic<size_t> next(0);
+        std::atomic<uint64_t> opened(0);
+        auto work = [&] {
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < all.size(); ) {
+                int64_t pick = pick_hint(all[i]);
+                if (pick < 0) {
+                    _tiles[all[i]].done = true;
+                } else if (grid::atomic_set(_grid.opened_plane(), size_t(pick))) {
+                    post_around(uint32_t(pick));
+                    opened.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        };
+        run_parallel(work, all.size());
+
+        _stats.hints += opened.load();
+        _grid.recount();
+        return opened.load();
+    }
+
+    const solver_stats &stats() const { return _stats; }
+    int threads() const { return _threads; }
+    int tile() const { return _tile; }
+
+protected:
+
+    struct tile_state {
+        std::mutex lock;
+        std::vector<uint32_t> inbox;
+        bool queued = false;    // 已经在下一轮的列表里
+        bool started = false;   // 第一次做时把块里所有已打开的格子放进队列
+        bool done = false;      // 没有没打开的安全格子了
+        std::vector<grid::word> pending;    // 已经在队列里的格子，免得重复排队，只有做这一块的线程碰
+    };
+
+    template <class Fn>
+    void run_parallel(Fn &work, size_t jobs) {
+        int n = int(std::min<size_t>(size_t(_threads), jobs));
+        sched::task_group group(*_pool);
+        for (int t = 1; t < n; t += 1)
+            group.run([&work] { work(); });
+        work();
+        group.wait();
+    }
+
+    uint32_t tile_of(uint32_t i) const {
+        uint32_t x = i % uint32_t(_width), y = i / uint32_t(_width);
+        return (y / _tile) * _tiles_x + x / _tile;
+    }
+
+    bool opened(uint32_t i) const { return grid::atomic_test(_grid.opened_plane(), i); }
+    bool known_mine(uint32_t i) const { return grid::atomic_test(_known.data(), i); }
+
+    /// 投到i所在块的收件箱，下一轮再做
+    void post(uint32_t i) {
+        auto &t = _tiles[tile_of(i)];
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(t.lock);
+            t.inbox.push_back(i);
+            first = !t.queued;
+            t.queued = true;
+        }
+        if (first) {
+            std::lock_guard<std::mutex> lock(_next_lock);
+            _next.push_back(tile_of(i));
+        }
+    }
+
+    /// i和它周围已打开的格子都投到收件箱
+    void post_around(uint32_t i) {
+        int x = int(i % uint32_t(_width)), y = int(i / uint32_t(_width));
+        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, _height - 1); ny += 1)
+            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, _width - 1); nx += 1)
+                if (opened(uint32_t(_grid.index(nx, ny))))
+                    post(uint32_t(_grid.index(nx, ny)));
+    }
+
+    void work_tile(uint32_t t, std::vector<uint32_t> &queue, solver_stats &stats) {
+        auto &ts = _tiles[t];
+        queue.clear();
+        {
+            std::lock_guard<std::mutex> lock(ts.lock);
+            queue.swap(ts.inbox);
+        }
+
+        int x0 = int(t % _tiles_x) * _tile, y0 = int(t / _tiles_x) * _tile;
+        int x1 = std::min(x0 + _tile, _width), y1 = std::min(y0 + _tile, _height);
+        // 块里的格子按块内的坐标找排队标记，免得每次都做除法
+        auto pending = [&](int x, int y) -> grid::word & {
+            return ts.pending[(size_t(y - y0) * _tile + (x - x0)) / 64];
+        };
+        auto bit = [&](int x, int y) {
+            return grid::word(1) << ((size_t(y - y0) * _tile + (x - x0)) % 64);
+        };
+        if (!ts.started) {
+            ts.started = true;
+            ts.pending.assign((size_t(_tile) * _tile + 63) / 64, 0);
+            for (int y = y0; y < y1; y += 1)
+                for (int x = x0; x < x1; x += 1)
+                    if (opened(uint32_t(_grid.index(x, y))))
+                        queue.push_back(uint32_t(_grid.index(x, y)));
+        }
+
+        auto touch = [&](int x, int y) {
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, _height - 1); ny += 1) {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, _width - 1); nx += 1) {
+                    uint32_t n = uint32_t(_grid.index(nx, ny));
+                    if (!opened(n))
+                        continue;
+                    if (nx < x0 || nx >= x1 || ny < y0 || ny >= y1) {
+                        post(n);
+                    } else if (!(pending(nx, ny) & bit(nx, ny))) {
+                        pending(nx, ny) |= bit(nx, ny);
+                        queue.push_back(n);
+                    }
+                }
+            }
+        };
+        auto mark_safe = [&](uint32_t i, int x, int y) {
+            if (grid::atomic_set(_grid.opened_plane(), i)) {
+                assert(!grid::atomic_test(_grid.mine_plane(), i));
+                stats.safe += 1;
+                touch(x, y);
+            }
+        };
+        auto mark_mine = [&](uint32_t i, int x, int y) {
+            if (grid::atomic_set(_known.data(), i)) {
+                assert(grid::atomic_test(_grid.mine_plane(), i));
+                stats.mines += 1;
+                touch(x, y);
+            }
+        };
+
+        uint64_t safe = stats.safe, mines = stats.mines;
+        while (!queue.empty()) {
+            uint32_t c = queue.back();
+            queue.pop_back();
+            int x = int(c % uint32_t(_width)), y = int(c / uint32_t(_width));
+            pending(x, y) &= ~bit(x, y);
+            deduce(x, y, mark_safe, mark_mine);
+        }
+        SIMPLEGAMES_PROBE4(solver_step, t, (x1 - x0) * (y1 - y0), stats.safe - safe, stats.mines - mines);
+    }
+
+    // 以(x, y)为中心的7x7窗口，第r行第c列是第r * 7 + c位，超出网格的位是0
+    static constexpr uint64_t BLOCK3 = 0x7 | (0x7 << 7) | (0x7 << 14);
+
+    /// 以(x, y)为中心、窗口里(cx, cy)周围3x3的位
+    static uint64_t block_at(int cx, int cy) {
+        return BLOCK3 << ((cy - 1) * 7 + (cx - 1));
+    }
+
+    uint64_t inbound(int x, int y) const {
+        if (x >= 3 && y >= 3 && x + 3 < _width && y + 3 < _height)
+            return (uint64_t(1) << 49) - 1;
+        uint64_t cols = 0, out = 0;
+        for (int c = 0; c < 7; c += 1)
+            if (x - 3 + c >= 0 && x - 3 + c < _width)
+                cols |= uint64_t(1) << c;
+        for (int r = 0; r < 7; r += 1)
+            if (y - 3 + r >= 0 && y - 3 + r < _height)
+                out |= cols << (r * 7);
+        return out;
+    }
+
+    /// 位平面上从第i位开始的7位
+    uint64_t load7(const grid::word *plane, size_t i) const {
+        size_t w = i / 64, b = i % 64;
+        uint64_t v = std::atomic_ref<const grid::word>(plane[w]).load(std::memory_order_relaxed) >> b;
+        if (b > 57 && w + 1 < _grid.plane_words())
+            v |= std::atomic_ref<const grid::word>(plane[w + 1]).load(std::memory_order_relaxed) << (64 - b);
+        return v & 0x7f;
+    }
+
+    uint64_t window(const grid::word *plane, int x, int y, uint64_t in, int r0 = 0, int r1 = 7) const {
+        uint64_t out = 0;
+        for (int r = r0; r < r1; r += 1) {
+            int ny = y - 3 + r;
+            if (ny < 0 || ny >= _height)
+                continue;
+            int nx = x - 3;
+            uint64_t bits = nx >= 0 ? load7(plane, _grid.index(nx, ny)) : load7(plane, _grid.index(0, ny)) << -nx;
+            out |= (bits & 0x7f) << (r * 7);
+        }
+        return out & in;
+    }
+
+    template <class Mark>
+    void mark_window(uint64_t mask, int x, int y, Mark &mark) {
+        while (mask) {
+            int pos = __builtin_ctzll(mask);
+            mask &= mask - 1;
+            int mx = x - 3 + pos % 7, my = y - 3 + pos / 7;
+            mark(uint32_t(_grid.index(mx, my)), mx, my);
+        }
+    }
+
+    template <class Safe, class Mine>
+    void deduce(int x, int y, Safe &mark_safe, Mine &mark_mine) {
+        // 大部分格子周围已经没有没打开的格子了，先只读中间三行
+        uint64_t in = inbound(x, y);
+        uint64_t ba = block_at(3, 3);
+        uint64_t opened = window(_grid.opened_plane(), x, y, in, 2, 5);
+        uint64_t known = window(_known.data(), x, y, in, 2, 5);
+        uint64_t ua = in & ba & ~opened & ~known;
+        if (ua == 0)
+            return;
+
+        // 只数已打开格子周围的地雷，也就是它显示的数字
+        uint64_t mines = window(_grid.mine_plane(), x, y, in);
+        int na = __builtin_popcountll(ua);
+        int ra = __builtin_popcountll(mines & ba) - __builtin_popcountll(known & ba);
+        if (ra == 0) {
+            mark_window(ua, x, y, mark_safe);
+            return;
+        }
+        if (ra == na) {
+            mark_window(ua, x, y, mark_mine);
+            return;
+        }
+
+        opened |= window(_grid.opened_plane(), x, y, in, 0, 2) | window(_grid.opened_plane(), x, y, in, 5, 7);
+        known |= window(_known.data(), x, y, in, 0, 2) | window(_known.data(), x, y, in, 5, 7);
+        uint64_t unknown = in & ~opened & ~known;
+        for (int by = 1; by <= 5; by += 1) {
+            for (int bx = 1; bx <= 5; bx += 1) {
+                int pos = by * 7 + bx;
+                if (pos == 3 * 7 + 3 || !((opened >> pos) & 1))
+                    continue;
+                uint64_t bb = block_at(bx, by);
+                uint64_t ub = unknown & bb;
+                if ((ua & ub) == 0)
+                    continue;
+                int rb = __builtin_popcountll(mines & bb) - __builtin_popcountll(known & bb);
+                uint64_t only_a = ua & ~ub, only_b = ub & ~ua;
+                int na_only = __builtin_popcountll(only_a), nb_only = __builtin_popcountll(only_b);
+
+                // 只有b才有的格子比只有a才有的格子多rb - ra个地雷
+                uint64_t mine = 0, safe = 0;
+                if (nb_only > 0 && rb - ra == nb_only) {
+                    mine = only_b, safe = only_a;
+                } else if (na_only > 0 && ra - rb == na_only) {
+                    mine = only_a, safe = only_b;
+                } else if (ra == rb && (na_only == 0 || nb_only == 0)) {
+                    safe = only_a | only_b;
+                }
+                if ((mine | safe) == 0)
+                    continue;
+                mark_window(mine, x, y, mark_mine);
+                mark_window(safe, x, y, mark_safe);
+                return;
+            }
+        }
+    }
+
+    /// 在一块里找一个还没打开的安全格子，没有时返回-1
+    int64_t pick_hint(uint32_t t) const {
+        int x0 = int(t % _tiles_x) * _tile, y0 = int(t / _tiles_x) * _tile;
+        int x1 = std::min(x0 + _tile, _width), y1 = std::min(y0 + _tile, _height);
+        int64_t any = -1;
+        for (int y = y0; y < y1; y += 1) {
+            for (int x = x0; x < x1; x += 1) {
+                uint32_t i = uint32_t(_grid.index(x, y));
+                if (opened(i) || grid::atomic_test(_grid.mine_plane(), i))
+                    continue;
+                for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, _height - 1); ny += 1)
+                    for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, _width - 1); nx += 1)
+                        if (opened(uint32_t(_grid.index(nx, ny))))
+                            return i;
+                if (any < 0)
+                    any = i;
+            }
+        }
+        return any;
+    }
+
+    grid &_grid;
+    int _width;
+    int _height;
+    int _tile;
+    int _threads;
+    std::unique_ptr<sched::scheduler> _pool;
+    int _tiles_x;
+    int _tiles_y;
+    std::vector<tile_state> _tiles;
+    std::vector<grid::word> _known;     // 推出来的地雷
+    std::vector<uint32_t> _active;      // 这一轮要做的块
+    std::vector<uint32_t> _next;        // 下一轮要做的块
+    std::mutex _next_lock;
+    solver_stats _stats;
+};
@@ -0,0 +1,546 @@
+#pragma once
+
+// 多条蛇的对战场地和搜索AI
+//
+// 场地是一个紧凑的快照: 每个格子1字节，蛇身的格子记着往蛇头方向的下一节在哪个方向
+// (和cell的next_direction一个意思)，每条蛇只另外记蛇头、蛇尾和长度，复制一份只要几百字节。
+// 所有的蛇同时走一步(step())，规则:
+//   - 先收蛇尾(正在变长的蛇不收)，所以可以跟着别的蛇的尾巴走
+//   - 撞墙、撞到蛇身的蛇死掉，两个蛇头撞在一起时短的死，一样长时都死
+//   - 吃到苹果的蛇下一步开始变长一节，死掉的蛇从场地上消失
+//
+// bot用偏执(paranoid)的极小极大搜索: 自己取最大，离得近的几条蛇当作一个整体取最小，
+// 同时走一步算一层；离得远的蛇按简单的规则走。叶子上从所有蛇头同时做一次洪水填充，
+// 按谁先到划分地盘。每个根节点的走法交给一个线程做迭代加深，到时间就用所有走法都搜完的最深一层。
+// 线程来自common/scheduler.h，游戏在等结果，所以是high优先级的任务。
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "../common/scheduler.h"
+
+namespace arena {
+
+    /// 方向，和cell::DUp等的顺序一样，但是从0开始
+    enum : uint8_t { UP, RIGHT, DOWN, LEFT };
+    constexpr int DX[4] = {0, 1, 0, -1};
+    constexpr int DY[4] = {-1, 0, 1, 0};
+
+    constexpr int MAX_SNAKES = 8;
+    constexpr uint8_t CELL_BODY = 0x80;  // 低2位是往蛇头方向的下一节的方向，第2~4位是蛇的编号
+    constexpr uint8_t CELL_APPLE = 0x40;
+
+    struct snake_info {
+        uint16_t head = 0;
+        uint16_t tail = 0;
+        uint16_t length = 0;
+        uint8_t dir = UP;    // 上一步走的方向
+        uint8_t grow = 0;    // 还要变长几节
+        bool alive = false;
+    };
+
+    class field {
+    public:
+        field() : _width(0), _height(0), _count(0) {}
+
+        void reset(int width, int height) {
+            _width = width;
+            _height = height;
+            _count = 0;
+            _cells.assign(width * height, 0);
+        }
+
+        int get_width() const { return _width; }
+        int get_height() const { return _height; }
+        int get_count() const { return _count; }
+        const snake_info &get_snake(int id) const { return _snakes[id]; }
+        uint8_t at(int idx) const { return _cells[idx]; }
+        bool is_body(int idx) const { return _cells[idx] & CELL_BODY; }
+        bool is_apple(int idx) const { return _cells[idx] == CELL_APPLE; }
+        int owner(int idx) const { return (_cells[idx] >> 2) & 7; }
+
+        int alive_count() const {
+            int n = 0;
+            for ( int i = 0; i < _count; i += 1 )
+                n += _snakes[i].alive;
+            return n;
+        }
+
+        /// 从idx往dir走一步，出界时返回-1
+        int neighbour(int idx, int dir) const {
+            int x = idx % _width + DX[dir], y = idx / _width + DY[dir];
+            if ( x < 0 || y < 0 || x >= _width || y >= _height )
+                return -1;
+            return y * _width + x;
+        }
+
+        /// 放一条蛇，蛇头在(x, y)，身体往dir的反方向伸出去，返回编号
+        /// 蛇至少要有两节，放不下时会短一些
+        int add_snake(int x, int y, int dir, int length) {
+            int id = _count++;
+            snake_info &s = _snakes[id];
+            int back = (dir + 2) % 4;
+            int idx = y * _width + x;
+            s.head = uint16_t(idx);
+            s.dir = uint8_t(dir);
+            s.length = 1;
+            s.grow = 0;
+            s.alive = true;
+            _cells[idx] = uint8_t(CELL_BODY | id << 2 | dir);
+            for ( int i = 1; i < length; i += 1 ) {
+                int next = neighbour(idx, back);
+                if ( next < 0 || _cells[next] )
+                    break;
+                _cells[next] = uint8_t(CELL_BODY | id << 2 | dir);
+                idx = next;
+                s.length += 1;
+            }
+            s.tail = uint16_t(idx);
+            return id;
+        }
+
+        void put_apple(int idx) {
+            _cells[idx] = CELL_APPLE;
+        }
+
+        /// 不会马上往回走的方向
+        bool allowed(int id, int dir) const {
+            return dir != (_snakes[id].dir + 2) % 4;
+        }
+
+        /// 所有活着的蛇按moves同时走一步，返回吃掉的苹果数
+        int step(const uint8_t *moves) {
+            int target[MAX_SNAKES];
+            bool eats[MAX_SNAKES];
+            int eaten = 0;
+            for ( int i = 0; i < _count; i += 1 ) {
+                target[i] = -1;
+                eats[i] = false;
+                if ( !_snakes[i].alive )
+                    continue;
+                target[i] = neighbour(_snakes[i].head, moves[i]);
+                eats[i] = target[i] >= 0 && _cells[target[i]] == CELL_APPLE;
+            }
+
+            // 收蛇尾
+            for ( int i = 0; i < _count; i += 1 ) {
+                snake_info &s = _snakes[i];
+                if ( !s.alive )
+                    continue;
+                if ( s.grow > 0 ) {
+                    s.grow -= 1;
+                    s.length += 1;
+                } else {
+                    int next = neighbour(s.tail, _cells[s.tail] & 3);
+                    _cells[s.tail] = 0;
+                    s.tail = uint16_t(next);
+                }
+            }
+
+            // 撞墙、撞身体、撞头
+            bool dies[MAX_SNAKES];
+            for ( int i = 0; i < _count; i += 1 ) {
+                dies[i] = false;
+                if ( !_snakes[i].alive )
+                    continue;
+                int t = target[i];
+                if ( t < 0 || (_cells[t] & CELL_BODY) ) {
+                    dies[i] = true;
+                    continue;
+                }
+                for ( int j = 0; j < _count; j += 1 ) {
+                    if ( j != i && _snakes[j].alive && target[j] == t && _snakes[j].length >= _snakes[i].length )
+                        dies[i] = true;
+                }
+            }
+
+            for ( int i = 0; i < _count; i += 1 ) {
+                snake_info &s = _snakes[i];
+                if ( !s.alive || dies[i] )
+                    continue;
+                int t = target[i];
+                _cells[s.head] = uint8_t(CELL_BODY | i << 2 | moves[i]);
+                _cells[t] = uint8_t(CELL_BODY | i << 2 | moves[i]);
+                s.head = uint16_t(t);
+                s.dir = moves[i];
+                if ( eats[i] ) {
+                    s.grow += 1;
+                    eaten += 1;
+                }
+            }
+
+            for ( int i = 0; i < _count; i += 1 ) {
+                if ( dies[i] )
+                    remove(i);
+            }
+            return eaten;
+        }
+
+    protected:
+        /// 从蛇尾沿着身体走到蛇头，把格子清掉
+        void remove(int id) {
+            snake_info &s = _snakes[id];
+            int idx = s.tail;
+            for ( int n = 0; n < s.length && idx >= 0; n += 1 ) {
+                uint8_t c = _cells[idx];
+                if ( !(c & CELL_BODY) || ((c >> 2) & 7) != id )
+                    break;
+                _cells[idx] = 0;
+                if ( idx == s.head )
+                    break;
+                idx = neighbour(idx, c & 3);
+            }
+            s.alive = false;
+        }
+
+        int _width;
+        int _height;
+        int _count;
+        std::vector<uint8_t> _cells;
+        snake_info _snakes[MAX_SNAKES];
+    };
+
+    /// 离得远的蛇和搜索里不考虑的蛇的走法: 能直走就直走，否则转向空一点的一边
+    inline uint8_t default_move(const field &f, int id) {
+        const snake_info &s = f.get_snake(id);
+        int best = s.dir, best_score = -1;
+        for ( int k = 0; k < 3; k += 1 ) {
+            int d = (s.dir + (k == 0 ? 0 : k == 1 ? 1 : 3)) % 4;
+            int t = f.neighbour(s.head, d);
+            if ( t < 0 || f.is_body(t) )
+                continue;
+            int score = k == 0 ? 1 : 0;
+            for ( int e = 0; e < 4; e += 1 ) {
+                int n = f.neighbour(t, e);
+                score += n >= 0 && !f.is_body(n) ? 2 : 0;
+            }
+            if ( score > best_score ) {
+                best_score = score;
+                best = d;
+            }
+        }
+        return uint8_t(best);
+    }
+
+    struct bot_config {
+        std::chrono::microseconds budget = std::chrono::milliseconds(5);
+        int threads = 0;         // 0表示用共用的调度器，不会多于根节点的走法数
+        int max_depth = 32;
+        int opponents = 2;       // 最多把几条离得最近的蛇当作对手搜索
+    };
+
+    struct bot_stats {
+        int depth = 0;           // 所有走法都搜完的深度(同时走的步数)
+        uint64_t nodes = 0;
+        double seconds = 0;
+
+        double nodes_per_sec() const {
+            return seconds > 0 ? nodes / seconds : 0;
+        }
+    };
+
+    class bot {
+    public:
+        explicit bot(const bot_config &cfg = bot_config()) : _config(cfg) {
+            if ( _config.threads <= 0 ) {
+                _pool = &sched::scheduler::shared();
+            } else {
+                _own_pool = std::make_unique<sched::scheduler>(_config.threads - 1);
+                _pool = _own_pool.get();
+            }
+            _config.threads = _pool->concurrency();
+        }
+
+        const bot_config &get_config() const { return _config; }
+
+        /// 为第me条蛇选一个方向，最晚在budget之后返回(第一层一定搜完)
+        uint8_t choose(const field &f, int me, bot_stats *stats = nullptr) {
+            using clock = std::chrono::steady_clock;
+            auto beg = clock::now();
+            auto deadline = beg + _config.budget;
+
+            uint8_t moves[3];
+            int nmoves = 0;
+            for ( int d = 0; d < 4; d += 1 ) {
+                if ( f.allowed(me, d) )
+                    moves[nmoves++] = uint8_t(d);
+            }
+
+            // 离得最近的几条蛇是对手
+            int opps[MAX_SNAKES], nopps = 0;
+            for ( int i = 0; i < f.get_count(); i += 1 ) {
+                if ( i != me && f.get_snake(i).alive )
+                    opps[nopps++] = i;
+            }
+            int hx = f.get_snake(me).head % f.get_width(), hy = f.get_snake(me).head / f.get_width();
+            auto dist = [&](int id) {
+                int h = f.get_snake(id).head;
+                return std::abs(h % f.get_width() - hx) + std::abs(h / f.get_width() - hy);
+            };
+            std::sort(opps, opps + nopps, [&](int a, int b) { return dist(a) < dist(b); });
+            nopps = std::min(nopps, _config.opponents);
+            int opp_dist[MAX_SNAKES];
+            for ( int k = 0; k < nopps; k += 1 )
+                opp_dist[k] = dist(opps[k]);
+
+            int nthreads = std::min(_config.threads, nmoves);
+            while ( int(_workers.size()) < nthreads )
+                _workers.emplace_back(new worker());
+
+            // 每个走法每一层搜出来的值，数组留着下次用，每步不用再分配
+            _values.assign(size_t(nmoves) * (_config.max_depth + 1), 0);
+            double *values = _values.data();
+            int done[3] = {0, 0, 0};
+            std::atomic<uint64_t> nodes(0);
+
+            auto work = [&](int t) {
+                worker &w = *_workers[t];
+                w.prepare(f, me, opps, opp_dist, nopps, _config.max_depth, deadline);
+                for ( int depth = 1; depth <= _config.max_depth; depth += 1 ) {
+                    bool finished = true;
+                    for ( int m = t; m < nmoves; m += nthreads ) {
+                        double v = w.root(moves[m], depth);
+                        if ( w.aborted() ) {
+                            finished = false;
+                            break;
+                        }
+                        values[size_t(m) * (_config.max_depth + 1) + depth] = v;
+                        done[m] = depth;
+                    }
+                    if ( !finished || clock::now() >= deadline )
+                        break;
+                }
+                nodes.fetch_add(w.nodes(), std::memory_order_relaxed);
+            };
+
+            sched::task_group group(*_pool, sched::priority::high);
+            for ( int t = 1; t < nthreads; t += 1 )
+                group.run([&work, t] { work(t); });
+            work(0);
+            group.wait();
+
+            int depth = _config.max_depth;
+            for ( int m = 0; m < nmoves; m += 1 )
+                depth = std::min(depth, done[m]);
+            int best = 0;
+            for ( int m = 1; m < nmoves; m += 1 ) {
+                if ( values[size_t(m) * (_config.max_depth + 1) + depth] > values[size_t(best) * (_config.max_depth + 1) + depth] )
+                    best = m;
+            }
+
+            if ( stats ) {
+                stats->depth = depth;
+                stats->nodes = nodes.load();
+                stats->seconds = std::chrono::duration<double>(clock::now() - beg).count();
+            }
+            return moves[best];
+        }
+
+    private:
+        static constexpr double WIN = 1e6;
+
+        /// 一个线程的搜索状态，每一层的场地都预先分配好
+        class worker {
+        public:
+            void prepare(const field &f, int me, const int *opps, const int *opp_dist, int nopps, int max_depth,
+                         std::chrono::steady_clock::time_point deadline) {
+                _root = f;
+                _me = me;
+                _nopps = nopps;
+                std::copy(opps, opps + nopps, _opps);
+                std::copy(opp_dist, opp_dist + nopps, _opp_dist);
+                _deadline = deadline;
+                _nodes = 0;
+                _abort = false;
+                if ( int(_ply.size()) < max_depth + 1 )
+                    _ply.resize(max_depth + 1);
+                int n = f.get_width() * f.get_height();
+                _dist.assign(n, 0);
+                _owner.assign(n, 0);
+                _queue.resize(n);
+            }
+
+            bool aborted() const { return _abort; }
+            uint64_t nodes() const { return _nodes; }
+
+            /// 根节点走mv，搜depth层
+            double root(uint8_t mv, int depth) {
+                // 第一层不检查时间，保证一定有结果
+                _check_time = depth > 1;
+                _abort = false;
+                // 蛇头之间每层最多近两格，搜索的范围里碰不到的蛇按默认的走法走，不用展开
+                _nactive = 0;
+                while ( _nactive < _nopps && _opp_dist[_nactive] <= 2 * depth + 2 )
+                    _nactive += 1;
+                return min_node(_root, mv, depth, 0, -WIN * 2, WIN * 2);
+            }
+
+        private:
+            /// 每个节点都要做几微秒的洪水填充，相比之下每次都看一下时间很便宜
+            bool out_of_time() {
+                ++_nodes;
+                if ( _check_time && std::chrono::steady_clock::now() >= _deadline )
+                    _abort = true;
+                return _abort;
+            }
+
+            /// 对手一起选走法，取对自己最坏的
+            double min_node(const field &f, uint8_t mv, int depth, int ply, double alpha, double beta) {
+                uint8_t moves[MAX_SNAKES];
+                for ( int i = 0; i < f.get_count(); i += 1 )
+                    moves[i] = f.get_snake(i).alive ? default_move(f, i) : 0;
+                moves[_me] = mv;
+
+                // 活着的对手的所有走法组合，每条蛇3个方向
+                int live[MAX_SNAKES], nlive = 0;
+                for ( int k = 0; k < _nactive; k += 1 ) {
+                    if ( f.get_snake(_opps[k]).alive )
+                        live[nlive++] = _opps[k];
+                }
+                int combos = 1;
+                for ( int k = 0; k < nlive; k += 1 )
+                    combos *= 3;
+
+                double best = WIN * 2;
+                field &child = _ply[ply];
+                for ( int c = 0; c < combos; c += 1 ) {
+                    int code = c;
+                    for ( int k = 0; k < nlive; k += 1 ) {
+                        const snake_info &s = f.get_snake(live[k]);
+                        int turn = code % 3;
+                        code /= 3;
+                        // 先试默认的走法
+                        int d = turn == 0 ? default_move(f, live[k]) : (default_move(f, live[k]) + (turn == 1 ? 1 : 3)) % 4;
+                        if ( d == (s.dir + 2) % 4 )
+                            d = s.dir;
+                        moves[live[k]] = uint8_t(d);
+                    }
+                    child = f;
+                    child.step(moves);
+                    double v = max_node(child, depth - 1, ply + 1, alpha, beta);
+                    if ( _abort )
+                        return 0;
+                    best = std::min(best, v);
+                    beta = std::min(beta, v);
+                    if ( alpha >= beta )
+                        break;
+                }
+                return best;
+            }
+
+            double max_node(const field &f, int depth, int ply, double alpha, double beta) {
+                if ( out_of_time() )
+                    return 0;
+                if ( !f.get_snake(_me).alive )
+                    return -WIN + ply; // 晚死比早死好
+                bool any_opp = false;
+                for ( int i = 0; i < f.get_count(); i += 1 )
+                    any_opp = any_opp || (i != _me && f.get_snake(i).alive);
+                if ( !any_opp )
+                    return WIN - ply;
+                if ( depth == 0 )
+                    return evaluate(f);
+
+                double best = -WIN * 2;
+                for ( int d = 0; d < 4; d += 1 ) {
+                    if ( !f.allowed(_me, d) )
+                        continue;
+                    double v = min_node(f, uint8_t(d), depth, ply, alpha, beta);
+                    if ( _abort )
+                        return 0;
+                    best = std::max(best, v);
+                    alpha = std::max(alpha, v);
+                    if ( alpha >= beta )
+                        break;
+                }
+                return best;
+            }
+
+            /// 从所有蛇头同时洪水填充，先到的蛇占那个格子，同时到的格子谁也不算
+            double evaluate(const field &f) {
+                int area[MAX_SNAKES] = {0};
+                int apple_dist = -1;
+                int hx = f.get_snake(_me).head % f.get_width(), hy = f.get_snake(_me).head / f.get_width();
+                std::fill(_owner.begin(), _owner.end(), uint8_t(0xff));
+                size_t qh = 0, qt = 0;
+                for ( int i = 0; i < f.get_count(); i += 1 ) {
+                    if ( !f.get_snake(i).alive )
+                        continue;
+                    int h = f.get_snake(i).head;
+                    _owner[h] = uint8_t(i);
+                    _dist[h] = 0;
+                    _queue[qt++] = h;
+                }
+                while ( qh < qt ) {
+                    int idx = _queue[qh++];
+                    uint8_t o = _owner[idx];
+                    if ( o == 0xfe )
+                        continue;
+                    for ( int d = 0; d < 4; d += 1 ) {
+                        int t = f.neighbour(idx, d);
+                        if ( t < 0 || f.is_body(t) )
+                            continue;
+                        if ( _owner[t] == 0xff ) {
+                            _owner[t] = o;
+                            _dist[t] = _dist[idx] + 1;
+                            _queue[qt++] = t;
+                            area[o] += 1;
+                            // 不管谁先到，离自己最近的苹果(直线距离)
+                            if ( f.is_apple(t) ) {
+                                int ad = std::abs(t % f.get_width() - hx) + std::abs(t / f.get_width() - hy);
+                                if ( apple_dist < 0 || ad < apple_dist )
+                                    apple_dist = ad;
+                            }
+                        } else if ( _owner[t] != o && _owner[t] < 0xfe && _dist[t] == _dist[idx] + 1 ) {
+                            area[_owner[t]] -= 1;
+                            _owner[t] = 0xfe;
+                        }
+                    }
+                }
+
+                const snake_info &s = f.get_snake(_me);
+                int opp_area = 0, opp_len = 0;
+                for ( int i = 0; i < f.get_count(); i += 1 ) {
+                    if ( i == _me || !f.get_snake(i).alive )
+                        continue;
+                    opp_area = std::max(opp_area, area[i]);
+                    opp_len = std::max(opp_len, int(f.get_snake(i).length + f.get_snake(i).grow));
+                }
+                double v = 0.25 * (area[_me] - opp_area) + 40.0 * (int(s.length + s.grow) - opp_len);
+                // 被关在比自己还小的地方基本上是死路
+                if ( area[_me] < s.length )
+                    v -= 2000 + 50.0 * (s.length - area[_me]);
+                if ( apple_dist >= 0 )
+                    v -= 4.0 * apple_dist;
+                return v;
+            }
+
+            field _root;
+            int _me = 0;
+            int _opps[MAX_SNAKES];     // 按离自己的距离排好
+            int _opp_dist[MAX_SNAKES];
+            int _nopps = 0;
+            int _nactive = 0;          // 这一次搜索里展开走法的对手
+            std::vector<field> _ply;
+            std::vector<int> _dist;
+            std::vector<uint8_t> _owner;
+            std::vector<int> _queue;
+            std::chrono::steady_clock::time_point _deadline;
+            uint64_t _nodes = 0;
+            bool _abort = false;
+            bool _check_time = false;
+        };
+
+        bot_config _config;
+        std::unique_ptr<sched::scheduler> _own_pool;
+        sched::scheduler *_pool;
+        std::vector<std::unique_ptr<worker>> _workers;
+        std::vector<double> _values;
+    };
+
+} // namespace arena
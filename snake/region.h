@@ -0,0 +1,363 @@
+#pragma once
+
+// 贪吃蛇空闲格子的连通性，用来保证苹果出在蛇头走得到的地方
+//
+// 空闲的格子(空格子、苹果和蛇头)按上下左右连通，用并查集维护:
+//   - 格子变空闲(蛇尾离开)时给它一个新的节点，和空闲的邻居合并
+//   - 格子被占用(蛇身)时看它周围一圈的8个格子，空闲的邻居在这一圈上还连在一起时
+//     去掉它不会把连通块分开，并查集仍然是准确的，只把连通块的大小减一；
+//     否则从上下左右的邻居同时广度优先搜索(split_off())，搜到一起的还连着，
+//     先搜完的一边是分出去的连通块，给它一个新的根，代价和分出去的小块(或者两边绕过来碰上的路)
+//     差不多大。搜的格子超过格子数的1/4(最多1024个)时放弃，标记为过期，等到要用的时候再从头重建，
+//     大场地上绕远路才碰上的情况不值得搜
+// 节点只增不减，用掉的节点超过格子数的两倍时也重建一次。
+// 每个tick只有蛇头后面和蛇尾两个格子变化，大多数tick是常数时间，
+// 40x40的场地上平均每个格子变化约0.2微秒，每个tick约0.4微秒(common/kernel_bench.cc的snake-regions，
+// 长100的蛇随机地走，每个tick还问一次连通性)；1024x1024和4096x4096上每个tick也在1微秒以内。
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../common/tracepoints.h"
+
+class free_regions {
+public:
+    free_regions() : _width(0), _height(0), _dirty(false), _rebuilds(0), _stale_ops(0), _epoch(0) {}
+
+    /// 所有格子都是空闲的
+    void reset(int width, int height) {
+        _width = width;
+        _height = height;
+        _open.assign(width * height, 1);
+        _node.assign(width * height, -1);
+        _seen.assign(width * height, 0);
+        rebuild();
+    }
+
+    int get_width() const { return _width; }
+    int get_height() const { return _height; }
+    bool is_open(int idx) const { return _open[idx] != 0; }
+    bool dirty() const { return _dirty; }
+    uint64_t rebuilds() const { return _rebuilds; }
+
+    /// 格子变为空闲或者被占用，状态没变时什么也不做
+    void set_open(int idx, bool open) {
+        if ( (_open[idx] != 0) == open )
+            return;
+        if ( _dirty )
+            _stale_ops += 1;
+        if ( open ) {
+            _open[idx] = 1;
+            if ( _parent.size() >= _open.size() * 2 + 16 ) {
+                rebuild();
+                return;
+            }
+            _node[idx] = new_node();
+            int x = idx % _width, y = idx / _width;
+            if ( x > 0 && _open[idx - 1] )
+                unite(_node[idx], _node[idx - 1]);
+            if ( x + 1 < _width && _open[idx + 1] )
+                unite(_node[idx], _node[idx + 1]);
+            if ( y > 0 && _open[idx - _width] )
+                unite(_node[idx], _node[idx - _width]);
+            if ( y + 1 < _height && _open[idx + _width] )
+                unite(_node[idx], _node[idx + _width]);
+        } else {
+            _open[idx] = 0;
+            if ( !_dirty ) {
+                if ( !splits(idx) )
+                    _size[find(_node[idx])] -= 1;
+                else if ( !split_off(idx, std::min(_open.size() / 4, size_t(1024))) )
+                    _dirty = true;
+            }
+            _node[idx] = -1;
+        }
+    }
+
+    /// a和b是否连通，过期时先重建
+    bool connected(int a, int b) {
+        if ( _dirty )
+            rebuild();
+        return _open[a] && _open[b] && find(_node[a]) == find(_node[b]);
+    }
+
+    /// 过期以后又变化了stale_ops次时重建，用来定期检查已经放下的苹果
+    bool refresh_if_stale(uint64_t stale_ops) {
+        if ( !_dirty || _stale_ops < stale_ops )
+            return false;
+        rebuild();
+        return true;
+    }
+
+    /// 在from所在的连通块里均匀地选一个满足pick的格子，没有时返回-1
+    /// 连通块大时随机撒点，小时从from开始广度优先遍历，代价和连通块的大小相比较小的那个差不多
+    template <class Pred, class Rng>
+    int sample(int from, Pred pick, Rng &rng) {
+        if ( _dirty )
+            rebuild();
+        if ( !_open[from] )
+            return -1;
+        int root = find(_node[from]);
+        int total = _width * _height;
+
+        if ( _size[root] * 8 >= total ) {
+            std::uniform_int_distribution<int> any(0, total - 1);
+            for ( int tries = 0; tries < 64; tries += 1 ) {
+                int idx = any(rng);
+                if ( _open[idx] && pick(idx) && find(_node[idx]) == root )
+                    return idx;
+            }
+        }
+
+        // 连通块小，或者里面可选的格子很少
+        _epoch += 1;
+        if ( _epoch == 0 ) {
+            std::fill(_seen.begin(), _seen.end(), 0);
+            _epoch = 1;
+        }
+        _queue.clear();
+        _picks.clear();
+        _queue.push_back(from);
+        _seen[from] = _epoch;
+        for ( size_t head = 0; head < _queue.size(); head += 1 ) {
+            int idx = _queue[head];
+            if ( pick(idx) )
+                _picks.push_back(idx);
+            int x = idx % _width, y = idx / _width;
+            if ( x > 0 )
+                visit(idx - 1);
+            if ( x + 1 < _width )
+                visit(idx + 1);
+            if ( y > 0 )
+                visit(idx - _width);
+            if ( y + 1 < _height )
+                visit(idx + _width);
+        }
+        if ( _picks.empty() )
+            return -1;
+        std::uniform_int_distribution<size_t> which(0, _picks.size() - 1);
+        return _picks[which(rng)];
+    }
+
+    /// 从头重建并查集
+    void rebuild() {
+        _parent.clear();
+        _size.clear();
+        int touched = 0;
+        for ( int idx = 0; idx < _width * _height; idx += 1 ) {
+            _node[idx] = _open[idx] ? new_node() : -1;
+            if ( !_open[idx] )
+                continue;
+            touched += 1;
+            if ( idx % _width > 0 && _open[idx - 1] )
+                unite(_node[idx], _node[idx - 1]);
+            if ( idx >= _width && _open[idx - _width] )
+                unite(_node[idx], _node[idx - _width]);
+        }
+        _dirty = false;
+        _stale_ops = 0;
+        _rebuilds += 1;
+        SIMPLEGAMES_PROBE2(flood_fill, _width * _height, touched);
+    }
+
+protected:
+    int new_node() {
+        int id = static_cast<int>(_parent.size());
+        _parent.push_back(id);
+        _size.push_back(1);
+        return id;
+    }
+
+    int find(int v) {
+        while ( _parent[v] != v ) {
+            _parent[v] = _parent[_parent[v]];
+            v = _parent[v];
+        }
+        return v;
+    }
+
+    void unite(int a, int b) {
+        a = find(a);
+        b = find(b);
+        if ( a == b )
+            return;
+        if ( _size[a] < _size[b] )
+            std::swap(a, b);
+        _parent[b] = a;
+        _size[a] += _size[b];
+    }
+
+    void visit(int idx) {
+        if ( _open[idx] && _seen[idx] != _epoch ) {
+            _seen[idx] = _epoch;
+            _queue.push_back(idx);
+        }
+    }
+
+    bool open_at(int x, int y) const {
+        return x >= 0 && y >= 0 && x < _width && y < _height && _open[y * _width + x];
+    }
+
+    /// idx刚被占用(_open已经清掉，_node还在)，它的上下左右邻居可能分到了不同的连通块:
+    /// 从每个邻居轮流一次展开一个格子，碰到别的邻居搜过的格子就说明两边还连着，合成一组；
+    /// 一组的队列空了就是搜完了一整个连通块，给它一个新的根。只剩一组还在搜时停下，它留着原来的根。
+    /// 搜过的格子超过limit时放弃，返回false(已经分出去的块是准确的，但原来的根的大小不对了)
+    bool split_off(int idx, size_t limit) {
+        int old_root = find(_node[idx]);
+        int n = 0;
+        int x = idx % _width, y = idx / _width;
+        int seeds[4];
+        if ( x > 0 && _open[idx - 1] )
+            seeds[n++] = idx - 1;
+        if ( x + 1 < _width && _open[idx + 1] )
+            seeds[n++] = idx + 1;
+        if ( y > 0 && _open[idx - _width] )
+            seeds[n++] = idx - _width;
+        if ( y + 1 < _height && _open[idx + _width] )
+            seeds[n++] = idx + _width;
+
+        // 第k个邻居搜过的格子在_seen里记为base + k
+        if ( _epoch > UINT32_MAX - 8 ) {
+            std::fill(_seen.begin(), _seen.end(), 0);
+            _epoch = 0;
+        }
+        uint32_t base = _epoch + 1;
+        _epoch += 4;
+        int group[4];
+        bool done[4] = {false, false, false, false};
+        size_t head[4] = {0, 0, 0, 0};
+        for ( int k = 0; k < n; k += 1 ) {
+            group[k] = k;
+            _fronts[k].clear();
+            _fronts[k].push_back(seeds[k]);
+            _seen[seeds[k]] = base + k;
+        }
+        auto root_of = [&](int k) {
+            while ( group[k] != k )
+                k = group[k];
+            return k;
+        };
+
+        size_t visited = n;
+        int removed = 1;
+        while ( true ) {
+            // 队列都空了的组是分出去的连通块
+            int live = 0;
+            for ( int g = 0; g < n; g += 1 ) {
+                if ( root_of(g) != g || done[g] )
+                    continue;
+                bool active = false;
+                for ( int k = 0; k < n; k += 1 )
+                    active = active || (root_of(k) == g && head[k] < _fronts[k].size());
+                if ( active ) {
+                    live += 1;
+                    continue;
+                }
+                done[g] = true;
+                int r = new_node();
+                _size[r] = 0;
+                for ( int k = 0; k < n; k += 1 ) {
+                    if ( root_of(k) != g )
+                        continue;
+                    for ( int c : _fronts[k] )
+                        _node[c] = r;
+                    _size[r] += int(_fronts[k].size());
+                }
+                removed += _size[r];
+            }
+            if ( live <= 1 )
+                break;
+            if ( visited > limit )
+                return false;
+
+            for ( int k = 0; k < n; k += 1 ) {
+                if ( head[k] >= _fronts[k].size() || done[root_of(k)] )
+                    continue;
+                int c = _fronts[k][head[k]++];
+                int cx = c % _width, cy = c / _width;
+                int around[4], m = 0;
+                if ( cx > 0 )
+                    around[m++] = c - 1;
+                if ( cx + 1 < _width )
+                    around[m++] = c + 1;
+                if ( cy > 0 )
+                    around[m++] = c - _width;
+                if ( cy + 1 < _height )
+                    around[m++] = c + _width;
+                for ( int i = 0; i < m; i += 1 ) {
+                    int nb = around[i];
+                    if ( !_open[nb] )
+                        continue;
+                    if ( _seen[nb] < base || _seen[nb] >= base + 4 ) {
+                        _seen[nb] = base + k;
+                        _fronts[k].push_back(nb);
+                        visited += 1;
+                    } else {
+                        int a = root_of(k), b = root_of(int(_seen[nb] - base));
+                        if ( a != b )
+                            group[std::max(a, b)] = std::min(a, b);
+                    }
+                }
+            }
+        }
+        _size[old_root] -= removed;
+        return true;
+    }
+
+    /// 去掉idx以后它空闲的上下左右邻居是否可能不再连通
+    /// 沿周围一圈的8个格子走，空闲的格子连成几段，含有上下左右邻居的段超过一段时可能分开
+    bool splits(int idx) const {
+        static const int ring[8][2] = {{0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}};
+        int x = idx % _width, y = idx / _width;
+        bool open[8];
+        for ( int i = 0; i < 8; i += 1 )
+            open[i] = open_at(x + ring[i][0], y + ring[i][1]);
+
+        // 从一个不空闲的格子开始走，这样每一段都是完整的
+        int start = -1;
+        for ( int i = 0; i < 8; i += 1 ) {
+            if ( !open[i] ) {
+                start = i;
+                break;
+            }
+        }
+        if ( start < 0 )
+            return false;
+
+        int arcs = 0;
+        bool in_arc = false, has_side = false;
+        for ( int k = 1; k <= 8; k += 1 ) {
+            int i = (start + k) % 8;
+            if ( open[i] ) {
+                in_arc = true;
+                has_side = has_side || i % 2 == 0;
+            } else if ( in_arc ) {
+                arcs += has_side;
+                in_arc = false;
+                has_side = false;
+            }
+        }
+        return arcs > 1;
+    }
+
+    int _width;
+    int _height;
+    std::vector<uint8_t> _open;
+    std::vector<int> _node;   // 格子对应的并查集节点，不空闲时是-1
+    std::vector<int> _parent;
+    std::vector<int> _size;   // 根节点上是连通块里空闲格子的个数
+    bool _dirty;
+    uint64_t _rebuilds;
+    uint64_t _stale_ops;
+
+    // sample()的临时空间
+    std::vector<uint32_t> _seen;
+    uint32_t _epoch;
+    std::vector<int> _queue;
+    std::vector<int> _picks;
+
+    // split_off()每个邻居的队列
+    std::vector<int> _fronts[4];
+};
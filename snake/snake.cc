@@ -1,3 +1,5 @@
+#define NCURSES_WIDECHAR 1
+
 #include <string>
 #include <exception>
 #include <locale>
@@ -12,6 +14,16 @@
 #include "unicode/utypes.h"
 #include "unicode/ucnv.h"
 
+#include "../common/alloc_stats.h"
+#include "../common/frame_arena.h"
+#include "../common/spectate.h"
+#include "../common/frame_pacer.h"
+#include "../common/output_budget.h"
+#include "../common/startup_timer.h"
+#include "../common/tracepoints.h"
+#include "region.h"
+#include "arena.h"
+
 bool UI_LOCK = false;
 
 int get_string_width(const std::string &str) {
@@ -154,6 +166,7 @@ public:
         _height(height),
         _head_pos(-1, -1) {
         _grid = new cell[width * height]();
+        _regions.reset(width, height);
     }
     
     ~grid() {
@@ -220,35 +233,54 @@ public:
     int add_apple() {
         return add_apple(false);
     }
+    /// 放一个苹果，只放在蛇头走得到的空格子上
+    /// force为false时已经有苹果就不放
+    /// @return 0: 放下了 1: 已经有苹果 2: 蛇头走得到的地方没有空格子了
     int add_apple(bool force) {
-        static std::uniform_int_distribution<int> wr(0, _width - 1), hr(0, _height - 1);
         static std::default_random_engine r(time(NULL));
         
-        bool haveblank = false;
-        for (int x = 0; x < _width; x += 1) {
-            for (int y = 0; y < _height; y += 1) {
-                int s = at(position(x, y)).get_status();
-                if ( s == cell::Empty ) {
-                    haveblank = true;
-                } else if ( s == cell::Apple && !force) {
-                    return 1;
+        if ( !force ) {
+            // 苹果被蛇头圈在外面时挪到走得到的地方，检查跟着定期的重建走，不用每个tick都重建
+            int head = index_of(_head_pos);
+            bool checked = _regions.refresh_if_stale(_width * _height / 16) || !_regions.dirty();
+            for ( size_t i = 0; i < _apples.size(); ) {
+                cell &c = _grid[_apples[i]];
+                if ( c.get_status() != cell::Apple ) {
+                    _apples[i] = _apples.back();
+                    _apples.pop_back();
+                } else if ( checked && !_regions.connected(head, _apples[i]) ) {
+                    c.set_status( cell::Empty );
+                    _apples[i] = _apples.back();
+                    _apples.pop_back();
+                } else {
+                    i += 1;
                 }
             }
+            if ( !_apples.empty() )
+                return 1;
         }
         
-        if ( !haveblank )
+        int idx = _regions.sample(index_of(_head_pos), [this](int i) {
+            return _grid[i].get_status() == cell::Empty;
+        }, r);
+        if ( idx < 0 )
             return 2;
-        position pos(0, 0);
-        do {
-            pos.x = wr(r);
-            pos.y = hr(r);
-        } while ( at(pos).get_status() != cell::Empty);
         
-        at(pos).set_status( cell::Apple );
+        _grid[idx].set_status( cell::Apple );
+        _apples.push_back(idx);
         
         return 0;
     }
     
+    /// 格子的状态变了以后调用，更新空闲格子的连通性
+    /// 每个tick只需要对蛇头原来的位置和蛇尾离开的位置调用
+    void sync_region(const position &pos) {
+        int s = at(pos).get_status();
+        _regions.set_open(index_of(pos), s == cell::Empty || s == cell::Apple || s == cell::SnakeHead);
+    }
+    
+    const free_regions& get_regions() { return _regions; }
+    
 protected:
     int _width;
     int _height;
@@ -256,6 +288,10 @@ protected:
     position _head_pos;
     cell* _grid;
     int _hided_bodies;
+    free_regions _regions;
+    std::vector<int> _apples;
+    
+    int index_of(const position &pos) { return pos.y * _width + pos.x; }
 };
 
 
@@ -264,9 +300,11 @@ class game {
 public:
     game(grid* v) :
         _grid(v),
+        _inited(false),
+        _debug(false),
         cfg_fix_rect(false),
         cfg_hardness(3),
-        _inited(false) {
+        cfg_pause_unfocused(false) {
         _grid->put_snake(3);
     }
     
@@ -282,6 +320,7 @@ public:
             curs_set(0);
             keypad(stdscr, 1);
             keypad(_scr, 1);
+            _focus.enable();
             
             _inited = true;
         }
@@ -311,13 +350,90 @@ public:
             k = -1,
             score = 0;
             
-        std::chrono::microseconds frame_time(static_cast<int64_t>(1 / static_cast<double>(cfg_hardness) * 1000000)), timer(0);
+        // 画整个棋盘，开始时先画一帧，之后每个tick画一帧
+        auto draw_board = [&]() {
+                SIMPLEGAMES_PROBE2(frame_begin, COLS, LINES);
+                werase(_scr);
+                erase();
+                
+                wborder(_scr, 0, 0, 0, 0, 0, 0, 0, 0);
+                
+                // 输出所有内容
+                for ( int x = 0; x < width; x += 1 ) {
+                    for ( int y = 0; y < height; y += 1 ) {
+                        int realx = x * k1 + 1;
+                        int realy = y + 1;
+                        switch(_grid->at(position(x, y)).get_status()) {
+                        case cell::Empty:
+                            mvwaddstr(_scr, realy, realx, blank);
+                            break;
+                        case cell::Apple:
+                            mvwaddstr(_scr, realy, realx, apple);
+                            break;
+                        case cell::Wall:
+                            mvwaddstr(_scr, realy, realx, wall);
+                            break;
+                        case cell::SnakeBody:
+                            mvwaddstr(_scr, realy, realx, body);
+                            break;
+                        case cell::SnakeHead:
+                            mvwaddstr(_scr, realy, realx, head);
+                            break;
+                        }
+                    }
+                }
+                // 判断屏幕尺寸，输出分数和运行时间
+                //strftime
+                
+                if (_debug) {
+                    // 上一个tick的内存分配情况和帧率
+                    char buf[160];
+                    snprintf(buf, sizeof(buf), "regions: rebuilds=%llu%s",
+                             (unsigned long long)_grid->get_regions().rebuilds(), _grid->get_regions().dirty() ? " (stale)" : "");
+                    mvaddstr(LINES - 5, 0, buf);
+                    _budget.format_stats(buf, sizeof(buf));
+                    mvaddstr(LINES - 4, 0, buf);
+                    _pacer.format_stats(buf, sizeof(buf));
+                    mvaddstr(LINES - 3, 0, buf);
+                    _alloc_stats.format_overlay(buf, sizeof(buf));
+                    mvaddstr(LINES - 2, 0, buf);
+                    _alloc_stats.format_phases(buf, sizeof(buf));
+                    mvaddstr(LINES - 1, 0, buf);
+                }
+                
+                _alloc_stats.phase("refresh");
+                // stdscr和_scr合成一次doupdate()，否则先刷新擦空的stdscr会让终端真的清一遍整个区域
+                wnoutrefresh(stdscr);
+                wnoutrefresh(_scr);
+                // 要在doupdate()清掉改过的行的标记之前
+                _spectate.publish();
+                flush_output();
+                SIMPLEGAMES_PROBE2(frame_end, COLS, LINES);
+        };
+        
+        draw_board();
+        if ( startup::global().first_frame() )
+            return;
+        
+        std::chrono::microseconds frame_time(static_cast<int64_t>(1 / static_cast<double>(cfg_hardness) * 1000000));
+        auto next_tick = std::chrono::steady_clock::now() + frame_time;
         while (1) {
         
+            // 上一帧超出了输出预算还没发出去
+            if ( _output_pending )
+                flush_output();
+            
             static auto process_key = [&]() -> int {
                 cell &headc = _grid->get_head();
                 int headd = headc.get_direction();
                 k = wgetch(_scr);
+                if ( k != ERR )
+                    SIMPLEGAMES_PROBE1(input, k);
+                _pacer.wakeup();
+                if ( _focus.handle_key(k) ) {
+                    _pacer.set_focused(_focus.focused());
+                    return 0;
+                }
                 if ( k == 'q' ) {
                     return 1;
                 } else if ( k == KEY_UP && headd != cell::DDown ) {
@@ -335,14 +451,22 @@ public:
                     _grid->at(tmp).set_status( cell::Apple );
                     */
                     _grid->add_apple(true);
+                } else if ( k == '\x04' ) {
+                    _debug = !_debug;
                 }
                 return 0;
             };
             
-            auto beg_time = std::chrono::steady_clock::now();
+            // 失去焦点时模拟照常进行(除非开启了cfg_pause_unfocused)，只是少画几帧
+            bool simulate = _focus.focused() || !cfg_pause_unfocused;
+            auto now = std::chrono::steady_clock::now();
             
-            if ( timer > frame_time ) {
-                timer = std::chrono::microseconds(0);
+            if ( simulate && now >= next_tick ) {
+                next_tick += frame_time;
+                if ( next_tick < now )
+                    next_tick = now + frame_time;
+                _alloc_stats.begin();
+                _alloc_stats.phase("logic");
             
                 win_x = COLS < width*k1 ? 0 : static_cast<int>((COLS - width*k1 + 2) / 2);
                 win_y = LINES < height*k1 ? 0 : 5;
@@ -352,6 +476,7 @@ public:
                     last_y = win_y;
                 }
                 
+                wtimeout(_scr, 0);
                 if (process_key())
                     break;
                 
@@ -360,6 +485,7 @@ public:
                 bool skip_move_body = false;
                 cell &head_cell = _grid->get_head();
                 position pos = _grid->get_head_pos();
+                position head_from(pos), tail_from(-1, -1);
                 int nd = head_cell.get_next_direction();
                 int d = head_cell.get_direction();
                 
@@ -400,6 +526,7 @@ public:
                             if ( src.get_status() != cell::SnakeBody )
                                 break;
                             _grid->move(pos, get_opposite_direction(nd), true);
+                            tail_from = pos;
                             nd = src.get_next_direction();
                         } catch(overflow_error &err) {
                             _render_gameover(err.what());
@@ -408,50 +535,33 @@ public:
                     }
                 }
                 
+                // 这个tick里只有蛇头原来的位置和蛇尾离开的位置变了是否空闲
+                _grid->sync_region(head_from);
+                if ( tail_from.x >= 0 )
+                    _grid->sync_region(tail_from);
                 _grid->add_apple();
+                SIMPLEGAMES_PROBE3(tick, score, width * height, skip_move_body);
                 
-                werase(_scr);
-                erase();
-                
-                wborder(_scr, 0, 0, 0, 0, 0, 0, 0, 0);
-                
-                // 输出所有内容
-                for ( int x = 0; x < width; x += 1 ) {
-                    for ( int y = 0; y < height; y += 1 ) {
-                        int realx = x * k1 + 1;
-                        int realy = y + 1;
-                        switch(_grid->at(position(x, y)).get_status()) {
-                        case cell::Empty:
-                            mvwaddstr(_scr, realy, realx, blank);
-                            break;
-                        case cell::Apple:
-                            mvwaddstr(_scr, realy, realx, apple);
-                            break;
-                        case cell::Wall:
-                            mvwaddstr(_scr, realy, realx, wall);
-                            break;
-                        case cell::SnakeBody:
-                            mvwaddstr(_scr, realy, realx, body);
-                            break;
-                        case cell::SnakeHead:
-                            mvwaddstr(_scr, realy, realx, head);
-                            break;
-                        }
-                    }
+                if ( !_pacer.frame_due(now) ) {
+                    _alloc_stats.end(k == ERR);
+                    continue;
                 }
-                // 判断屏幕尺寸，输出分数和运行时间
-                //strftime
+                _pacer.frame_done(now);
                 
-                refresh();
-                wrefresh(_scr);
+                _alloc_stats.phase("draw");
+                draw_board();
+                _alloc_stats.end(k == ERR);
             } else {
+                // 睡到下一个tick或者有按键为止，暂停时一直等到有按键
+                auto deadline = simulate ? next_tick : std::chrono::steady_clock::time_point::max();
+                if ( _output_pending )
+                    deadline = std::min(deadline, _budget.retry_at());
+                wtimeout(_scr, _pacer.timeout_ms(now, deadline));
                 if (process_key())
                     break;
+                if (!simulate)
+                    next_tick = std::chrono::steady_clock::now() + frame_time;
             }
-                
-            auto end_time = std::chrono::steady_clock::now();
-            
-            timer += std::chrono::duration_cast<std::chrono::microseconds>(end_time - beg_time);
         } // while (1)
     } // void _render_game()
     
@@ -459,39 +569,377 @@ public:
         WINDOW* win;
     }
     
+    void cleanup() {
+        _focus.disable();
+    }
+    
+    const alloc_stats::frame_stats& get_alloc_stats() { return _alloc_stats; }
+    const pacing::frame_pacer& get_pacer() { return _pacer; }
+    const pacing::output_budget& get_output_budget() { return _budget; }
+    
 protected:
+    /// 在输出预算允许时把积攒的变化发给终端，不允许时留到下一帧合在一起发
+    void flush_output() {
+        auto beg = std::chrono::steady_clock::now();
+        _output_pending = !_budget.admit(beg);
+        if ( _output_pending )
+            return;
+        doupdate();
+        _budget.sent(beg, std::chrono::steady_clock::now());
+    }
+    
     grid* _grid;
     WINDOW* _scr;
     
     bool _inited;
+    bool _debug;
+    alloc_stats::frame_stats _alloc_stats;
+    spectate::publisher _spectate{"snake"};
+    pacing::focus_tracker _focus;
+    // 有焦点时每个tick都画，失去焦点时见SIMPLEGAMES_UNFOCUSED_FPS
+    pacing::frame_pacer _pacer{std::chrono::steady_clock::duration::zero()};
+    pacing::output_budget _budget;
+    bool _output_pending = false;
 
 public:
     
     bool cfg_fix_rect;
     int cfg_fps;
     int cfg_hardness;
+    bool cfg_pause_unfocused;
+};
+
+
+/// 对战模式: 玩家(0号蛇)和几条bot蛇在同一块场地里同时走，活到最后的赢
+class arena_game {
+public:
+    arena_game(int width, int height, int bots, const arena::bot_config &cfg) :
+        _bot(cfg),
+        _bots(std::min(std::max(bots, 1), arena::MAX_SNAKES - 1)),
+        _rng(time(NULL)),
+        _debug(false),
+        cfg_hardness(6) {
+        _field.reset(width, height);
+        place_snakes(_field, _bots + 1);
+        for ( int i = 0; i <= _bots; i += 1 )
+            add_apple(_field, _rng);
+    }
+    
+    /// 蛇的初始位置: 先四个角附近，再四条边的中间
+    static void place_snakes(arena::field &f, int count) {
+        int w = f.get_width(), h = f.get_height();
+        const int spots[arena::MAX_SNAKES][3] = {
+            {w / 4, h / 4, arena::DOWN}, {w * 3 / 4, h * 3 / 4, arena::UP},
+            {w * 3 / 4, h / 4, arena::DOWN}, {w / 4, h * 3 / 4, arena::UP},
+            {w / 2, h / 4, arena::RIGHT}, {w / 2, h * 3 / 4, arena::LEFT},
+            {w / 8, h / 2, arena::DOWN}, {w * 7 / 8, h / 2, arena::UP},
+        };
+        for ( int i = 0; i < count; i += 1 )
+            f.add_snake(spots[i][0], spots[i][1], spots[i][2], 3);
+    }
+    
+    /// 在随机的空格子上放一个苹果，没有空格子时什么也不做
+    template <class Rng>
+    static void add_apple(arena::field &f, Rng &r) {
+        int n = f.get_width() * f.get_height();
+        std::uniform_int_distribution<int> any(0, n - 1);
+        for ( int tries = 0; tries < 64; tries += 1 ) {
+            int idx = any(r);
+            if ( f.at(idx) == 0 ) {
+                f.put_apple(idx);
+                return;
+            }
+        }
+        std::vector<int> blanks;
+        for ( int idx = 0; idx < n; idx += 1 ) {
+            if ( f.at(idx) == 0 )
+                blanks.push_back(idx);
+        }
+        if ( !blanks.empty() )
+            f.put_apple(blanks[std::uniform_int_distribution<size_t>(0, blanks.size() - 1)(r)]);
+    }
+    
+    void render() {
+        int width = _field.get_width(), height = _field.get_height();
+        _scr = newwin(height + 2, width * 2 + 2, 3, std::max(0, (COLS - width * 2 - 2) / 2));
+        if (_scr == NULL)
+            throw overflow_error(height + 2, width * 2 + 2);
+        keypad(_scr, 1);
+        curs_set(0);
+        
+        std::vector<arena::bot_stats> stats(_bots + 1);
+        uint8_t player_dir = _field.get_snake(0).dir;
+        const char *result = nullptr;
+        std::chrono::microseconds frame_time(static_cast<int64_t>(1000000 / cfg_hardness));
+        auto next_tick = std::chrono::steady_clock::now();
+        
+        while (1) {
+            // 上一帧超出了输出预算还没发出去
+            if ( _output_pending )
+                flush_output();
+            
+            auto now = std::chrono::steady_clock::now();
+            if ( result == nullptr && now >= next_tick ) {
+                next_tick += frame_time;
+                if ( next_tick < now )
+                    next_tick = now + frame_time;
+                
+                uint8_t moves[arena::MAX_SNAKES] = {0};
+                moves[0] = player_dir;
+                for ( int i = 1; i <= _bots; i += 1 ) {
+                    if ( _field.get_snake(i).alive )
+                        moves[i] = _bot.choose(_field, i, &stats[i]);
+                }
+                int eaten = _field.step(moves);
+                for ( int k = 0; k < eaten; k += 1 )
+                    add_apple(_field, _rng);
+                
+                if ( !_field.get_snake(0).alive )
+                    result = "你输了，按q退出";
+                else if ( _field.alive_count() == 1 )
+                    result = "你赢了，按q退出";
+                draw(stats, result);
+            }
+            
+            // 睡到下一个tick或者有按键为止，有没发出去的输出时最晚在预算允许时醒来
+            auto deadline = result ? std::chrono::steady_clock::time_point::max() : next_tick;
+            if ( _output_pending )
+                deadline = std::min(deadline, _budget.retry_at());
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            wtimeout(_scr, deadline == std::chrono::steady_clock::time_point::max() ? -1 : static_cast<int>(std::max<int64_t>(wait, 0)));
+            int k = wgetch(_scr);
+            int d = -1;
+            if ( k == 'q' ) {
+                break;
+            } else if ( k == KEY_UP ) {
+                d = arena::UP;
+            } else if ( k == KEY_RIGHT ) {
+                d = arena::RIGHT;
+            } else if ( k == KEY_DOWN ) {
+                d = arena::DOWN;
+            } else if ( k == KEY_LEFT ) {
+                d = arena::LEFT;
+            } else if ( k == '\x04' ) {
+                _debug = !_debug;
+                draw(stats, result);
+            }
+            if ( d >= 0 && _field.allowed(0, d) )
+                player_dir = uint8_t(d);
+        }
+        delwin(_scr);
+    }
+    
+    const pacing::output_budget& get_output_budget() { return _budget; }
+    
+protected:
+    /// 颜色在第一次画bot蛇时才初始化，每条蛇的颜色对也是用到时才设置
+    int color_pair(int id) {
+        static const short colors[] = {COLOR_GREEN, COLOR_RED, COLOR_BLUE, COLOR_MAGENTA, COLOR_CYAN, COLOR_YELLOW, COLOR_WHITE, COLOR_RED};
+        if ( !_colors_started ) {
+            _colors_started = true;
+            start_color();
+            use_default_colors();
+        }
+        if ( !(_pairs_ready & (1u << id)) ) {
+            _pairs_ready |= 1u << id;
+            init_pair(id + 1, colors[id], -1);
+        }
+        return COLOR_PAIR(id + 1);
+    }
+    
+    /// 和普通模式一样，在输出预算允许时才doupdate()
+    void flush_output() {
+        auto beg = std::chrono::steady_clock::now();
+        _output_pending = !_budget.admit(beg);
+        if ( _output_pending )
+            return;
+        doupdate();
+        _budget.sent(beg, std::chrono::steady_clock::now());
+    }
+    
+    void draw(const std::vector<arena::bot_stats> &stats, const char *result) {
+        int width = _field.get_width(), height = _field.get_height();
+        erase();
+        werase(_scr);
+        wborder(_scr, 0, 0, 0, 0, 0, 0, 0, 0);
+        for ( int y = 0; y < height; y += 1 ) {
+            for ( int x = 0; x < width; x += 1 ) {
+                int idx = y * width + x;
+                if ( _field.is_apple(idx) ) {
+                    mvwaddstr(_scr, y + 1, x * 2 + 1, "🍎");
+                } else if ( _field.is_body(idx) ) {
+                    int id = _field.owner(idx);
+                    bool head = _field.get_snake(id).head == idx;
+                    if ( id == 0 ) {
+                        mvwaddstr(_scr, y + 1, x * 2 + 1, head ? "🐍" : "🍞");
+                    } else {
+                        int pair = color_pair(id);
+                        wattron(_scr, pair);
+                        mvwaddstr(_scr, y + 1, x * 2 + 1, head ? "@@" : "[]");
+                        wattroff(_scr, pair);
+                    }
+                }
+            }
+        }
+        
+        // 每条蛇的长度，死掉的显示x
+        frame_mem::string line(_frame_arena);
+        line += "你: ";
+        for ( int i = 0; i <= _bots; i += 1 ) {
+            if ( i == 1 )
+                line += "  bot:";
+            const arena::snake_info &sn = _field.get_snake(i);
+            line += " ";
+            if ( sn.alive )
+                frame_mem::append_int(line, sn.length);
+            else
+                line += "x";
+        }
+        mvaddstr(1, 0, line.c_str());
+        if ( result )
+            mvaddstr(2, 0, result);
+        
+        if ( _debug ) {
+            for ( int i = 1; i <= _bots; i += 1 ) {
+                char buf[96];
+                snprintf(buf, sizeof(buf), "bot %d: depth=%d nodes=%llu %.0fk nodes/s %.1fms", i, stats[i].depth,
+                         (unsigned long long)stats[i].nodes, stats[i].nodes_per_sec() / 1000, stats[i].seconds * 1000);
+                mvaddstr(LINES - _bots - 1 + i, 0, buf);
+            }
+            char buf[160];
+            _frame_arena.format_stats(buf, sizeof(buf));
+            mvaddstr(LINES - _bots - 1, 0, buf);
+        }
+        wnoutrefresh(stdscr);
+        wnoutrefresh(_scr);
+        // 要在doupdate()清掉改过的行的标记之前
+        _spectate.publish();
+        flush_output();
+        _frame_arena.reset();
+    }
+    
+    arena::field _field;
+    arena::bot _bot;
+    int _bots;
+    std::default_random_engine _rng;
+    WINDOW* _scr;
+    bool _debug;
+    frame_mem::arena _frame_arena;  // 每帧拼的文字，画完就清空
+    bool _colors_started = false;
+    unsigned _pairs_ready = 0;      // 已经init_pair()的蛇，按位
+    spectate::publisher _spectate{"snake"};
+    pacing::output_budget _budget;
+    bool _output_pending = false;
+    
+public:
+    int cfg_hardness;
 };
 
 
 
+/// 不开界面地让bot互相对战，统计搜索深度、速度和每次思考的用时
+int arena_bench(int ticks, int snakes, const arena::bot_config &cfg) {
+    arena::bot b(cfg);
+    std::default_random_engine rng(1);
+    std::vector<double> lat;
+    double depth = 0, nodes = 0, seconds = 0;
+    int games = 0;
+    while ( static_cast<int>(lat.size()) < ticks ) {
+        arena::field f;
+        f.reset(24, 20);
+        arena_game::place_snakes(f, snakes);
+        for ( int i = 0; i < snakes; i += 1 )
+            arena_game::add_apple(f, rng);
+        games += 1;
+        while ( f.alive_count() > 1 && static_cast<int>(lat.size()) < ticks ) {
+            uint8_t moves[arena::MAX_SNAKES] = {0};
+            for ( int i = 0; i < snakes; i += 1 ) {
+                if ( !f.get_snake(i).alive )
+                    continue;
+                arena::bot_stats st;
+                moves[i] = b.choose(f, i, &st);
+                lat.push_back(st.seconds * 1000);
+                depth += st.depth;
+                nodes += st.nodes;
+                seconds += st.seconds;
+            }
+            int eaten = f.step(moves);
+            for ( int k = 0; k < eaten; k += 1 )
+                arena_game::add_apple(f, rng);
+        }
+    }
+    std::sort(lat.begin(), lat.end());
+    size_t n = lat.size();
+    printf("%zu searches in %d games, %d snakes, budget %.1fms, %d threads\n", n, games, snakes,
+           b.get_config().budget.count() / 1000.0, b.get_config().threads);
+    printf("depth %.2f, %.0f nodes/s, latency p50 %.2fms p99 %.2fms max %.2fms\n", depth / n, nodes / seconds,
+           lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+    return 0;
+}
+
+
+
 void endgame() {
     endwin();
 }
 
-int main() {
+// 用法:
+//   snake                      单人模式
+//   snake --arena [N]          和N条bot对战(默认3条)
+//   snake --arena-bench TICKS  不开界面地让bot互相对战，输出搜索的统计
+//   --bot-budget MS            bot每步的思考时间，默认5毫秒
+//   --bot-threads N            bot搜索用的线程数，默认CPU核数
+//   --measure-startup          单人模式画完第一帧就退出，输出启动各阶段的用时
+int main(int argc, char **argv) {
+    int bots = 0, bench = 0;
+    arena::bot_config cfg;
+    for ( int i = 1; i < argc; i += 1 ) {
+        std::string arg(argv[i]);
+        if ( arg == "--arena" ) {
+            bots = 3;
+            if ( i + 1 < argc && isdigit(argv[i + 1][0]) )
+                bots = atoi(argv[++i]);
+        } else if ( arg == "--arena-bench" && i + 1 < argc ) {
+            bench = atoi(argv[++i]);
+        } else if ( arg == "--bot-budget" && i + 1 < argc ) {
+            cfg.budget = std::chrono::microseconds(static_cast<int64_t>(atof(argv[++i]) * 1000));
+        } else if ( arg == "--bot-threads" && i + 1 < argc ) {
+            cfg.threads = atoi(argv[++i]);
+        } else if ( arg == "--measure-startup" ) {
+            startup::global().enable();
+        } else {
+            fprintf(stderr, "usage: %s [--arena [N] | --arena-bench TICKS] [--bot-budget MS] [--bot-threads N] [--measure-startup]\n", argv[0]);
+            return 2;
+        }
+    }
+    if ( bench > 0 )
+        return arena_bench(bench, std::max(2, std::min(bots ? bots + 1 : 4, arena::MAX_SNAKES)), cfg);
+    
     atexit(&endgame);
     
     setlocale(LC_ALL, "");
+    startup::global().mark("setlocale");
     
     initscr();
     cbreak();
     noecho();
+    startup::global().mark("initscr");
+    
+    if ( bots > 0 ) {
+        arena_game duel(24, 20, bots, cfg);
+        duel.render();
+        endwin();
+        if (getenv("SIMPLEGAMES_PACING_STATS"))
+            duel.get_output_budget().report(stderr, "snake");
+        return EXIT_SUCCESS;
+    }
     
     grid this_grid(20, 20);
     game no_game_no_life(&this_grid);
     no_game_no_life.cfg_fix_rect = true;
     no_game_no_life.cfg_hardness = 6;
     no_game_no_life.init();
+    startup::global().mark("init");
     
     try {
         no_game_no_life.render();
@@ -499,5 +947,17 @@ int main() {
         
     }
     
+    no_game_no_life.cleanup();
+    endwin();
+    if ( startup::global().done() ) {
+        startup::global().report(stderr, "snake");
+        return EXIT_SUCCESS;
+    }
+    no_game_no_life.get_alloc_stats().report(stderr, "snake");
+    if (getenv("SIMPLEGAMES_PACING_STATS")) {
+        no_game_no_life.get_pacer().report(stderr, "snake");
+        no_game_no_life.get_output_budget().report(stderr, "snake");
+    }
+    
     return EXIT_SUCCESS;
 }
\ No newline at end of file
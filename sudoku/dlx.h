@@ -0,0 +1,215 @@
+#pragma once
+
+// Knuth的舞蹈链(DLX)，解精确覆盖问题
+//
+// 矩阵的每一列是一个约束，每一行是一个选择，要选出若干行使每个主列恰好被覆盖一次，
+// 次列(secondary)最多被覆盖一次。数独和它的各种变体都能写成这种形式，见sudoku_dlx.h。
+//
+// 所有节点放在一个连续的数组里，上下左右用下标互相链接，不在堆上一个个分配:
+//   - 0号节点是根，1..columns()号是列头，列头的size是这一列还剩几行
+//   - 之后每行的节点连续存放，左右链接成环
+// 主列的列头挂在根的左右链表上，次列的列头自己成环，选列时不会被选到。
+// 搜索每次选剩下行最少的主列，递归深度不超过主列数。
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace dlx {
+
+    class exact_cover {
+    public:
+
+        exact_cover(int primary, int secondary = 0) : _primary(primary), _updates(0) {
+            int columns = primary + secondary;
+            _nodes.resize(columns + 1);
+            _size.assign(columns + 1, 0);
+            for( int i = 0; i <= columns; i++ ) {
+                _nodes[i].up = _nodes[i].down = i;
+                _nodes[i].col = i;
+                _nodes[i].row = -1;
+            }
+            // 主列挂在根上，次列自己成环
+            for( int i = 0; i <= primary; i++ ) {
+                _nodes[i].left = i == 0 ? primary : i - 1;
+                _nodes[i].right = i == primary ? 0 : i + 1;
+            }
+            for( int i = primary + 1; i <= columns; i++ )
+                _nodes[i].left = _nodes[i].right = i;
+        }
+
+        int columns() const { return int(_size.size()) - 1; }
+        int primary() const { return _primary; }
+        int rows() const { return int(_row_start.size()); }
+
+        /// 添加一行，cols是列号(从0开始，主列在前)，返回行号
+        /// 必须在choose()和solve()之前加完
+        int add_row(const int *cols, int n) {
+            int row = rows();
+            int first = int(_nodes.size());
+            _row_start.push_back(first);
+            for( int k = 0; k < n; k++ ) {
+                int c = cols[k] + 1;
+                int x = int(_nodes.size());
+                node nd;
+                nd.col = c;
+                nd.row = row;
+                nd.left = k == 0 ? first + n - 1 : x - 1;
+                nd.right = k == n - 1 ? first : x + 1;
+                nd.up = _nodes[c].up;
+                nd.down = c;
+                _nodes[_nodes[c].up].down = x;
+                _nodes[c].up = x;
+                _nodes.push_back(nd);
+                _size[c] += 1;
+            }
+            return row;
+        }
+
+        int add_row(std::initializer_list<int> cols) {
+            return add_row(cols.begin(), int(cols.size()));
+        }
+
+        /// 事先选中一行(比如数独的已知数字)，和已经选中的行冲突时什么也不做并返回false
+        bool choose(int row) {
+            int first = _row_start[row];
+            int x = first;
+            do {
+                if( _size[_nodes[x].col] >= COVERED )
+                    return false;
+                x = _nodes[x].right;
+            } while( x != first );
+            x = first;
+            do {
+                cover(_nodes[x].col);
+                x = _nodes[x].right;
+            } while( x != first );
+            _chosen.push_back(row);
+            return true;
+        }
+
+        /// 撤销所有choose()，回到刚加完行的状态
+        void reset() {
+            while( !_chosen.empty() ) {
+                int first = _row_start[_chosen.back()];
+                _chosen.pop_back();
+                int x = _nodes[first].left;
+                while( true ) {
+                    uncover(_nodes[x].col);
+                    if( x == first )
+                        break;
+                    x = _nodes[x].left;
+                }
+            }
+        }
+
+        /// 找解，最多找limit个，返回找到的个数
+        /// 每找到一个解调用on_solution(const std::vector<int> &rows)，其中不含choose()的行，返回false时提前停止
+        template <class Fn>
+        uint64_t solve(uint64_t limit, Fn on_solution) {
+            _found = 0;
+            _stop = false;
+            _solution.clear();
+            if( limit > 0 )
+                search(limit, on_solution);
+            return _found;
+        }
+
+        uint64_t solve(uint64_t limit) {
+            return solve(limit, [](const std::vector<int> &) { return true; });
+        }
+
+        /// 已经选中的行(choose()的)
+        const std::vector<int> &chosen() const { return _chosen; }
+
+        /// 累计的链接更新次数，衡量搜索的工作量
+        uint64_t updates() const { return _updates; }
+
+    protected:
+
+        static constexpr int COVERED = 1 << 24;
+
+        struct node {
+            int left, right, up, down;
+            int col;
+            int row;
+        };
+
+        void cover(int c) {
+            node *n = _nodes.data();
+            n[n[c].right].left = n[c].left;
+            n[n[c].left].right = n[c].right;
+            _size[c] += COVERED;
+            for( int i = n[c].down; i != c; i = n[i].down ) {
+                for( int j = n[i].right; j != i; j = n[j].right ) {
+                    n[n[j].down].up = n[j].up;
+                    n[n[j].up].down = n[j].down;
+                    _size[n[j].col] -= 1;
+                    _updates += 1;
+                }
+            }
+        }
+
+        void uncover(int c) {
+            node *n = _nodes.data();
+            for( int i = n[c].up; i != c; i = n[i].up ) {
+                for( int j = n[i].left; j != i; j = n[j].left ) {
+                    _size[n[j].col] += 1;
+                    n[n[j].down].up = j;
+                    n[n[j].up].down = j;
+                }
+            }
+            _size[c] -= COVERED;
+            n[n[c].right].left = c;
+            n[n[c].left].right = c;
+        }
+
+        template <class Fn>
+        void search(uint64_t limit, Fn &on_solution) {
+            node *n = _nodes.data();
+            if( n[0].right == 0 ) {
+                _found += 1;
+                if( !on_solution(static_cast<const std::vector<int> &>(_solution)) || _found >= limit )
+                    _stop = true;
+                return;
+            }
+
+            // 被覆盖的列的size加上了COVERED，直接按下标顺序扫整个数组找最小的，
+            // 没有分支，比沿着根的链表一个个跳快
+            const int *size = _size.data();
+            int best_size = INT_MAX;
+            for( int c = 1; c <= _primary; c++ )
+                best_size = std::min(best_size, size[c]);
+            if( best_size == 0 )
+                return;
+            int best = 1;
+            while( size[best] != best_size )
+                best++;
+
+            cover(best);
+            for( int r = n[best].down; r != best && !_stop; r = n[r].down ) {
+                _solution.push_back(n[r].row);
+                for( int j = n[r].right; j != r; j = n[j].right )
+                    cover(n[j].col);
+                search(limit, on_solution);
+                for( int j = n[r].left; j != r; j = n[j].left )
+                    uncover(n[j].col);
+                _solution.pop_back();
+            }
+            uncover(best);
+        }
+
+        int _primary;
+        std::vector<node> _nodes;
+        std::vector<int> _size;         // 列头: 这一列还剩几行，被覆盖时再加上COVERED
+        std::vector<int> _row_start;    // 每行第一个节点
+        std::vector<int> _chosen;
+        std::vector<int> _solution;
+        uint64_t _found;
+        bool _stop;
+        uint64_t _updates;
+    };
+
+} // namespace dlx
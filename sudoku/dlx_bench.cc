@@ -0,0 +1,146 @@
+// 舞蹈链数独求解器的测试(sudoku_dlx.h)
+// compile with: c++ -O2 dlx_bench.cc -o sudoku-dlx -std=c++17
+//
+// 每行一道题(见sudoku_solver::parse，'#'开头的行跳过)，解出每道题的解的个数(最多--limit个，
+// 默认2，也就是检查解是否唯一)，输出每秒解的题数。没有给文件时用内置的几道题，FILE为-时读标准输入。
+//
+// 用法:
+//   sudoku-dlx [--box WxH] [--x] [--regions STR] [--limit N] [--repeat R] [--print] [FILE...]
+// --x是X数独(对角线)，--regions给出锯齿数独的区域(n * n个字符，相同的字符是同一个区域)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sudoku_dlx.h"
+
+// 内置的题: 几道有名的难题和几道普通的题
+static const char *BUILTIN[] = {
+    "003020600900305001001806400008102900700000008006708200002609500800203009005010300",
+    "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",
+    "52...6.........7.13...........4..8..6......5...........418.........3..2...87.....",
+    "6.....8.3.4.7.................5.4.7.3..2.....1.6.......2.....5.....8.6......1....",
+    "48.3............71.2.......7.5....6....2..8.............1.76...3.....4......5....",
+    "....14....3....2...7..........9...3.6.1.............8.2.....1.4....5.6.....7.8...",
+    "8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4..",
+    "..53.....8......2..7..1.5..4....53...1..7...6..32...8..6.5....9..4....3......97..",
+    "1....7.9..3..2...8..96..5....53..9...1..8...26....4...3......1..4......7..7...3..",
+    "000000010400000000020000000000050407008000300001090000300400200050100000000806000",
+};
+
+int main(int argc, char **argv) {
+    int box_w = 3, box_h = 3, repeat = 1;
+    uint64_t limit = 2;
+    bool diagonal = false, print = false;
+    std::string regions;
+    std::vector<std::string> files;
+
+    for( int i = 1; i < argc; i++ ) {
+        auto arg = [&](const char *name) { return strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if( arg("--box") ) {
+            if( sscanf(argv[++i], "%dx%d", &box_w, &box_h) != 2 )
+                box_w = box_h = 0;
+        } else if( arg("--regions") ) {
+            regions = argv[++i];
+        } else if( arg("--limit") ) {
+            limit = strtoull(argv[++i], nullptr, 10);
+        } else if( arg("--repeat") ) {
+            repeat = atoi(argv[++i]);
+        } else if( strcmp(argv[i], "--x") == 0 ) {
+            diagonal = true;
+        } else if( strcmp(argv[i], "--print") == 0 ) {
+            print = true;
+        } else if( argv[i][0] != '-' || strcmp(argv[i], "-") == 0 ) {
+            files.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "usage: %s [--box WxH] [--x] [--regions STR] [--limit N] [--repeat R] [--print] [FILE...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if( box_w <= 0 || box_h <= 0 || box_w * box_h > 35 || repeat <= 0 || limit == 0 )
+        return 2;
+
+    dlx::sudoku_shape shape = regions.empty()
+        ? (diagonal ? dlx::sudoku_shape::diagonal(box_w, box_h) : dlx::sudoku_shape::standard(box_w, box_h))
+        : dlx::sudoku_shape::jigsaw(regions);
+    if( shape.n == 0 ) {
+        fprintf(stderr, "bad --regions\n");
+        return 2;
+    }
+    if( !regions.empty() && diagonal )
+        shape.extra = dlx::sudoku_shape::diagonal(1, shape.n).extra;
+
+    // 读题
+    std::vector<std::vector<int>> puzzles;
+    std::vector<int> grid;
+    auto add = [&](const std::string &line) {
+        if( line.empty() || line[0] == '#' )
+            return;
+        if( dlx::sudoku_solver::parse(line, shape.n, grid) )
+            puzzles.push_back(grid);
+    };
+    if( files.empty() ) {
+        for( auto p : BUILTIN )
+            add(p);
+        if( shape.n != 9 )
+            puzzles.clear();
+    }
+    for( auto &f : files ) {
+        std::ifstream in;
+        if( f != "-" ) {
+            in.open(f);
+            if( !in ) {
+                perror(f.c_str());
+                return 1;
+            }
+        }
+        std::istream &is = f == "-" ? std::cin : in;
+        for( std::string line; std::getline(is, line); )
+            add(line);
+    }
+    if( puzzles.empty() ) {
+        fprintf(stderr, "no puzzles\n");
+        return 1;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    dlx::sudoku_solver solver(shape);
+    double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    size_t unique = 0, multiple = 0, none = 0;
+    std::vector<int> solution;
+    auto beg = std::chrono::steady_clock::now();
+    uint64_t updates0 = solver.updates();
+    for( int r = 0; r < repeat; r++ ) {
+        for( auto &p : puzzles ) {
+            uint64_t n = solver.solve(p, limit, print && r == 0 ? &solution : nullptr);
+            if( r > 0 )
+                continue;
+            if( n == 0 )
+                none++;
+            else if( n == 1 )
+                unique++;
+            else
+                multiple++;
+            if( print && n > 0 ) {
+                for( int v : solution )
+                    putchar(v < 10 ? '0' + v : 'A' + v - 10);
+                putchar('\n');
+            }
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+    double solved = double(puzzles.size()) * repeat;
+
+    printf("%zu puzzles (n=%d%s), %zu unique, %zu with more than one solution, %zu unsolvable\n",
+           puzzles.size(), shape.n, shape.extra.empty() ? "" : ", with extra groups", unique, multiple, none);
+    printf("%.0f puzzles/s, %.1f us/puzzle, %.0f updates/puzzle, matrix built in %.2fms\n",
+           secs > 0 ? solved / secs : 0.0, secs * 1e6 / solved, double(solver.updates() - updates0) / solved,
+           build * 1000);
+    return 0;
+}
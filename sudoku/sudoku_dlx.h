@@ -0,0 +1,191 @@
+#pragma once
+
+// 用舞蹈链(dlx.h)解数独和它的变体
+//
+// 边长为n的数独，每个格子填一个数字是一行(n * n * n行)，每行覆盖这些列:
+//   - 这个格子有数字
+//   - 这一行有这个数字、这一列有这个数字、这个区域有这个数字
+//   - 格子属于的每个额外的组里有这个数字(比如X数独的两条对角线)
+// 标准数独的区域是宫，锯齿数独的区域是任意形状，只要每个区域恰好n个格子。
+// 额外的组不满n个格子时数字最多出现一次，用次列表示。
+// 矩阵只建一次，每道题choose()已知的数字、搜索、再reset()。
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dlx.h"
+
+namespace dlx {
+
+    struct sudoku_shape {
+        int n = 0;                              // 边长，数字是1..n
+        std::vector<int> region;                // 每个格子所在的区域，按行存，区域号0..n-1
+        std::vector<std::vector<int>> extra;    // 额外的组，每个数字在组里最多出现一次，满n个格子时恰好一次
+
+        /// 标准数独，宫是box_w x box_h
+        static sudoku_shape standard(int box_w, int box_h) {
+            sudoku_shape s;
+            s.n = box_w * box_h;
+            s.region.resize(s.n * s.n);
+            for( int y = 0; y < s.n; y++ )
+                for( int x = 0; x < s.n; x++ )
+                    s.region[y * s.n + x] = (y / box_h) * (s.n / box_w) + x / box_w;
+            return s;
+        }
+
+        /// 锯齿数独，regions是n * n个字符，相同的字符是同一个区域; 形状不对时n为0
+        static sudoku_shape jigsaw(const std::string &regions) {
+            sudoku_shape s;
+            int n = 0;
+            while( n * n < int(regions.size()) )
+                n++;
+            if( n * n != int(regions.size()) )
+                return s;
+            std::vector<int> id(256, -1), count;
+            s.region.resize(n * n);
+            for( int i = 0; i < n * n; i++ ) {
+                unsigned char ch = regions[i];
+                if( id[ch] < 0 ) {
+                    id[ch] = int(count.size());
+                    count.push_back(0);
+                }
+                s.region[i] = id[ch];
+                count[id[ch]]++;
+            }
+            if( int(count.size()) != n )
+                return s;
+            for( int c : count )
+                if( c != n )
+                    return s;
+            s.n = n;
+            return s;
+        }
+
+        /// X数独: 标准数独再加上两条对角线
+        static sudoku_shape diagonal(int box_w, int box_h) {
+            sudoku_shape s = standard(box_w, box_h);
+            std::vector<int> main, anti;
+            for( int i = 0; i < s.n; i++ ) {
+                main.push_back(i * s.n + i);
+                anti.push_back(i * s.n + (s.n - 1 - i));
+            }
+            s.extra.push_back(main);
+            s.extra.push_back(anti);
+            return s;
+        }
+    };
+
+    class sudoku_solver {
+    public:
+
+        explicit sudoku_solver(const sudoku_shape &shape) : _n(shape.n), _matrix(primary_columns(shape), secondary_columns(shape)) {
+            int n = _n, cells = n * n;
+            // 每个格子属于哪些额外的组
+            std::vector<std::vector<int>> groups(cells);
+            for( size_t g = 0; g < shape.extra.size(); g++ )
+                for( int cell : shape.extra[g] )
+                    groups[cell].push_back(int(g));
+            // 列号: 主列在前(格子、行、列、区域、满n格的组)，次列在后(不满n格的组)
+            std::vector<int> group_col(shape.extra.size());
+            int next_primary = cells * 4, next_secondary = primary_columns(shape);
+            for( size_t g = 0; g < shape.extra.size(); g++ ) {
+                if( int(shape.extra[g].size()) == n ) {
+                    group_col[g] = next_primary;
+                    next_primary += n;
+                } else {
+                    group_col[g] = next_secondary;
+                    next_secondary += n;
+                }
+            }
+
+            std::vector<int> cols;
+            for( int cell = 0; cell < cells; cell++ ) {
+                int y = cell / n, x = cell % n;
+                for( int d = 0; d < n; d++ ) {
+                    cols.clear();
+                    cols.push_back(cell);
+                    cols.push_back(cells + y * n + d);
+                    cols.push_back(cells * 2 + x * n + d);
+                    cols.push_back(cells * 3 + shape.region[cell] * n + d);
+                    for( int g : groups[cell] )
+                        cols.push_back(group_col[g] + d);
+                    // 行号就是cell * n + d
+                    _matrix.add_row(cols.data(), int(cols.size()));
+                }
+            }
+        }
+
+        int size() const { return _n; }
+
+        /// 解一道题，grid是n * n个数字(0是空格)，最多数到limit个解
+        /// solution不为空时填入找到的第一个解，返回解的个数，已知数字互相冲突时是0
+        uint64_t solve(const std::vector<int> &grid, uint64_t limit, std::vector<int> *solution = nullptr) {
+            int n = _n;
+            _matrix.reset();
+            for( int cell = 0; cell < n * n; cell++ ) {
+                int v = grid[cell];
+                if( v < 0 || v > n )
+                    return 0;
+                if( v != 0 && !_matrix.choose(cell * n + v - 1) )
+                    return 0;
+            }
+            if( solution )
+                *solution = grid;
+            bool first = true;
+            return _matrix.solve(limit, [&](const std::vector<int> &rows) {
+                if( solution && first ) {
+                    for( int r : rows )
+                        (*solution)[r / n] = r % n + 1;
+                }
+                first = false;
+                return true;
+            });
+        }
+
+        uint64_t updates() const { return _matrix.updates(); }
+
+        /// 解析一道题: 数字是已知数字，'.'和'0'是空格，其他字符跳过
+        /// 10以上的数字用字母A..Z，读到n * n个格子时返回true
+        static bool parse(const std::string &text, int n, std::vector<int> &grid) {
+            grid.clear();
+            for( char ch : text ) {
+                int v = -1;
+                if( ch == '.' || ch == '0' )
+                    v = 0;
+                else if( ch >= '1' && ch <= '9' )
+                    v = ch - '0';
+                else if( ch >= 'A' && ch <= 'Z' )
+                    v = ch - 'A' + 10;
+                else if( ch >= 'a' && ch <= 'z' )
+                    v = ch - 'a' + 10;
+                if( v < 0 || v > n )
+                    continue;
+                grid.push_back(v);
+            }
+            return int(grid.size()) == n * n;
+        }
+
+    protected:
+
+        static int primary_columns(const sudoku_shape &s) {
+            int cols = s.n * s.n * 4;
+            for( auto &g : s.extra )
+                if( int(g.size()) == s.n )
+                    cols += s.n;
+            return cols;
+        }
+
+        static int secondary_columns(const sudoku_shape &s) {
+            int cols = 0;
+            for( auto &g : s.extra )
+                if( int(g.size()) != s.n )
+                    cols += s.n;
+            return cols;
+        }
+
+        int _n;
+        exact_cover _matrix;
+    };
+
+} // namespace dlx
@@ -1,11 +1,10 @@
 #include <ncurses.h>
 #include <string>
-#include <uchar.h>
-#include <stringpiece.h>
-#include <unistr.h>
+#include <string_view>
 #include <iostream>
 #include <exception>
 #include <functional>
+#include <optional>
 #include <locale.h>
 #include <random>
 #include <ctime>
@@ -13,6 +12,21 @@
 #include <utility>
 #include <chrono>
 #include <thread>
+#include <vector>
+
+#include "../common/alloc_stats.h"
+#include "../common/frame_arena.h"
+#include "../common/spectate.h"
+#include "../common/frame_pacer.h"
+#include "../common/output_budget.h"
+#include "../common/startup_timer.h"
+#include "../common/coro_loop.h"
+#include "../common/tracepoints.h"
+#include "east_asian_width.h"
+#include "grid.h"
+#include "record.h"
+#include "evil.h"
+#include "book.h"
 
 #define CALC_CENTER_BEGIN(scrwidth, strwidth) (int(((scrwidth) - (strwidth)) / 2))
 #define CENTER_BEGIN(scrwidth, str) CALC_CENTER_BEGIN(scrwidth, x2048::get_string_width(str))
@@ -31,35 +45,10 @@ static const char *LICENSE = "MIT LICENSE";
 
 namespace x2048 {
     
-    using i32 = int32_t;
-    using i64 = int64_t;
-    using u32 = uint32_t;
-    using u64 = uint64_t;
-    using f32 = float;
-    using f64 = double;
-
     bool AMBIGUOUS_AS_WIDE = false;
 
-    std::default_random_engine rand(time(NULL));
-
     auto get_string_width(const char *rawstr) {
-        auto str = icu::UnicodeString::fromUTF8(icu::StringPiece(rawstr));
-        auto len = str.length();
-        i32 width = 0;
-        for( int i = 0; i < len; i++) {
-            switch((UEastAsianWidth)u_getIntPropertyValue(str.charAt(i), UCHAR_EAST_ASIAN_WIDTH)) {
-            case U_EA_NEUTRAL: case U_EA_HALFWIDTH: case U_EA_NARROW:
-                width += 1;
-                break;
-            case U_EA_FULLWIDTH: case U_EA_WIDE:
-                width += 2;
-                break;
-            default:
-                width += AMBIGUOUS_AS_WIDE ? 2 : 1;
-                break;
-            }
-        }
-        return width;
+        return i32(eaw::string_width(rawstr, AMBIGUOUS_AS_WIDE));
     }
 
     auto get_string_width(const std::string &str) {
@@ -94,17 +83,6 @@ namespace x2048 {
         return x1 > tmp ? x1 : tmp;
     }
 
-    enum class DIRECTION {
-        UP,
-        DOWN,
-        RIGHT,
-        LEFT,
-    };
-
-
-
-
-
     class GameStop : public std::exception {
     public:
         GameStop(int code, const std::string &reason) : mCode(code), mReason(reason) {}
@@ -144,296 +122,6 @@ namespace x2048 {
 
 
 
-    /// 网格类，存储数字
-    /// Example: 创建一个大小为4 x 3的网格并随机写入数字8
-    ///   Grid g(4, 3);
-    ///   g.generate(8);
-    class Grid {
-    public:
-        using storage_t = i64;
-        Grid(int w, int h) : mWidth(w), mHeight(h), mGrid(nullptr), mScore(0) {
-            reset();
-        }
-
-        ~Grid() {
-            delete mGrid;
-            mGrid = nullptr;
-        }
-
-        void reset(int w, int h) {
-            mWidth = w;
-            mHeight = h;
-            reset();
-        }
-
-        void reset() {
-            delete mGrid;
-            mGrid = new storage_t[mWidth * mHeight];
-            memset((void*)mGrid, 0, mWidth * mHeight * sizeof(storage_t));
-
-            score() = 0;
-        }
-
-        bool is_full() const {
-            bool have_blank = false;
-            for( int i = 0; i < mWidth * mHeight; i++ ) {
-                if( mGrid[i] == 0 ) {
-                    have_blank = true;
-                    break;
-                }
-            }
-            return !have_blank;
-        }
-
-        bool is_fail() const {
-            if( !is_full() )
-                return false;
-            for( int x = 0; x < width(); x++ ) {
-                for( int y = 0; y < height(); y++ ) {
-                    auto cur = get(x, y);
-                    if( y > 0 && cur == get(x, y - 1) )
-                        return false;
-                    if( y < width() - 1 && cur == get(x, y + 1) )
-                        return false;
-                    if( x > 0 && cur == get(x - 1, y) )
-                        return false;
-                    if( x < height() - 1 && cur == get(x + 1, y) )
-                        return false;
-                }
-            }
-            return true;
-        }
-
-        /// Put specified value into the empty randomly.
-        /// Return true if there is not any empty which can be filled.
-        bool generate(const storage_t &targetval) {
-            static std::uniform_int_distribution<int> pos_dist(0, mWidth * mHeight - 1);
-            if( is_full() )
-                return true;
-
-            while(true) {
-                storage_t &val = mGrid[pos_dist(rand)];
-                if( val == 0 ) {
-                    val = targetval;
-                    break;
-                }
-            }
-
-            return false;
-        }
-
-        bool generate_randomly() {
-            static std::uniform_int_distribution<int> false_1i4(0, 3);
-            if( !false_1i4(rand) ) {
-                if( !false_1i4(rand) ) {
-                    if( !false_1i4(rand) ) {
-                        return generate(16);
-                    } else {
-                        return generate(8);
-                    }
-                } else {
-                    return generate(4);
-                }
-            } else {
-                return generate(2);
-            }
-        }
-
-        int slide(int x, int y, DIRECTION dire, bool skip_merge) {
-            auto &cur = get(x, y);
-            int coord = 1;
-
-            if( cur == 0 )
-                return -1;
-            while(true) {
-                try {
-                    auto &target = __get_dire(x, y, dire, coord);
-                    if( target != 0 ) {
-                        if( skip_merge ) {
-                            throw std::out_of_range("");
-                        } else if( target == cur ) {
-                            target *= 2;
-                            cur = 0;
-                            return target;
-                        } else {
-                            throw std::out_of_range("");
-                        }
-                    }
-                } catch(std::out_of_range & e) {
-                    if( coord > 1 ) {
-                        auto &target = __get_dire(x, y, dire, coord - 1);
-                        target = cur;
-                        cur = 0;
-                        return 0;
-                    } else {
-                        return -1;
-                    }
-                }
-                coord++;
-            }
-        }
-
-        /// 向一个方向合并格子
-        /// 将此次操作获得的分数累加到score上并返回
-        /// @param dire 将要合并的方向
-        /// @param have_motions_out 如果有任何操作将会被设置为true，否则为false，可以为nullptr
-        i64 merge(DIRECTION dire, bool *have_motions_out = nullptr) {
-            i64 increase = only_merge(dire, have_motions_out);
-            if( increase > 0 )
-                mScore += increase;
-            return increase;
-        }
-
-        /// 仅合并格子
-        /// 不累加score，将获得的分数返回
-        /// @param dire 将要合并的方向
-        /// @param have_motions_out 如果有任何操作将会被设置为true，否则为false，可以为nullptr
-        i64 only_merge(DIRECTION dire, bool *have_motions_out = nullptr) {
-            i64 new_score = 0; // 增加的分数
-            bool skip_merge = false;
-            bool have_motions = false;
-
-            #define __iter(iname, maxi) for( int iname = 0; iname < (maxi); iname++)
-
-            // 合并阶段
-            switch(dire) {
-            case DIRECTION::UP:
-                __iter(x, width()) {
-                    skip_merge = false;
-                    __iter(y, height()) {
-                        i64 r = slide(x, y, dire, skip_merge);
-                        if( r > 0 ) {
-                            skip_merge = true;
-                            new_score += r;
-                        }
-                        if( r >= 0 )
-                            have_motions = true;
-                    }
-                }
-                break;
-            case DIRECTION::DOWN:
-                __iter(x, width()) {
-                    skip_merge = false;
-                    __iter(y_i, height()) {
-                        int y = height() - 1 - y_i;
-                        i64 r = slide(x, y, dire, skip_merge);
-                        if( r > 0 ) {
-                            skip_merge = true;
-                            new_score += r;
-                        }
-                        if( r >= 0 )
-                            have_motions = true;
-                    }
-                }
-                break;
-            case DIRECTION::RIGHT:
-                __iter(y, height()) {
-                    skip_merge = false;
-                    __iter(x_i, width()) {
-                        int x = width() - 1 - x_i;
-                        i64 r = slide(x, y, dire, skip_merge);
-                        if( r > 0 ) {
-                            skip_merge = true;
-                            new_score += r;
-                        }
-                        if( r >= 0 )
-                            have_motions = true;
-                    }
-                }
-                break;
-            case DIRECTION::LEFT:
-                __iter(y, height()) {
-                    skip_merge = false;
-                    __iter(x, width()) {
-                        i64 r = slide(x, y, dire, skip_merge);
-                        if( r > 0 ) {
-                            skip_merge = true;
-                            new_score += r;
-                        }
-                        if( r >= 0 )
-                            have_motions = true;
-                    }
-                }
-                break;
-            }
-
-
-            if( have_motions_out )
-                *have_motions_out = have_motions;
-            return have_motions ? new_score : -1;
-        }
-
-        i64 &score() {
-            return mScore;
-        }
-
-        storage_t &get(int x, int y) {
-            if( x >= mWidth || x < 0 || y < 0 || y >= mHeight )
-                throw std::out_of_range("Position X " + std::to_string(x) + " Y " + std::to_string(y) + " is out of range");
-            return mGrid[x + y * mWidth];
-        }
-
-        storage_t get(int x, int y) const {
-            if( x >= mWidth || x < 0 || y < 0 || y >= mHeight )
-                throw std::out_of_range("Position X " + std::to_string(x) + " Y " + std::to_string(y) + " is out of range");
-            return mGrid[x + y * mWidth];
-        }
-
-        void put(int x, int y, const storage_t &val) {
-            get(x, y) = val;
-        }
-
-        int width() const {
-            return mWidth;
-        }
-
-        int height() const {
-            return mHeight;
-        }
-
-    private:
-        int mWidth;
-        int mHeight;
-        storage_t *mGrid;
-
-        i64 mScore;
-
-        storage_t &__get_dire(int x, int y, DIRECTION dire, int coord = 1) {
-            switch(dire) {
-            case DIRECTION::UP:
-                y -= coord;
-                break;
-            case DIRECTION::DOWN:
-                y += coord;
-                break;
-            case DIRECTION::RIGHT:
-                x += coord;
-                break;
-            case DIRECTION::LEFT:
-                x -= coord;
-                break;
-            }
-            return get(x, y);
-        }
-
-        DIRECTION __opposite_dire(DIRECTION dire) {
-            switch(dire) {
-            case DIRECTION::UP:
-                return DIRECTION::DOWN;
-            case DIRECTION::DOWN:
-                return DIRECTION::UP;
-            case DIRECTION::RIGHT:
-                return DIRECTION::LEFT;
-            case DIRECTION::LEFT:
-                return DIRECTION::RIGHT;
-            default:
-                return DIRECTION::UP;
-            }
-        }
-    };
-
-
-
     /// 执行游戏的类，自适应WINDOW大小
     /// 创建时会为窗口及TTY设置一些参数并调用savetty()，销毁时调用resetty()
     /// 以下是可配置的变量(懒得做Property，所以在游戏运行时请勿更改)
@@ -441,9 +129,15 @@ namespace x2048 {
     /// config_height   - 游戏网格高度
     /// config_fix_rect - 宽度增加以使网格为正方形
     /// config_size     - 单个格子边长，若开启config_fix_rect则宽度乘2
+    /// config_animate  - 播放格子滑动的动画，链路慢时(见output_budget.h)不播放
+    /// config_anim_time - 动画时长(毫秒)
+    /// config_anim_fps - 动画的帧率
+    /// config_evil     - 困难模式，新的格子出在对玩家最不利的位置(见evil.h)
+    /// config_evil_budget - 困难模式每次出子的搜索时间(毫秒)，应比动画短
+    /// 每个界面(render_*)是一个协程，由mLoop驱动，等输入时co_await mLoop.key()
     class Game {
     public:
-        Game(WINDOW *_win = stdscr, int width = 4, int height = 6) : mWin(_win), mGrid(width, height), config_width(width), config_height(height), config_fix_rect(true), config_size(GRID_SIZE) {
+        Game(WINDOW *_win = stdscr, int width = 4, int height = 6) : mWin(_win), mGrid(width, height), config_width(width), config_height(height), config_fix_rect(true), config_size(GRID_SIZE), config_animate(true), config_anim_time(100), config_anim_fps(60), config_evil(false), config_evil_budget(40) {
             savetty();
             keypad(mWin, 1);
             scrollok(mWin, 0);
@@ -452,33 +146,30 @@ namespace x2048 {
             cbreak();
             curs_set(0);
 
-            start_color();
-            use_default_colors();
-            init_color(COLOR_GRAY, 0xa0, 0xa0, 0xa0);
-            init_pair(PAIR_HIGHLIGHT, COLOR_BLACK, COLOR_WHITE);
-            init_pair(PAIR_DIALOG, COLOR_RED, COLOR_GRAY);
-            init_pair(PAIR_GREEN_TEXT, COLOR_GREEN, 0);
+            mFocus.enable();
         }
 
         ~Game() {
+            mFocus.disable();
             resetty();
         }
 
         struct choice_t {
-            choice_t(const std::string &a, double b, const std::string &k, std::function<void()> cb) : text(a), ratio(b), match_keys(k), callback(cb) {}
+            choice_t(const std::string &a, double b, const std::string &k, std::function<coro::task<>()> cb) : text(a), ratio(b), match_keys(k), callback(cb) {}
             std::string text;
             double ratio;
             std::string match_keys;
-            std::function<void ()> callback;
+            std::function<coro::task<> ()> callback;
         };
         
-        void render_title() {
+        coro::task<> render_title() {
             static const char *TITLE = "X2048!";
             //static const int TITLE_WIDTH = get_string_width(TITLE);
 
-            constexpr int CHOICES_NBR = 3;
+            constexpr int CHOICES_NBR = 4;
             static choice_t CHOICES[CHOICES_NBR] = {
                 choice_t("开始游戏(A)", 0.3, "Aa", std::bind(&Game::render_game, this)),
+                choice_t("困难模式(H)", 0.4, "Hh", std::bind(&Game::render_evil_game, this)),
                 choice_t("设置(S)",     0.5, "Ss", std::bind(&Game::render_settings, this)),
                 choice_t("退出游戏(Q)", 0.7, "Qq", std::bind(&Game::stop, this))
             };
@@ -500,21 +191,21 @@ namespace x2048 {
                     if( curr.text.empty() )
                         continue;
                     if( select == i )
-                        wattron(mWin, COLOR_PAIR(PAIR_HIGHLIGHT));
+                        wattron(mWin, color_pair(PAIR_HIGHLIGHT));
                     waddstrcenter(mWin, int(getmaxy(mWin) * curr.ratio), curr.text.c_str());
                     if( select == i )
-                        wattroff(mWin, COLOR_PAIR(PAIR_HIGHLIGHT));
+                        wattroff(mWin, color_pair(PAIR_HIGHLIGHT));
                 }
 
-                wrefresh(mWin);
+                present();
 
-                k = getch();
+                k = co_await mLoop.key();
                 // 选项的Callback
                 for( int i = 0; i < CHOICES_NBR; i++ ) {
                     auto &curr = CHOICES[i];
                     for( auto c : curr.match_keys ) {
                         if( k == c )
-                            curr.callback();
+                            co_await curr.callback();
                     }
                 }
                 // 方向键
@@ -540,21 +231,35 @@ namespace x2048 {
                         TITLE = STR.c_str();
                     }
                 case KEY_ENTER: case 10: case 13:
-                    CHOICES[select].callback();
+                    co_await CHOICES[select].callback();
                     break;
                 }
             }
         } // void render_title()
 
-        void render_game() {
+        coro::task<> render_game() {
             bool cond = true;
             bool dbg = false;
-            std::chrono::milliseconds frametime(10);
+            bool dirty = true;
+            bool full = true; // 整屏重画
+            int last_maxx = -1, last_maxy = -1;
             auto timer = std::chrono::steady_clock::duration::zero();
             auto usedtime = std::chrono::steady_clock::duration::zero();
+            auto last_tick = std::chrono::steady_clock::now();
 
+            u64 seed = record::new_seed();
             mGrid.reset(config_width, config_height);
+            mGrid.seed(seed);
             mGrid.generate(2);
+            probe_spawn();
+            // 困难模式的出子不是由种子决定的，没法回放，不记录
+            if( !config_evil )
+                mRecorder.begin(seed, mGrid.width(), mGrid.height());
+            mAnimating = false;
+            bool spawn_pending = false; // 困难模式下等待后台线程给出出子的位置
+            int queued = ERR;           // 等待出子时按下的方向键
+            mShown.assign(mGrid.width() * mGrid.height(), -1);
+            mHint.clear();
 
             int k = 0;
 
@@ -563,83 +268,153 @@ namespace x2048 {
 
                 auto beg = std::chrono::steady_clock::now();
 
-                werase(mWin);
+                // 用时按真实时间累加，不依赖帧率，失去焦点时也照常计时
+                timer += beg - last_tick;
+                last_tick = beg;
 
-                // 绘制分数
-                {
-                    auto score_str = std::to_string(mGrid.score());
-                    auto score_prefix = "Score: ";
-                    int score_str_l = get_string_width(score_str);
-                    int score_prefix_l = get_string_width(score_prefix);
-                    int xpos = CALC_CENTER_BEGIN(getmaxx(mWin), score_str_l + score_prefix_l);
-                    int ypos = 2; 
-                    mvwaddstr(mWin, ypos, xpos, score_prefix);
-                    wattron(mWin, COLOR_PAIR(PAIR_GREEN_TEXT));
-                    mvwaddstr(mWin, ypos, xpos + score_prefix_l, score_str.c_str());
-                    wattroff(mWin, COLOR_PAIR(PAIR_GREEN_TEXT));
+                mAllocStats.begin();
+
+                if( getmaxx(mWin) != last_maxx || getmaxy(mWin) != last_maxy ) {
+                    last_maxx = getmaxx(mWin);
+                    last_maxy = getmaxy(mWin);
+                    full = true;
                 }
 
-                // 绘制时间
-                {
-                    int seconds = std::chrono::duration_cast<std::chrono::seconds>(timer).count();
-                    int minutes = i32(seconds / 60);
-                    seconds %= 60;
+                // 只有状态变化、动画进行中或者到了下一帧的时间才重绘，而且只重画变化的部分
+                bool anim_due = mAnimating && beg >= mAnimNextFrame;
+                if( full || dirty || anim_due || mPacer.frame_due(beg) ) {
+                    SIMPLEGAMES_PROBE2(frame_begin, getmaxx(mWin), getmaxy(mWin));
+                    mAllocStats.phase("draw");
 
-                    std::string text("Used time: ");
-                    text += std::to_string(minutes) + "分" + std::to_string(seconds) + "秒";
-                    waddstrcenter(mWin, 3, text.c_str());
+                    auto l = grid_layout(mGrid);
 
-                    timer += frametime;
-                }
+                    if( full ) {
+                        mAnimating = false;
+                        werase(mWin);
+                    }
+
+                    draw_hud(l, timer, full);
+                    draw_hint(l, full);
+
+                    if( dbg ) {
+                        frame_mem::string text(mFrameArena);
+                        text += "FrameTime=";
+                        frame_mem::append_int(text, std::chrono::duration_cast<std::chrono::microseconds>(usedtime).count());
+                        text += "微秒";
+                        if( config_evil ) {
+                            char evil_buf[96];
+                            snprintf(evil_buf, sizeof(evil_buf), " spawn: depth=%d nodes=%llu %.1fms",
+                                     mEvilLast.depth, (unsigned long long)mEvilLast.nodes, mEvilLast.seconds * 1000);
+                            text += evil_buf;
+                        }
+
+                        // 上一帧的内存分配情况和帧率，用栈上的缓冲区避免影响统计
+                        char buf[6][160];
+                        snprintf(buf[0], sizeof(buf[0]), "%s", text.c_str());
+                        mPacer.format_stats(buf[1], sizeof(buf[1]));
+                        mBudget.format_stats(buf[2], sizeof(buf[2]));
+                        mAllocStats.format_overlay(buf[3], sizeof(buf[3]));
+                        mAllocStats.format_phases(buf[4], sizeof(buf[4]));
+                        mFrameArena.format_stats(buf[5], sizeof(buf[5]));
+                        for( int i = 0; i < 6; i++ ) {
+                            int y = getmaxy(mWin) - 6 + i;
+                            // 和网格重叠的行只在整屏重画时画，随后被网格盖住
+                            if( !full && y < l.y + l.height )
+                                continue;
+                            wmove(mWin, y, 0);
+                            wclrtoeol(mWin);
+                            waddstrcenter(mWin, y, buf[i]);
+                        }
+                    }
+
+                    if( full ) {
+                        draw_grid();
+                        int n = mGrid.width() * mGrid.height();
+                        for( int i = 0; i < n; i++ )
+                            mShown[i] = mGrid.data()[i];
+                    } else if( mAnimating ) {
+                        if( anim_due )
+                            draw_animation(beg);
+                    } else {
+                        sync_cells(l);
+                    }
+
+                    mAllocStats.phase("refresh");
 
-                if( dbg ) {
-                    std::string text("FrameTime=");
-                    text += std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(usedtime).count()) + "微秒";
-                    waddstrcenter(mWin, getmaxy(mWin) - 3, text.c_str());
+                    present();
+                    SIMPLEGAMES_PROBE2(frame_end, getmaxx(mWin), getmaxy(mWin));
+
+                    auto drawn = std::chrono::steady_clock::now();
+                    usedtime = drawn - beg;
+                    mPacer.frame_done(drawn);
+                    dirty = false;
+                    full = false;
                 }
 
-                draw_grid();
+                mAllocStats.phase("input");
+
+                if( !spawn_pending && queued != ERR ) {
+                    // 出子以后再处理等待时按下的方向键
+                    k = queued;
+                    queued = ERR;
+                } else {
+                    // 睡到下一帧(动画的下一帧)或者有输入为止，等待出子时每隔几毫秒看一次结果
+                    auto now = std::chrono::steady_clock::now();
+                    auto deadline = mAnimating ? mAnimNextFrame : std::chrono::steady_clock::time_point::max();
+                    if( spawn_pending )
+                        deadline = std::min(deadline, now + std::chrono::milliseconds(2));
+                    k = co_await mLoop.key(mPacer.timeout_ms(now, deadline));
+                    mPacer.wakeup();
+                }
 
-                nodelay(mWin, 1);
-                k = wgetch(mWin);
-                nodelay(mWin, 0);
+                if( k != ERR )
+                    SIMPLEGAMES_PROBE1(input, k);
+                if( mFocus.handle_key(k) ) {
+                    mPacer.set_focused(mFocus.focused());
+                    mAllocStats.end(true);
+                    continue;
+                }
+                if( spawn_pending && (k == KEY_UP || k == KEY_DOWN || k == KEY_LEFT || k == KEY_RIGHT) ) {
+                    queued = k;
+                    k = ERR;
+                }
+                if( k != ERR )
+                    dirty = true;
 
-                bool valid;
+                bool valid = false;
+                DIRECTION dire = DIRECTION::UP;
                 switch(k) {
                 case KEY_UP:
-                    mGrid.merge(DIRECTION::UP, &valid);
-                    if( valid )
-                        gen = true;
+                    dire = DIRECTION::UP;
+                    gen = true;
                     break;
                 case KEY_DOWN:
-                    mGrid.merge(DIRECTION::DOWN, &valid);
-                    if( valid )
-                        gen = true;
+                    dire = DIRECTION::DOWN;
+                    gen = true;
                     break;
                 case KEY_RIGHT:
-                    mGrid.merge(DIRECTION::RIGHT, &valid);
-                    if( valid )
-                        gen = true;
+                    dire = DIRECTION::RIGHT;
+                    gen = true;
                     break;
                 case KEY_LEFT:
-                    mGrid.merge(DIRECTION::LEFT, &valid);
-                    if( valid )
-                        gen = true;
+                    dire = DIRECTION::LEFT;
+                    gen = true;
                     break;
                 case 'q': 
                 {
+                    finish_animation();
                     bool lcond = true;
                     while(lcond) {
                         const char *msg = "确认退出？Y/n";
                         int msgw = get_string_width(msg);
                         int x = CALC_CENTER_BEGIN(getmaxx(mWin), msgw + 2);
                         int y = CALC_CENTER_BEGIN(getmaxy(mWin), 3);
-                        wattron(mWin, COLOR_PAIR(PAIR_DIALOG));
+                        wattron(mWin, color_pair(PAIR_DIALOG));
                         wfill(mWin, x, y, x + msgw + 1, y + 2, " ");
                         waddstrcenter(mWin, y + 1, msg);
-                        wattroff(mWin, COLOR_PAIR(PAIR_DIALOG));
-                        wrefresh(mWin);
-                        switch(getch()) {
+                        wattroff(mWin, color_pair(PAIR_DIALOG));
+                        present();
+                        switch(co_await mLoop.key()) {
                         case 'y': case 'Y':
                             cond = false;
                             lcond = false;
@@ -649,35 +424,85 @@ namespace x2048 {
                             break;
                         }
                     }
+                    full = true;
                     break;
                 }
                 case '\x04':
                     dbg = !dbg;
+                    full = true;
+                    break;
+                case 'h': case 'H':
+                    if( !spawn_pending )
+                        hint();
                     break;
                 } // switch(k)
 
-                wrefresh(mWin);
+                // 链路慢时动画的每一帧都要占带宽，直接跳到结果
+                bool animate = config_animate && !mBudget.constrained();
+                if( gen ) {
+                    // 上一次的动画还没播完就直接跳到结尾
+                    finish_animation();
+                    i64 increase;
+                    if( animate ) {
+                        const Grid::storage_t *cells = mGrid.data();
+                        mAnimBefore.assign(cells, cells + mGrid.width() * mGrid.height());
+                        increase = mGrid.merge(dire, mMoves, &valid);
+                    } else {
+                        increase = mGrid.merge(dire, &valid);
+                    }
+                    SIMPLEGAMES_PROBE4(move, int(dire), mGrid.width() * mGrid.height(), mGrid.moved(), increase);
+                    gen = valid;
+                    if( valid ) {
+                        mRecorder.move(dire);
+                        mHint.clear();
+                    }
+                }
+
+                mAllocStats.phase("logic");
 
                 if( !cond ) {
-                    return;
+                    mRecorder.finish(mGrid.score());
+                    co_return;
                 }
 
+                bool spawned = false;
                 if( gen ) {
-                    mGrid.generate_randomly();
-                    if( mGrid.is_fail() ) {
-                        cond = false;
-                        throw GameOver(mGrid.score(), "莫得可以合并的格子了!", timer);
+                    if( config_evil ) {
+                        // 搜索的时间比滑动的动画短，动画播完时新的格子已经出来了
+                        mSpawner.request(mGrid, std::chrono::milliseconds(config_evil_budget));
+                        spawn_pending = true;
+                    } else {
+                        mGrid.generate_randomly();
+                        probe_spawn();
+                        spawned = true;
+                    }
+                    if( animate && !mMoves.empty() )
+                        start_animation(mMoves);
+                }
+
+                evil::Searcher::result spawn;
+                if( spawn_pending && mSpawner.poll(spawn) ) {
+                    spawn_pending = false;
+                    if( spawn.index >= 0 ) {
+                        mGrid.generate_at(spawn.index, spawn.value);
+                        SIMPLEGAMES_PROBE3(spawn, spawn.index, spawn.value, mGrid.width() * mGrid.height());
                     }
+                    mEvilLast = spawn;
+                    spawned = true;
+                    dirty = true;
+                }
+
+                if( spawned && mGrid.is_fail() ) {
+                    cond = false;
+                    mRecorder.finish(mGrid.score());
+                    throw GameOver(mGrid.score(), "莫得可以合并的格子了!", timer);
                 }
 
-                auto end = std::chrono::steady_clock::now();
-                usedtime = end - beg;
-                if( usedtime < frametime )
-                    std::this_thread::sleep_for(frametime - usedtime);
+                mAllocStats.end(k == ERR);
             }
         } // void render_game()
 
-        void render_gameover(const GameOver &gg) {
+        coro::task<> render_gameover(GameOver gg) {
             static constexpr int DIALOG_H = 10;
             static constexpr const char *TITLE = "游戏结束！";
             auto why = gg.what();
@@ -695,7 +520,7 @@ namespace x2048 {
 
                 werase(mWin);
 
-                wattron(mWin, COLOR_PAIR(PAIR_DIALOG));
+                wattron(mWin, color_pair(PAIR_DIALOG));
                 wfill(mWin, xpos_orig, ypos_orig, xpos_orig + width - 1, ypos_orig + DIALOG_H - 1, " ");
 
                 waddstrcenter(mWin, ypos_orig + 1, TITLE);
@@ -705,19 +530,19 @@ namespace x2048 {
                 waddstrcenter(mWin, ypos_orig + 7, "按下R查看最后游戏界面");
                 waddstrcenter(mWin, ypos_orig + 8, "按下Q退出");
 
-                wrefresh(mWin);
+                present();
 
-                wattroff(mWin, COLOR_PAIR(PAIR_DIALOG));
+                wattroff(mWin, color_pair(PAIR_DIALOG));
 
-                k = getch();
+                k = co_await mLoop.key();
                 switch(k) {
                 case 'R': case 'r':
                     while(true) {
                         werase(mWin);
                         draw_grid();
                         waddstrcenter(mWin, getmaxy(mWin) - 2, "按下Q退出查看");
-                        wrefresh(mWin);
-                        int k = getch();
+                        present();
+                        int k = co_await mLoop.key();
                         if( k == 'q' || k == 'Q' ) {
                             break;
                         }
@@ -731,18 +556,24 @@ namespace x2048 {
         } // void render_gameover()
 
         void draw_number(int gx, int gy, int global_xcoord, int global_ycoord, u64 nbr) {
+            int xsize = config_fix_rect ? config_size * 2 : config_size;
+            int xpos_orig = global_xcoord + 1 + gx * (xsize + 1);
+            int ypos_orig = global_ycoord + 1 + gy * (config_size + 1);
+            draw_number_at(xpos_orig, ypos_orig, nbr);
+        } // void draw_number()
+
+        /// 以(xpos_orig, ypos_orig)为格子内部的左上角绘制数字，动画中的格子不一定对齐网格
+        void draw_number_at(int xpos_orig, int ypos_orig, u64 nbr) {
             auto &size = config_size;
             auto &fix_rect = config_fix_rect;
             int xsize = fix_rect ? size * 2 : size;
 
-            std::string str = std::to_string(nbr);
+            frame_mem::string str(mFrameArena);
+            frame_mem::append_int(str, nbr);
             int len = str.size();
             if( !len )
                 return;
 
-            int xpos_orig = global_xcoord + 1 + gx * (size + 1) * (fix_rect ? 2 : 1);
-            int ypos_orig = global_ycoord + 1 + gy * (size + 1);
-
             int lines = int(len / xsize) + 1;
             int lastline = len % xsize;
 
@@ -760,7 +591,7 @@ namespace x2048 {
 
             // 绘制最后一行
             mvwaddstr(mWin, ypos_orig + ybeg + lines - 1, xpos_orig + last_xcoord, str.c_str());
-        } // void draw_number()
+        } // void draw_number_at()
 
         void draw_grid(const Grid &grid) {
             auto &size = config_size;
@@ -864,35 +695,429 @@ namespace x2048 {
             draw_grid(mGrid);
         }
 
-        void render_settings() {
+        /// 屏幕上的一块矩形区域
+        struct rect_t {
+            int x, y, w, h;
+
+            bool intersects(const rect_t &o) const {
+                return x < o.x + o.w && o.x < x + w && y < o.y + o.h && o.y < y + h;
+            }
+        };
+
+        /// 网格在屏幕上的位置和尺寸，与draw_grid()一致
+        struct layout_t {
+            int x, y;          // 左上角
+            int width, height; // 包括边框
+            int cw, ch;        // 单个格子内部的宽和高
+        };
+
+        layout_t grid_layout(const Grid &grid) const {
+            layout_t l;
+            l.cw = config_fix_rect ? config_size * 2 : config_size;
+            l.ch = config_size;
+            l.width = grid.width() * (l.cw + 1) + 1;
+            l.height = grid.height() * (l.ch + 1) + 1;
+            l.x = CALC_CENTER_BEGIN(getmaxx(mWin), l.width);
+            l.y = CALC_CENTER_BEGIN(getmaxy(mWin), l.height);
+            return l;
+        }
+
+        /// 第index个格子内部的矩形
+        rect_t cell_rect(const layout_t &l, int index) const {
+            int gx = index % mGrid.width(), gy = index / mGrid.width();
+            return rect_t{l.x + 1 + gx * (l.cw + 1), l.y + 1 + gy * (l.ch + 1), l.cw, l.ch};
+        }
+
+        /// draw_number_at()在(xpos_orig, ypos_orig)绘制nbr时会覆盖的矩形
+        rect_t number_rect(int xpos_orig, int ypos_orig, u64 nbr) const {
+            int len = 1;
+            for( u64 v = nbr; v >= 10; v /= 10 )
+                len += 1;
+            int xsize = config_fix_rect ? config_size * 2 : config_size;
+            int lines = int(len / xsize) + 1;
+            int ybeg = CALC_CENTER_BEGIN(config_size, lines);
+            if( lines == 1 )
+                return rect_t{xpos_orig + CALC_CENTER_BEGIN(xsize, len), ypos_orig + ybeg, len, 1};
+            return rect_t{xpos_orig, ypos_orig + ybeg, xsize, lines};
+        }
+
+        /// 网格背景(边框或空白)在网格内坐标(lx, ly)处的字符
+        const char *border_at(const layout_t &l, int lx, int ly) const {
+            bool left = lx == 0, right = lx == l.width - 1, vsep = lx % (l.cw + 1) == 0;
+            if( ly == 0 )
+                return left ? "╔" : right ? "╗" : vsep ? "╦" : "═";
+            if( ly == l.height - 1 )
+                return left ? "╚" : right ? "╝" : vsep ? "╩" : "═";
+            if( ly % (l.ch + 1) == 0 )
+                return left ? "╠" : right ? "╣" : vsep ? "╬" : "═";
+            return vsep ? "║" : " ";
+        }
+
+        /// 用网格背景重画一块矩形，只动网格内部的字符
+        void repaint_rect(const layout_t &l, const rect_t &r) {
+            for( int y = r.y; y < r.y + r.h; y++ ) {
+                int ly = y - l.y;
+                if( ly < 0 || ly >= l.height )
+                    continue;
+                for( int x = r.x; x < r.x + r.w; x++ ) {
+                    int lx = x - l.x;
+                    if( lx < 0 || lx >= l.width )
+                        continue;
+                    mvwaddstr(mWin, y, x, border_at(l, lx, ly));
+                }
+            }
+        }
+
+        /// 把和屏幕上显示的不一样的格子重画，只画变化了的格子
+        void sync_cells(const layout_t &l) {
+            int n = mGrid.width() * mGrid.height();
+            const Grid::storage_t *cells = mGrid.data();
+            for( int i = 0; i < n; i++ ) {
+                if( mShown[i] == cells[i] )
+                    continue;
+                auto r = cell_rect(l, i);
+                for( int y = r.y; y < r.y + r.h; y++ )
+                    mvwhline(mWin, y, r.x, ' ', r.w);
+                if( cells[i] != 0 )
+                    draw_number_at(r.x, r.y, cells[i]);
+                mShown[i] = cells[i];
+            }
+        }
+
+        /// 根据合并前的网格和移动记录开始播放滑动动画
+        void start_animation(const std::vector<tile_move> &moves) {
+            int n = mGrid.width() * mGrid.height();
+            auto l = grid_layout(mGrid);
+
+            mAnimStatic.assign(n, 0);
+            for( int i = 0; i < n; i++ )
+                mAnimStatic[i] = mAnimBefore[i] != 0;
+
+            mAnimTiles.clear();
+            for( auto &m : moves ) {
+                mAnimStatic[m.from] = 0;
+                // 原来的位置会在动画里被擦掉
+                mShown[m.from] = 0;
+                auto from = cell_rect(l, m.from);
+                anim_tile_t tile;
+                tile.from = m.from;
+                tile.to = m.to;
+                tile.value = mAnimBefore[m.from];
+                tile.last = number_rect(from.x, from.y, tile.value);
+                mAnimTiles.push_back(tile);
+            }
+
+            mAnimating = true;
+            mAnimBegin = std::chrono::steady_clock::now();
+            mAnimNextFrame = mAnimBegin;
+        }
+
+        /// 擦掉移动中的格子上一帧画的位置，被擦到的静止格子重画
+        void erase_anim_tiles(const layout_t &l) {
+            for( auto &tile : mAnimTiles )
+                repaint_rect(l, tile.last);
+
+            int n = mGrid.width() * mGrid.height();
+            for( int i = 0; i < n; i++ ) {
+                if( !mAnimStatic[i] )
+                    continue;
+                auto c = cell_rect(l, i);
+                auto r = number_rect(c.x, c.y, mAnimBefore[i]);
+                for( auto &tile : mAnimTiles ) {
+                    if( r.intersects(tile.last) ) {
+                        draw_number_at(c.x, c.y, mAnimBefore[i]);
+                        break;
+                    }
+                }
+            }
+        }
+
+        /// 画动画的一帧，动画结束时画出最终的网格
+        void draw_animation(std::chrono::steady_clock::time_point now) {
+            auto l = grid_layout(mGrid);
+            auto duration = std::chrono::milliseconds(config_anim_time);
+            double t = std::chrono::duration<double>(now - mAnimBegin) / duration;
+            if( t >= 1 ) {
+                finish_animation();
+                return;
+            }
+
+            erase_anim_tiles(l);
+
+            // 先快后慢
+            double e = 1 - (1 - t) * (1 - t);
+            for( auto &tile : mAnimTiles ) {
+                auto from = cell_rect(l, tile.from), to = cell_rect(l, tile.to);
+                int x = from.x + int((to.x - from.x) * e + 0.5);
+                int y = from.y + int((to.y - from.y) * e + 0.5);
+                tile.last = number_rect(x, y, tile.value);
+                draw_number_at(x, y, tile.value);
+            }
+
+            mAnimNextFrame = now + std::chrono::microseconds(1000000 / config_anim_fps);
+        }
+
+        /// 立即结束动画，把网格画成最终状态
+        void finish_animation() {
+            if( !mAnimating )
+                return;
+            auto l = grid_layout(mGrid);
+            erase_anim_tiles(l);
+            mAnimating = false;
+            sync_cells(l);
+        }
+
+        /// 重画分数和时间，只有内容变化时才动屏幕
+        void draw_hud(const layout_t &l, std::chrono::steady_clock::duration timer, bool force) {
+            // 网格挡住了这两行时只在整屏重画时画(会被网格盖住，和以前一样)
+            if( !force && l.y <= 3 )
+                return;
+
+            frame_mem::string score_str(mFrameArena);
+            frame_mem::append_int(score_str, mGrid.score());
+            if( force || std::string_view(score_str) != mHudScore ) {
+                mHudScore.assign(score_str.data(), score_str.size());
+                auto score_prefix = config_evil ? "[困难] Score: " : "Score: ";
+                int score_str_l = get_string_width(score_str.c_str());
+                int score_prefix_l = get_string_width(score_prefix);
+                int xpos = CALC_CENTER_BEGIN(getmaxx(mWin), score_str_l + score_prefix_l);
+                int ypos = 2; 
+                wmove(mWin, ypos, 0);
+                wclrtoeol(mWin);
+                mvwaddstr(mWin, ypos, xpos, score_prefix);
+                wattron(mWin, color_pair(PAIR_GREEN_TEXT));
+                mvwaddstr(mWin, ypos, xpos + score_prefix_l, score_str.c_str());
+                wattroff(mWin, color_pair(PAIR_GREEN_TEXT));
+            }
+
+            int seconds = std::chrono::duration_cast<std::chrono::seconds>(timer).count();
+            int minutes = i32(seconds / 60);
+            seconds %= 60;
+
+            frame_mem::string text(mFrameArena);
+            text += "Used time: ";
+            frame_mem::append_int(text, minutes) += "分";
+            frame_mem::append_int(text, seconds) += "秒";
+            if( force || std::string_view(text) != mHudTime ) {
+                mHudTime.assign(text.data(), text.size());
+                wmove(mWin, 3, 0);
+                wclrtoeol(mWin);
+                waddstrcenter(mWin, 3, text.c_str());
+            }
+        }
+
+        /// 玩家的棋盘上出了子才触发spawn探针，搜索和模拟用的Grid不触发
+        void probe_spawn() {
+            int i = mGrid.spawned();
+            if( i >= 0 )
+                SIMPLEGAMES_PROBE3(spawn, i, mGrid.data()[i], mGrid.width() * mGrid.height());
+        }
+
+        /// 提示下一步: 先查开局库，查不到时做一次浅的expectimax搜索
+        /// 开局库在第一次提示时才打开，不拖慢启动
+        void hint() {
+            static const char *const ARROWS[4] = {"↑", "↓", "→", "←"};
+            if( !mBookOpened ) {
+                mBookOpened = true;
+                mBook.open(book::book_path());
+            }
+            DIRECTION d;
+            if( mBook.deeper_than_live() && mBook.lookup(mGrid, d) )
+                mHint = std::string("提示: ") + ARROWS[int(d)] + " (开局库)";
+            else if( mHintSearch.best_move(mGrid, book::LIVE_DEPTH, d) )
+                mHint = std::string("提示: ") + ARROWS[int(d)] + " (搜索)";
+            else
+                mHint = "提示: 没有可以走的方向";
+        }
+
+        /// 画提示，网格上面没有空行时画在最下面一行，内容变化时才动屏幕
+        void draw_hint(const layout_t &l, bool force) {
+            int y = l.y > 4 ? 4 : getmaxy(mWin) - 1;
+            if( y < 0 || (y >= l.y && y < l.y + l.height) )
+                return;
+            if( !force && mHint == mHintShown )
+                return;
+            mHintShown = mHint;
+            wmove(mWin, y, 0);
+            wclrtoeol(mWin);
+            if( !mHint.empty() )
+                waddstrcenter(mWin, y, mHint.c_str());
+        }
+
+        /// 颜色在第一次用到时才初始化，每个颜色对也是用到时才设置，不拖慢启动
+        int color_pair(int pair) {
+            if( !mColorsStarted ) {
+                mColorsStarted = true;
+                start_color();
+                use_default_colors();
+            }
+            if( !(mPairsReady & (1u << pair)) ) {
+                mPairsReady |= 1u << pair;
+                switch(pair) {
+                case PAIR_HIGHLIGHT:
+                    init_pair(PAIR_HIGHLIGHT, COLOR_BLACK, COLOR_WHITE);
+                    break;
+                case PAIR_DIALOG:
+                    init_color(COLOR_GRAY, 0xa0, 0xa0, 0xa0);
+                    init_pair(PAIR_DIALOG, COLOR_RED, COLOR_GRAY);
+                    break;
+                case PAIR_GREEN_TEXT:
+                    init_pair(PAIR_GREEN_TEXT, COLOR_GREEN, 0);
+                    break;
+                }
+            }
+            return COLOR_PAIR(pair);
+        }
+
+        /// 刷新窗口，并在开启观战时发布这一帧的变化
+        /// 输出超出链路的预算时先不发，交给后台的flush_later()，和之后的变化合成一帧再发
+        void present() {
+            wnoutrefresh(mWin);
+            if( startup::global().first_frame() ) {
+                doupdate();
+                throw GameStop(0, "startup measured");
+            }
+            // 要在doupdate()清掉改过的行的标记之前
+            mSpectate.publish();
+            if( !flush_output() && !mFlushScheduled ) {
+                mFlushScheduled = true;
+                mLoop.spawn(flush_later());
+            }
+            // 一帧到这里就画完了，这一帧拼的字符串都不再用
+            mFrameArena.reset();
+        }
+
+        /// 在预算允许时把积攒的变化发给终端，返回是否发了
+        bool flush_output() {
+            auto beg = std::chrono::steady_clock::now();
+            if( !mBudget.admit(beg) ) {
+                mOutputPending = true;
+                return false;
+            }
+            doupdate();
+            mBudget.sent(beg, std::chrono::steady_clock::now());
+            mOutputPending = false;
+            return true;
+        }
+
+        coro::task<> flush_later() {
+            while( mOutputPending ) {
+                co_await mLoop.sleep_until(mBudget.retry_at());
+                if( mOutputPending )
+                    flush_output();
+            }
+            mFlushScheduled = false;
+        }
+
+        /// 困难模式的一局，结束后恢复成普通模式
+        coro::task<> render_evil_game() {
+            config_evil = true;
+            try {
+                co_await render_game();
+            } catch(...) {
+                config_evil = false;
+                throw;
+            }
+            config_evil = false;
+        } // void render_evil_game()
+
+        coro::task<> render_settings() {
             waddstrcenter(mWin, int(getmaxy(mWin) * 0.5), "In development!");
             waddstrcenter(mWin, int(getmaxy(mWin) * 0.5) + 1, "Press any key to back");
-            getch();
+            co_await mLoop.key();
         } // void render_settings()
 
         /// Always throw a GameStop exception with code 0 message "Normally exit"
-        void stop() {
+        coro::task<> stop() {
             throw GameStop(0, "Normally exit");
+            co_return;
         } // void stop()
 
-        void run() {
+        coro::task<> run_screens() {
             while(true) {
+                // catch里不能co_await，先把异常存下来
+                std::optional<GameOver> over;
                 try {
-                    render_title();
+                    co_await render_title();
                 } catch(GameOver &gg) {
-                    render_gameover(gg);
+                    over.emplace(gg);
                 }
+                if( over )
+                    co_await render_gameover(*over);
             }
+        } // void run_screens()
+
+        void run() {
+            mLoop.run(run_screens());
         } // void run()
 
+        const alloc_stats::frame_stats &frame_alloc_stats() const {
+            return mAllocStats;
+        }
+
+        const pacing::frame_pacer &frame_pacer() const {
+            return mPacer;
+        }
+
+        const pacing::output_budget &output_budget() const {
+            return mBudget;
+        }
+
+        const frame_mem::arena &frame_arena() const {
+            return mFrameArena;
+        }
+
         int config_width;
         int config_height;
         int config_size;
         bool config_fix_rect;
+        bool config_animate;
+        int config_anim_time;
+        int config_anim_fps;
+        bool config_evil;
+        int config_evil_budget;
 
     private:
         WINDOW *mWin;
+        coro::event_loop mLoop{mWin};
         Grid mGrid;
+        alloc_stats::frame_stats mAllocStats;
+        frame_mem::arena mFrameArena;           // 画一帧时的临时字符串，present()时清空
+        spectate::publisher mSpectate{PROGRAM};
+        pacing::focus_tracker mFocus;
+        record::Recorder mRecorder;
+        evil::Spawner mSpawner;
+        evil::Searcher::result mEvilLast;
+        book::Book mBook;
+        bool mBookOpened = false;
+        book::Expectimax mHintSearch{14};
+        std::string mHint;      // 提示键给出的走法，走了一步以后清掉
+        std::string mHintShown;
+        // 有焦点时每250毫秒检查一次时间是否需要更新，动画的帧另外安排，失去焦点时见SIMPLEGAMES_UNFOCUSED_FPS
+        pacing::frame_pacer mPacer{std::chrono::milliseconds(250)};
+        pacing::output_budget mBudget;
+        bool mColorsStarted = false;
+        unsigned mPairsReady = 0;       // 已经init_pair()的颜色对，按位
+        bool mOutputPending = false;    // 有变化因为超出预算还没发给终端
+        bool mFlushScheduled = false;   // flush_later()正在等
+
+        // 脏矩形和动画
+        struct anim_tile_t {
+            int from;
+            int to;
+            Grid::storage_t value;
+            rect_t last; // 上一帧画在哪里
+        };
+        std::vector<Grid::storage_t> mShown;      // 屏幕上每个格子显示的数字，-1表示需要重画
+        std::vector<Grid::storage_t> mAnimBefore; // 合并前的网格
+        std::vector<tile_move> mMoves;
+        std::vector<anim_tile_t> mAnimTiles;
+        std::vector<u8> mAnimStatic;              // 动画中不动的格子
+        bool mAnimating = false;
+        std::chrono::steady_clock::time_point mAnimBegin;
+        std::chrono::steady_clock::time_point mAnimNextFrame;
+        std::string mHudScore;
+        std::string mHudTime;
         int mEasterStatus;
     };
 
@@ -901,17 +1126,32 @@ namespace x2048 {
 
 }
 
-int main() {
+int main(int argc, char **argv) {
+    auto &startup = startup::global();
+    if( argc == 2 && strcmp(argv[1], "--measure-startup") == 0 ) {
+        startup.enable();
+    } else if( argc > 1 ) {
+        std::cerr << "usage: " << argv[0] << " [--measure-startup]" << std::endl;
+        return 2;
+    }
+
     setlocale(LC_ALL, "");
+    startup.mark("setlocale");
 
     initscr();
+    startup.mark("initscr");
 
     x2048::Game game;
+    startup.mark("game");
 
     try {
         game.run();
     } catch(x2048::GameStop &stop_msg) {
         endwin();
+        if( startup.done() ) {
+            startup.report(stderr, "X2048");
+            return 0;
+        }
         std::cerr << "[X2048] Game exited";
         if( stop_msg.code() != 0 )
             std::cerr << " with code " + std::to_string(stop_msg.code());
@@ -926,5 +1166,12 @@ int main() {
         std::cerr << "[X2048] GAME STOPPED DUE TO AN UNKNOWN ERROR THOWN!" << std::endl;
     }
     endwin();
+    game.frame_alloc_stats().report(stderr, "X2048");
+    if( alloc_stats::enabled )
+        game.frame_arena().report(stderr, "X2048");
+    if( getenv("SIMPLEGAMES_PACING_STATS") ) {
+        game.frame_pacer().report(stderr, "X2048");
+        game.output_budget().report(stderr, "X2048");
+    }
     return 0;
 }
@@ -0,0 +1,533 @@
+// 2048对局记录的离线分析(记录格式见record.h)
+// compile with: make x2048-analyze
+//
+// 用法:
+//   x2048-analyze [-j N] FILE...              分析记录文件
+//   x2048-analyze --synth N [-j N] [--seed S] FILE
+//                                             生成N局模拟对局追加到FILE，用来测试和压测
+//
+// 读文件的线程把记录按批放进有界队列，工作线程回放并各自统计，最后合并，
+// 所以内存占用和文件大小无关。
+// 每一步和内置的贪心策略(立即得分最多的方向)比较，再用同样的种子让贪心完整地下一局作为基准。
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/scheduler.h"
+#include "grid.h"
+#include "record.h"
+
+namespace x2048 {
+namespace analyze {
+
+    constexpr int CURVE_STEP = 50;     // 分数曲线每50步一个点
+    constexpr int CURVE_POINTS = 200;  // 最多到10000步
+    constexpr int LOG_BUCKETS = 64;
+    constexpr size_t BATCH_BYTES = 1 << 20;
+
+    inline int log2_bucket(u64 v) {
+        int b = 0;
+        while( v > 1 && b < LOG_BUCKETS - 1 ) {
+            v >>= 1;
+            b += 1;
+        }
+        return b;
+    }
+
+    /// 一个线程的统计结果，大小固定
+    struct stats {
+        u64 records = 0;
+        u64 bad = 0;          // 数据损坏或者回放出无效操作
+        u64 mismatch = 0;     // 回放的分数和记录的不一致(比如出子的算法变了)
+        u64 moves = 0;
+        u64 greedy_agree = 0; // 这一步的得分和贪心一样多
+        u64 greedy_gain = 0;  // 贪心这一步能得分的步数
+        u64 missed = 0;       // 贪心能得分而这一步没得分
+        u64 lost_score = 0;   // 比贪心少得的分数之和
+        u64 dir[4] = {};
+
+        u64 baseline_games = 0;
+        u64 baseline_wins = 0; // 玩家的分数比同一种子下的贪心高
+        double score_sum = 0;
+        double baseline_score_sum = 0;
+
+        u64 curve_n[CURVE_POINTS] = {};
+        double curve_sum[CURVE_POINTS] = {};
+        u64 baseline_curve_n[CURVE_POINTS] = {};
+        double baseline_curve_sum[CURVE_POINTS] = {};
+
+        u64 final_score[LOG_BUCKETS] = {};
+        u64 max_tile[LOG_BUCKETS] = {};
+        u64 length[LOG_BUCKETS] = {};
+        u64 time_hist[256] = {};
+        u64 timed_moves = 0;
+
+        stats &operator+=(const stats &o) {
+            records += o.records;
+            bad += o.bad;
+            mismatch += o.mismatch;
+            moves += o.moves;
+            greedy_agree += o.greedy_agree;
+            greedy_gain += o.greedy_gain;
+            missed += o.missed;
+            lost_score += o.lost_score;
+            for( int i = 0; i < 4; i++ )
+                dir[i] += o.dir[i];
+            baseline_games += o.baseline_games;
+            baseline_wins += o.baseline_wins;
+            score_sum += o.score_sum;
+            baseline_score_sum += o.baseline_score_sum;
+            for( int i = 0; i < CURVE_POINTS; i++ ) {
+                curve_n[i] += o.curve_n[i];
+                curve_sum[i] += o.curve_sum[i];
+                baseline_curve_n[i] += o.baseline_curve_n[i];
+                baseline_curve_sum[i] += o.baseline_curve_sum[i];
+            }
+            for( int i = 0; i < LOG_BUCKETS; i++ ) {
+                final_score[i] += o.final_score[i];
+                max_tile[i] += o.max_tile[i];
+                length[i] += o.length[i];
+            }
+            for( int i = 0; i < 256; i++ )
+                time_hist[i] += o.time_hist[i];
+            timed_moves += o.timed_moves;
+            return *this;
+        }
+    };
+
+    /// 贪心: 立即得分最多的方向，得分一样时按UP DOWN RIGHT LEFT的顺序
+    /// 没有可以走的方向时返回false
+    inline bool greedy_move(const Grid &grid, Grid &scratch, DIRECTION &best, i64 &best_gain) {
+        bool any = false;
+        best_gain = -1;
+        for( int d = 0; d < 4; d++ ) {
+            scratch = grid;
+            bool valid = false;
+            i64 gain = scratch.only_merge(DIRECTION(d), &valid);
+            if( valid && gain > best_gain ) {
+                best_gain = gain;
+                best = DIRECTION(d);
+                any = true;
+            }
+        }
+        return any;
+    }
+
+    inline Grid::storage_t max_tile(const Grid &grid) {
+        Grid::storage_t m = 0;
+        for( int i = 0; i < grid.width() * grid.height(); i++ )
+            m = std::max(m, grid.data()[i]);
+        return m;
+    }
+
+    /// 从同样的种子开始，全程用贪心下完一局，moves_limit防止死循环
+    inline i64 play_greedy(const record::header &h, stats &st, u32 moves_limit) {
+        Grid grid(h.width, h.height), scratch(h.width, h.height);
+        grid.seed(h.seed);
+        grid.generate(2);
+        for( u32 i = 0; i < moves_limit; i++ ) {
+            DIRECTION d;
+            i64 gain;
+            if( !greedy_move(grid, scratch, d, gain) )
+                break;
+            grid.merge(d);
+            grid.generate_randomly();
+            if( i / CURVE_STEP < u32(CURVE_POINTS) && i % CURVE_STEP == 0 ) {
+                st.baseline_curve_n[i / CURVE_STEP] += 1;
+                st.baseline_curve_sum[i / CURVE_STEP] += double(grid.score());
+            }
+        }
+        return grid.score();
+    }
+
+    /// 只回放不统计，检查操作都有效、分数和记录一致
+    inline bool verify_record(const record::header &h, const u8 *moves, stats &st) {
+        Grid grid(h.width, h.height);
+        grid.seed(h.seed);
+        grid.generate(2);
+        for( u32 i = 0; i < h.moves; i++ ) {
+            bool valid = false;
+            grid.merge(record::move_at(moves, i), &valid);
+            if( !valid ) {
+                st.bad += 1;
+                return false;
+            }
+            grid.generate_randomly();
+        }
+        if( u64(grid.score()) != h.score ) {
+            st.mismatch += 1;
+            return false;
+        }
+        return true;
+    }
+
+    /// 回放一条记录并统计
+    /// 先确认记录是好的再统计，坏记录不会留下半局的数据
+    inline void analyze_record(const u8 *raw, stats &st) {
+        record::header h;
+        if( !record::decode_header(raw, h) ) {
+            st.bad += 1;
+            return;
+        }
+        const u8 *moves = raw + record::HEADER_SIZE;
+        const u8 *times = (h.flags & record::RECORD_HAS_TIMES) ? moves + (size_t(h.moves) + 3) / 4 : nullptr;
+        if( !verify_record(h, moves, st) )
+            return;
+
+        Grid grid(h.width, h.height), scratch(h.width, h.height);
+        grid.seed(h.seed);
+        grid.generate(2);
+
+        for( u32 i = 0; i < h.moves; i++ ) {
+            DIRECTION d = record::move_at(moves, i);
+
+            DIRECTION best;
+            i64 best_gain;
+            greedy_move(grid, scratch, best, best_gain);
+
+            i64 gain = grid.merge(d);
+            grid.generate_randomly();
+
+            st.dir[int(d)] += 1;
+            if( gain == best_gain )
+                st.greedy_agree += 1;
+            if( best_gain > 0 ) {
+                st.greedy_gain += 1;
+                if( gain <= 0 )
+                    st.missed += 1;
+            }
+            if( gain < best_gain )
+                st.lost_score += u64(best_gain - std::max<i64>(gain, 0));
+            if( i % CURVE_STEP == 0 && i / CURVE_STEP < u32(CURVE_POINTS) ) {
+                st.curve_n[i / CURVE_STEP] += 1;
+                st.curve_sum[i / CURVE_STEP] += double(grid.score());
+            }
+            if( times ) {
+                st.time_hist[times[i]] += 1;
+                st.timed_moves += 1;
+            }
+        }
+
+        st.records += 1;
+        st.moves += h.moves;
+        st.score_sum += double(grid.score());
+        st.final_score[log2_bucket(u64(grid.score()))] += 1;
+        st.max_tile[log2_bucket(u64(max_tile(grid)))] += 1;
+        st.length[log2_bucket(h.moves)] += 1;
+
+        i64 baseline = play_greedy(h, st, h.moves * 4 + 10000);
+        st.baseline_games += 1;
+        st.baseline_score_sum += double(baseline);
+        if( grid.score() > baseline )
+            st.baseline_wins += 1;
+    }
+
+    /// 一批原始记录，offsets是每条记录的起点
+    struct batch {
+        std::vector<u8> raw;
+        std::vector<size_t> offsets;
+    };
+
+    /// 有界的批队列，读文件的线程在队列满时等待
+    class batch_queue {
+    public:
+        explicit batch_queue(size_t capacity) : mCapacity(capacity), mClosed(false) {}
+
+        void push(std::unique_ptr<batch> b) {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mNotFull.wait(lock, [this] { return mItems.size() < mCapacity; });
+            mItems.push_back(std::move(b));
+            mNotEmpty.notify_one();
+        }
+
+        std::unique_ptr<batch> pop() {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mNotEmpty.wait(lock, [this] { return !mItems.empty() || mClosed; });
+            if( mItems.empty() )
+                return nullptr;
+            auto b = std::move(mItems.front());
+            mItems.pop_front();
+            mNotFull.notify_one();
+            return b;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mClosed = true;
+            mNotEmpty.notify_all();
+        }
+
+    private:
+        size_t mCapacity;
+        bool mClosed;
+        std::deque<std::unique_ptr<batch>> mItems;
+        std::mutex mMutex;
+        std::condition_variable mNotEmpty;
+        std::condition_variable mNotFull;
+    };
+
+    /// 时间直方图的百分位(毫秒)
+    inline double time_percentile(const stats &st, double p) {
+        if( st.timed_moves == 0 )
+            return 0;
+        u64 want = u64(p * double(st.timed_moves - 1));
+        u64 seen = 0;
+        for( int c = 0; c < 256; c++ ) {
+            seen += st.time_hist[c];
+            if( seen > want )
+                return record::time_from_code(u8(c));
+        }
+        return record::time_from_code(255);
+    }
+
+    inline void print_log_hist(const char *title, const u64 *hist, u64 total) {
+        printf("%s\n", title);
+        for( int i = 0; i < LOG_BUCKETS; i++ ) {
+            if( hist[i] == 0 )
+                continue;
+            printf("  >= %-10llu %10llu  %5.1f%%\n", 1ull << i, (unsigned long long)hist[i], 100.0 * hist[i] / total);
+        }
+    }
+
+    inline void report(const stats &st, double secs, int threads) {
+        printf("records: %llu ok, %llu bad, %llu score mismatch\n",
+               (unsigned long long)st.records, (unsigned long long)st.bad, (unsigned long long)st.mismatch);
+        printf("replayed %llu moves in %.2fs with %d threads: %.0f records/s, %.0f moves/s\n",
+               (unsigned long long)st.moves, secs, threads, st.records / secs, st.moves / secs);
+        if( st.records == 0 )
+            return;
+
+        printf("\nmove quality vs greedy (max immediate score):\n");
+        printf("  same gain as greedy:   %5.1f%%\n", 100.0 * st.greedy_agree / st.moves);
+        printf("  missed a merge:        %5.1f%% of %llu moves where greedy could merge\n",
+               st.greedy_gain ? 100.0 * st.missed / st.greedy_gain : 0.0, (unsigned long long)st.greedy_gain);
+        printf("  score left behind:     %.2f per move\n", double(st.lost_score) / st.moves);
+        printf("  directions:            up %.1f%%  down %.1f%%  right %.1f%%  left %.1f%%\n",
+               100.0 * st.dir[0] / st.moves, 100.0 * st.dir[1] / st.moves, 100.0 * st.dir[2] / st.moves, 100.0 * st.dir[3] / st.moves);
+        printf("  mean final score:      %.1f (greedy on the same seeds: %.1f)\n",
+               st.score_sum / st.records, st.baseline_games ? st.baseline_score_sum / st.baseline_games : 0.0);
+        printf("  beat greedy:           %5.1f%% of games\n", 100.0 * st.baseline_wins / st.records);
+
+        printf("\nscore curve (mean score after move N, games still running):\n");
+        printf("  %8s %12s %10s %12s %10s\n", "move", "score", "games", "greedy", "games");
+        for( int i = 0; i < CURVE_POINTS; i++ ) {
+            if( st.curve_n[i] == 0 && st.baseline_curve_n[i] == 0 )
+                continue;
+            printf("  %8d %12.1f %10llu %12.1f %10llu\n", i * CURVE_STEP,
+                   st.curve_n[i] ? st.curve_sum[i] / st.curve_n[i] : 0.0, (unsigned long long)st.curve_n[i],
+                   st.baseline_curve_n[i] ? st.baseline_curve_sum[i] / st.baseline_curve_n[i] : 0.0,
+                   (unsigned long long)st.baseline_curve_n[i]);
+        }
+
+        printf("\n");
+        print_log_hist("final score:", st.final_score, st.records);
+        print_log_hist("max tile:", st.max_tile, st.records);
+        print_log_hist("moves per game:", st.length, st.records);
+
+        if( st.timed_moves ) {
+            printf("\ntime per move (ms): p10 %.0f  p50 %.0f  p90 %.0f  p99 %.0f  max %.0f\n",
+                   time_percentile(st, 0.1), time_percentile(st, 0.5), time_percentile(st, 0.9),
+                   time_percentile(st, 0.99), time_percentile(st, 1.0));
+            u64 hist[LOG_BUCKETS] = {};
+            for( int c = 0; c < 256; c++ )
+                hist[log2_bucket(u64(record::time_from_code(u8(c))))] += st.time_hist[c];
+            print_log_hist("time per move (ms):", hist, st.timed_moves);
+        }
+    }
+
+    inline int run_analyze(const std::vector<const char *> &files, int threads) {
+        batch_queue queue(size_t(threads) * 2);
+        std::vector<stats> results(threads);
+        std::vector<std::thread> workers;
+
+        auto beg = std::chrono::steady_clock::now();
+        for( int t = 0; t < threads; t++ ) {
+            workers.emplace_back([&queue, &results, t] {
+                // 每个线程各自统计，最后合并，避免共享计数器
+                auto local = std::make_unique<stats>();
+                while( auto b = queue.pop() ) {
+                    for( size_t off : b->offsets )
+                        analyze_record(b->raw.data() + off, *local);
+                }
+                results[t] = *local;
+            });
+        }
+
+        int rc = 0;
+        for( auto file : files ) {
+            FILE *fp = fopen(file, "rb");
+            if( !fp ) {
+                fprintf(stderr, "cannot open %s\n", file);
+                rc = 1;
+                continue;
+            }
+            std::vector<char> iobuf(1 << 20);
+            setvbuf(fp, iobuf.data(), _IOFBF, iobuf.size());
+
+            auto b = std::make_unique<batch>();
+            b->raw.reserve(BATCH_BYTES + 4096);
+            record::header h;
+            size_t offset = 0;      // 下一条记录在文件里的位置
+            while( true ) {
+                size_t at = b->raw.size();
+                if( !record::read_next(fp, h, b->raw) )
+                    break;
+                b->offsets.push_back(at);
+                offset += b->raw.size() - at;
+                if( b->raw.size() >= BATCH_BYTES ) {
+                    queue.push(std::move(b));
+                    b = std::make_unique<batch>();
+                    b->raw.reserve(BATCH_BYTES + 4096);
+                }
+            }
+            if( errno != 0 || ferror(fp) ) {
+                fprintf(stderr, "%s: corrupt or truncated record at offset %zu, skipping the rest\n",
+                        file, offset);
+                rc = 1;
+            }
+            if( !b->offsets.empty() )
+                queue.push(std::move(b));
+            fclose(fp);
+        }
+        queue.close();
+
+        auto total = std::make_unique<stats>();
+        for( int t = 0; t < threads; t++ ) {
+            workers[t].join();
+            *total += results[t];
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+        report(*total, secs, threads);
+        return rc;
+    }
+
+    /// 模拟一局: 大部分时候走贪心，有一定概率随机走，用时也是随机的
+    inline void synth_game(u64 seed, std::vector<u8> &out) {
+        Rng policy(seed ^ 0x5deece66dull);
+        Grid grid(4, 6), scratch(4, 6);
+        grid.seed(seed);
+        grid.generate(2);
+
+        record::header h{};
+        h.version = record::VERSION;
+        h.width = 4;
+        h.height = 6;
+        h.flags = record::RECORD_HAS_TIMES;
+        h.seed = seed;
+        h.start_time = i64(time(nullptr));
+
+        std::vector<u8> moves, times;
+        u64 total_ms = 0;
+        while( true ) {
+            DIRECTION d;
+            i64 gain;
+            if( !greedy_move(grid, scratch, d, gain) )
+                break;
+            if( policy.below(4) == 0 ) {
+                // 随机挑一个有效的方向
+                for( int tries = 0; tries < 8; tries++ ) {
+                    DIRECTION r = DIRECTION(policy.below(4));
+                    scratch = grid;
+                    bool valid = false;
+                    scratch.only_merge(r, &valid);
+                    if( valid ) {
+                        d = r;
+                        break;
+                    }
+                }
+            }
+            grid.merge(d);
+            grid.generate_randomly();
+
+            u32 i = h.moves++;
+            if( i % 4 == 0 )
+                moves.push_back(0);
+            moves.back() |= u8(u8(d) << ((i % 4) * 2));
+            u64 ms = 80 + policy.below(400) + (policy.below(20) == 0 ? policy.below(5000) : 0);
+            total_ms += ms;
+            times.push_back(record::time_code(ms));
+        }
+
+        h.score = u64(grid.score());
+        h.duration_ms = u32(total_ms);
+        record::encode_header(out, h);
+        out.insert(out.end(), moves.begin(), moves.end());
+        out.insert(out.end(), times.begin(), times.end());
+    }
+
+    inline int run_synth(u64 count, u64 seed, int threads, const char *file) {
+        FILE *fp = fopen(file, "ab");
+        if( !fp ) {
+            fprintf(stderr, "cannot open %s\n", file);
+            return 1;
+        }
+        std::mutex out_mutex;
+        auto beg = std::chrono::steady_clock::now();
+
+        // 每256局一个任务，写文件的缓冲区每个线程一个
+        sched::scheduler pool(threads - 1);
+        std::vector<std::vector<u8>> bufs(size_t(pool.concurrency()));
+        sched::parallel_for_range(pool, 0, size_t(count), 256, [&](size_t first, size_t last) {
+            Rng seeds(0);
+            std::vector<u8> &buf = bufs[size_t(pool.worker_index())];
+            buf.reserve(BATCH_BYTES + 4096);
+            for( u64 i = first; i < last; i++ ) {
+                seeds.seed(seed + i);
+                synth_game(seeds.next(), buf);
+            }
+            std::lock_guard<std::mutex> lock(out_mutex);
+            fwrite(buf.data(), 1, buf.size(), fp);
+            buf.clear();
+        });
+        fclose(fp);
+
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+        printf("wrote %llu games to %s in %.2fs (%.0f games/s)\n", (unsigned long long)count, file, secs, count / secs);
+        return 0;
+    }
+
+} // namespace analyze
+} // namespace x2048
+
+int main(int argc, char **argv) {
+    using namespace x2048;
+
+    int threads = int(std::thread::hardware_concurrency());
+    u64 synth = 0;
+    u64 seed = 1;
+    std::vector<const char *> files;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp(argv[i], "-j") == 0 && i + 1 < argc ) {
+            threads = atoi(argv[++i]);
+        } else if( strcmp(argv[i], "--synth") == 0 && i + 1 < argc ) {
+            synth = strtoull(argv[++i], nullptr, 10);
+        } else if( strcmp(argv[i], "--seed") == 0 && i + 1 < argc ) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if( threads <= 0 )
+        threads = 1;
+
+    if( files.empty() || (synth && files.size() != 1) ) {
+        fprintf(stderr, "usage: %s [-j N] FILE...\n", argv[0]);
+        fprintf(stderr, "       %s --synth N [-j N] [--seed S] FILE\n", argv[0]);
+        return 2;
+    }
+
+    if( synth )
+        return analyze::run_synth(synth, seed, threads, files.front());
+    return analyze::run_analyze(files, threads);
+}
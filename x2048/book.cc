@@ -0,0 +1,191 @@
+// 生成2048的开局库(book.h)
+// compile with: make x2048-book
+//
+// 从开局(一个2出在任意格子)出发，每一步先对所有局面做expectimax搜索定下走法，
+// 再按所有可能的出子展开到下一步，同样的局面(含翻转)合并概率，概率低于--min-prob的丢掉。
+// 展开的局面数随步数指数增长，--plies和--min-prob一起决定开局库的大小。
+//
+// 用法:
+//   x2048-book [--plies N] [--depth D] [--min-prob P] [-j N] [--width W] [--height H] [OUT]
+// OUT默认是book_path()
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../common/scheduler.h"
+#include "grid.h"
+#include "book.h"
+
+namespace x2048 {
+
+    struct position {
+        Grid grid;
+        double prob;
+        DIRECTION best;
+        bool movable;
+    };
+
+    /// 并行地为每个局面搜出最好的走法，searches是每个线程一个的搜索器(置换表很大，用到时才建)
+    inline void search_all(std::vector<position> &ps, int depth, sched::scheduler &pool,
+                           std::vector<std::unique_ptr<book::Expectimax>> &searches, u64 &nodes) {
+        searches.resize(size_t(pool.concurrency()));
+        nodes += sched::parallel_reduce(pool, 0, ps.size(), 4, u64(0), [&](size_t first, size_t last) {
+            auto &search = searches[size_t(pool.worker_index())];
+            if( !search )
+                search = std::make_unique<book::Expectimax>(20);
+            u64 n = 0;
+            for( size_t i = first; i < last; i++ ) {
+                ps[i].movable = search->best_move(ps[i].grid, depth, ps[i].best);
+                n += search->nodes();
+            }
+            return n;
+        }, std::plus<u64>());
+    }
+
+    /// 走完这一步之后按所有可能的出子展开，合并同样的局面
+    inline std::vector<position> expand(const std::vector<position> &ps, double min_prob) {
+        std::unordered_map<u64, size_t> index;
+        std::vector<position> out;
+        for( auto &p : ps ) {
+            if( !p.movable )
+                continue;
+            Grid moved(p.grid);
+            moved.only_merge(p.best);
+            int n = moved.width() * moved.height();
+            int blanks = 0;
+            for( int i = 0; i < n; i++ )
+                blanks += moved.data()[i] == 0;
+            for( int i = 0; i < n; i++ ) {
+                if( moved.data()[i] != 0 )
+                    continue;
+                for( int k = 0; k < book::SPAWN_KINDS; k++ ) {
+                    double prob = p.prob * book::SPAWN_PROB[k] / blanks;
+                    if( prob < min_prob )
+                        continue;
+                    moved.generate_at(i, book::SPAWN_VALUE[k]);
+                    u64 key = book::canonical_hash(moved);
+                    auto it = index.find(key);
+                    if( it == index.end() ) {
+                        index.emplace(key, out.size());
+                        out.push_back(position{moved, prob, DIRECTION::UP, false});
+                    } else {
+                        out[it->second].prob += prob;
+                    }
+                    moved.generate_at(i, 0);
+                }
+            }
+        }
+        return out;
+    }
+
+} // namespace x2048
+
+int main(int argc, char **argv) {
+    using namespace x2048;
+
+    // 比游戏里查不到时的现场搜索(book::LIVE_DEPTH)深，开局库才有用
+    int plies = 4, depth = 4, threads = 0;
+    int width = 4, height = 6;
+    double min_prob = 1e-5;
+    std::string path;
+
+    for( int i = 1; i < argc; i++ ) {
+        auto arg = [&](const char *name) { return strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if( arg("--plies") ) {
+            plies = atoi(argv[++i]);
+        } else if( arg("--depth") ) {
+            depth = atoi(argv[++i]);
+        } else if( arg("--min-prob") ) {
+            min_prob = atof(argv[++i]);
+        } else if( arg("-j") ) {
+            threads = atoi(argv[++i]);
+        } else if( arg("--width") ) {
+            width = atoi(argv[++i]);
+        } else if( arg("--height") ) {
+            height = atoi(argv[++i]);
+        } else if( argv[i][0] != '-' && path.empty() ) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [--plies N] [--depth D] [--min-prob P] [-j N] [--width W] [--height H] [OUT]\n", argv[0]);
+            return 2;
+        }
+    }
+    if( plies <= 0 || plies > 255 || depth <= 0 || width <= 0 || height <= 0 || width > 255 || height > 255 )
+        return 2;
+    if( depth <= book::LIVE_DEPTH )
+        fprintf(stderr, "warning: --depth %d is not deeper than the live hint search (%d), the game will ignore this book\n",
+                depth, book::LIVE_DEPTH);
+    if( threads <= 0 )
+        threads = sched::scheduler::default_threads();
+    if( path.empty() )
+        path = book::book_path();
+    if( path.empty() ) {
+        fprintf(stderr, "no output file\n");
+        return 1;
+    }
+
+    auto beg = std::chrono::steady_clock::now();
+
+    // 开局: 一个2出在任意一个格子
+    std::vector<position> ps;
+    {
+        std::unordered_map<u64, size_t> index;
+        double p = 1.0 / (width * height);
+        for( int i = 0; i < width * height; i++ ) {
+            Grid g(width, height);
+            g.generate_at(i, 2);
+            u64 key = book::canonical_hash(g);
+            auto it = index.find(key);
+            if( it == index.end() ) {
+                index.emplace(key, ps.size());
+                ps.push_back(position{g, p, DIRECTION::UP, false});
+            } else {
+                ps[it->second].prob += p;
+            }
+        }
+    }
+
+    sched::scheduler pool(threads - 1);
+    std::vector<std::unique_ptr<book::Expectimax>> searches;
+    std::vector<std::pair<u64, DIRECTION>> entries;
+    u64 nodes = 0;
+    for( int ply = 0; ply < plies; ply++ ) {
+        auto t0 = std::chrono::steady_clock::now();
+        search_all(ps, depth, pool, searches, nodes);
+        double covered = 0;
+        for( auto &p : ps ) {
+            if( !p.movable )
+                continue;
+            // 表里存的是规范形式下的方向
+            int sym;
+            u64 key = book::canonical_hash(p.grid, &sym);
+            entries.emplace_back(key, book::flip_dire(p.best, sym));
+            covered += p.prob;
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        fprintf(stderr, "ply %d: %zu positions, %.4f of the probability mass, %.2fs\n", ply, ps.size(), covered, secs);
+        if( ply + 1 < plies )
+            ps = expand(ps, min_prob);
+    }
+
+    book::Writer writer(entries.size());
+    for( auto &e : entries )
+        writer.add(e.first, e.second);
+    if( !writer.save(path, width, height, plies, depth) ) {
+        perror(path.c_str());
+        return 1;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+    printf("%s: %u positions, %dx%d, %d plies, depth %d, %.0f nodes/s, %.1fs\n", path.c_str(), writer.entries(),
+           width, height, plies, depth, secs > 0 ? double(nodes) / secs : 0.0, secs);
+    return 0;
+}
@@ -0,0 +1,424 @@
+#pragma once
+
+// 2048的开局库
+//
+// 开局的前几步只会出现有限的局面。离线工具(book.cc)从开局出发，按开局库自己给出的走法
+// 和所有可能的出子展开，出现概率太低的局面丢掉，对每个局面做一次深的expectimax搜索，
+// 把最好的方向写进文件。游戏启动时把文件mmap进来，提示键先查开局库，查不到再做一次浅的搜索。
+//
+// 局面按左右、上下翻转取规范形式(4种对称)，存的是规范形式的哈希，方向在查询时翻转回来。
+// 文件格式(小端序):
+//    0  u32 magic "X2BK"
+//    4  u8  版本(1)
+//    5  u8  网格宽度
+//    6  u8  网格高度
+//    7  u8  展开的步数
+//    8  u32 哈希表大小的对数
+//   12  u32 局面数
+//   16  u32 搜索深度
+//   20  u32 保留
+//   24  哈希表，每项u64: 哈希清掉低2位(结果为0时用4) | 方向，0表示空，线性探测，
+//       至少留一个空项
+//
+// 环境变量:
+//   SIMPLEGAMES_2048_BOOK  开局库文件，默认$XDG_DATA_HOME/simplegames/x2048.book
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grid.h"
+#include "evil.h"
+#include "record.h"
+
+namespace x2048 {
+namespace book {
+
+    constexpr u32 MAGIC = 0x4b423258; // "X2BK"
+    constexpr u8 VERSION = 1;
+    constexpr size_t HEADER_SIZE = 24;
+
+    /// 开局库查不到时现场搜索的深度; 开局库的搜索深度要比它深才有用，不比它深的开局库不查
+    constexpr int LIVE_DEPTH = 2;
+
+    /// 出子的概率，和Grid::generate_randomly()一致
+    constexpr int SPAWN_KINDS = 4;
+    constexpr Grid::storage_t SPAWN_VALUE[SPAWN_KINDS] = {2, 4, 8, 16};
+    constexpr double SPAWN_PROB[SPAWN_KINDS] = {3.0 / 4, 3.0 / 16, 3.0 / 64, 1.0 / 64};
+
+    inline int exponent(Grid::storage_t v) {
+        return v ? __builtin_ctzll(u64(v)) : 0;
+    }
+
+    /// 第sym种翻转(bit0左右，bit1上下)下局面的哈希
+    inline u64 hash_flipped(const Grid &g, int sym) {
+        int w = g.width(), h = g.height();
+        const Grid::storage_t *c = g.data();
+        u64 hv = 0x510e527fade682d1ull ^ (u64(w) << 8 | u64(h));
+        for( int y = 0; y < h; y++ ) {
+            for( int x = 0; x < w; x++ ) {
+                int sx = (sym & 1) ? w - 1 - x : x;
+                int sy = (sym & 2) ? h - 1 - y : y;
+                u64 z = hv + (u64(exponent(c[sx + sy * w])) + 1) * 0x9e3779b97f4a7c15ull;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                hv = z ^ (z >> 31);
+            }
+        }
+        return hv;
+    }
+
+    /// 规范形式的哈希(4种翻转里最小的)，sym_out是用到的翻转
+    inline u64 canonical_hash(const Grid &g, int *sym_out = nullptr) {
+        u64 best = 0;
+        int best_sym = 0;
+        for( int sym = 0; sym < 4; sym++ ) {
+            u64 hv = hash_flipped(g, sym);
+            if( sym == 0 || hv < best ) {
+                best = hv;
+                best_sym = sym;
+            }
+        }
+        if( sym_out )
+            *sym_out = best_sym;
+        return best;
+    }
+
+    /// 把翻转后的局面里的方向换成原局面里的方向(翻转是自己的逆，反过来也一样)
+    inline DIRECTION flip_dire(DIRECTION d, int sym) {
+        if( (sym & 1) && (d == DIRECTION::LEFT || d == DIRECTION::RIGHT) )
+            return d == DIRECTION::LEFT ? DIRECTION::RIGHT : DIRECTION::LEFT;
+        if( (sym & 2) && (d == DIRECTION::UP || d == DIRECTION::DOWN) )
+            return d == DIRECTION::UP ? DIRECTION::DOWN : DIRECTION::UP;
+        return d;
+    }
+
+    /// 表项里存的键，不会是0
+    inline u64 slot_key(u64 hv) {
+        u64 k = hv & ~u64(3);
+        return k ? k : 4;
+    }
+
+    /// 带概率剪枝和置换表的expectimax，depth是玩家走的步数
+    /// 离线工具用它做深的搜索，游戏里离开开局库以后用它做浅的搜索
+    class Expectimax {
+    public:
+        /// 置换表在第一次搜索时才分配
+        explicit Expectimax(int table_bits = 16) : mMask((size_t(1) << table_bits) - 1) {}
+
+        /// 没有可以走的方向时返回false
+        bool best_move(const Grid &g, int depth, DIRECTION &out, double min_prob = 1e-4) {
+            mGen += 1;
+            mMinProb = min_prob;
+            mNodes = 0;
+            if( mTable.empty() )
+                mTable.resize(mMask + 1);
+            if( int(mPly.size()) < depth * 2 + 2 || mPly[0].width() != g.width() || mPly[0].height() != g.height() )
+                mPly.assign(depth * 2 + 2, g);
+
+            double best = 0;
+            bool any = false;
+            for( int d = 0; d < 4; d++ ) {
+                Grid &child = mPly[0];
+                child = g;
+                bool moved = false;
+                i64 gain = child.only_merge(DIRECTION(d), &moved);
+                if( !moved )
+                    continue;
+                double v = chance_node(child, depth, 1, 1.0) + double(gain);
+                if( !any || v > best ) {
+                    best = v;
+                    out = DIRECTION(d);
+                    any = true;
+                }
+            }
+            return any;
+        }
+
+        u64 nodes() const {
+            return mNodes;
+        }
+
+    private:
+        static constexpr double DEAD = -1e5;
+
+        struct entry {
+            u64 key = 0;
+            u32 gen = 0;
+            u8 depth = 0;
+            float value = 0;
+        };
+
+        /// 玩家走一步，返回这一步的得分加上之后的期望
+        double max_node(const Grid &g, int depth, int ply, double prob) {
+            if( depth == 0 )
+                return evil::Searcher::evaluate(g);
+            double best = DEAD;
+            Grid &child = mPly[ply];
+            for( int d = 0; d < 4; d++ ) {
+                child = g;
+                bool moved = false;
+                i64 gain = child.only_merge(DIRECTION(d), &moved);
+                if( !moved )
+                    continue;
+                best = std::max(best, chance_node(child, depth, ply + 1, prob) + double(gain));
+            }
+            return best;
+        }
+
+        /// 随机出子，对所有空格子和数字取期望
+        double chance_node(const Grid &g, int depth, int ply, double prob) {
+            mNodes += 1;
+            if( prob < mMinProb )
+                return evil::Searcher::evaluate(g);
+
+            u64 key = hash_flipped(g, 0);
+            entry &e = mTable[key & mMask];
+            if( e.gen == mGen && e.key == key && e.depth >= depth )
+                return e.value;
+
+            int n = g.width() * g.height();
+            int blanks = 0;
+            for( int i = 0; i < n; i++ )
+                blanks += g.data()[i] == 0;
+            if( blanks == 0 )
+                return evil::Searcher::evaluate(g);
+
+            Grid &child = mPly[ply];
+            child = g;
+            double sum = 0, mass = 0;
+            for( int i = 0; i < n; i++ ) {
+                if( g.data()[i] != 0 )
+                    continue;
+                for( int k = 0; k < SPAWN_KINDS; k++ ) {
+                    double p = SPAWN_PROB[k] / blanks;
+                    // 概率小的数字在概率本来就不大的分支里不再展开
+                    if( prob * p < mMinProb && k > 0 )
+                        continue;
+                    child.generate_at(i, SPAWN_VALUE[k]);
+                    sum += p * max_node(child, depth - 1, ply + 1, prob * p);
+                    mass += p;
+                    child.generate_at(i, 0);
+                }
+            }
+            // 剪掉的分支不算，按展开了的概率归一，否则剪得多的局面期望偏低
+            sum /= mass;
+
+            e.key = key;
+            e.gen = mGen;
+            e.depth = u8(depth);
+            e.value = float(sum);
+            return sum;
+        }
+
+        std::vector<entry> mTable;
+        size_t mMask;
+        u32 mGen = 0;
+        double mMinProb = 1e-4;
+        u64 mNodes = 0;
+        std::vector<Grid> mPly;
+    };
+
+    /// 开局库文件的路径
+    inline std::string book_path() {
+        if( const char *env = getenv("SIMPLEGAMES_2048_BOOK") )
+            return env;
+        return record::data_file("x2048.book");
+    }
+
+    /// mmap进来的开局库，只读
+    class Book {
+    public:
+        Book() : mBase(nullptr), mSize(0), mTable(nullptr), mMask(0), mWidth(0), mHeight(0), mEntries(0), mDepth(0) {}
+
+        ~Book() {
+            close();
+        }
+
+        Book(const Book &) = delete;
+        Book &operator=(const Book &) = delete;
+
+        /// 打开失败(没有文件或者格式不对)时返回false，此时lookup()总是查不到
+        /// copy为true时把整个文件读进自己分配的内存，不mmap: 页缓存里的文件只在一个NUMA节点上，
+        /// 在每个节点上各读一份(见common/numa.h的replicated)，查表就不用跨节点
+        bool open(const std::string &path, bool copy = false) {
+            close();
+            if( path.empty() )
+                return false;
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if( fd < 0 )
+                return false;
+            struct stat st;
+            if( fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE ) {
+                ::close(fd);
+                return false;
+            }
+            void *p;
+            if( copy ) {
+                // u64的数组分配，表项是对齐的
+                mCopy.reset(new u64[(size_t(st.st_size) + 7) / 8]);
+                p = mCopy.get();
+                size_t done = 0;
+                while( done < size_t(st.st_size) ) {
+                    ssize_t n = ::pread(fd, static_cast<u8*>(p) + done, size_t(st.st_size) - done, off_t(done));
+                    if( n <= 0 )
+                        break;
+                    done += size_t(n);
+                }
+                ::close(fd);
+                if( done != size_t(st.st_size) ) {
+                    mCopy.reset();
+                    return false;
+                }
+            } else {
+                p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if( p == MAP_FAILED )
+                    return false;
+            }
+
+            const u8 *h = static_cast<const u8*>(p);
+            u32 bits = u32(record::get_le(h + 8, 4));
+            // 局面数占满整张表时查不到的局面找不到空项，不要这样的文件
+            if( record::get_le(h, 4) != MAGIC || h[4] != VERSION || bits > 40
+                || size_t(st.st_size) != HEADER_SIZE + (size_t(8) << bits)
+                || record::get_le(h + 12, 4) >= (u64(1) << bits) ) {
+                if( mCopy )
+                    mCopy.reset();
+                else
+                    munmap(p, size_t(st.st_size));
+                return false;
+            }
+            mBase = p;
+            mSize = size_t(st.st_size);
+            mWidth = h[5];
+            mHeight = h[6];
+            mEntries = u32(record::get_le(h + 12, 4));
+            mDepth = int(record::get_le(h + 16, 4));
+            mTable = reinterpret_cast<const u64*>(h + HEADER_SIZE);
+            mMask = (size_t(1) << bits) - 1;
+            return true;
+        }
+
+        void close() {
+            if( mBase && !mCopy )
+                munmap(mBase, mSize);
+            mCopy.reset();
+            mBase = nullptr;
+            mTable = nullptr;
+        }
+
+        bool loaded() const {
+            return mTable != nullptr;
+        }
+
+        u32 entries() const {
+            return mEntries;
+        }
+
+        /// 生成时每个局面的搜索深度
+        int depth() const {
+            return mDepth;
+        }
+
+        /// 比现场搜索(LIVE_DEPTH)深，值得先查
+        bool deeper_than_live() const {
+            return loaded() && mDepth > LIVE_DEPTH;
+        }
+
+        /// 在开局库里找grid的走法
+        /// 最多探测整张表一遍，文件头里的局面数不对、表其实是满的也不会死循环
+        bool lookup(const Grid &g, DIRECTION &out) const {
+            if( !mTable || g.width() != mWidth || g.height() != mHeight )
+                return false;
+            int sym;
+            u64 key = slot_key(canonical_hash(g, &sym));
+            size_t i = key >> 2 & mMask;
+            for( size_t probes = 0; probes <= mMask; probes++, i = (i + 1) & mMask ) {
+                u64 slot = mTable[i];
+                if( slot == 0 )
+                    return false;
+                if( (slot & ~u64(3)) == key ) {
+                    out = flip_dire(DIRECTION(slot & 3), sym);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        void *mBase;
+        size_t mSize;
+        std::unique_ptr<u64[]> mCopy;   // open(path, true)时文件的内容
+        const u64 *mTable;
+        size_t mMask;
+        int mWidth;
+        int mHeight;
+        u32 mEntries;
+        int mDepth;
+    };
+
+    /// 写开局库用的哈希表，moves里是规范形式下的方向
+    class Writer {
+    public:
+        explicit Writer(size_t expected) {
+            int bits = 4;
+            while( (size_t(1) << bits) < expected * 2 )
+                bits += 1;
+            mBits = bits;
+            mTable.assign(size_t(1) << bits, 0);
+        }
+
+        void add(u64 canonical, DIRECTION canonical_dire) {
+            u64 key = slot_key(canonical);
+            size_t mask = mTable.size() - 1;
+            for( size_t i = key >> 2 & mask;; i = (i + 1) & mask ) {
+                if( mTable[i] == 0 || (mTable[i] & ~u64(3)) == key ) {
+                    if( mTable[i] == 0 )
+                        mEntries += 1;
+                    mTable[i] = key | u64(canonical_dire);
+                    return;
+                }
+            }
+        }
+
+        bool save(const std::string &path, int width, int height, int plies, int depth) const {
+            std::vector<u8> out;
+            record::put_le(out, MAGIC, 4);
+            out.push_back(VERSION);
+            out.push_back(u8(width));
+            out.push_back(u8(height));
+            out.push_back(u8(plies));
+            record::put_le(out, u64(mBits), 4);
+            record::put_le(out, mEntries, 4);
+            record::put_le(out, u64(depth), 4);
+            record::put_le(out, 0, 4);
+            for( u64 slot : mTable )
+                record::put_le(out, slot, 8);
+
+            FILE *fp = fopen(path.c_str(), "wb");
+            if( !fp )
+                return false;
+            bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+            return fclose(fp) == 0 && ok;
+        }
+
+        u32 entries() const {
+            return mEntries;
+        }
+
+    private:
+        int mBits;
+        u32 mEntries = 0;
+        std::vector<u64> mTable;
+    };
+
+} // namespace book
+} // namespace x2048
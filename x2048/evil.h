@@ -0,0 +1,402 @@
+#pragma once
+
+// 2048的困难模式: 新的格子不随机出，而是出在对玩家最不利的位置
+//
+// 用带alpha-beta剪枝的极小极大搜索(玩家取最大，出子的一方取最小)，按深度逐层加深，
+// 到时间就用最后一层完整搜完的结果。为了在时间内搜得更深:
+//   - 走法排序: 置换表里记下的最好的走法先试，出子按静态评估从差到好排
+//   - 置换表: 同样的局面(不同的走法顺序)只搜一次。表在两次搜索之间不清空，
+//     表项的键的低位(和下标重复，本来没用)换成这次搜索的代数，上一次搜索留下的表项自然对不上
+// 困难模式只出2和4。
+// Spawner在后台线程里搜索，游戏循环用poll()取结果，不会卡住输入。
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "grid.h"
+
+namespace x2048 {
+namespace evil {
+
+    using clock = std::chrono::steady_clock;
+
+    constexpr double LOSS = -1e9;
+
+    /// 出子的搜索，单线程使用
+    class Searcher {
+    public:
+        struct result {
+            int index = -1;              // 出在哪个格子，-1表示没有空格子
+            Grid::storage_t value = 2;
+            int depth = 0;               // 完整搜完的深度(层数，出子和移动各算一层)
+            u64 nodes = 0;
+            double seconds = 0;
+        };
+
+        /// 置换表在第一次搜索时才分配，只创建不搜索(比如普通模式的游戏)时不占内存和启动时间
+        explicit Searcher(int table_bits = 18) : mMask((size_t(1) << table_bits) - 1) {}
+
+        /// 在deadline之前尽量搜深，最少搜一层
+        result search(const Grid &grid, clock::time_point deadline, int max_depth = 16) {
+            auto beg = clock::now();
+            result best;
+
+            // 代数在低位里转一圈以后才真的清空一次表
+            mGen = (mGen + 1) & mMask;
+            if( mTable.empty() || mGen == 0 ) {
+                mTable.assign(mMask + 1, entry{});
+                mGen = 1;
+            }
+            mPly.clear();
+            mPly.resize(max_depth + 1, grid);
+            mCands.resize(max_depth + 1);
+            mNodes = 0;
+            mDeadline = deadline;
+
+            for( int depth = 1; depth <= max_depth; depth++ ) {
+                mAbort = false;
+                int index = -1;
+                Grid::storage_t value = 2;
+                min_node(grid, depth, 0, LOSS * 2, -LOSS * 2, &index, &value);
+                if( mAbort && depth > 1 )
+                    break;
+                best.index = index;
+                best.value = value;
+                best.depth = depth;
+                if( index < 0 || clock::now() >= deadline )
+                    break;
+            }
+
+            best.nodes = mNodes;
+            best.seconds = std::chrono::duration<double>(clock::now() - beg).count();
+            return best;
+        }
+
+        /// 局面的静态评估，越大对玩家越有利
+        static double evaluate(const Grid &g) {
+            const Grid::storage_t *c = g.data();
+            int w = g.width(), h = g.height();
+            int empties = 0, pairs = 0;
+            double mono = 0;
+
+            // 行
+            for( int y = 0; y < h; y++ ) {
+                double inc = 0, dec = 0;
+                for( int x = 0; x < w; x++ ) {
+                    int e = exponent(c[x + y * w]);
+                    if( e == 0 )
+                        empties += 1;
+                    if( x + 1 < w ) {
+                        int n = exponent(c[x + 1 + y * w]);
+                        if( e > n )
+                            dec += e - n;
+                        else
+                            inc += n - e;
+                        if( e != 0 && e == n )
+                            pairs += 1;
+                    }
+                }
+                mono += std::min(inc, dec);
+            }
+            // 列
+            for( int x = 0; x < w; x++ ) {
+                double inc = 0, dec = 0;
+                for( int y = 0; y + 1 < h; y++ ) {
+                    int e = exponent(c[x + y * w]), n = exponent(c[x + (y + 1) * w]);
+                    if( e > n )
+                        dec += e - n;
+                    else
+                        inc += n - e;
+                    if( e != 0 && e == n )
+                        pairs += 1;
+                }
+                mono += std::min(inc, dec);
+            }
+
+            return empties * 270.0 + pairs * 70.0 - mono * 47.0;
+        }
+
+    private:
+        enum : u8 { EXACT, LOWER, UPPER };
+
+        struct entry {
+            u64 key = 0;
+            float value = 0;
+            i8 depth = -1;
+            u8 flag = EXACT;
+            i16 best = -1; // 最好的走法: 方向，或者 格子 * 2 + (值是4)
+        };
+
+        struct cand {
+            i16 code;
+            double score;
+        };
+
+        static int exponent(Grid::storage_t v) {
+            return v ? __builtin_ctzll(u64(v)) : 0;
+        }
+
+        static u64 hash(const Grid &g, bool spawn_turn) {
+            u64 h = spawn_turn ? 0x6a09e667f3bcc908ull : 0xbb67ae8584caa73bull;
+            const Grid::storage_t *c = g.data();
+            for( int i = 0; i < g.width() * g.height(); i++ ) {
+                u64 z = h + (u64(i) << 8 | u64(exponent(c[i]))) * 0x9e3779b97f4a7c15ull;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                h = z ^ (z >> 27);
+            }
+            return h;
+        }
+
+        bool out_of_time() {
+            if( (++mNodes & 1023) == 0 && clock::now() >= mDeadline )
+                mAbort = true;
+            return mAbort;
+        }
+
+        /// 表项里存的键: 低位是搜索的代数
+        u64 tag(u64 key) const {
+            return (key & ~u64(mMask)) | mGen;
+        }
+
+        entry *probe(u64 key) {
+            entry &e = mTable[key & mMask];
+            return e.key == tag(key) ? &e : nullptr;
+        }
+
+        void store(u64 key, int depth, double value, double alpha, double beta, int best) {
+            entry &e = mTable[key & mMask];
+            if( e.key == tag(key) && e.depth > depth )
+                return;
+            e.key = tag(key);
+            e.depth = i8(depth);
+            e.value = float(value);
+            e.best = i16(best);
+            e.flag = value <= alpha ? UPPER : value >= beta ? LOWER : EXACT;
+        }
+
+        /// 用置换表的结果剪枝，返回true表示可以直接用value
+        static bool cutoff(const entry *e, int depth, double &alpha, double &beta, double &value) {
+            if( !e || e->depth < depth )
+                return false;
+            if( e->flag == EXACT ) {
+                value = e->value;
+                return true;
+            }
+            if( e->flag == LOWER )
+                alpha = std::max(alpha, double(e->value));
+            else
+                beta = std::min(beta, double(e->value));
+            if( alpha >= beta ) {
+                value = e->value;
+                return true;
+            }
+            return false;
+        }
+
+        /// 玩家走一步
+        double max_node(const Grid &g, int depth, int ply, double alpha, double beta) {
+            if( depth == 0 )
+                return evaluate(g);
+            if( out_of_time() )
+                return 0;
+
+            double a0 = alpha, b0 = beta, value;
+            u64 key = hash(g, false);
+            entry *e = probe(key);
+            if( cutoff(e, depth, alpha, beta, value) )
+                return value;
+
+            // 置换表里的最好方向先试
+            int order[4] = {0, 3, 2, 1};
+            if( e && e->best >= 0 && e->best < 4 ) {
+                std::swap(order[0], *std::find(order, order + 4, int(e->best)));
+            }
+
+            double best = LOSS;
+            int best_dir = -1;
+            Grid &child = mPly[ply];
+            for( int d : order ) {
+                child = g;
+                bool moved = false;
+                child.only_merge(DIRECTION(d), &moved);
+                if( !moved )
+                    continue;
+                double v = min_node(child, depth - 1, ply + 1, alpha, beta, nullptr, nullptr);
+                if( mAbort )
+                    return 0;
+                if( v > best || best_dir < 0 ) {
+                    best = v;
+                    best_dir = d;
+                }
+                alpha = std::max(alpha, v);
+                if( alpha >= beta )
+                    break;
+            }
+
+            store(key, depth, best, a0, b0, best_dir);
+            return best;
+        }
+
+        /// 出子的一方选格子和数字，index_out不为空时是根节点
+        double min_node(const Grid &g, int depth, int ply, double alpha, double beta, int *index_out, Grid::storage_t *value_out) {
+            if( depth == 0 )
+                return evaluate(g);
+            // 根节点不检查时间，保证第一层一定能搜完
+            if( index_out == nullptr && out_of_time() )
+                return 0;
+
+            double a0 = alpha, b0 = beta, value;
+            u64 key = hash(g, true);
+            entry *e = probe(key);
+            if( !index_out && cutoff(e, depth, alpha, beta, value) )
+                return value;
+
+            Grid &child = mPly[ply];
+            child = g;
+            auto &cands = mCands[ply];
+            cands.clear();
+            int n = g.width() * g.height();
+            const Grid::storage_t *c = g.data();
+            for( int i = 0; i < n; i++ ) {
+                if( c[i] != 0 )
+                    continue;
+                for( int four = 0; four < 2; four++ ) {
+                    double s = 0;
+                    // 静态评估只用来排序，太浅时不值得
+                    if( depth >= 2 ) {
+                        child.put(i % g.width(), i / g.width(), four ? 4 : 2);
+                        s = evaluate(child);
+                        child.put(i % g.width(), i / g.width(), 0);
+                    }
+                    cands.push_back(cand{i16(i * 2 + four), s});
+                }
+            }
+            if( cands.empty() )
+                return evaluate(g);
+
+            int hint = e ? e->best : -1;
+            std::sort(cands.begin(), cands.end(), [hint](const cand &a, const cand &b) {
+                if( (a.code == hint) != (b.code == hint) )
+                    return a.code == hint;
+                return a.score < b.score;
+            });
+
+            double best = -LOSS;
+            int best_code = cands.front().code;
+            for( size_t k = 0; k < cands.size(); k++ ) {
+                int code = cands[k].code;
+                int idx = code / 2;
+                child.put(idx % g.width(), idx / g.width(), (code & 1) ? 4 : 2);
+                double v = max_node(child, depth - 1, ply + 1, alpha, beta);
+                child.put(idx % g.width(), idx / g.width(), 0);
+                if( mAbort )
+                    break;
+                if( v < best ) {
+                    best = v;
+                    best_code = code;
+                }
+                beta = std::min(beta, v);
+                if( alpha >= beta )
+                    break;
+            }
+
+            if( index_out ) {
+                *index_out = best_code / 2;
+                *value_out = (best_code & 1) ? 4 : 2;
+            }
+            if( !mAbort )
+                store(key, depth, best, a0, b0, best_code);
+            return best;
+        }
+
+        std::vector<entry> mTable;
+        size_t mMask;
+        u64 mGen = 0;
+        std::vector<Grid> mPly;               // 每一层的临时网格，避免递归里分配内存
+        std::vector<std::vector<cand>> mCands;
+        u64 mNodes = 0;
+        bool mAbort = false;
+        clock::time_point mDeadline;
+    };
+
+    /// 后台线程里跑Searcher
+    class Spawner {
+    public:
+        Spawner() : mJob(1, 1), mStop(false), mHasJob(false), mHasResult(false) {}
+
+        ~Spawner() {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStop = true;
+            }
+            mCond.notify_all();
+            if( mThread.joinable() )
+                mThread.join();
+        }
+
+        /// 为grid找一个出子的位置，budget之后poll()就能取到结果
+        void request(const Grid &grid, clock::duration budget) {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mJob = grid;
+                mBudget = budget;
+                mHasJob = true;
+                mHasResult = false;
+                if( !mThread.joinable() )
+                    mThread = std::thread(&Spawner::loop, this);
+            }
+            mCond.notify_all();
+        }
+
+        /// 不阻塞，结果还没出来时返回false
+        bool poll(Searcher::result &out) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if( !mHasResult )
+                return false;
+            out = mResult;
+            mHasResult = false;
+            return true;
+        }
+
+    private:
+        void loop() {
+            Grid local(1, 1);
+            std::unique_lock<std::mutex> lock(mMutex);
+            while( true ) {
+                mCond.wait(lock, [this] { return mStop || mHasJob; });
+                if( mStop )
+                    return;
+                local = mJob;
+                auto deadline = clock::now() + mBudget;
+                mHasJob = false;
+                lock.unlock();
+
+                auto r = mSearcher.search(local, deadline);
+
+                lock.lock();
+                // 搜索期间来了新的请求时丢掉旧结果
+                if( !mHasJob ) {
+                    mResult = r;
+                    mHasResult = true;
+                }
+            }
+        }
+
+        Searcher mSearcher;
+        Grid mJob;
+        clock::duration mBudget;
+        Searcher::result mResult;
+        bool mStop;
+        bool mHasJob;
+        bool mHasResult;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        std::thread mThread;
+    };
+
+} // namespace evil
+} // namespace x2048
@@ -0,0 +1,369 @@
+#pragma once
+
+// 2048的网格和合并规则，不依赖ncurses，游戏本体和离线工具(analyze.cc)共用
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+
+namespace x2048 {
+
+    using i8 = int8_t;
+    using u8 = uint8_t;
+    using i16 = int16_t;
+    using u16 = uint16_t;
+    using i32 = int32_t;
+    using i64 = int64_t;
+    using u32 = uint32_t;
+    using u64 = uint64_t;
+    using f32 = float;
+    using f64 = double;
+
+    /// 顺序不能改，记录文件里每步用2位存的就是这个值
+    enum class DIRECTION {
+        UP,
+        DOWN,
+        RIGHT,
+        LEFT,
+    };
+
+    /// 一次合并中一个格子的移动，下标为x + y * width
+    /// merged为true表示它移动后和目标格子合并了
+    struct tile_move {
+        u16 from;
+        u16 to;
+        bool merged;
+    };
+
+    /// 可复现的随机数发生器(splitmix64)
+    /// 记录文件只存种子，出子的位置和数字靠它重新推出来，所以算法和用法都不能再改
+    class Rng {
+    public:
+        explicit Rng(u64 s = 0) : mState(s) {}
+
+        void seed(u64 s) {
+            mState = s;
+        }
+
+        u64 next() {
+            u64 z = (mState += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+        /// [0, n)
+        u32 below(u32 n) {
+            return u32(((next() >> 32) * n) >> 32);
+        }
+
+    private:
+        u64 mState;
+    };
+
+
+
+    /// 网格类，存储数字
+    /// Example: 创建一个大小为4 x 3的网格并随机写入数字8
+    ///   Grid g(4, 3);
+    ///   g.generate(8);
+    class Grid {
+    public:
+        using storage_t = i64;
+        Grid(int w, int h) : mWidth(w), mHeight(h), mGrid(nullptr), mScore(0) {
+            reset();
+        }
+
+        Grid(const Grid &other) : mWidth(0), mHeight(0), mGrid(nullptr), mScore(0) {
+            *this = other;
+        }
+
+        Grid &operator=(const Grid &other) {
+            if( this == &other )
+                return *this;
+            if( mGrid == nullptr || mWidth * mHeight != other.mWidth * other.mHeight ) {
+                storage_t *buf = new storage_t[other.mWidth * other.mHeight];
+                delete[] mGrid;
+                mGrid = buf;
+            }
+            mWidth = other.mWidth;
+            mHeight = other.mHeight;
+            memcpy((void*)mGrid, other.mGrid, mWidth * mHeight * sizeof(storage_t));
+            mScore = other.mScore;
+            mRng = other.mRng;
+            return *this;
+        }
+
+        ~Grid() {
+            delete[] mGrid;
+            mGrid = nullptr;
+        }
+
+        void reset(int w, int h) {
+            mWidth = w;
+            mHeight = h;
+            reset();
+        }
+
+        void reset() {
+            delete[] mGrid;
+            mGrid = new storage_t[mWidth * mHeight];
+            memset((void*)mGrid, 0, mWidth * mHeight * sizeof(storage_t));
+
+            score() = 0;
+        }
+
+        /// 设置出子用的随机数种子，同样的种子和同样的操作序列得到同样的棋局
+        void seed(u64 s) {
+            mRng.seed(s);
+        }
+
+        bool is_full() const {
+            bool have_blank = false;
+            for( int i = 0; i < mWidth * mHeight; i++ ) {
+                if( mGrid[i] == 0 ) {
+                    have_blank = true;
+                    break;
+                }
+            }
+            return !have_blank;
+        }
+
+        bool is_fail() const {
+            if( !is_full() )
+                return false;
+            for( int x = 0; x < width(); x++ ) {
+                for( int y = 0; y < height(); y++ ) {
+                    auto cur = get(x, y);
+                    if( y < height() - 1 && cur == get(x, y + 1) )
+                        return false;
+                    if( x < width() - 1 && cur == get(x + 1, y) )
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        /// Put specified value into the empty randomly.
+        /// Return true if there is not any empty which can be filled.
+        bool generate(const storage_t &targetval) {
+            int blanks = 0;
+            for( int i = 0; i < mWidth * mHeight; i++ ) {
+                if( mGrid[i] == 0 )
+                    blanks += 1;
+            }
+            mSpawned = -1;
+            if( blanks == 0 )
+                return true;
+
+            // 在空格子里均匀地挑一个
+            int nth = int(mRng.below(u32(blanks)));
+            for( int i = 0; i < mWidth * mHeight; i++ ) {
+                if( mGrid[i] == 0 && nth-- == 0 ) {
+                    mGrid[i] = targetval;
+                    mSpawned = i;
+                    break;
+                }
+            }
+
+            return false;
+        }
+
+        bool generate_randomly() {
+            if( !mRng.below(4) ) {
+                if( !mRng.below(4) ) {
+                    if( !mRng.below(4) ) {
+                        return generate(16);
+                    } else {
+                        return generate(8);
+                    }
+                } else {
+                    return generate(4);
+                }
+            } else {
+                return generate(2);
+            }
+        }
+
+        /// 在指定的格子(下标x + y * width)放一个数字，困难模式用来代替随机出子
+        void generate_at(int index, const storage_t &targetval) {
+            mGrid[index] = targetval;
+        }
+
+        /// 向一个方向合并格子
+        /// 将此次操作获得的分数累加到score上并返回
+        /// @param dire 将要合并的方向
+        /// @param have_motions_out 如果有任何操作将会被设置为true，否则为false，可以为nullptr
+        i64 merge(DIRECTION dire, bool *have_motions_out = nullptr) {
+            i64 increase = only_merge(dire, have_motions_out);
+            if( increase > 0 )
+                mScore += increase;
+            return increase;
+        }
+
+        /// 同merge，并把每个格子的移动记录到moves中(会先清空moves)
+        i64 merge(DIRECTION dire, std::vector<tile_move> &moves, bool *have_motions_out = nullptr) {
+            i64 increase = only_merge(dire, moves, have_motions_out);
+            if( increase > 0 )
+                mScore += increase;
+            return increase;
+        }
+
+        /// 仅合并格子
+        /// 不累加score，将获得的分数返回
+        /// @param dire 将要合并的方向
+        /// @param have_motions_out 如果有任何操作将会被设置为true，否则为false，可以为nullptr
+        i64 only_merge(DIRECTION dire, bool *have_motions_out = nullptr) {
+            auto ignore = [](int, int, bool) {};
+            return __merge_lines(dire, have_motions_out, ignore);
+        }
+
+        /// 同only_merge，并把每个格子的移动记录到moves中(会先清空moves)
+        i64 only_merge(DIRECTION dire, std::vector<tile_move> &moves, bool *have_motions_out = nullptr) {
+            moves.clear();
+            auto record = [&moves](int from, int to, bool merged) {
+                moves.push_back(tile_move{u16(from), u16(to), merged});
+            };
+            return __merge_lines(dire, have_motions_out, record);
+        }
+
+        i64 &score() {
+            return mScore;
+        }
+
+        i64 score() const {
+            return mScore;
+        }
+
+        storage_t &get(int x, int y) {
+            if( x >= mWidth || x < 0 || y < 0 || y >= mHeight )
+                throw std::out_of_range("Position X " + std::to_string(x) + " Y " + std::to_string(y) + " is out of range");
+            return mGrid[x + y * mWidth];
+        }
+
+        storage_t get(int x, int y) const {
+            if( x >= mWidth || x < 0 || y < 0 || y >= mHeight )
+                throw std::out_of_range("Position X " + std::to_string(x) + " Y " + std::to_string(y) + " is out of range");
+            return mGrid[x + y * mWidth];
+        }
+
+        void put(int x, int y, const storage_t &val) {
+            get(x, y) = val;
+        }
+
+        int width() const {
+            return mWidth;
+        }
+
+        /// 按行存储的原始数据，下标为x + y * width
+        const storage_t *data() const {
+            return mGrid;
+        }
+
+        int height() const {
+            return mHeight;
+        }
+
+        /// 上一次合并移动或合并了的格子数
+        int moved() const {
+            return mMoved;
+        }
+
+        /// 上一次generate()放数字的格子(下标x + y * width)，没有空格子时是-1
+        int spawned() const {
+            return mSpawned;
+        }
+
+    private:
+        int mWidth;
+        int mHeight;
+        storage_t *mGrid;
+
+        i64 mScore;
+        Rng mRng;
+        int mMoved = 0;     // 上一次合并移动了的格子数
+        int mSpawned = -1;  // 上一次出子的格子
+
+        /// 合并的核心，逐行处理，不抛异常也不分配内存
+        /// 规则: 格子依次向dire方向滑动，每一行最多合并一次
+        /// record(from, to, merged)在每个移动了的格子上调用，下标为x + y * width
+        template<typename RecordT>
+        i64 __merge_lines(DIRECTION dire, bool *have_motions_out, RecordT &record) {
+            int lines, len, first, line_step, step;
+            switch(dire) {
+            case DIRECTION::UP:
+                lines = mWidth; len = mHeight; first = 0; line_step = 1; step = mWidth;
+                break;
+            case DIRECTION::DOWN:
+                lines = mWidth; len = mHeight; first = (mHeight - 1) * mWidth; line_step = 1; step = -mWidth;
+                break;
+            case DIRECTION::RIGHT:
+                lines = mHeight; len = mWidth; first = mWidth - 1; line_step = mWidth; step = -1;
+                break;
+            case DIRECTION::LEFT: default:
+                lines = mHeight; len = mWidth; first = 0; line_step = mWidth; step = 1;
+                break;
+            }
+
+            i64 new_score = 0; // 增加的分数
+            bool have_motions = false;
+            int moved = 0;
+
+            for( int l = 0; l < lines; l++ ) {
+                int beg = first + l * line_step;
+                int out = 0;          // 下一个空位
+                bool merged = false;  // 这一行是否已经合并过
+                for( int i = 0; i < len; i++ ) {
+                    int idx = beg + i * step;
+                    storage_t v = mGrid[idx];
+                    if( v == 0 )
+                        continue;
+                    int prev = beg + (out - 1) * step;
+                    if( !merged && out > 0 && mGrid[prev] == v ) {
+                        mGrid[prev] = v * 2;
+                        mGrid[idx] = 0;
+                        new_score += v * 2;
+                        merged = true;
+                        have_motions = true;
+                        moved += 1;
+                        record(idx, prev, true);
+                    } else {
+                        int to = beg + out * step;
+                        if( to != idx ) {
+                            mGrid[to] = v;
+                            mGrid[idx] = 0;
+                            have_motions = true;
+                            moved += 1;
+                            record(idx, to, false);
+                        }
+                        out += 1;
+                    }
+                }
+            }
+
+            if( have_motions_out )
+                *have_motions_out = have_motions;
+            mMoved = moved;
+            return have_motions ? new_score : -1;
+        }
+
+        DIRECTION __opposite_dire(DIRECTION dire) {
+            switch(dire) {
+            case DIRECTION::UP:
+                return DIRECTION::DOWN;
+            case DIRECTION::DOWN:
+                return DIRECTION::UP;
+            case DIRECTION::RIGHT:
+                return DIRECTION::LEFT;
+            case DIRECTION::LEFT:
+                return DIRECTION::RIGHT;
+            default:
+                return DIRECTION::UP;
+            }
+        }
+    };
+
+} // namespace x2048
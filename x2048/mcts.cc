@@ -0,0 +1,168 @@
+// 不开界面地用MCTS玩家(mcts.h)下若干局，和随机策略在同样的种子上比较分数分布
+// compile with: make x2048-mcts
+//
+// 用法:
+//   x2048-mcts [--games N] [--budget MS] [-j N] [--batch N] [--depth N]
+//              [--rollout random|greedy] [--seed S] [--width W] [--height H]
+// 默认在4x6上下1局，每步想5毫秒; MCTS一局能走一万多步(单线程约两分钟)，进度每50步打在stderr上
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "grid.h"
+#include "mcts.h"
+
+namespace x2048 {
+
+    struct game_result {
+        i64 score;
+        Grid::storage_t max_tile;
+        u32 moves;
+    };
+
+    inline Grid::storage_t max_tile_of(const Grid &grid) {
+        Grid::storage_t m = 0;
+        for( int i = 0; i < grid.width() * grid.height(); i++ )
+            m = std::max(m, grid.data()[i]);
+        return m;
+    }
+
+    inline game_result play_random(int w, int h, u64 seed) {
+        Grid grid(w, h);
+        grid.seed(seed);
+        grid.generate(2);
+        Rng policy(seed ^ 0xa5a5a5a5a5a5a5a5ull);
+        u32 moves = 0;
+        while( true ) {
+            bool moved = false;
+            u32 first = policy.below(4);
+            for( u32 i = 0; i < 4 && !moved; i++ )
+                grid.merge(DIRECTION((first + i) % 4), &moved);
+            if( !moved )
+                break;
+            grid.generate_randomly();
+            moves += 1;
+        }
+        return game_result{grid.score(), max_tile_of(grid), moves};
+    }
+
+    /// 一局要走上千步，每步都要想满budget，所以每50步在stderr上报一次进度
+    inline game_result play_mcts(mcts::Player &player, int w, int h, u64 seed, mcts::search_stats &total,
+                                 int game, int games) {
+        Grid grid(w, h);
+        grid.seed(seed);
+        grid.generate(2);
+        Rng search_seeds(seed);
+        u32 moves = 0;
+        while( true ) {
+            DIRECTION d;
+            mcts::search_stats st;
+            if( !player.choose(grid, d, search_seeds.next(), &st) )
+                break;
+            total.rollouts += st.rollouts;
+            total.nodes += st.nodes;
+            total.seconds += st.seconds;
+            grid.merge(d);
+            grid.generate_randomly();
+            moves += 1;
+            if( moves % 50 == 0 )
+                fprintf(stderr, "\rgame %d/%d: move %u score %lld", game, games, moves, (long long)grid.score());
+        }
+        return game_result{grid.score(), max_tile_of(grid), moves};
+    }
+
+    inline void print_distribution(const char *name, std::vector<game_result> &results) {
+        std::sort(results.begin(), results.end(), [](const game_result &a, const game_result &b) { return a.score < b.score; });
+        size_t n = results.size();
+        double mean = 0, moves = 0;
+        for( auto &r : results ) {
+            mean += double(r.score);
+            moves += r.moves;
+        }
+        mean /= double(n);
+        moves /= double(n);
+        auto pct = [&](double p) { return results[size_t(p * double(n - 1))].score; };
+        printf("%-8s mean %9.1f  p10 %7lld  p50 %7lld  p90 %7lld  max %7lld  moves/game %.1f\n", name, mean,
+               (long long)pct(0.1), (long long)pct(0.5), (long long)pct(0.9), (long long)results.back().score, moves);
+
+        // 最大的格子的分布
+        printf("%-8s max tile:", "");
+        for( Grid::storage_t t = 2; t <= (Grid::storage_t(1) << 20); t *= 2 ) {
+            size_t c = 0;
+            for( auto &r : results )
+                c += r.max_tile == t;
+            if( c )
+                printf("  %lld:%.0f%%", (long long)t, 100.0 * double(c) / double(n));
+        }
+        printf("\n");
+    }
+
+} // namespace x2048
+
+int main(int argc, char **argv) {
+    using namespace x2048;
+
+    int games = 1;
+    int width = 4, height = 6;
+    u64 seed = 1;
+    mcts::config cfg;
+    cfg.budget = std::chrono::milliseconds(5);
+
+    for( int i = 1; i < argc; i++ ) {
+        auto arg = [&](const char *name) { return strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if( arg("--games") ) {
+            games = atoi(argv[++i]);
+        } else if( arg("--budget") ) {
+            cfg.budget = std::chrono::microseconds(i64(atof(argv[++i]) * 1000));
+        } else if( arg("-j") ) {
+            cfg.threads = atoi(argv[++i]);
+        } else if( arg("--batch") ) {
+            cfg.batch = atoi(argv[++i]);
+        } else if( arg("--depth") ) {
+            cfg.rollout_depth = atoi(argv[++i]);
+        } else if( arg("--rollout") ) {
+            cfg.rollout = strcmp(argv[++i], "greedy") == 0 ? mcts::ROLLOUT::GREEDY : mcts::ROLLOUT::RANDOM;
+        } else if( arg("--seed") ) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if( arg("--width") ) {
+            width = atoi(argv[++i]);
+        } else if( arg("--height") ) {
+            height = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--games N] [--budget MS] [-j N] [--batch N] [--depth N]\n"
+                            "          [--rollout random|greedy] [--seed S] [--width W] [--height H]\n", argv[0]);
+            return 2;
+        }
+    }
+    if( games <= 0 || width <= 0 || height <= 0 )
+        return 2;
+
+    mcts::Player player(cfg);
+    printf("%d games on %dx%d, budget %.1fms/move, %d threads, batch %d, %s rollouts of %d moves\n",
+           games, width, height, player.get_config().budget.count() / 1000.0, player.get_config().threads,
+           player.get_config().batch, cfg.rollout == mcts::ROLLOUT::GREEDY ? "greedy" : "random", cfg.rollout_depth);
+
+    std::vector<game_result> random_results, mcts_results;
+    mcts::search_stats total;
+    Rng seeds(seed);
+    for( int g = 0; g < games; g++ ) {
+        u64 s = seeds.next();
+        random_results.push_back(play_random(width, height, s));
+        mcts_results.push_back(play_mcts(player, width, height, s, total, g + 1, games));
+        fprintf(stderr, "\rgame %d/%d: move %u score %lld, done\n", g + 1, games, mcts_results.back().moves,
+                (long long)mcts_results.back().score);
+    }
+
+    print_distribution("random", random_results);
+    print_distribution("mcts", mcts_results);
+    u64 searches = 0;
+    for( auto &r : mcts_results )
+        searches += r.moves;
+    printf("search: %.0f rollouts/s, %.0f rollouts/move, %.0f nodes/move\n", total.rollouts_per_sec(),
+           searches ? double(total.rollouts) / searches : 0.0, searches ? double(total.nodes) / searches : 0.0);
+    return 0;
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+// 2048的蒙特卡洛树搜索(MCTS)玩家，只依赖grid.h
+//
+// 出子是随机的，所以树只按操作序列展开(open-loop)，每次下降时重新随机出子。
+// 几个线程共享一棵树，节点的访问次数和奖励都是原子变量:
+//   - 下降时先给路径上的节点加batch次访问(相当于virtual loss，让别的线程换条路走)
+//   - 到叶子后连续做batch次rollout，再把奖励之和一次性加到路径上
+// 奖励是这一局从根节点开始多得的分数。每步的思考时间由budget决定，到时间就停。
+// 线程来自common/scheduler.h: threads为0时用进程共用的调度器，否则自己建一个。
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "../common/scheduler.h"
+#include "grid.h"
+
+namespace x2048 {
+namespace mcts {
+
+    enum class ROLLOUT {
+        RANDOM, // 随机方向
+        GREEDY, // 立即得分最多的方向，一样多时随机
+    };
+
+    struct config {
+        std::chrono::microseconds budget = std::chrono::milliseconds(50);
+        int threads = 0;           // 0表示用共用的调度器，线程数见SIMPLEGAMES_THREADS
+        int batch = 8;             // 每到一个叶子做几次rollout
+        int rollout_depth = 64;    // rollout最多走几步
+        ROLLOUT rollout = ROLLOUT::RANDOM;
+        double exploration = 0.7;  // UCB的系数，乘以根节点的平均奖励
+        u32 max_nodes = 1 << 18;   // 树的大小上限，到了以后只做rollout不再展开
+    };
+
+    /// 一次搜索的统计
+    struct search_stats {
+        u64 rollouts = 0;
+        u64 nodes = 0;
+        double seconds = 0;
+
+        double rollouts_per_sec() const {
+            return seconds > 0 ? rollouts / seconds : 0;
+        }
+    };
+
+    class Player {
+    public:
+        explicit Player(const config &cfg = config()) : mConfig(cfg) {
+            if( mConfig.threads <= 0 ) {
+                mPool = &sched::scheduler::shared();
+            } else {
+                mOwnPool = std::make_unique<sched::scheduler>(mConfig.threads - 1);
+                mPool = mOwnPool.get();
+            }
+            mConfig.threads = mPool->concurrency();
+            if( mConfig.batch <= 0 )
+                mConfig.batch = 1;
+        }
+
+        const config &get_config() const {
+            return mConfig;
+        }
+
+        /// 为grid选一个方向，没有可以走的方向时返回false
+        /// seed决定这次搜索里的随机数，同样的seed在单线程下结果一样
+        bool choose(const Grid &grid, DIRECTION &out, u64 seed, search_stats *stats = nullptr) {
+            auto beg = std::chrono::steady_clock::now();
+            auto deadline = beg + mConfig.budget;
+
+            // 根节点的状态是确定的，先把无效的方向排除掉
+            bool valid[4];
+            int nvalid = 0;
+            for( int d = 0; d < 4; d++ ) {
+                Grid tmp(grid);
+                tmp.only_merge(DIRECTION(d), &valid[d]);
+                if( valid[d] ) {
+                    nvalid += 1;
+                    out = DIRECTION(d);
+                }
+            }
+            if( nvalid == 0 )
+                return false;
+            if( nvalid == 1 ) {
+                if( stats )
+                    *stats = search_stats{};
+                return true;
+            }
+
+            node root;
+            mNodes.store(1, std::memory_order_relaxed);
+            std::atomic<u64> rollouts(0);
+
+            auto work = [&](int t) {
+                worker w(*this, grid, root, Rng(seed + u64(t) * 0x9e3779b97f4a7c15ull));
+                u64 done = 0;
+                do {
+                    done += w.iterate(valid);
+                } while( std::chrono::steady_clock::now() < deadline );
+                rollouts.fetch_add(done, std::memory_order_relaxed);
+            };
+
+            // 每个线程一个一直做到时间用完的任务，调用的线程自己做第0个
+            sched::task_group group(*mPool, sched::priority::high);
+            for( int t = 1; t < mConfig.threads; t++ )
+                group.run([&work, t] { work(t); });
+            work(0);
+            group.wait();
+
+            // 访问次数最多的方向
+            u32 best_visits = 0;
+            for( int d = 0; d < 4; d++ ) {
+                node *c = root.child[d].load(std::memory_order_relaxed);
+                if( valid[d] && c && c->visits.load(std::memory_order_relaxed) > best_visits ) {
+                    best_visits = c->visits.load(std::memory_order_relaxed);
+                    out = DIRECTION(d);
+                }
+            }
+
+            if( stats ) {
+                stats->rollouts = rollouts.load();
+                stats->nodes = mNodes.load();
+                stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+            }
+            return true;
+        }
+
+    private:
+        struct node {
+            std::atomic<u32> visits{0};
+            std::atomic<u64> value{0}; // 奖励之和
+            std::atomic<node*> child[4] = {};
+
+            ~node() {
+                for( auto &c : child )
+                    delete c.load(std::memory_order_relaxed);
+            }
+        };
+
+        /// 一个线程的搜索状态，grid都是预先分配好的，循环里不再分配内存(展开节点除外)
+        class worker {
+        public:
+            worker(Player &p, const Grid &root_grid, node &root, Rng rng) :
+                mPlayer(p), mRootGrid(root_grid), mRoot(root), mRng(rng),
+                mGrid(root_grid), mRollout(root_grid), mScratch(root_grid) {
+                mPath.reserve(64);
+            }
+
+            /// 一次下降加batch次rollout，返回做了几次rollout
+            u32 iterate(const bool *root_valid) {
+                const config &cfg = mPlayer.mConfig;
+                u32 batch = u32(cfg.batch);
+
+                mGrid = mRootGrid;
+                mGrid.seed(mRng.next());
+                mPath.clear();
+
+                node *n = &mRoot;
+                mPath.push_back(n);
+                n->visits.fetch_add(batch, std::memory_order_relaxed);
+
+                while( true ) {
+                    int d = select(n, n == &mRoot ? root_valid : nullptr);
+                    if( d < 0 )
+                        break; // 死局
+                    mGrid.generate_randomly();
+
+                    node *c = n->child[d].load(std::memory_order_acquire);
+                    bool expanded = false;
+                    if( !c ) {
+                        if( mPlayer.mNodes.load(std::memory_order_relaxed) >= cfg.max_nodes )
+                            break;
+                        node *fresh = new node;
+                        if( n->child[d].compare_exchange_strong(c, fresh, std::memory_order_acq_rel) ) {
+                            c = fresh;
+                            mPlayer.mNodes.fetch_add(1, std::memory_order_relaxed);
+                            expanded = true;
+                        } else {
+                            delete fresh; // 别的线程先展开了，c已经是它的节点
+                        }
+                    }
+                    c->visits.fetch_add(batch, std::memory_order_relaxed);
+                    mPath.push_back(c);
+                    n = c;
+                    if( expanded )
+                        break;
+                }
+
+                // 从叶子开始连续做batch次rollout，结果一次性加到路径上
+                u64 reward = 0;
+                for( u32 b = 0; b < batch; b++ ) {
+                    mRollout = mGrid;
+                    mRollout.seed(mRng.next());
+                    rollout(mRollout);
+                    reward += u64(mRollout.score() - mRootGrid.score());
+                }
+                for( node *p : mPath )
+                    p->value.fetch_add(reward, std::memory_order_relaxed);
+                return batch;
+            }
+
+        private:
+            /// 按UCB选一个方向并在mGrid上走这一步，没有有效的方向时返回-1
+            /// 非根节点的有效方向取决于这次随机出来的局面，所以按UCB从高到低逐个试
+            int select(node *n, const bool *valid) {
+                const config &cfg = mPlayer.mConfig;
+                double parent_visits = double(n->visits.load(std::memory_order_relaxed));
+                double root_visits = double(mRoot.visits.load(std::memory_order_relaxed));
+                double scale = root_visits > 0 ? double(mRoot.value.load(std::memory_order_relaxed)) / root_visits : 1;
+                if( scale < 1 )
+                    scale = 1;
+                double log_n = std::log(parent_visits + 1);
+
+                double ucb[4];
+                for( int d = 0; d < 4; d++ ) {
+                    node *c = n->child[d].load(std::memory_order_acquire);
+                    u32 v = c ? c->visits.load(std::memory_order_relaxed) : 0;
+                    if( v == 0 ) {
+                        // 没走过的方向优先，加一点随机避免所有线程挤在同一个方向
+                        ucb[d] = 1e30 * (1 + mRng.below(1024));
+                    } else {
+                        double mean = double(c->value.load(std::memory_order_relaxed)) / v;
+                        ucb[d] = mean + cfg.exploration * scale * std::sqrt(log_n / v);
+                    }
+                    if( valid && !valid[d] )
+                        ucb[d] = -1;
+                }
+
+                for( int tries = 0; tries < 4; tries++ ) {
+                    int best = -1;
+                    for( int d = 0; d < 4; d++ ) {
+                        if( ucb[d] >= 0 && (best < 0 || ucb[d] > ucb[best]) )
+                            best = d;
+                    }
+                    if( best < 0 )
+                        return -1;
+                    bool moved = false;
+                    mGrid.merge(DIRECTION(best), &moved);
+                    if( moved )
+                        return best;
+                    ucb[best] = -1;
+                }
+                return -1;
+            }
+
+            void rollout(Grid &g) {
+                const config &cfg = mPlayer.mConfig;
+                for( int step = 0; step < cfg.rollout_depth; step++ ) {
+                    bool moved = false;
+                    if( cfg.rollout == ROLLOUT::GREEDY ) {
+                        i64 best_gain = -1;
+                        int best = -1;
+                        u32 first = mRng.below(4);
+                        for( u32 i = 0; i < 4; i++ ) {
+                            int d = int((first + i) % 4);
+                            mScratch = g;
+                            bool valid = false;
+                            i64 gain = mScratch.only_merge(DIRECTION(d), &valid);
+                            if( valid && gain > best_gain ) {
+                                best_gain = gain;
+                                best = d;
+                            }
+                        }
+                        if( best >= 0 )
+                            g.merge(DIRECTION(best), &moved);
+                    } else {
+                        // 随机的起点，依次试到一个有效的方向为止
+                        u32 first = mRng.below(4);
+                        for( u32 i = 0; i < 4 && !moved; i++ )
+                            g.merge(DIRECTION((first + i) % 4), &moved);
+                    }
+                    if( !moved )
+                        return;
+                    g.generate_randomly();
+                }
+            }
+
+            Player &mPlayer;
+            const Grid &mRootGrid;
+            node &mRoot;
+            Rng mRng;
+            Grid mGrid;
+            Grid mRollout;
+            Grid mScratch;
+            std::vector<node*> mPath;
+        };
+
+        config mConfig;
+        std::unique_ptr<sched::scheduler> mOwnPool;
+        sched::scheduler *mPool;
+        std::atomic<u32> mNodes{0};
+    };
+
+} // namespace mcts
+} // namespace x2048
@@ -0,0 +1,280 @@
+#pragma once
+
+// 2048的对局记录
+//
+// 每局只存种子和操作序列，出子由Grid的随机数发生器(grid.h中的Rng)按种子重新推出来。
+// 一条记录(小端序):
+//    0  u32 magic "X2RC"
+//    4  u8  版本(1)
+//    5  u8  网格宽度
+//    6  u8  网格高度
+//    7  u8  flags，RECORD_HAS_TIMES表示带每步用时
+//    8  u64 种子
+//   16  u64 最终分数，回放时用来校验
+//   24  i64 开始时间(unix秒)
+//   32  u32 步数
+//   36  u32 总用时(毫秒)
+//   40  每步2位(DIRECTION的值)，低位在前，共(步数 + 3) / 4字节
+//       每步用时1字节(见time_code())，共步数字节
+// 只记录有效的操作(网格发生了变化，随后出子)，开局先generate(2)再依次执行。
+//
+// 记录在一局结束时用一次write()追加到滚动文件末尾，文件超过上限时改名为<文件>.1再重新开始。
+// 环境变量:
+//   SIMPLEGAMES_2048_RECORDS      记录文件，默认$XDG_DATA_HOME/simplegames/x2048.rec
+//                                 ($HOME/.local/share/...)，设为空或者0时不记录
+//   SIMPLEGAMES_2048_RECORDS_MAX  单个文件的上限(字节)，默认64MiB
+//
+// 离线分析见analyze.cc
+
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grid.h"
+
+namespace x2048 {
+namespace record {
+
+    constexpr u32 MAGIC = 0x43523258; // "X2RC"
+    constexpr u8 VERSION = 1;
+    constexpr size_t HEADER_SIZE = 40;
+    constexpr u8 RECORD_HAS_TIMES = 1;
+    constexpr u32 MAX_MOVES = 1u << 26;  // 读不能seek的输入时一条记录最多的步数
+
+    struct header {
+        u8 version;
+        u8 width;
+        u8 height;
+        u8 flags;
+        u64 seed;
+        u64 score;
+        i64 start_time;
+        u32 moves;
+        u32 duration_ms;
+    };
+
+    /// 记录头后面还有多少字节
+    inline size_t body_size(const header &h) {
+        size_t n = (size_t(h.moves) + 3) / 4;
+        if( h.flags & RECORD_HAS_TIMES )
+            n += h.moves;
+        return n;
+    }
+
+    inline void put_le(std::vector<u8> &out, u64 v, int bytes) {
+        for( int i = 0; i < bytes; i++ )
+            out.push_back(u8(v >> (i * 8)));
+    }
+
+    inline u64 get_le(const u8 *p, int bytes) {
+        u64 v = 0;
+        for( int i = 0; i < bytes; i++ )
+            v |= u64(p[i]) << (i * 8);
+        return v;
+    }
+
+    inline void encode_header(std::vector<u8> &out, const header &h) {
+        put_le(out, MAGIC, 4);
+        out.push_back(h.version);
+        out.push_back(h.width);
+        out.push_back(h.height);
+        out.push_back(h.flags);
+        put_le(out, h.seed, 8);
+        put_le(out, h.score, 8);
+        put_le(out, u64(h.start_time), 8);
+        put_le(out, h.moves, 4);
+        put_le(out, h.duration_ms, 4);
+    }
+
+    /// 解析HEADER_SIZE字节的记录头，magic、版本或者尺寸不对时返回false
+    inline bool decode_header(const u8 *p, header &h) {
+        if( get_le(p, 4) != MAGIC )
+            return false;
+        h.version = p[4];
+        h.width = p[5];
+        h.height = p[6];
+        h.flags = p[7];
+        h.seed = get_le(p + 8, 8);
+        h.score = get_le(p + 16, 8);
+        h.start_time = i64(get_le(p + 24, 8));
+        h.moves = u32(get_le(p + 32, 4));
+        h.duration_ms = u32(get_le(p + 36, 4));
+        return h.version == VERSION && h.width > 0 && h.height > 0;
+    }
+
+    /// 第i步的方向，moves指向记录头之后
+    inline DIRECTION move_at(const u8 *moves, u32 i) {
+        return DIRECTION((moves[i / 4] >> ((i % 4) * 2)) & 3);
+    }
+
+    /// 每步用时按对数压成1字节，每翻一倍8档(误差约9%)，最多约2^31毫秒
+    inline u8 time_code(u64 ms) {
+        double c = std::round(8 * std::log2(1.0 + double(ms)));
+        return c >= 255 ? 255 : u8(c);
+    }
+
+    inline double time_from_code(u8 code) {
+        return std::exp2(code / 8.0) - 1;
+    }
+
+    /// 新开一局用的种子
+    inline u64 new_seed() {
+        std::random_device rd;
+        u64 s = (u64(rd()) << 32) ^ rd();
+        return s ^ u64(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    /// 数据目录($XDG_DATA_HOME/simplegames或$HOME/.local/share/simplegames)下的文件，
+    /// 目录不存在时创建，找不到数据目录时返回空
+    inline std::string data_file(const char *name) {
+        std::string dir;
+        if( const char *xdg = getenv("XDG_DATA_HOME") ) {
+            dir = xdg;
+        } else if( const char *home = getenv("HOME") ) {
+            dir = std::string(home) + "/.local/share";
+            mkdir(dir.c_str(), 0755);
+        } else {
+            return std::string();
+        }
+        dir += "/simplegames";
+        mkdir(dir.c_str(), 0755);
+        return dir + "/" + name;
+    }
+
+    /// 记录文件的路径，为空表示不记录
+    inline std::string records_path() {
+        const char *env = getenv("SIMPLEGAMES_2048_RECORDS");
+        if( env )
+            return (env[0] == 0 || std::string(env) == "0") ? std::string() : std::string(env);
+        return data_file("x2048.rec");
+    }
+
+    inline u64 records_max_bytes() {
+        const char *env = getenv("SIMPLEGAMES_2048_RECORDS_MAX");
+        long long v = env ? atoll(env) : 0;
+        return v > 0 ? u64(v) : u64(64) << 20;
+    }
+
+    /// 把一条完整的记录追加到文件末尾，必要时先滚动
+    /// O_APPEND加一次write()，几个游戏同时结束也不会交错
+    inline bool append(const std::string &path, const std::vector<u8> &rec) {
+        struct stat st;
+        if( stat(path.c_str(), &st) == 0 && u64(st.st_size) + rec.size() > records_max_bytes() )
+            rename(path.c_str(), (path + ".1").c_str());
+
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if( fd < 0 )
+            return false;
+        ssize_t n = write(fd, rec.data(), rec.size());
+        close(fd);
+        return n == ssize_t(rec.size());
+    }
+
+    /// 从文件里读下一条记录，把原始字节(记录头 + 内容)追加到raw后面
+    /// 文件正好结束时返回false并把errno设为0，记录头损坏、步数超出文件剩下的长度
+    /// (不能seek时超出MAX_MOVES)或者记录被截断时返回false并把errno设为EINVAL
+    inline bool read_next(FILE *fp, header &h, std::vector<u8> &raw) {
+        u8 buf[HEADER_SIZE];
+        size_t got = fread(buf, 1, HEADER_SIZE, fp);
+        if( got != HEADER_SIZE || !decode_header(buf, h) ) {
+            errno = (got == 0 && feof(fp)) ? 0 : EINVAL;
+            return false;
+        }
+        size_t body = body_size(h);
+        struct stat st;
+        off_t pos = ftello(fp);
+        size_t limit = body_size(header{VERSION, 1, 1, RECORD_HAS_TIMES, 0, 0, 0, MAX_MOVES, 0});
+        if( fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && pos >= 0 )
+            limit = st.st_size > pos ? size_t(st.st_size - pos) : 0;
+        if( body > limit ) {
+            errno = EINVAL;
+            return false;
+        }
+        size_t at = raw.size();
+        raw.insert(raw.end(), buf, buf + HEADER_SIZE);
+        raw.resize(at + HEADER_SIZE + body);
+        if( fread(raw.data() + at + HEADER_SIZE, 1, body, fp) != body ) {
+            raw.resize(at);
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    /// 游戏中用的记录器，操作先攒在内存里，一局结束时一次写完
+    class Recorder {
+    public:
+        Recorder() : mActive(false) {}
+
+        void begin(u64 seed, int width, int height) {
+            mHeader = header{};
+            mHeader.version = VERSION;
+            mHeader.width = u8(width);
+            mHeader.height = u8(height);
+            mHeader.flags = RECORD_HAS_TIMES;
+            mHeader.seed = seed;
+            mHeader.start_time = i64(time(nullptr));
+            mMoves.clear();
+            mTimes.clear();
+            mMoves.reserve(1024);
+            mTimes.reserve(4096);
+            mBegin = std::chrono::steady_clock::now();
+            mLast = mBegin;
+            mActive = true;
+        }
+
+        /// 记录一次有效的操作
+        void move(DIRECTION dire) {
+            if( !mActive )
+                return;
+            auto now = std::chrono::steady_clock::now();
+            u32 i = mHeader.moves++;
+            if( i % 4 == 0 )
+                mMoves.push_back(0);
+            mMoves.back() |= u8(u8(dire) << ((i % 4) * 2));
+            mTimes.push_back(time_code(u64(std::chrono::duration_cast<std::chrono::milliseconds>(now - mLast).count())));
+            mLast = now;
+        }
+
+        /// 一局结束，写入文件，一步都没走的局不记录
+        void finish(u64 score) {
+            if( !mActive )
+                return;
+            mActive = false;
+            if( mHeader.moves == 0 )
+                return;
+            std::string path = records_path();
+            if( path.empty() )
+                return;
+
+            mHeader.score = score;
+            mHeader.duration_ms = u32(std::chrono::duration_cast<std::chrono::milliseconds>(mLast - mBegin).count());
+            std::vector<u8> rec;
+            rec.reserve(HEADER_SIZE + mMoves.size() + mTimes.size());
+            encode_header(rec, mHeader);
+            rec.insert(rec.end(), mMoves.begin(), mMoves.end());
+            rec.insert(rec.end(), mTimes.begin(), mTimes.end());
+            append(path, rec);
+        }
+
+    private:
+        bool mActive;
+        header mHeader;
+        std::vector<u8> mMoves;
+        std::vector<u8> mTimes;
+        std::chrono::steady_clock::time_point mBegin;
+        std::chrono::steady_clock::time_point mLast;
+    };
+
+} // namespace record
+} // namespace x2048